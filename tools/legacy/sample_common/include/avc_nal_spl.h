@@ -72,6 +72,10 @@ protected:
     mfxBitstream m_bitstream;
 };
 
+// returns position of the first 00 00 <value> sequence in [begin, end), end if there is none,
+// value 1 finds start code prefix, value 3 finds preventing start-code byte
+const mfxU8* FindZeroZeroByte(const mfxU8* begin, const mfxU8* end, mfxU8 value);
+
 void SwapMemoryAndRemovePreventingBytes(mfxU8* pDestination,
                                         mfxU32& nDstSize,
                                         mfxU8* pSource,
@@ -75,6 +75,11 @@ public:
 
     void ResetCurrentState();
 
+    // in in-place mode frames aren't copied, they are returned as ranges of source buffer and the
+    // source is moved past returned frame; data of incomplete frame isn't consumed, so caller
+    // should append new data to it, end of stream is signalled by MFX_BITSTREAM_EOS flag
+    void SetInPlace(bool bInPlace);
+
 protected:
     std::unique_ptr<NALUnitSplitter> m_pNALSplitter;
 
@@ -84,6 +89,11 @@ protected:
 
     mfxStatus ProcessNalUnit(mfxI32 nalType, mfxBitstream* destination);
 
+    mfxStatus GetFrameInPlace(mfxBitstream* bs_in, FrameSplitterInfo** frame);
+    mfxStatus CompleteFrameInPlace(mfxBitstream* bs_in,
+                                   mfxU32 frameLength,
+                                   FrameSplitterInfo** frame);
+
     mfxStatus DecodeHeader(mfxBitstream* nalUnit);
     mfxStatus DecodeSEI(mfxBitstream* nalUnit);
     AVCSlice* DecodeSliceHeader(mfxBitstream* nalUnit);
@@ -110,6 +120,15 @@ protected:
 
     enum { BUFFER_SIZE = 1024 * 1024 };
 
+    // slice header is expected to fit this size, so the rest of slice isn't de-emulated
+    enum { SLICE_HEADER_SIZE = 1024 };
+    // ones written after de-emulated prefix, so parsing longer header stops within the memory
+    enum { SLICE_HEADER_PADDING = 128 };
+
+    bool m_bInPlace;
+    mfxU32 m_nScanOffset; // offset of data not split yet in source of in-place mode
+    mfxBitstream m_inPlaceNal; // nal unit in source of in-place mode
+
     std::vector<mfxU8> m_currentFrame;
     std::vector<mfxU8> m_swappingMemory;
     std::list<AVCSlice> m_slicesStorage;
@@ -10,6 +10,7 @@
 #include <string.h>
 #include <functional>
 #include <list>
+#include <map>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -61,8 +62,19 @@ private:
 // Ex. Preallocated frame chain with type=FROM_ENCODE | FROM_VPPIN will be returned when
 // request type contains either FROM_ENCODE or FROM_VPPIN
 
+// Released frame chains can be kept in the frame pool and handed back to following requests of
+// the same format, size, type and number of frames, so components reset doesn't reallocate
+// surfaces. The pool is disabled by default.
+
 // This class does not allocate any actual memory
 
+struct FramePoolStats {
+    mfxU64 hits; // allocations served by pooled frame chains
+    mfxU64 misses; // allocations passed to allocator while pool is enabled
+    mfxU64 evictions; // pooled chains released to stay within the limit
+    mfxU64 pooledBytes; // estimated size of pooled chains
+};
+
 class BaseFrameAllocator : public MFXFrameAllocator {
 public:
     BaseFrameAllocator();
@@ -77,6 +89,10 @@ public:
                                    mfxMemId* midOut);
     virtual mfxStatus FreeFrames(mfxFrameAllocResponse* response);
 
+    // 0 disables the pool and releases pooled chains
+    void SetFramePoolLimit(mfxU64 maxBytes);
+    FramePoolStats GetFramePoolStats();
+
     virtual mfxStatus Create3DLutMemory(mfxMemId memId, const char* lut3d_file_name) {
         return MFX_ERR_NONE;
     }
@@ -168,6 +184,27 @@ protected:
         }
     };
 
+    struct FrameChain {
+        mfxFrameAllocResponse response;
+        mfxFrameInfo info;
+        mfxU16 type;
+        mfxU64 bytes;
+    };
+
+    // chains allocated while pool is enabled, by mids array
+    std::map<mfxMemId*, FrameChain> m_chains;
+    // released chains, the oldest first
+    std::list<FrameChain> m_pool;
+    mfxU64 m_poolLimit;
+    FramePoolStats m_poolStats;
+
+    // following methods expect mtx to be locked
+    bool TakePooledChain(mfxFrameAllocRequest* request, mfxFrameAllocResponse* response);
+    void TrackChain(mfxFrameAllocRequest* request, mfxFrameAllocResponse* response);
+    mfxStatus ReleaseOrPoolChain(mfxFrameAllocResponse* response);
+    void ShrinkFramePool(mfxU64 maxBytes);
+    void ReleaseFramePool();
+
     // checks if request is supported
     virtual mfxStatus CheckRequestType(mfxFrameAllocRequest* request);
 
@@ -0,0 +1,58 @@
+/*############################################################################
+  # Copyright (C) 2005 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef __FRAME_COPY_H__
+#define __FRAME_COPY_H__
+
+#include "vpl/mfxdefs.h"
+
+// instruction set of frame copy kernels
+enum FrameCopyIsa { FRAME_COPY_C = 0, FRAME_COPY_SSE2, FRAME_COPY_AVX2, FRAME_COPY_ISA_COUNT };
+
+// kernels converting planes of raw frames, width of chroma planes is number of U (or V) samples
+// in a row
+struct FrameCopyKernels {
+    const char* name;
+
+    // UVUV... -> UU... + VV...
+    void (*SplitUV)(const mfxU8* src,
+                    mfxU32 srcPitch,
+                    mfxU8* dstU,
+                    mfxU32 dstPitchU,
+                    mfxU8* dstV,
+                    mfxU32 dstPitchV,
+                    mfxU32 width,
+                    mfxU32 height);
+
+    // UU... + VV... -> UVUV...
+    void (*MergeUV)(const mfxU8* srcU,
+                    mfxU32 srcPitchU,
+                    const mfxU8* srcV,
+                    mfxU32 srcPitchV,
+                    mfxU8* dst,
+                    mfxU32 dstPitch,
+                    mfxU32 width,
+                    mfxU32 height);
+
+    // shifts count 16-bit samples right, e.g. to convert MSB-aligned 10-bit data to LSB-aligned
+    void (*ShiftRight16)(const mfxU16* src, mfxU16* dst, mfxU32 count, mfxU32 shift);
+};
+
+// returns kernels of the best instruction set supported by CPU, selected on the first call
+const FrameCopyKernels* GetFrameCopyKernels();
+
+// returns kernels of required instruction set, NULL if it isn't supported by CPU or build
+const FrameCopyKernels* GetFrameCopyKernels(FrameCopyIsa isa);
+
+// copies rows of plane, rows are copied by single memcpy if both planes have no padding
+void CopyPlane(const mfxU8* src,
+               mfxU32 srcPitch,
+               mfxU8* dst,
+               mfxU32 dstPitch,
+               mfxU32 width,
+               mfxU32 height);
+
+#endif // __FRAME_COPY_H__
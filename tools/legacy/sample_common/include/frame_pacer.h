@@ -0,0 +1,164 @@
+/*############################################################################
+  # Copyright (C) 2005 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#pragma once
+
+#include <stdio.h>
+#include <algorithm>
+#include "vm/time_defs.h"
+#include "vpl/mfxdefs.h"
+
+// paces frames to the target frame rate against absolute timeline: deadline of frame n is
+// start + n * frameRateD / frameRateN, so sleep errors and processing jitter don't accumulate
+// and rational rates like 30000/1001 are kept exactly. Thread sleeps till spin time before the
+// deadline and spins the rest, so OS timer slack doesn't delay the frame. Frame which comes
+// after its deadline is passed at once and counted as late, if it is late for more than a frame
+// interval timeline is restarted from it instead of bursting frames to catch up.
+class CFramePacer {
+public:
+#if defined(_WIN32) || defined(_WIN64)
+    static const mfxU32 DEFAULT_SPIN_TIME = 1000; // us
+#else
+    static const mfxU32 DEFAULT_SPIN_TIME = 100; // us
+#endif
+
+    CFramePacer()
+            : m_frameRateN(0),
+              m_frameRateD(1),
+              m_spinTime(DEFAULT_SPIN_TIME * 1000ull),
+              m_start(0),
+              m_index(0),
+              m_numFrames(0),
+              m_numLate(0),
+              m_numResyncs(0),
+              m_maxLateness(0),
+              m_totalWakeError(0),
+              m_maxWakeError(0) {}
+
+    // frameRateN 0 disables pacing, statistics are reset
+    void Reset(mfxU32 frameRateN, mfxU32 frameRateD = 1) {
+        m_frameRateN     = frameRateN;
+        m_frameRateD     = frameRateD ? frameRateD : 1;
+        m_start          = 0;
+        m_index          = 0;
+        m_numFrames      = 0;
+        m_numLate        = 0;
+        m_numResyncs     = 0;
+        m_maxLateness    = 0;
+        m_totalWakeError = 0;
+        m_maxWakeError   = 0;
+    }
+
+    void SetSpinTime(mfxU32 usec) {
+        m_spinTime = usec * 1000ull;
+    }
+
+    bool IsEnabled() const {
+        return m_frameRateN != 0;
+    }
+
+    // waits for the deadline of the next frame, the first call starts timeline
+    void Work() {
+        if (!IsEnabled())
+            return;
+
+        mfxU64 now = msdk_time_get_monotonic_ns();
+        if (!m_numFrames++) {
+            m_start = now;
+            m_index = 0;
+            return;
+        }
+
+        mfxU64 deadline = m_start + GetFrameOffset(++m_index);
+        if (now < deadline) {
+            if (deadline - now > m_spinTime)
+                msdk_time_sleep_until_ns(deadline - m_spinTime);
+            while ((now = msdk_time_get_monotonic_ns()) < deadline) {
+            }
+            // non-zero only if sleep itself overshot the deadline
+            m_totalWakeError += now - deadline;
+            m_maxWakeError = std::max(m_maxWakeError, now - deadline);
+            return;
+        }
+
+        mfxU64 lateness = now - deadline;
+        m_numLate++;
+        m_maxLateness = std::max(m_maxLateness, lateness);
+        if (lateness > GetFrameOffset(1)) {
+            m_start = now;
+            m_index = 0;
+            m_numResyncs++;
+        }
+    }
+
+    // offset of frame n from the start of timeline in ns
+    mfxU64 GetFrameOffset(mfxU64 n) const {
+        if (!IsEnabled())
+            return 0;
+        // whole number of seconds is split out, so n * 1e9 * frameRateD doesn't overflow
+        mfxU64 seconds = n / m_frameRateN * m_frameRateD;
+        mfxU64 rest    = n % m_frameRateN * m_frameRateD;
+        return seconds * NSEC_PER_SEC + (mfxU64)((mfxF64)rest * NSEC_PER_SEC / m_frameRateN);
+    }
+
+    mfxU64 GetNumFrames() const {
+        return m_numFrames;
+    }
+
+    mfxU64 GetNumLateFrames() const {
+        return m_numLate;
+    }
+
+    mfxU64 GetNumResyncs() const {
+        return m_numResyncs;
+    }
+
+    // in ns
+    mfxU64 GetMaxLateness() const {
+        return m_maxLateness;
+    }
+
+    // drift of wake up time from the deadline for frames which came in time, in ns
+    mfxU64 GetAvgWakeError() const {
+        mfxU64 numInTime = m_numFrames - m_numLate - (m_numFrames ? 1 : 0);
+        return numInTime ? m_totalWakeError / numInTime : 0;
+    }
+
+    mfxU64 GetMaxWakeError() const {
+        return m_maxWakeError;
+    }
+
+    void PrintStatistics(const char* prefix) const {
+        if (!IsEnabled())
+            return;
+        printf("%s %u/%u fps, frames:%llu, late:%llu(max %.3lfms), resyncs:%llu, "
+               "drift avg:%.3lfus max:%.3lfus\n",
+               prefix,
+               m_frameRateN,
+               m_frameRateD,
+               (unsigned long long int)m_numFrames,
+               (unsigned long long int)m_numLate,
+               (double)m_maxLateness / 1e6,
+               (unsigned long long int)m_numResyncs,
+               (double)GetAvgWakeError() / 1e3,
+               (double)m_maxWakeError / 1e3);
+    }
+
+protected:
+    static const mfxU64 NSEC_PER_SEC = 1000000000ull;
+
+    mfxU32 m_frameRateN;
+    mfxU32 m_frameRateD;
+    mfxU64 m_spinTime; // ns
+    mfxU64 m_start; // start of timeline, ns
+    mfxU64 m_index; // number of frame since start of timeline
+    mfxU64 m_numFrames;
+    mfxU64 m_numLate;
+    mfxU64 m_numResyncs;
+    mfxU64 m_maxLateness;
+    mfxU64 m_totalWakeError;
+    mfxU64 m_maxWakeError;
+};
@@ -0,0 +1,245 @@
+/*############################################################################
+  # Copyright (C) 2005 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#pragma once
+
+#include <cassert>
+#include <vector>
+#include "vpl/mfxdefs.h"
+
+// free list of fixed number of slots linked by indices, Acquire and Release are O(1) and don't
+// allocate memory. Slots are handed out in the order they were released (FIFO), so pools which
+// complete tasks in order reuse them in ring order. Not thread-safe, callers serialize access.
+class CFreeList {
+public:
+    enum : mfxU32 {
+        INVALID_INDEX = 0xFFFFFFFF, // end of the list / no free slot
+        ACQUIRED      = 0xFFFFFFFE // link value of slot which is in use
+    };
+
+    CFreeList() : m_next(), m_head(INVALID_INDEX), m_tail(INVALID_INDEX), m_numFree(0) {}
+
+    // (re)initializes list with all slots free in index order
+    void Init(mfxU32 size) {
+        m_next.assign(size, ACQUIRED);
+        ReleaseAll();
+    }
+
+    void Close() {
+        m_next.clear();
+        m_head    = INVALID_INDEX;
+        m_tail    = INVALID_INDEX;
+        m_numFree = 0;
+    }
+
+    // returns index of the first free slot and marks it as used, INVALID_INDEX if none
+    mfxU32 Acquire() {
+        mfxU32 index = m_head;
+        if (index == INVALID_INDEX)
+            return INVALID_INDEX;
+
+        m_head = m_next[index];
+        if (m_head == INVALID_INDEX)
+            m_tail = INVALID_INDEX;
+        m_next[index] = ACQUIRED;
+        m_numFree--;
+        return index;
+    }
+
+    // returns index of the slot which next Acquire will return without taking it
+    mfxU32 Peek() const {
+        return m_head;
+    }
+
+    // appends slot to the end of the list or puts it to the front, so it's acquired next,
+    // returns false for out of range or already free slot
+    bool Release(mfxU32 index, bool toFront = false) {
+        if (index >= m_next.size() || m_next[index] != ACQUIRED)
+            return false;
+
+        if (toFront) {
+            m_next[index] = m_head;
+            m_head        = index;
+            if (m_tail == INVALID_INDEX)
+                m_tail = index;
+        }
+        else {
+            m_next[index] = INVALID_INDEX;
+            if (m_tail == INVALID_INDEX)
+                m_head = index;
+            else
+                m_next[m_tail] = index;
+            m_tail = index;
+        }
+        m_numFree++;
+        return true;
+    }
+
+    void ReleaseAll() {
+        mfxU32 size = (mfxU32)m_next.size();
+        for (mfxU32 i = 0; i < size; i++) {
+            m_next[i] = (i + 1 < size) ? i + 1 : INVALID_INDEX;
+        }
+        m_head    = size ? 0 : (mfxU32)INVALID_INDEX;
+        m_tail    = size ? size - 1 : (mfxU32)INVALID_INDEX;
+        m_numFree = size;
+    }
+
+    bool IsFree(mfxU32 index) const {
+        return index < m_next.size() && m_next[index] != ACQUIRED;
+    }
+
+    mfxU32 GetSize() const {
+        return (mfxU32)m_next.size();
+    }
+
+    mfxU32 GetNumFree() const {
+        return m_numFree;
+    }
+
+protected:
+    std::vector<mfxU32> m_next;
+    mfxU32 m_head;
+    mfxU32 m_tail;
+    mfxU32 m_numFree;
+};
+
+// preallocated items of type T with CFreeList on top of them, items are addressed by pointer,
+// which is converted to index by pointer arithmetic, so Release doesn't search the pool
+template <class T>
+class CFreeListPool {
+public:
+    CFreeListPool() : m_items(), m_freeList() {}
+
+    void Init(mfxU32 size) {
+        m_items.clear();
+        m_items.resize(size);
+        m_freeList.Init(size);
+    }
+
+    void Close() {
+        m_items.clear();
+        m_freeList.Close();
+    }
+
+    T* Acquire() {
+        mfxU32 index = m_freeList.Acquire();
+        return (index == CFreeList::INVALID_INDEX) ? nullptr : &m_items[index];
+    }
+
+    bool Release(T* pItem) {
+        return m_freeList.Release(GetIndex(pItem));
+    }
+
+    void ReleaseAll() {
+        m_freeList.ReleaseAll();
+    }
+
+    bool IsFree(const T* pItem) const {
+        return m_freeList.IsFree(GetIndex(pItem));
+    }
+
+    // returns INVALID_INDEX for item which doesn't belong to the pool
+    mfxU32 GetIndex(const T* pItem) const {
+        if (!pItem || m_items.empty() || pItem < &m_items[0] || pItem > &m_items.back())
+            return CFreeList::INVALID_INDEX;
+        return (mfxU32)(pItem - &m_items[0]);
+    }
+
+    T& operator[](mfxU32 index) {
+        return m_items[index];
+    }
+
+    mfxU32 GetSize() const {
+        return (mfxU32)m_items.size();
+    }
+
+    mfxU32 GetNumFree() const {
+        return m_freeList.GetNumFree();
+    }
+
+protected:
+    std::vector<T> m_items;
+    CFreeList m_freeList;
+};
+
+// double-ended queue with capacity fixed at Init, replaces std::list of in-flight items where
+// their number is bounded, so push/pop don't allocate a node per item
+template <class T>
+class CFixedQueue {
+public:
+    CFixedQueue() : m_items(), m_head(0), m_size(0) {}
+
+    void Init(mfxU32 capacity) {
+        m_items.assign(capacity, T());
+        clear();
+    }
+
+    // returns false if queue is full
+    bool push_back(const T& item) {
+        if (m_size == m_items.size())
+            return false;
+        m_items[(m_head + m_size) % m_items.size()] = item;
+        m_size++;
+        return true;
+    }
+
+    void pop_front() {
+        if (!m_size)
+            return;
+        m_head = (m_head + 1) % m_items.size();
+        m_size--;
+    }
+
+    void pop_back() {
+        if (m_size)
+            m_size--;
+    }
+
+    // front, back and operator[] require item to be in the queue, so capacity is not 0 there
+    T& front() {
+        assert(m_size);
+        return m_items[m_head];
+    }
+
+    T& back() {
+        assert(m_size);
+        return m_items[(m_head + m_size - 1) % m_items.size()];
+    }
+
+    // i-th item from the front
+    T& operator[](mfxU32 i) {
+        assert(i < m_size);
+        return m_items[(m_head + i) % m_items.size()];
+    }
+
+    const T& operator[](mfxU32 i) const {
+        assert(i < m_size);
+        return m_items[(m_head + i) % m_items.size()];
+    }
+
+    mfxU32 size() const {
+        return m_size;
+    }
+
+    bool empty() const {
+        return !m_size;
+    }
+
+    mfxU32 capacity() const {
+        return (mfxU32)m_items.size();
+    }
+
+    void clear() {
+        m_head = 0;
+        m_size = 0;
+    }
+
+protected:
+    std::vector<T> m_items;
+    mfxU32 m_head;
+    mfxU32 m_size;
+};
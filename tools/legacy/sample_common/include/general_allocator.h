@@ -14,6 +14,7 @@
 #include <memory>
 
 class SysMemFrameAllocator;
+struct SysMemAllocatorStats;
 
 // Wrapper on standard allocator for concurrent allocation of
 // D3D and system surfaces
@@ -25,6 +26,9 @@ public:
     virtual mfxStatus Init(mfxAllocatorParams* pParams);
     virtual mfxStatus Close();
 
+    // counters of allocator used for system memory surfaces
+    mfxStatus GetSysMemStats(SysMemAllocatorStats* stats);
+
 protected:
     virtual mfxStatus LockFrame(mfxMemId mid, mfxFrameData* ptr);
     virtual mfxStatus UnlockFrame(mfxMemId mid, mfxFrameData* ptr);
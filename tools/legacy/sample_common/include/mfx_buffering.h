@@ -20,7 +20,9 @@
 struct msdkFrameSurface {
     mfxFrameSurface1
         frame; // NOTE: this _should_ be the first item (see CBuffering::FindUsedSurface())
+    msdk_tick arrival; // tick when bitstream data of frame was read
     msdk_tick submit; // tick when frame was submitted for processing
+    msdk_tick synced; // tick when processing of frame was completed
     mfxU16 render_lock; // signifies that frame is locked for rendering
     msdkFrameSurface* prev;
     msdkFrameSurface* next;
@@ -118,6 +118,7 @@ enum LibVABackend {
 
 #define MSDK_MAX_FILENAME_LEN            1024
 #define MSDK_MAX_USER_DATA_UNREG_SEI_LEN 80
+#define MSDK_MAX_CPUS                    1024
 
 #define MSDK_PRINT_RET_MSG(ERR, MSG)                                                    \
     {                                                                                   \
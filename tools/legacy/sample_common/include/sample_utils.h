@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <algorithm>
 #include <fstream>
+#include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -21,6 +22,7 @@
 #include <atomic>
 #include <condition_variable>
 #include <iostream>
+#include <list>
 #include <thread>
 
 #include "mfxdeprecated.h"
@@ -34,6 +36,7 @@
 
 #include "vm/atomic_defs.h"
 #include "vm/file_defs.h"
+#include "vm/memory_defs.h"
 #include "vm/strings_defs.h"
 #include "vm/thread_defs.h"
 #include "vm/time_defs.h"
@@ -811,6 +814,56 @@ private:
     std::vector<mfxU8> m_data;
 };
 
+// reads file by large blocks, so small reads are served from memory. With non-zero prefetch
+// depth blocks are read in separate thread which keeps up to depth blocks ahead of the reader
+class CSmplReadAheadFile {
+public:
+    enum { DEFAULT_BLOCK_SIZE = 4 * 1024 * 1024 };
+
+    CSmplReadAheadFile(FILE* file, mfxU32 blockSize, mfxU32 prefetchDepth);
+    virtual ~CSmplReadAheadFile();
+
+    // same as fread of size bytes
+    size_t Read(mfxU8* dst, size_t size);
+    // drops data read ahead and sets file position from the beginning, same as fseek
+    int Seek(long offset);
+    // reads size bytes from the current file position to memory, then data is read from memory
+    // only: reading ends at the end of loaded data and seek doesn't access the file
+    size_t Preload(size_t size);
+
+protected:
+    struct Block {
+        std::vector<mfxU8> data;
+        size_t size;
+    };
+
+    // makes the next block current, returns false at the end of file
+    bool NextBlock();
+    void StartPrefetch();
+    void StopPrefetch();
+    void PrefetchRoutine();
+
+    FILE* m_file;
+    mfxU32 m_nBlockSize;
+    mfxU32 m_nPrefetchDepth;
+
+    Block m_current; // block the data is read from
+    size_t m_nPos; // position in the current block
+    bool m_bPreloaded; // current block holds all data
+
+    // blocks read by prefetch thread, free blocks are reused
+    std::list<Block> m_ready;
+    std::list<Block> m_free;
+    bool m_bEOF;
+    bool m_bStop;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_thread;
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(CSmplReadAheadFile);
+};
+
 class CSmplYUVReader {
 public:
     typedef std::list<std::string>::iterator ls_iterator;
@@ -825,10 +878,25 @@ public:
     virtual mfxStatus LoadNextFrame(mfxFrameSurface1* pSurface);
     virtual mfxStatus LoadNextFrame(mfxFrameSurface1* pSurface, int bytes_to_read, mfxU8* buf_read);
     virtual void Reset();
+    // number of frames read ahead by separate thread, 0 - input is read by calling thread
+    // should be called before Init
+    virtual void SetPrefetchDepth(mfxU32 depth);
+    // number of frames loaded to memory with the first frame, further frames are read from memory
+    // and reading ends after them, 0 - input is read from file
+    // should be called before Init
+    virtual void SetPreloadFrames(mfxU32 nFrames);
     mfxU32 m_ColorFormat; // color format of input YUV data, YUV420 or NV12
 
 protected:
+    // reads from view file through read-ahead buffer, same as fread
+    size_t ReadData(mfxU32 vid, void* dst, size_t size, size_t count);
+
     std::vector<FILE*> m_files;
+    // created on the first frame, when frame size is known
+    std::vector<std::unique_ptr<CSmplReadAheadFile>> m_readers;
+    mfxU32 m_nPrefetchDepth;
+    mfxU32 m_nPreloadFrames;
+    std::vector<mfxU8> m_chromaBuf; // planes of I420/YV12 input before interleaving
 
     bool shouldShift10BitsHigh;
     bool m_bInited;
@@ -847,6 +915,9 @@ public:
     virtual mfxStatus WriteNextFrame(mfxBitstream* pMfxBitstream, mfxU32 targetID, mfxU32 frameNum);
     virtual mfxStatus Reset();
     virtual void Close();
+    // size of file buffer, larger buffer coalesces frames into fewer writes
+    // should be called before the first frame is written
+    virtual mfxStatus SetWriteBufferSize(mfxU32 size);
     mfxU32 m_nProcessedFramesNum;
     bool m_bSkipWriting;
 
@@ -857,6 +928,37 @@ protected:
     FILE* m_fSource;
     bool m_bInited;
     std::string m_sFile;
+    mfxU32 m_nWriteBufferSize;
+};
+
+// growing byte buffer aligned to page size, so frames packed to it are written from page boundary
+class CSmplAlignedBuffer {
+public:
+    enum { ALIGNMENT = 4096 };
+
+    CSmplAlignedBuffer() : m_pData(NULL), m_nSize(0), m_nCapacity(0) {}
+    virtual ~CSmplAlignedBuffer();
+
+    mfxU8* GetData() const {
+        return m_pData;
+    }
+    size_t GetSize() const {
+        return m_nSize;
+    }
+    void Clear() {
+        m_nSize = 0;
+    }
+    // appends size bytes of src, returns false if buffer can't be grown
+    bool Append(const void* src, size_t size);
+    void Swap(CSmplAlignedBuffer& other);
+
+protected:
+    mfxU8* m_pData;
+    size_t m_nSize;
+    size_t m_nCapacity;
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(CSmplAlignedBuffer);
 };
 
 class CSmplYUVWriter {
@@ -874,15 +976,47 @@ public:
         m_bIsMultiView = true;
     }
 
+    // packs each frame into contiguous buffer and writes it by single write instead of writing
+    // rows, with bAsync frame is written by separate thread while the next one is packed
+    void SetFrameBatching(bool bEnable, bool bAsync = false);
+
 protected:
     CSmplYUVWriter(CSmplYUVWriter const&)                  = delete;
     const CSmplYUVWriter& operator=(CSmplYUVWriter const&) = delete;
 
+    mfxStatus WriteFrame(mfxFrameSurface1* pSurface, bool bI420);
+    mfxStatus PackNextFrame(mfxFrameSurface1* pSurface);
+    mfxStatus PackNextFrameI420(mfxFrameSurface1* pSurface);
+    // same as fwrite, in batching mode data is appended to the frame buffer
+    size_t WriteData(const void* src, size_t size, size_t count, FILE* dst);
+    // writes packed frame or passes it to writer thread
+    mfxStatus CommitFrame(FILE* dst);
+    // waits until writer thread writes pending frame, returns its status
+    mfxStatus WaitPendingFrame();
+    void StopWriterThread();
+    void WriterRoutine();
+
     FILE *m_fDest, **m_fDestMVC;
     bool m_bInited, m_bIsMultiView;
     mfxU32 m_numCreatedFiles;
     std::string m_sFile;
     mfxU32 m_nViews;
+
+    bool m_bBatching;
+    bool m_bAsync;
+    CSmplAlignedBuffer m_frameBuf; // frame being packed
+    std::vector<mfxU16> m_shiftBuf; // rows converted from MSB-aligned data
+    std::vector<mfxU8> m_chromaBuf; // chroma planes split for I420 output
+
+    // frame passed to writer thread, it is swapped with m_frameBuf
+    CSmplAlignedBuffer m_pendingBuf;
+    FILE* m_pendingFile;
+    bool m_bPending;
+    bool m_bStopWriter;
+    mfxStatus m_writeStatus;
+    std::mutex m_writeMutex;
+    std::condition_variable m_writeCV;
+    std::thread m_writerThread;
 };
 
 class CSmplBitstreamReader {
@@ -904,6 +1038,127 @@ protected:
     bool m_bInited;
 };
 
+// reads file mapped to memory, instead of copying data to the buffer of bitstream, bitstream is
+// pointed to the next window of the mapping, so data is copied only after rewinding to the file
+// beginning, when unused data of bitstream is not followed by the file data in the mapping.
+// Falls back to regular reading if file can't be mapped
+class CSmplBitstreamMappedReader : public CSmplBitstreamReader {
+public:
+    CSmplBitstreamMappedReader();
+    virtual ~CSmplBitstreamMappedReader();
+
+    virtual void Reset();
+    virtual void Close();
+    virtual mfxStatus Init(const char* strFileName);
+    virtual mfxStatus ReadNextFrame(mfxBitstream* pBS);
+
+protected:
+    // copies unused data of bitstream and following file data to the buffer owned by bitstream
+    mfxStatus CopyNextChunk(mfxBitstream* pBS);
+
+    msdk_file_map_handle m_hMapping;
+    mfxU8* m_pMappedData;
+    mfxU64 m_nFileSize;
+    mfxU64 m_nPos; // file offset of the first byte which wasn't passed to bitstream yet
+    // own buffer of bitstream, bitstream is switched back to it when data has to be copied
+    mfxU8* m_pOwnData;
+    mfxU32 m_nOwnMaxLength;
+    bool m_bOwnDataFromFile; // data in own buffer ends at m_nPos and follows file layout
+};
+
+// input file shared by all readers of the process which open the same file name. File is read
+// once by chunks, chunk is kept while any reader uses it, last read chunks are retained to serve
+// readers which lag behind
+class CSmplSharedInput {
+public:
+    typedef std::shared_ptr<const std::vector<mfxU8>> Chunk;
+
+    enum { CHUNK_SIZE = 4 * 1024 * 1024, RETAINED_CHUNKS = 16 };
+
+    virtual ~CSmplSharedInput();
+
+    // returns registered input for the file name, opens file if it isn't registered yet
+    static std::shared_ptr<CSmplSharedInput> Open(const char* strFileName);
+
+    // returns chunk with index nChunk, chunk is empty if it is beyond the end of file
+    mfxStatus GetChunk(mfxU64 nChunk, Chunk& chunk);
+
+    mfxU64 GetNumRequests();
+    mfxU64 GetNumReads();
+
+protected:
+    CSmplSharedInput();
+    mfxStatus Init(const char* strFileName);
+
+    std::mutex m_mutex;
+    FILE* m_fSource;
+    mfxU64 m_nFileChunk; // index of the chunk at the current file position
+    std::vector<std::weak_ptr<const std::vector<mfxU8>>> m_Chunks;
+    std::list<Chunk> m_RetainedChunks;
+    mfxU64 m_nRequests;
+    mfxU64 m_nReads;
+
+    static std::mutex s_RegistryMutex;
+    static std::map<std::string, std::weak_ptr<CSmplSharedInput>> s_Registry;
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(CSmplSharedInput);
+};
+
+// reads file through the process-wide CSmplSharedInput, so sessions decoding the same file
+// don't read it from disk independently
+class CSmplBitstreamSharedReader : public CSmplBitstreamReader {
+public:
+    CSmplBitstreamSharedReader();
+    virtual ~CSmplBitstreamSharedReader();
+
+    virtual void Reset();
+    virtual void Close();
+    virtual mfxStatus Init(const char* strFileName);
+    virtual mfxStatus ReadNextFrame(mfxBitstream* pBS);
+
+protected:
+    std::shared_ptr<CSmplSharedInput> m_pInput;
+    CSmplSharedInput::Chunk m_pChunk;
+    mfxU64 m_nChunk; // index of the chunk to read from
+    size_t m_nChunkPos; // position of the next byte to read in the chunk
+};
+
+// keeps the beginning of the input in memory, so reading doesn't access the file during the run.
+// Data is loaded by the source reader at Init: frames of frame readers (like IVF) are kept whole,
+// data of stream readers is cut at the last start code inside the size limit. Reset rewinds to
+// the beginning of loaded data
+class CSmplBitstreamPreloadedReader : public CSmplBitstreamReader {
+public:
+    enum { CHUNK_SIZE = 1024 * 1024 };
+
+    CSmplBitstreamPreloadedReader();
+    virtual ~CSmplBitstreamPreloadedReader();
+
+    // source is owned by the reader, file reader is used if it isn't set
+    // should be called before Init
+    void SetSource(std::unique_ptr<CSmplBitstreamReader>& source, mfxU64 nMaxSize);
+    // number of loaded bytes
+    mfxU64 GetSize() const {
+        return m_data.size();
+    }
+
+    virtual void Reset();
+    virtual void Close();
+    virtual mfxStatus Init(const char* strFileName);
+    virtual mfxStatus ReadNextFrame(mfxBitstream* pBS);
+
+protected:
+    std::unique_ptr<CSmplBitstreamReader> m_pSource;
+    mfxU64 m_nMaxSize;
+    std::vector<mfxU8> m_data;
+    std::vector<size_t> m_frames; // offsets of frames in data, if source reads whole frames
+    bool m_bCompleteFrames;
+    bool m_bWholeFile; // input isn't cut, so the end of data is the end of stream
+    size_t m_nPos; // position of the next byte to read
+    size_t m_nFrame; // index of the next frame to read
+};
+
 class CH264FrameReader : public CSmplBitstreamReader {
 public:
     CH264FrameReader();
@@ -914,6 +1169,10 @@ public:
     virtual mfxStatus Init(const char* strFileName);
     virtual mfxStatus ReadNextFrame(mfxBitstream* pBS);
 
+    // frames are split in input buffer and copied to output bitstream directly, should be called
+    // before Init
+    void SetInPlaceSplitting(bool bEnable);
+
 private:
     mfxBitstream* m_processedBS;
     // input bit stream
@@ -929,6 +1188,7 @@ private:
     mfxU8* m_plainBuffer;
     mfxU32 m_plainBufferSize;
     mfxBitstream m_outBS;
+    bool m_bInPlace;
 };
 
 //provides output bistream with at least 1 frame, reports about error
@@ -1409,35 +1669,45 @@ mfxStatus StrFormatToCodecFormatFourCC(char* strInput, mfxU32& codecFormat);
 const char* StatusToString(mfxStatus sts);
 mfxI32 getMonitorType(char* str);
 
-void WaitForDeviceToBecomeFree(MFXVideoSession& session,
-                               mfxSyncPoint& syncPoint,
-                               mfxStatus& currentStatus);
+// waits after MFX_WRN_DEVICE_BUSY till the device is likely free: completes the oldest operation
+// in flight if the caller has one, otherwise backs off, first yielding the CPU and then sleeping
+// for exponentially growing time up to MAX_SLEEP_TIME. Counts busy events and time spent in them.
+class CDeviceBusyWaiter {
+public:
+    static const mfxU32 SPIN_ATTEMPTS  = 4;
+    static const mfxU32 MIN_SLEEP_TIME = 50; // us
+    static const mfxU32 MAX_SLEEP_TIME = 1000; // us
 
-mfxU16 FourCCToChroma(mfxU32 fourCC);
+    CDeviceBusyWaiter();
 
-class FPSLimiter {
-public:
-    FPSLimiter()  = default;
-    ~FPSLimiter() = default;
-    void Reset(mfxU32 fps) {
-        m_delayTicks = fps ? msdk_time_get_frequency() / fps : 0;
+    // attempt is the number of busy statuses returned in a row for the same call. syncOldest
+    // returns MFX_ERR_NOT_FOUND if nothing is in flight, other errors are returned to the caller
+    mfxStatus Wait(mfxU32 attempt, const std::function<mfxStatus()>& syncOldest = nullptr);
+    // syncs on the given sync point, completed sync point is reset, so it isn't polled again
+    mfxStatus Wait(mfxU32 attempt, MFXVideoSession& session, mfxSyncPoint& syncPoint);
+
+    mfxU64 GetNumEvents() const {
+        return m_numEvents;
     }
-    void Work() {
-        msdk_tick current_tick = msdk_time_get_tick();
-        while (m_delayTicks && (m_startTick + m_delayTicks > current_tick)) {
-            msdk_tick left_tick = m_startTick + m_delayTicks - current_tick;
-            uint32_t sleepTime  = (uint32_t)(left_tick * 1000 / msdk_time_get_frequency());
-            MSDK_SLEEP(sleepTime);
-            current_tick = msdk_time_get_tick();
-        };
-        m_startTick = msdk_time_get_tick();
+    // in ns
+    mfxU64 GetTimeLost() const {
+        return m_timeLost;
     }
+    void PrintStatistics(const char* prefix) const;
 
 protected:
-    msdk_tick m_startTick  = 0;
-    msdk_tick m_delayTicks = 0;
+    void BackOff(mfxU32 attempt);
+
+    std::atomic<mfxU64> m_numEvents;
+    std::atomic<mfxU64> m_timeLost;
+
+private:
+    CDeviceBusyWaiter(const CDeviceBusyWaiter&);
+    void operator=(const CDeviceBusyWaiter&);
 };
 
+mfxU16 FourCCToChroma(mfxU32 fourCC);
+
 #if defined(_WIN32) || defined(_WIN64)
 mfxStatus PrintLoadedModules();
 #else
@@ -8,8 +8,13 @@
 #define __SYSMEM_ALLOCATOR_H__
 
 #include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
 #include <vector>
 #include "base_allocator.h"
+#include "vm/memory_defs.h"
 
 struct sBuffer {
     mfxU32 id;
@@ -22,9 +27,33 @@ struct sFrame {
     mfxFrameInfo info;
 };
 
+enum SysMemBackend {
+    SYSMEM_BACKEND_HEAP = 0, // every buffer is allocated from the heap and zeroed
+    SYSMEM_BACKEND_SLAB // buffers are carved from large arenas and reused after release
+};
+
 struct SysMemAllocatorParams : mfxAllocatorParams {
-    SysMemAllocatorParams() : mfxAllocatorParams(), pBufferAllocator(NULL) {}
+    SysMemAllocatorParams()
+            : mfxAllocatorParams(),
+              pBufferAllocator(NULL),
+              backend(SYSMEM_BACKEND_HEAP),
+              hugePages(MSDK_HUGE_PAGES_OFF),
+              numaNode(-1),
+              bZeroFill(false) {}
     MFXBufferAllocator* pBufferAllocator;
+
+    // parameters of own buffer allocator, used if pBufferAllocator isn't set
+    SysMemBackend backend;
+    msdk_huge_pages hugePages; // pages backing slab arenas
+    mfxI32 numaNode; // node to bind slab arenas to, negative means no binding
+    bool bZeroFill; // zero slab buffers on reuse, fresh arenas are zeroed by the system
+};
+
+struct SysMemAllocatorStats {
+    mfxU64 numAllocs; // number of AllocBuffer calls
+    mfxU64 allocTime; // total time spent in AllocBuffer in microseconds
+    mfxU64 reservedBytes; // memory currently taken from the system by the allocator
+    mfxU64 rssBytes; // resident set size of the whole process
 };
 
 class SysMemFrameAllocator : public BaseFrameAllocator {
@@ -38,6 +67,9 @@ public:
     virtual mfxStatus UnlockFrame(mfxMemId mid, mfxFrameData* ptr);
     virtual mfxStatus GetFrameHDL(mfxMemId mid, mfxHDL* handle);
 
+    // returns MFX_ERR_UNSUPPORTED if external buffer allocator isn't SysMemBufferAllocator
+    mfxStatus GetStats(SysMemAllocatorStats* stats);
+
 protected:
     virtual mfxStatus CheckRequestType(mfxFrameAllocRequest* request);
     virtual mfxStatus ReleaseResponse(mfxFrameAllocResponse* response);
@@ -57,7 +89,8 @@ protected:
     MFXBufferAllocator* m_pBufferAllocator;
     bool m_bOwnBufferAllocator;
 
-    std::vector<mfxFrameAllocResponse*> m_vResp;
+    // copies of allocated responses, callers may release a response through another copy
+    std::vector<mfxFrameAllocResponse> m_vResp;
 
     mfxMemId* GetMidHolder(mfxMemId mid);
 };
@@ -70,6 +103,43 @@ public:
     virtual mfxStatus LockBuffer(mfxMemId mid, mfxU8** ptr);
     virtual mfxStatus UnlockBuffer(mfxMemId mid);
     virtual mfxStatus FreeBuffer(mfxMemId mid);
+
+    SysMemAllocatorStats GetStats() const;
+
+protected:
+    void CountAlloc(std::chrono::steady_clock::time_point start);
+
+    std::atomic<mfxU64> m_numAllocs;
+    std::atomic<mfxU64> m_allocTime;
+    std::atomic<mfxU64> m_reservedBytes;
+};
+
+// Keeps buffers in large arenas taken directly from the system, optionally on huge pages and
+// bound to NUMA node. Released buffers go to free lists and are handed out again to requests
+// of the same size, arenas are returned to the system only by destructor.
+class SlabBufferAllocator : public SysMemBufferAllocator {
+public:
+    SlabBufferAllocator(msdk_huge_pages hugePages, mfxI32 numaNode, bool bZeroFill);
+    virtual ~SlabBufferAllocator();
+    virtual mfxStatus AllocBuffer(mfxU32 nbytes, mfxU16 type, mfxMemId* mid);
+    virtual mfxStatus FreeBuffer(mfxMemId mid);
+
+protected:
+    struct Arena {
+        mfxU8* base;
+        size_t size;
+        size_t used;
+    };
+
+    mfxU8* TakeBlock(size_t blockSize);
+
+    msdk_huge_pages m_hugePages;
+    mfxI32 m_numaNode;
+    bool m_bZeroFill;
+
+    std::mutex m_mutex;
+    std::vector<Arena> m_arenas;
+    std::map<size_t, std::vector<sBuffer*>> m_freeBlocks; // released blocks by size
 };
 
 #endif // __SYSMEM_ALLOCATOR_H__
\ No newline at end of file
@@ -7,12 +7,106 @@
 #pragma once
 
 #include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <string>
 #include <vector>
 #include "math.h"
 #include "vm/strings_defs.h"
 #include "vm/time_defs.h"
 #include "vpl/mfxstructures.h"
 
+// histogram of time measurements with log-linear buckets (HDR-like), keeps values from 1us to
+// ~19 hours with precision better than 1.6% in fixed memory, no per-sample storage
+class CLatencyHistogram {
+public:
+    CLatencyHistogram() : m_counts(), m_count(0), m_max(0) {}
+
+    inline void Enable() {
+        m_counts.assign(NUM_BUCKETS, 0);
+    }
+
+    inline bool IsEnabled() const {
+        return !m_counts.empty();
+    }
+
+    // adds value in seconds
+    inline void Add(mfxF64 delta) {
+        if (m_counts.empty())
+            return;
+
+        const mfxU64 maxValue = ((mfxU64)1 << MAX_VALUE_BITS) - 1;
+        mfxU64 value          = delta > 0 ? (mfxU64)(delta * 1000000) : 0;
+        if (value > maxValue)
+            value = maxValue;
+        m_counts[GetBucket(value)]++;
+        m_count++;
+        m_max = std::max(m_max, value);
+    }
+
+    inline mfxU64 GetCount() const {
+        return m_count;
+    }
+
+    // returns value below which given percent of measurements fall, in seconds
+    inline mfxF64 GetPercentile(mfxF64 percentile) const {
+        if (!m_count)
+            return 0;
+
+        mfxU64 rank = (mfxU64)ceil(percentile / 100 * m_count);
+        rank        = std::max(rank, (mfxU64)1);
+        mfxU64 sum  = 0;
+        for (mfxU32 i = 0; i < NUM_BUCKETS; i++) {
+            sum += m_counts[i];
+            if (sum >= rank)
+                return std::min(GetBucketValue(i), m_max) / 1000000.;
+        }
+        return m_max / 1000000.;
+    }
+
+    inline void Reset() {
+        std::fill(m_counts.begin(), m_counts.end(), 0);
+        m_count = 0;
+        m_max   = 0;
+    }
+
+protected:
+    // values below 2 * SUB_BUCKETS are exact, above it each power of two is split to
+    // SUB_BUCKETS linear buckets
+    enum {
+        SUB_BUCKET_BITS = 6,
+        SUB_BUCKETS     = 1 << SUB_BUCKET_BITS,
+        MAX_VALUE_BITS  = 36,
+        NUM_BUCKETS     = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKETS
+    };
+
+    static inline mfxU32 GetBucket(mfxU64 value) {
+        if (value < 2 * SUB_BUCKETS)
+            return (mfxU32)value;
+
+        mfxU32 shift = 0;
+        while ((value >> shift) >= 2 * SUB_BUCKETS)
+            shift++;
+        return (shift + 1) * SUB_BUCKETS + (mfxU32)(value >> shift) - SUB_BUCKETS;
+    }
+
+    // returns middle of the bucket
+    static inline mfxU64 GetBucketValue(mfxU32 bucket) {
+        if (bucket < 2 * SUB_BUCKETS)
+            return bucket;
+
+        mfxU32 shift = bucket / SUB_BUCKETS - 1;
+        mfxU64 lower = (mfxU64)(bucket % SUB_BUCKETS + SUB_BUCKETS) << shift;
+        return lower + (((mfxU64)1 << shift) >> 1);
+    }
+
+    std::vector<mfxU64> m_counts;
+    mfxU64 m_count;
+    mfxU64 m_max;
+};
+
 class CTimeStatisticsReal {
 public:
     CTimeStatisticsReal() {
@@ -37,12 +131,17 @@ public:
     }
 
     inline void StopTimeMeasurement() {
-        mfxF64 delta = GetDeltaTime();
+        AddMeasurement(GetDeltaTime());
+    }
+
+    // accounts time measured outside, e.g. in other thread, in seconds
+    inline void AddMeasurement(mfxF64 delta) {
         totalTime += delta;
         totalTimeSquares += delta * delta;
         // dump in ms:
         if (m_bNeedDumping)
             m_time_deltas.push_back(delta * 1000);
+        m_histogram.Add(delta);
 
         if (delta < minTime) {
             minTime = delta;
@@ -60,6 +159,16 @@ public:
         }
     }
 
+    // splits time since start between numItems processed at once, so there is a measurement
+    // per item
+    inline void StopTimeMeasurementWithCheck(mfxU32 numItems) {
+        if (start && numItems) {
+            mfxF64 delta = GetDeltaTime() / numItems;
+            for (mfxU32 i = 0; i < numItems; i++)
+                AddMeasurement(delta);
+        }
+    }
+
     inline mfxF64 GetDeltaTime() {
         return MSDK_GET_TIME(msdk_time_get_tick(), start, GetFrequency());
     }
@@ -76,6 +185,26 @@ public:
         m_bNeedDumping = false;
     }
 
+    // measurements in ms added while dumping was on
+    inline const std::vector<mfxF64>& GetDeltas() const {
+        return m_time_deltas;
+    }
+
+    // histogram accumulates measurements for the whole run, it is not cleared by
+    // ResetStatistics, so percentiles can be printed both per window and at the end
+    inline void TurnOnHistogram() {
+        m_histogram.Enable();
+    }
+
+    inline mfxU64 GetHistogramNumMeasurements() {
+        return m_histogram.GetCount();
+    }
+
+    inline mfxF64 GetPercentile(mfxF64 percentile, bool inSeconds = true) {
+        mfxF64 value = m_histogram.GetPercentile(percentile);
+        return inSeconds ? value : value * 1000;
+    }
+
     inline void PrintStatistics(const char* prefix) {
         printf("%s Total:%.3lfms(%llu smpls),Avg %.3lfms,StdDev:%.3lfms,Min:%.3lfms,Max:%.3lfms\n",
                prefix,
@@ -140,6 +269,7 @@ protected:
     mfxU64 numMeasurements;
     std::vector<mfxF64> m_time_deltas;
     bool m_bNeedDumping;
+    CLatencyHistogram m_histogram;
 };
 
 class CTimeStatisticsDummy {
@@ -159,8 +289,12 @@ public:
 
     inline void StopTimeMeasurement() {}
 
+    inline void AddMeasurement(mfxF64 /*delta*/) {}
+
     inline void StopTimeMeasurementWithCheck() {}
 
+    inline void StopTimeMeasurementWithCheck(mfxU32 /*numItems*/) {}
+
     inline mfxF64 GetDeltaTime() {
         return 0;
     }
@@ -173,6 +307,16 @@ public:
 
     inline void TurnOffDumping() {}
 
+    inline void TurnOnHistogram() {}
+
+    inline mfxU64 GetHistogramNumMeasurements() {
+        return 0;
+    }
+
+    inline mfxF64 GetPercentile(mfxF64, bool) {
+        return 0;
+    }
+
     inline void PrintStatistics(const char* /*prefix*/) {}
 
     inline mfxU64 GetNumMeasurements() {
@@ -205,6 +349,133 @@ protected:
     static msdk_tick frequency;
 };
 
+// latency of processing stages of frames, every stage keeps measurements of the whole run in
+// histogram, so percentiles are reported without storing all frames. Measurements may come from
+// different threads. Statistics are collected regardless of TIME_STATS
+class CStageLatencyStat {
+public:
+    struct Percentile {
+        mfxF64 Value;
+        const char* Name;
+    };
+    enum { NUM_PERCENTILES = 4 };
+
+    // percentiles printed and written to reports: p50, p90, p99 and p99.9
+    static const Percentile& GetReportPercentile(mfxU32 i) {
+        static const Percentile percentiles[NUM_PERCENTILES] = { { 50, "p50" },
+                                                                 { 90, "p90" },
+                                                                 { 99, "p99" },
+                                                                 { 99.9, "p99.9" } };
+        return percentiles[i];
+    }
+
+    // names of numStages stages, the array must outlive the object
+    CStageLatencyStat(const char* const* names, mfxU32 numStages)
+            : m_mutex(),
+              m_bEnabled(false),
+              m_names(names),
+              m_stages(numStages) {}
+    virtual ~CStageLatencyStat() {}
+
+    void Enable() {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        for (CTimeStatisticsReal& stage : m_stages) {
+            stage.TurnOnHistogram();
+        }
+        m_bEnabled = true;
+    }
+
+    bool IsEnabled() const {
+        return m_bEnabled;
+    }
+
+    // keeps every measurement of the stage in addition to the histogram, they are returned by
+    // GetDeltas of the stage
+    void KeepDeltas(mfxU32 stage) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        if (stage < m_stages.size())
+            m_stages[stage].TurnOnDumping();
+    }
+
+    // delta is in seconds
+    void AddMeasurement(mfxU32 stage, mfxF64 delta) {
+        if (!m_bEnabled || stage >= m_stages.size())
+            return;
+
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_stages[stage].AddMeasurement(delta);
+    }
+
+    mfxU32 GetNumStages() const {
+        return (mfxU32)m_stages.size();
+    }
+
+    const char* GetStageName(mfxU32 stage) const {
+        return m_names[stage];
+    }
+
+    // stages are read after all measurements are added, e.g. at the end of the run
+    CTimeStatisticsReal& GetStage(mfxU32 stage) {
+        return m_stages[stage];
+    }
+
+    // writes <name>.csv and <name>.json with number of samples, average, percentiles and max of
+    // every stage in ms, jsonFields are put to the beginning of json object, e.g. "\"id\":0,"
+    mfxStatus WriteReport(const std::string& name, const std::string& jsonFields = "") {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        std::ofstream csv_file(name + ".csv");
+        std::ofstream json_file(name + ".json");
+        if (!csv_file || !json_file) {
+            printf("ERROR: latency report %s cannot be open\n", name.c_str());
+            return MFX_ERR_NOT_FOUND;
+        }
+        csv_file << std::fixed << std::setprecision(3);
+        json_file << std::fixed << std::setprecision(3);
+
+        csv_file << "stage,samples,avg";
+        for (mfxU32 i = 0; i < NUM_PERCENTILES; i++)
+            csv_file << "," << GetReportPercentile(i).Name;
+        csv_file << ",max" << std::endl;
+        json_file << "{" << jsonFields << "\"stages\":[";
+        bool first = true;
+        for (mfxU32 i = 0; i < m_stages.size(); i++) {
+            CTimeStatisticsReal& stage = m_stages[i];
+            if (!stage.GetNumMeasurements())
+                continue;
+
+            csv_file << m_names[i] << "," << stage.GetNumMeasurements() << ","
+                     << stage.GetAvgTime(false);
+            json_file << (first ? "" : ",") << std::endl
+                      << "{\"stage\":\"" << m_names[i]
+                      << "\",\"samples\":" << stage.GetNumMeasurements()
+                      << ",\"avg\":" << stage.GetAvgTime(false);
+            for (mfxU32 j = 0; j < NUM_PERCENTILES; j++) {
+                const Percentile& percentile = GetReportPercentile(j);
+                mfxF64 value                 = stage.GetPercentile(percentile.Value, false);
+                csv_file << "," << value;
+                json_file << ",\"" << percentile.Name << "\":" << value;
+            }
+            csv_file << "," << stage.GetMaxTime(false) << std::endl;
+            json_file << ",\"max\":" << stage.GetMaxTime(false) << "}";
+            first = false;
+        }
+        json_file << std::endl << "]}" << std::endl;
+
+        return (csv_file && json_file) ? MFX_ERR_NONE : MFX_ERR_UNKNOWN;
+    }
+
+protected:
+    std::mutex m_mutex;
+    bool m_bEnabled;
+    const char* const* m_names;
+    std::vector<CTimeStatisticsReal> m_stages;
+
+private:
+    CStageLatencyStat(const CStageLatencyStat&);
+    void operator=(const CStageLatencyStat&);
+};
+
 #ifdef TIME_STATS
 typedef CTimeStatisticsReal CTimeStatistics;
 #else
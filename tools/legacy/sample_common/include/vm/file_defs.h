@@ -24,4 +24,12 @@
     #define msdk_fgets fgets
 #endif // #if defined(_WIN32) || defined(_WIN64)
 
+/* Declare file mapping handle */
+typedef void* msdk_file_map_handle;
+
+/* Maps whole file to memory for sequential reading, pages are copy-on-write, so mapped data
+   can be modified without affecting the file. Returns NULL on failure */
+msdk_file_map_handle msdk_file_map(const char* file_name, mfxU8** data, mfxU64* size);
+void msdk_file_unmap(msdk_file_map_handle handle);
+
 #endif // #ifndef __FILE_DEFS_H__
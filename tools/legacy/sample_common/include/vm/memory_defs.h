@@ -0,0 +1,35 @@
+/*############################################################################
+  # Copyright (C) 2005 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef __MEMORY_DEFS_H__
+#define __MEMORY_DEFS_H__
+
+#include "vpl/mfxdefs.h"
+
+#include <stddef.h>
+
+enum msdk_huge_pages {
+    MSDK_HUGE_PAGES_OFF = 0,
+    MSDK_HUGE_PAGES_TRANSPARENT, // advise the kernel to back memory by transparent huge pages
+    MSDK_HUGE_PAGES_EXPLICIT // use reserved huge pages, falls back to regular pages
+};
+
+#define MSDK_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/* Allocates page-aligned memory directly from the system, bound to the given NUMA node unless
+   it is negative. Memory is zeroed by the system on first touch. Returns NULL on failure */
+void* msdk_large_alloc(size_t size, msdk_huge_pages huge_pages, mfxI32 numa_node);
+void msdk_large_free(void* ptr, size_t size);
+
+/* Allocates size bytes aligned to alignment, which is a power of two multiple of pointer size.
+   Returns NULL on failure */
+void* msdk_aligned_malloc(size_t size, size_t alignment);
+void msdk_aligned_free(void* ptr);
+
+/* Returns resident set size of the process in bytes, 0 if it is unknown */
+mfxU64 msdk_get_rss(void);
+
+#endif // #ifndef __MEMORY_DEFS_H__
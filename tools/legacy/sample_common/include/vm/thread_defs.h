@@ -7,6 +7,7 @@
 #ifndef __THREAD_DEFS_H__
 #define __THREAD_DEFS_H__
 
+#include <vector>
 #include "vm/strings_defs.h"
 #include "vpl/mfxdefs.h"
 
@@ -121,4 +122,13 @@ mfxStatus msdk_setrlimit_vmem(mfxU64 size);
 mfxStatus msdk_thread_get_schedtype(const char*, mfxI32& type);
 void msdk_thread_printf_scheduling_help();
 
+// CPU placement of the calling thread, threads created by it inherit the affinity
+mfxStatus msdk_thread_get_affinity(std::vector<mfxU32>& cpus);
+mfxStatus msdk_thread_set_affinity(const std::vector<mfxU32>& cpus);
+// makes memory of the calling thread to be allocated on the NUMA node if possible,
+// negative node restores default policy
+mfxStatus msdk_thread_set_numa_node(mfxI32 node);
+mfxU32 msdk_get_numa_node_count();
+mfxStatus msdk_get_numa_node_cpus(mfxU32 node, std::vector<mfxU32>& cpus);
+
 #endif //__THREAD_DEFS_H__
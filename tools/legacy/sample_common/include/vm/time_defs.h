@@ -52,4 +52,9 @@ msdk_tick msdk_time_get_tick(void);
 msdk_tick msdk_time_get_frequency(void);
 mfxU64 rdtsc(void);
 
+// monotonic clock in nanoseconds, not affected by system time changes
+mfxU64 msdk_time_get_monotonic_ns(void);
+// sleeps until absolute time of msdk_time_get_monotonic_ns() clock
+void msdk_time_sleep_until_ns(mfxU64 deadline);
+
 #endif // #ifndef __TIME_DEFS_H__
@@ -1721,6 +1721,10 @@ mfxStatus DecodeExpGolombOne(mfxU32** ppBitStream,
     }
     length -= 8 - thisChunksLength;
 
+    /* longer codeword can only come from truncated or corrupted data */
+    if (length > 32)
+        return MFX_ERR_UNDEFINED_BEHAVIOR;
+
     avcUngetNBits((*ppBitStream), (*pBitOffset), 8 - (thisChunksLength + 1));
 
     /* Get info portion of codeword */
@@ -5,10 +5,19 @@
   ############################################################################*/
 
 #include "avc_nal_spl.h"
+#include <string.h>
 #include <algorithm>
 #include "avc_structures.h"
 #include "sample_defs.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define NAL_SPL_SSE2
+    #include <emmintrin.h>
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #endif
+#endif
+
 namespace ProtectedLibrary {
 
 static const mfxU32 MFX_TIME_STAMP_FREQUENCY = 90000; // will go to mfxdefs.h
@@ -36,21 +45,66 @@ inline bool IsVLCCode(mfxI32 iCode) {
            (NAL_UT_AUXILIARY == (iCode & AVC_NAL_UNITTYPE_BITS_MASK));
 }
 
+#ifdef NAL_SPL_SSE2
+static inline mfxU32 LowestBit(mfxU32 mask) {
+    #if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+    #else
+    return __builtin_ctz(mask);
+    #endif
+}
+#endif
+
+const mfxU8* FindZeroZeroByte(const mfxU8* begin, const mfxU8* end, mfxU8 value) {
+#ifdef NAL_SPL_SSE2
+    // checks 16 positions at once, sequence starting at the last one ends 2 bytes further
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i last = _mm_set1_epi8((char)value);
+    for (; end - begin >= 18; begin += 16) {
+        __m128i b0 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)begin), zero);
+        __m128i b1 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(begin + 1)), zero);
+        __m128i b2 = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(begin + 2)), last);
+        mfxU32 mask = (mfxU32)_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(b0, b1), b2));
+        if (mask)
+            return begin + LowestBit(mask);
+    }
+#else
+    // memchr skips bytes which can't end the sequence
+    while (end - begin >= 3) {
+        const mfxU8* p = (const mfxU8*)memchr(begin + 2, value, end - begin - 2);
+        if (!p)
+            return end;
+        if (!p[-2] && !p[-1])
+            return p - 2;
+        begin = p - 1;
+    }
+#endif
+    for (; end - begin >= 3; begin++) {
+        if (!begin[0] && !begin[1] && begin[2] == value)
+            return begin;
+    }
+    return end;
+}
+
 static mfxI32 FindStartCode(mfxU8*(&pb), mfxU32& nSize) {
     // there is no data
     if (nSize < 4)
         return 0;
 
-    // find start code
-    while ((4 <= nSize) && ((0 != pb[0]) || (0 != pb[1]) || (1 != pb[2]))) {
-        pb += 1;
-        nSize -= 1;
+    // find start code followed by at least one byte
+    mfxU8* end  = pb + nSize - 1;
+    mfxU8* code = (mfxU8*)FindZeroZeroByte(pb, end, 1);
+    if (code == end) {
+        pb    = end - 2;
+        nSize = 3;
+        return 0;
     }
 
-    if (4 <= nSize)
-        return ((pb[0] << 24) | (pb[1] << 16) | (pb[2] << 8) | (pb[3]));
-
-    return 0;
+    nSize -= (mfxU32)(code - pb);
+    pb = code;
+    return ((pb[0] << 24) | (pb[1] << 16) | (pb[2] << 8) | (pb[3]));
 }
 
 mfxStatus MoveBitstream(mfxBitstream* source, mfxI32 moveSize) {
@@ -236,41 +290,33 @@ mfxI32 StartCodeIterator::EndOfStream(mfxBitstream* dst) {
 }
 
 mfxI32 StartCodeIterator::FindStartCode(mfxU8*(&pb), mfxU32& size, mfxI32& startCodeSize) {
-    mfxU32 zeroCount = 0;
-
-    for (mfxU32 i = 0; i < (mfxU32)size; i++, pb++) {
-        switch (pb[0]) {
-            case 0x00:
-                zeroCount++;
-                break;
-            case 0x01:
-                if (zeroCount >= 2) {
-                    startCodeSize = std::min(zeroCount + 1, 4u);
-                    size -= i + 1;
-                    pb++; // remove 0x01 symbol
-                    zeroCount = 0;
-                    if (size >= 1) {
-                        return pb[0] & AVC_NAL_UNITTYPE_BITS_MASK;
-                    }
-                    else {
-                        pb -= startCodeSize;
-                        size += startCodeSize;
-                        startCodeSize = 0;
-                        return 0;
-                    }
-                }
-                zeroCount = 0;
-                break;
-            default:
-                zeroCount = 0;
-                break;
+    mfxU8* begin = pb;
+    mfxU8* end   = pb + size;
+    mfxU8* code  = (mfxU8*)FindZeroZeroByte(begin, end, 1);
+
+    if (code != end) {
+        // start code is 4 bytes long if it is preceded by one more zero
+        startCodeSize = (code > begin && !code[-1]) ? 4 : 3;
+        pb            = code + 3; // remove 0x01 symbol
+        size          = (mfxU32)(end - pb);
+        if (size >= 1) {
+            return pb[0] & AVC_NAL_UNITTYPE_BITS_MASK;
+        }
+        else {
+            pb -= startCodeSize;
+            size += startCodeSize;
+            startCodeSize = 0;
+            return 0;
         }
     }
 
-    zeroCount = std::min(zeroCount, 3u);
-    pb -= zeroCount;
+    // keep trailing zeros, they may be a part of start code
+    mfxU32 zeroCount = 0;
+    while (zeroCount < 3 && pb < end - zeroCount && !end[-1 - (mfxI32)zeroCount])
+        zeroCount++;
+
+    pb = end - zeroCount;
     size += zeroCount;
-    zeroCount     = 0;
     startCodeSize = 0;
     return 0;
 }
@@ -316,145 +362,46 @@ mfxI32 NALUnitSplitter::GetNalUnits(mfxBitstream* source, mfxBitstream*& destina
     return iCode;
 }
 
-/* temporal class definition */
-class H264DwordPointer_ {
-public:
-    // Default constructor
-    H264DwordPointer_(void) {
-        m_pDest    = NULL;
-        m_nByteNum = 0;
-        m_iCur     = 0;
-    }
-
-    H264DwordPointer_ operator=(void* pDest) {
-        m_pDest    = (mfxU32*)pDest;
-        m_nByteNum = 0;
-        m_iCur     = 0;
-
-        return *this;
-    }
-
-    // Increment operator
-    H264DwordPointer_& operator++(void) {
-        if (4 == ++m_nByteNum) {
-            *m_pDest = m_iCur;
-            m_pDest += 1;
-            m_nByteNum = 0;
-            m_iCur     = 0;
-        }
-        else
-            m_iCur <<= 8;
-
-        return *this;
-    }
-
-    mfxU8 operator=(mfxU8 nByte) {
-        m_iCur = (m_iCur & ~0x0ff) | ((mfxU32)nByte);
-
-        return nByte;
-    }
-
-protected:
-    mfxU32* m_pDest; // pointer to destination buffer
-    mfxU32 m_nByteNum; // number of current byte in dword
-    mfxU32 m_iCur; // current dword
-};
-
-class H264SourcePointer_ {
-public:
-    // Default constructor
-    H264SourcePointer_(void) {
-        m_pSource       = NULL;
-        m_nRemovedBytes = 0;
-        m_nZeros        = 0;
-    }
-
-    H264SourcePointer_& operator=(mfxU8* pSource) {
-        m_pSource = (mfxU8*)pSource;
-
-        m_nZeros        = 0;
-        m_nRemovedBytes = 0;
-
-        return *this;
-    }
-
-    H264SourcePointer_& operator++(void) {
-        mfxU8 bCurByte = m_pSource[0];
-
-        if (0 == bCurByte)
-            m_nZeros += 1;
-        else {
-            if ((3 == bCurByte) && (2 <= m_nZeros))
-                m_nRemovedBytes += 1;
-            m_nZeros = 0;
-        }
-
-        m_pSource += 1;
-
-        return *this;
-    }
-
-    bool IsPrevent(void) {
-        if ((3 == m_pSource[0]) && (2 <= m_nZeros))
-            return true;
-        else
-            return false;
-    }
-
-    operator mfxU8(void) {
-        return m_pSource[0];
-    }
-
-    mfxU32 GetRemovedBytes(void) {
-        return m_nRemovedBytes;
-    }
-
-protected:
-    mfxU8* m_pSource; // pointer to destination buffer
-    mfxU32 m_nZeros; // number of preceding zeros
-    mfxU32 m_nRemovedBytes; // number of removed bytes
-};
-
 void SwapMemoryAndRemovePreventingBytes(mfxU8* pDestination,
                                         mfxU32& nDstSize,
                                         mfxU8* pSource,
                                         mfxU32 nSrcSize) {
-    H264DwordPointer_ pDst;
-    H264SourcePointer_ pSrc;
-    size_t i;
-
-    // DwordPointer object is swapping written bytes
-    // H264SourcePointer_ removes preventing start-code bytes
-
-    // reset pointer(s)
-    pSrc = pSource;
-    pDst = pDestination;
-
-    // first two bytes
-    i = 0;
-    while (i < std::min(2u, nSrcSize)) {
-        pDst = (mfxU8)pSrc;
-        ++pDst;
-        ++pSrc;
-        ++i;
-    }
-
-    // do swapping
-    while (i < (mfxU32)nSrcSize) {
-        if (false == pSrc.IsPrevent()) {
-            pDst = (mfxU8)pSrc;
-            ++pDst;
-        }
-        ++pSrc;
-        ++i;
+    const mfxU8* src = pSource;
+    const mfxU8* end = pSource + nSrcSize;
+    mfxU8* dst       = pDestination;
+
+    // copy data between preventing start-code bytes (0x03 after two zeros) by blocks
+    for (;;) {
+        const mfxU8* prevent = FindZeroZeroByte(src, end, 3);
+        if (prevent == end)
+            break;
+
+        dst = std::copy(src, prevent + 2, dst);
+        src = prevent + 3;
     }
+    dst = std::copy(src, end, dst);
 
     // write padding bytes
-    nDstSize = nSrcSize - pSrc.GetRemovedBytes();
-    while (nDstSize & 3) {
-        pDst = (mfxU8)(0);
-        ++nDstSize;
-        ++pDst;
+    nDstSize = (mfxU32)(dst - pDestination);
+    while (nDstSize & 3)
+        pDestination[nDstSize++] = 0;
+
+    // swap bytes of each dword
+    mfxU32 i = 0;
+#ifdef NAL_SPL_SSE2
+    for (; i + 16 <= nDstSize; i += 16) {
+        __m128i* p = (__m128i*)(pDestination + i);
+        __m128i v  = _mm_loadu_si128(p);
+        v          = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        v          = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        v          = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        _mm_storeu_si128(p, v);
+    }
+#endif
+    for (; i < nDstSize; i += 4) {
+        mfxU8* p = pDestination + i;
+        mfxU32 dword = ((mfxU32)p[0] << 24) | ((mfxU32)p[1] << 16) | ((mfxU32)p[2] << 8) | p[3];
+        memcpy(p, &dword, sizeof(dword));
     }
 }
 
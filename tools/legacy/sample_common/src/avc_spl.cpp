@@ -29,6 +29,9 @@ AVC_Spl::AVC_Spl()
           m_currentInfo(nullptr),
           m_pLastSlice(nullptr),
           m_lastNalUnit(nullptr),
+          m_bInPlace(false),
+          m_nScanOffset(0),
+          m_inPlaceNal(),
           m_currentFrame(),
           m_swappingMemory(),
           m_slicesStorage(),
@@ -62,6 +65,9 @@ mfxStatus AVC_Spl::Init() {
     m_frame.Data  = &m_currentFrame[0];
     m_frame.Slice = &m_slices[0];
 
+    m_nScanOffset = 0;
+    m_inPlaceNal  = {};
+
     return MFX_ERR_NONE;
 }
 
@@ -77,9 +83,14 @@ mfxStatus AVC_Spl::Reset() {
     m_lastNalUnit = 0;
     m_pLastSlice  = 0;
     m_currentInfo = 0;
+    m_nScanOffset = 0;
     return MFX_ERR_NONE;
 }
 
+void AVC_Spl::SetInPlace(bool bInPlace) {
+    m_bInPlace = bInPlace;
+}
+
 mfxU8* AVC_Spl::GetMemoryForSwapping(mfxU32 size) {
     if (m_swappingMemory.size() <= size + 8)
         m_swappingMemory.resize(size + 8);
@@ -257,15 +268,37 @@ AVCSlice* AVC_Spl::DecodeSliceHeader(mfxBitstream* nalUnit) {
     m_slicesStorage.push_back(AVCSlice());
     AVCSlice* pSlice = &m_slicesStorage.back();
 
+    // only slice header is parsed, so the rest of slice isn't de-emulated unless header is longer
     mfxU32 swappingSize   = nalUnit->DataLength;
-    mfxU8* swappingMemory = GetMemoryForSwapping(swappingSize);
+    mfxU8* swappingMemory = GetMemoryForSwapping(swappingSize + SLICE_HEADER_PADDING);
+    mfxU32 headerSize     = std::min<mfxU32>(nalUnit->DataLength, SLICE_HEADER_SIZE);
 
     BytesSwapper::SwapMemory(swappingMemory,
                              swappingSize,
                              nalUnit->Data + nalUnit->DataOffset,
-                             nalUnit->DataLength);
+                             headerSize);
+    if (headerSize < nalUnit->DataLength)
+        memset(swappingMemory + swappingSize, 0xff, SLICE_HEADER_PADDING);
+
+    // header which fails to parse or doesn't fit into the prefix is parsed from the whole nal
+    // unit, returns false if it's de-emulated already
+    auto swapWholeNalUnit = [&]() {
+        if (headerSize == nalUnit->DataLength)
+            return false;
+
+        headerSize   = nalUnit->DataLength;
+        swappingSize = nalUnit->DataLength;
+        BytesSwapper::SwapMemory(swappingMemory,
+                                 swappingSize,
+                                 nalUnit->Data + nalUnit->DataOffset,
+                                 headerSize);
+        return true;
+    };
 
     mfxI32 pps_pid = pSlice->RetrievePicParamSetNumber(swappingMemory, swappingSize);
+    if (pps_pid == -1 && swapWholeNalUnit()) {
+        pps_pid = pSlice->RetrievePicParamSetNumber(swappingMemory, swappingSize);
+    }
     if (pps_pid == -1) {
         return 0;
     }
@@ -307,7 +340,13 @@ AVCSlice* AVC_Spl::DecodeSliceHeader(mfxBitstream* nalUnit) {
     pSlice->m_seqParamSetEx = m_headers.m_SeqExParams.GetHeader(seq_parameter_set_id);
     pSlice->m_dTime         = nalUnit->TimeStamp;
 
-    if (!pSlice->DecodeHeader(swappingMemory, swappingSize)) {
+    // bitstream reads dwords, so header is complete if it ends before the last one
+    bool bDecoded = pSlice->DecodeHeader(swappingMemory, swappingSize);
+    if ((!bDecoded || pSlice->GetBitStream()->BytesDecoded() + sizeof(mfxU32) >= swappingSize) &&
+        swapWholeNalUnit()) {
+        bDecoded = pSlice->DecodeHeader(swappingMemory, swappingSize);
+    }
+    if (!bDecoded) {
         return 0;
     }
 
@@ -451,6 +490,10 @@ mfxStatus AVC_Spl::AddSlice(AVCSlice* pSlice) {
 mfxStatus AVC_Spl::AddNalUnit(mfxBitstream* nalUnit) {
     static mfxU8 start_code_prefix[] = { 0, 0, 1 };
 
+    // nal unit is left in source
+    if (m_bInPlace)
+        return MFX_ERR_NONE;
+
     if (m_frame.DataLength + nalUnit->DataLength + sizeof(start_code_prefix) >= BUFFER_SIZE)
         return MFX_ERR_NOT_ENOUGH_BUFFER;
 
@@ -475,19 +518,21 @@ mfxStatus AVC_Spl::AddSliceNalUnit(mfxBitstream* nalUnit, AVCSlice* slice) {
 
     mfxU32 sliceLength = (mfxU32)(nalUnit->DataLength + sizeof(start_code_prefix));
 
-    if (m_frame.DataLength + sliceLength >= BUFFER_SIZE)
-        return MFX_ERR_NOT_ENOUGH_BUFFER;
+    if (!m_bInPlace) {
+        if (m_frame.DataLength + sliceLength >= BUFFER_SIZE)
+            return MFX_ERR_NOT_ENOUGH_BUFFER;
 
-    MSDK_MEMCPY_BUF(m_frame.Data,
-                    m_frame.DataLength,
-                    BUFFER_SIZE,
-                    start_code_prefix,
-                    sizeof(start_code_prefix));
-    MSDK_MEMCPY_BUF(m_frame.Data,
-                    m_frame.DataLength + sizeof(start_code_prefix),
-                    BUFFER_SIZE,
-                    nalUnit->Data + nalUnit->DataOffset,
-                    nalUnit->DataLength);
+        MSDK_MEMCPY_BUF(m_frame.Data,
+                        m_frame.DataLength,
+                        BUFFER_SIZE,
+                        start_code_prefix,
+                        sizeof(start_code_prefix));
+        MSDK_MEMCPY_BUF(m_frame.Data,
+                        m_frame.DataLength + sizeof(start_code_prefix),
+                        BUFFER_SIZE,
+                        nalUnit->Data + nalUnit->DataOffset,
+                        nalUnit->DataLength);
+    }
 
     if (!m_frame.SliceNum) {
         m_frame.TimeStamp = nalUnit->TimeStamp;
@@ -507,8 +552,9 @@ mfxStatus AVC_Spl::AddSliceNalUnit(mfxBitstream* nalUnit, AVCSlice* slice) {
     newSlice.HeaderLength = (mfxU32)bs->BytesDecoded();
 
     // add number of 003 sequence to HeaderLength
-    for (mfxU8* ptr = nalUnit->Data + sizeof(start_code_prefix);
-         ptr < nalUnit->Data + sizeof(start_code_prefix) + newSlice.HeaderLength;
+    mfxU8* nalData = nalUnit->Data + nalUnit->DataOffset;
+    for (mfxU8* ptr = nalData + sizeof(start_code_prefix);
+         ptr < nalData + sizeof(start_code_prefix) + newSlice.HeaderLength;
          ptr++) {
         if (ptr[0] == 0 && ptr[1] == 0 && ptr[2] == 3) {
             newSlice.HeaderLength++;
@@ -517,8 +563,10 @@ mfxStatus AVC_Spl::AddSliceNalUnit(mfxBitstream* nalUnit, AVCSlice* slice) {
 
     newSlice.HeaderLength += sizeof(start_code_prefix) + 1;
 
+    // in-place frame starts at the beginning of source, start code of slice is kept there
     newSlice.DataLength = sliceLength;
-    newSlice.DataOffset = m_frame.DataLength;
+    newSlice.DataOffset = m_bInPlace ? (mfxU32)(nalUnit->DataOffset - sizeof(start_code_prefix))
+                                     : m_frame.DataLength;
     if (IS_I_SLICE(slice->GetSliceHeader()->slice_type))
         newSlice.SliceType = TYPE_I;
     else if (IS_P_SLICE(slice->GetSliceHeader()->slice_type))
@@ -526,7 +574,8 @@ mfxStatus AVC_Spl::AddSliceNalUnit(mfxBitstream* nalUnit, AVCSlice* slice) {
     else if (IS_B_SLICE(slice->GetSliceHeader()->slice_type))
         newSlice.SliceType = TYPE_B;
 
-    m_frame.DataLength += sliceLength;
+    if (!m_bInPlace)
+        m_frame.DataLength += sliceLength;
 
     if (!m_currentInfo->m_index)
         m_frame.FirstFieldSliceNum++;
@@ -601,6 +650,9 @@ mfxStatus AVC_Spl::ProcessNalUnit(mfxI32 nalType, mfxBitstream* nalUnit) {
 mfxStatus AVC_Spl::GetFrame(mfxBitstream* bs_in, FrameSplitterInfo** frame) {
     *frame = 0;
 
+    if (m_bInPlace)
+        return GetFrameInPlace(bs_in, frame);
+
     do {
         if (m_pLastSlice) {
             AVCSlice* pSlice = m_pLastSlice;
@@ -630,6 +682,82 @@ mfxStatus AVC_Spl::GetFrame(mfxBitstream* bs_in, FrameSplitterInfo** frame) {
     return MFX_ERR_MORE_DATA;
 }
 
+mfxStatus AVC_Spl::GetFrameInPlace(mfxBitstream* bs_in, FrameSplitterInfo** frame) {
+    if (!bs_in)
+        return MFX_ERR_MORE_DATA;
+
+    // source could be moved since previous call, frame always starts at the beginning of it
+    mfxU8* data      = bs_in->Data + bs_in->DataOffset;
+    mfxU8* end       = data + bs_in->DataLength;
+    bool endOfStream = (bs_in->DataFlag & MFX_BITSTREAM_EOS) != 0;
+
+    m_frame.Data      = data;
+    m_inPlaceNal.Data = data;
+
+    if (m_pLastSlice) {
+        AVCSlice* pSlice = m_pLastSlice;
+        mfxStatus sts    = AddSlice(pSlice);
+        if (!m_lastNalUnit) {
+            printf("ERROR: m_lastNalUnit=NULL\n");
+            return MFX_ERR_NULL_PTR;
+        }
+        AddSliceNalUnit(m_lastNalUnit, pSlice);
+        m_lastNalUnit = 0;
+        if (sts == MFX_ERR_NONE)
+            return CompleteFrameInPlace(bs_in, m_nScanOffset, frame);
+    }
+
+    for (;;) {
+        mfxU8* code = (mfxU8*)FindZeroZeroByte(data + m_nScanOffset, end, 1);
+        mfxU8* nal  = (end - code > 3) ? code + 3 : end;
+        if (nal == end) {
+            if (endOfStream && m_frame.SliceNum)
+                return CompleteFrameInPlace(bs_in, bs_in->DataLength, frame);
+            return MFX_ERR_MORE_DATA;
+        }
+
+        // nal unit is complete when the next start code or end of stream is found
+        mfxU8* next = (mfxU8*)FindZeroZeroByte(nal, end, 1);
+        if (next == end && !endOfStream) {
+            m_nScanOffset = (mfxU32)(code - data);
+            return MFX_ERR_MORE_DATA;
+        }
+
+        // zero_byte before the next start code doesn't belong to nal unit
+        mfxU8* nalEnd = (next != end && next > nal && !next[-1]) ? next - 1 : next;
+
+        m_inPlaceNal.DataOffset = (mfxU32)(nal - data);
+        m_inPlaceNal.DataLength = (mfxU32)(nalEnd - nal);
+        m_inPlaceNal.TimeStamp  = bs_in->TimeStamp;
+        m_nScanOffset           = (mfxU32)(nalEnd - data);
+
+        mfxStatus sts = ProcessNalUnit(nal[0] & NAL_UNITTYPE_BITS, &m_inPlaceNal);
+        if (sts == MFX_ERR_NONE) {
+            // nal unit begins the next frame
+            if (code > data && !code[-1])
+                code--;
+            return CompleteFrameInPlace(bs_in, (mfxU32)(code - data), frame);
+        }
+    }
+}
+
+mfxStatus AVC_Spl::CompleteFrameInPlace(mfxBitstream* bs_in,
+                                        mfxU32 frameLength,
+                                        FrameSplitterInfo** frame) {
+    m_frame.DataLength = frameLength;
+
+    // frame data stays valid until caller moves or appends source
+    bs_in->DataOffset += frameLength;
+    bs_in->DataLength -= frameLength;
+    m_nScanOffset -= std::min(m_nScanOffset, frameLength);
+    if (m_lastNalUnit)
+        m_inPlaceNal.DataOffset -= frameLength;
+
+    m_currentInfo = 0;
+    *frame        = &m_frame;
+    return MFX_ERR_NONE;
+}
+
 AVCSlice::AVCSlice() {
     Reset();
 }
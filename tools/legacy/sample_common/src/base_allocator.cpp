@@ -67,7 +67,14 @@ mfxStatus MFXFrameAllocator::GetHDL_(mfxHDL pthis, mfxMemId mid, mfxHDL* handle)
     return self.GetFrameHDL(mid, handle);
 }
 
-BaseFrameAllocator::BaseFrameAllocator() : mtx(), m_responses(), m_ExtResponses() {}
+BaseFrameAllocator::BaseFrameAllocator()
+        : mtx(),
+          m_responses(),
+          m_ExtResponses(),
+          m_chains(),
+          m_pool(),
+          m_poolLimit(0),
+          m_poolStats() {}
 
 BaseFrameAllocator::~BaseFrameAllocator() {}
 
@@ -86,7 +93,134 @@ mfxStatus BaseFrameAllocator::ReallocFrame(mfxMemId midIn,
                                            const mfxFrameInfo* info,
                                            mfxU16 memType,
                                            mfxMemId* midOut) {
-    return ReallocImpl(midIn, info, memType, midOut);
+    mfxStatus sts = ReallocImpl(midIn, info, memType, midOut);
+    if (sts != MFX_ERR_NONE)
+        return sts;
+
+    // chain with reallocated frame doesn't match its description anymore, so don't pool it
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto it = m_chains.begin(); it != m_chains.end(); ++it) {
+        mfxMemId* end = it->first + it->second.response.NumFrameActual;
+        if (std::find(it->first, end, *midOut) != end || std::find(it->first, end, midIn) != end) {
+            m_chains.erase(it);
+            break;
+        }
+    }
+    return sts;
+}
+
+// approximate size of frame for the frame pool limit
+static mfxU64 EstimateFrameSize(const mfxFrameInfo& info) {
+    mfxU64 pixels = (mfxU64)info.Width * info.Height;
+    switch (info.FourCC) {
+        case MFX_FOURCC_NV12:
+        case MFX_FOURCC_YV12:
+        case MFX_FOURCC_I420:
+            return pixels * 3 / 2;
+        case MFX_FOURCC_NV16:
+        case MFX_FOURCC_I422:
+        case MFX_FOURCC_YUY2:
+        case MFX_FOURCC_UYVY:
+        case MFX_FOURCC_RGB565:
+        case MFX_FOURCC_R16:
+            return pixels * 2;
+        case MFX_FOURCC_P010:
+        case MFX_FOURCC_P016:
+        case MFX_FOURCC_I010:
+        case MFX_FOURCC_RGB3:
+        case MFX_FOURCC_RGBP:
+            return pixels * 3;
+        case MFX_FOURCC_Y416:
+            return pixels * 8;
+        default:
+            return pixels * 4;
+    }
+}
+
+bool BaseFrameAllocator::TakePooledChain(mfxFrameAllocRequest* request,
+                                         mfxFrameAllocResponse* response) {
+    if (!m_poolLimit)
+        return false;
+
+    for (auto it = m_pool.begin(); it != m_pool.end(); ++it) {
+        if (it->type == request->Type && it->info.FourCC == request->Info.FourCC &&
+            it->info.Width == request->Info.Width && it->info.Height == request->Info.Height &&
+            it->response.NumFrameActual == request->NumFrameSuggested) {
+            *response         = it->response;
+            response->AllocId = request->AllocId;
+            m_poolStats.pooledBytes -= it->bytes;
+            m_poolStats.hits++;
+            m_chains[response->mids] = *it;
+            m_pool.erase(it);
+            return true;
+        }
+    }
+
+    m_poolStats.misses++;
+    return false;
+}
+
+void BaseFrameAllocator::TrackChain(mfxFrameAllocRequest* request,
+                                    mfxFrameAllocResponse* response) {
+    if (!m_poolLimit || !response->mids)
+        return;
+
+    FrameChain chain;
+    chain.response           = *response;
+    chain.info               = request->Info;
+    chain.type               = request->Type;
+    chain.bytes              = EstimateFrameSize(request->Info) * response->NumFrameActual;
+    m_chains[response->mids] = chain;
+}
+
+mfxStatus BaseFrameAllocator::ReleaseOrPoolChain(mfxFrameAllocResponse* response) {
+    auto it = m_chains.find(response->mids);
+    if (it == m_chains.end())
+        return ReleaseResponse(response);
+
+    FrameChain chain = it->second;
+    m_chains.erase(it);
+    if (chain.bytes > m_poolLimit)
+        return ReleaseResponse(response);
+
+    ShrinkFramePool(m_poolLimit - chain.bytes);
+    m_pool.push_back(chain);
+    m_poolStats.pooledBytes += chain.bytes;
+    // chain is released for caller as ReleaseResponse would do
+    response->mids = 0;
+    return MFX_ERR_NONE;
+}
+
+void BaseFrameAllocator::ShrinkFramePool(mfxU64 maxBytes) {
+    while (!m_pool.empty() && m_poolStats.pooledBytes > maxBytes) {
+        ReleaseResponse(&m_pool.front().response);
+        m_poolStats.pooledBytes -= m_pool.front().bytes;
+        m_poolStats.evictions++;
+        m_pool.pop_front();
+    }
+}
+
+void BaseFrameAllocator::ReleaseFramePool() {
+    for (auto& chain : m_pool)
+        ReleaseResponse(&chain.response);
+    m_pool.clear();
+    m_chains.clear();
+    m_poolStats.pooledBytes = 0;
+}
+
+void BaseFrameAllocator::SetFramePoolLimit(mfxU64 maxBytes) {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    m_poolLimit = maxBytes;
+    if (maxBytes)
+        ShrinkFramePool(maxBytes);
+    else
+        ReleaseFramePool();
+}
+
+FramePoolStats BaseFrameAllocator::GetFramePoolStats() {
+    std::lock_guard<std::mutex> lock(mtx);
+    return m_poolStats;
 }
 
 mfxStatus BaseFrameAllocator::AllocFrames(mfxFrameAllocRequest* request,
@@ -124,7 +258,14 @@ mfxStatus BaseFrameAllocator::AllocFrames(mfxFrameAllocRequest* request,
         }
 
         if (!foundInCache) {
-            sts = AllocImpl(request, response);
+            std::unique_lock<std::mutex> lock(mtx);
+            if (!TakePooledChain(request, response)) {
+                lock.unlock();
+                sts = AllocImpl(request, response);
+                lock.lock();
+                if (sts == MFX_ERR_NONE)
+                    TrackChain(request, response);
+            }
             if (sts == MFX_ERR_NONE) {
                 response->AllocId = request->AllocId;
                 m_ExtResponses.push_back(
@@ -141,7 +282,14 @@ mfxStatus BaseFrameAllocator::AllocFrames(mfxFrameAllocRequest* request,
         // reserve space before allocation to avoid memory leak
         m_responses.push_back(mfxFrameAllocResponse());
 
-        sts = AllocImpl(request, response);
+        std::unique_lock<std::mutex> lock(mtx);
+        if (!TakePooledChain(request, response)) {
+            lock.unlock();
+            sts = AllocImpl(request, response);
+            lock.lock();
+            if (sts == MFX_ERR_NONE)
+                TrackChain(request, response);
+        }
         if (sts == MFX_ERR_NONE) {
             m_responses.back() = *response;
         }
@@ -169,7 +317,7 @@ mfxStatus BaseFrameAllocator::FreeFrames(mfxFrameAllocResponse* response) {
 
     if (i != m_ExtResponses.end()) {
         if ((--i->m_refCount) == 0) {
-            sts = ReleaseResponse(response);
+            sts = ReleaseOrPoolChain(response);
             m_ExtResponses.erase(i);
         }
         return sts;
@@ -182,7 +330,7 @@ mfxStatus BaseFrameAllocator::FreeFrames(mfxFrameAllocResponse* response) {
                      std::bind(IsSame(), *response, std::placeholders::_1));
 
     if (i2 != m_responses.end()) {
-        sts = ReleaseResponse(response);
+        sts = ReleaseOrPoolChain(response);
         m_responses.erase(i2);
         return sts;
     }
@@ -194,6 +342,8 @@ mfxStatus BaseFrameAllocator::FreeFrames(mfxFrameAllocResponse* response) {
 mfxStatus BaseFrameAllocator::Close() {
     std::lock_guard<std::mutex> lock(mtx);
 
+    ReleaseFramePool();
+
     std::list<UniqueResponse>::iterator i;
     for (i = m_ExtResponses.begin(); i != m_ExtResponses.end(); i++) {
         ReleaseResponse(&*i);
@@ -0,0 +1,302 @@
+/*############################################################################
+  # Copyright (C) 2005 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include "frame_copy.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define FRAME_COPY_X86
+    #include <immintrin.h>
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+        #define FRAME_COPY_TARGET(isa)
+    #else
+        #define FRAME_COPY_TARGET(isa) __attribute__((target(isa)))
+    #endif
+#endif
+
+static void SplitUV_C(const mfxU8* src,
+                      mfxU32 srcPitch,
+                      mfxU8* dstU,
+                      mfxU32 dstPitchU,
+                      mfxU8* dstV,
+                      mfxU32 dstPitchV,
+                      mfxU32 width,
+                      mfxU32 height) {
+    for (mfxU32 i = 0; i < height; i++) {
+        const mfxU8* s = src + (size_t)i * srcPitch;
+        mfxU8* u       = dstU + (size_t)i * dstPitchU;
+        mfxU8* v       = dstV + (size_t)i * dstPitchV;
+        for (mfxU32 j = 0; j < width; j++) {
+            u[j] = s[2 * j];
+            v[j] = s[2 * j + 1];
+        }
+    }
+}
+
+static void MergeUV_C(const mfxU8* srcU,
+                      mfxU32 srcPitchU,
+                      const mfxU8* srcV,
+                      mfxU32 srcPitchV,
+                      mfxU8* dst,
+                      mfxU32 dstPitch,
+                      mfxU32 width,
+                      mfxU32 height) {
+    for (mfxU32 i = 0; i < height; i++) {
+        const mfxU8* u = srcU + (size_t)i * srcPitchU;
+        const mfxU8* v = srcV + (size_t)i * srcPitchV;
+        mfxU8* d       = dst + (size_t)i * dstPitch;
+        for (mfxU32 j = 0; j < width; j++) {
+            d[2 * j]     = u[j];
+            d[2 * j + 1] = v[j];
+        }
+    }
+}
+
+static void ShiftRight16_C(const mfxU16* src, mfxU16* dst, mfxU32 count, mfxU32 shift) {
+    for (mfxU32 i = 0; i < count; i++) {
+        dst[i] = src[i] >> shift;
+    }
+}
+
+#ifdef FRAME_COPY_X86
+
+FRAME_COPY_TARGET("sse2")
+static void SplitUV_SSE2(const mfxU8* src,
+                         mfxU32 srcPitch,
+                         mfxU8* dstU,
+                         mfxU32 dstPitchU,
+                         mfxU8* dstV,
+                         mfxU32 dstPitchV,
+                         mfxU32 width,
+                         mfxU32 height) {
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+    mfxU32 simdWidth   = width & ~15u;
+
+    for (mfxU32 i = 0; i < height; i++) {
+        const mfxU8* s = src + (size_t)i * srcPitch;
+        mfxU8* u       = dstU + (size_t)i * dstPitchU;
+        mfxU8* v       = dstV + (size_t)i * dstPitchV;
+
+        for (mfxU32 j = 0; j < simdWidth; j += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(s + 2 * j));
+            __m128i b = _mm_loadu_si128((const __m128i*)(s + 2 * j + 16));
+            _mm_storeu_si128((__m128i*)(u + j),
+                             _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+            _mm_storeu_si128((__m128i*)(v + j),
+                             _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+        }
+        for (mfxU32 j = simdWidth; j < width; j++) {
+            u[j] = s[2 * j];
+            v[j] = s[2 * j + 1];
+        }
+    }
+}
+
+FRAME_COPY_TARGET("sse2")
+static void MergeUV_SSE2(const mfxU8* srcU,
+                         mfxU32 srcPitchU,
+                         const mfxU8* srcV,
+                         mfxU32 srcPitchV,
+                         mfxU8* dst,
+                         mfxU32 dstPitch,
+                         mfxU32 width,
+                         mfxU32 height) {
+    mfxU32 simdWidth = width & ~15u;
+
+    for (mfxU32 i = 0; i < height; i++) {
+        const mfxU8* u = srcU + (size_t)i * srcPitchU;
+        const mfxU8* v = srcV + (size_t)i * srcPitchV;
+        mfxU8* d       = dst + (size_t)i * dstPitch;
+
+        for (mfxU32 j = 0; j < simdWidth; j += 16) {
+            __m128i a = _mm_loadu_si128((const __m128i*)(u + j));
+            __m128i b = _mm_loadu_si128((const __m128i*)(v + j));
+            _mm_storeu_si128((__m128i*)(d + 2 * j), _mm_unpacklo_epi8(a, b));
+            _mm_storeu_si128((__m128i*)(d + 2 * j + 16), _mm_unpackhi_epi8(a, b));
+        }
+        for (mfxU32 j = simdWidth; j < width; j++) {
+            d[2 * j]     = u[j];
+            d[2 * j + 1] = v[j];
+        }
+    }
+}
+
+FRAME_COPY_TARGET("avx2")
+static void SplitUV_AVX2(const mfxU8* src,
+                         mfxU32 srcPitch,
+                         mfxU8* dstU,
+                         mfxU32 dstPitchU,
+                         mfxU8* dstV,
+                         mfxU32 dstPitchV,
+                         mfxU32 width,
+                         mfxU32 height) {
+    const __m256i mask = _mm256_set1_epi16(0x00FF);
+    mfxU32 simdWidth   = width & ~31u;
+
+    for (mfxU32 i = 0; i < height; i++) {
+        const mfxU8* s = src + (size_t)i * srcPitch;
+        mfxU8* u       = dstU + (size_t)i * dstPitchU;
+        mfxU8* v       = dstV + (size_t)i * dstPitchV;
+
+        for (mfxU32 j = 0; j < simdWidth; j += 32) {
+            __m256i a = _mm256_loadu_si256((const __m256i*)(s + 2 * j));
+            __m256i b = _mm256_loadu_si256((const __m256i*)(s + 2 * j + 32));
+            // pack works within 128-bit lanes, so quadwords are reordered afterwards
+            __m256i uu =
+                _mm256_packus_epi16(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+            __m256i vv = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+            _mm256_storeu_si256((__m256i*)(u + j), _mm256_permute4x64_epi64(uu, 0xD8));
+            _mm256_storeu_si256((__m256i*)(v + j), _mm256_permute4x64_epi64(vv, 0xD8));
+        }
+        for (mfxU32 j = simdWidth; j < width; j++) {
+            u[j] = s[2 * j];
+            v[j] = s[2 * j + 1];
+        }
+    }
+}
+
+FRAME_COPY_TARGET("avx2")
+static void MergeUV_AVX2(const mfxU8* srcU,
+                         mfxU32 srcPitchU,
+                         const mfxU8* srcV,
+                         mfxU32 srcPitchV,
+                         mfxU8* dst,
+                         mfxU32 dstPitch,
+                         mfxU32 width,
+                         mfxU32 height) {
+    mfxU32 simdWidth = width & ~31u;
+
+    for (mfxU32 i = 0; i < height; i++) {
+        const mfxU8* u = srcU + (size_t)i * srcPitchU;
+        const mfxU8* v = srcV + (size_t)i * srcPitchV;
+        mfxU8* d       = dst + (size_t)i * dstPitch;
+
+        for (mfxU32 j = 0; j < simdWidth; j += 32) {
+            // unpack works within 128-bit lanes, so quadwords are reordered beforehand
+            __m256i a = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i*)(u + j)), 0xD8);
+            __m256i b = _mm256_permute4x64_epi64(_mm256_loadu_si256((const __m256i*)(v + j)), 0xD8);
+            _mm256_storeu_si256((__m256i*)(d + 2 * j), _mm256_unpacklo_epi8(a, b));
+            _mm256_storeu_si256((__m256i*)(d + 2 * j + 32), _mm256_unpackhi_epi8(a, b));
+        }
+        for (mfxU32 j = simdWidth; j < width; j++) {
+            d[2 * j]     = u[j];
+            d[2 * j + 1] = v[j];
+        }
+    }
+}
+
+FRAME_COPY_TARGET("sse2")
+static void ShiftRight16_SSE2(const mfxU16* src, mfxU16* dst, mfxU32 count, mfxU32 shift) {
+    const __m128i shiftReg = _mm_cvtsi32_si128((int)shift);
+    mfxU32 simdCount       = count & ~7u;
+
+    for (mfxU32 i = 0; i < simdCount; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_srl_epi16(a, shiftReg));
+    }
+    for (mfxU32 i = simdCount; i < count; i++) {
+        dst[i] = src[i] >> shift;
+    }
+}
+
+FRAME_COPY_TARGET("avx2")
+static void ShiftRight16_AVX2(const mfxU16* src, mfxU16* dst, mfxU32 count, mfxU32 shift) {
+    const __m128i shiftReg = _mm_cvtsi32_si128((int)shift);
+    mfxU32 simdCount       = count & ~15u;
+
+    for (mfxU32 i = 0; i < simdCount; i += 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_srl_epi16(a, shiftReg));
+    }
+    for (mfxU32 i = simdCount; i < count; i++) {
+        dst[i] = src[i] >> shift;
+    }
+}
+
+static bool IsIsaSupported(FrameCopyIsa isa) {
+    switch (isa) {
+        case FRAME_COPY_C:
+            return true;
+    #if defined(_MSC_VER)
+        case FRAME_COPY_SSE2: {
+            int info[4] = {};
+            __cpuid(info, 1);
+            return (info[3] & (1 << 26)) != 0;
+        }
+        case FRAME_COPY_AVX2: {
+            int info[4] = {};
+            __cpuid(info, 1);
+            // OS has to save AVX state
+            bool osxsave = (info[2] & (1 << 27)) != 0;
+            if (!osxsave || (_xgetbv(0) & 0x6) != 0x6)
+                return false;
+            __cpuidex(info, 7, 0);
+            return (info[1] & (1 << 5)) != 0;
+        }
+    #else
+        case FRAME_COPY_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case FRAME_COPY_AVX2:
+            return __builtin_cpu_supports("avx2");
+    #endif
+        default:
+            return false;
+    }
+}
+
+#else
+
+static bool IsIsaSupported(FrameCopyIsa isa) {
+    return isa == FRAME_COPY_C;
+}
+
+#endif // FRAME_COPY_X86
+
+static const FrameCopyKernels g_FrameCopyKernels[FRAME_COPY_ISA_COUNT] = {
+    { "C", SplitUV_C, MergeUV_C, ShiftRight16_C },
+#ifdef FRAME_COPY_X86
+    { "SSE2", SplitUV_SSE2, MergeUV_SSE2, ShiftRight16_SSE2 },
+    { "AVX2", SplitUV_AVX2, MergeUV_AVX2, ShiftRight16_AVX2 },
+#else
+    { "SSE2", NULL, NULL, NULL },
+    { "AVX2", NULL, NULL, NULL },
+#endif
+};
+
+const FrameCopyKernels* GetFrameCopyKernels(FrameCopyIsa isa) {
+    if (isa < FRAME_COPY_C || isa >= FRAME_COPY_ISA_COUNT || !IsIsaSupported(isa))
+        return NULL;
+    return &g_FrameCopyKernels[isa];
+}
+
+const FrameCopyKernels* GetFrameCopyKernels() {
+    static const FrameCopyKernels* kernels = []() {
+        for (int isa = FRAME_COPY_ISA_COUNT - 1; isa > FRAME_COPY_C; isa--) {
+            const FrameCopyKernels* k = GetFrameCopyKernels((FrameCopyIsa)isa);
+            if (k)
+                return k;
+        }
+        return &g_FrameCopyKernels[FRAME_COPY_C];
+    }();
+    return kernels;
+}
+
+void CopyPlane(const mfxU8* src,
+               mfxU32 srcPitch,
+               mfxU8* dst,
+               mfxU32 dstPitch,
+               mfxU32 width,
+               mfxU32 height) {
+    if (srcPitch == width && dstPitch == width) {
+        memcpy(dst, src, (size_t)width * height);
+        return;
+    }
+
+    for (mfxU32 i = 0; i < height; i++) {
+        memcpy(dst + (size_t)i * dstPitch, src + (size_t)i * srcPitch, width);
+    }
+}
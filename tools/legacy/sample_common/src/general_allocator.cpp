@@ -54,14 +54,27 @@ mfxStatus GeneralAllocator::Init(mfxAllocatorParams* pParams) {
         MSDK_CHECK_STATUS(sts, "m_D3DAllocator.get failed");
     }
 
+    // system memory allocator can be configured when no video memory allocator is requested
     m_SYSAllocator.reset(new SysMemFrameAllocator());
-    sts = m_SYSAllocator->Init(0);
+    sts = m_SYSAllocator->Init(dynamic_cast<SysMemAllocatorParams*>(pParams));
     MSDK_CHECK_STATUS(sts, "m_SYSAllocator.get failed");
 
     return sts;
 }
+mfxStatus GeneralAllocator::GetSysMemStats(SysMemAllocatorStats* stats) {
+    if (!m_SYSAllocator.get())
+        return MFX_ERR_NOT_INITIALIZED;
+
+    return m_SYSAllocator->GetStats(stats);
+}
 mfxStatus GeneralAllocator::Close() {
     mfxStatus sts = MFX_ERR_NONE;
+    {
+        // pooled chains are owned by wrapped allocators
+        std::lock_guard<std::mutex> lock(mtx);
+        ReleaseFramePool();
+    }
+
     if (m_D3DAllocator.get()) {
         sts = m_D3DAllocator.get()->Close();
         MSDK_CHECK_STATUS(sts, "m_D3DAllocator.get failed");
@@ -6,11 +6,13 @@
 
 #include "mfx_samples_config.h"
 
+#include <ctype.h>
 #include <math.h>
 #include <algorithm>
 #include <iostream>
 #include <map>
 
+#include "frame_copy.h"
 #include "sample_defs.h"
 #include "sample_utils.h"
 #include "time_statistics.h"
@@ -96,9 +98,167 @@ mfxStatus GetFrameLength(mfxU16 width, mfxU16 height, mfxU32 ColorFormat, mfxU32
     return MFX_ERR_NONE;
 }
 
+CSmplReadAheadFile::CSmplReadAheadFile(FILE* file, mfxU32 blockSize, mfxU32 prefetchDepth)
+        : m_file(file),
+          m_nBlockSize(blockSize ? blockSize : 1),
+          m_nPrefetchDepth(prefetchDepth),
+          m_current(),
+          m_nPos(0),
+          m_bPreloaded(false),
+          m_ready(),
+          m_free(),
+          m_bEOF(false),
+          m_bStop(false),
+          m_mutex(),
+          m_cv(),
+          m_thread() {
+    m_current.size = 0;
+    StartPrefetch();
+}
+
+CSmplReadAheadFile::~CSmplReadAheadFile() {
+    StopPrefetch();
+}
+
+size_t CSmplReadAheadFile::Read(mfxU8* dst, size_t size) {
+    size_t nRead = 0;
+    while (nRead < size) {
+        if (m_nPos == m_current.size) {
+            if (m_bPreloaded)
+                break;
+
+            // large reads skip the intermediate buffer if nothing is read ahead
+            if (!m_nPrefetchDepth && size - nRead >= m_nBlockSize)
+                return nRead + fread(dst + nRead, 1, size - nRead, m_file);
+
+            if (!NextBlock())
+                break;
+        }
+
+        size_t n = std::min(size - nRead, m_current.size - m_nPos);
+        memcpy(dst + nRead, m_current.data.data() + m_nPos, n);
+        m_nPos += n;
+        nRead += n;
+    }
+    return nRead;
+}
+
+int CSmplReadAheadFile::Seek(long offset) {
+    if (m_bPreloaded) {
+        if (offset < 0 || (size_t)offset > m_current.size)
+            return -1;
+        m_nPos = offset;
+        return 0;
+    }
+
+    StopPrefetch();
+    m_current.size = 0;
+    m_nPos         = 0;
+
+    int res = fseek(m_file, offset, SEEK_SET);
+
+    StartPrefetch();
+    return res;
+}
+
+size_t CSmplReadAheadFile::Preload(size_t size) {
+    // data already read ahead is taken by Read, the rest is dropped with prefetch thread
+    Block block;
+    block.data.resize(size);
+    block.size = Read(block.data.data(), size);
+    StopPrefetch();
+
+    m_current    = std::move(block);
+    m_nPos       = 0;
+    m_bPreloaded = true;
+    return m_current.size;
+}
+
+bool CSmplReadAheadFile::NextBlock() {
+    m_nPos = 0;
+
+    if (!m_nPrefetchDepth) {
+        m_current.data.resize(m_nBlockSize);
+        m_current.size = fread(m_current.data.data(), 1, m_nBlockSize, m_file);
+        return m_current.size != 0;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this]() {
+        return !m_ready.empty() || m_bEOF;
+    });
+    if (m_ready.empty()) {
+        m_current.size = 0;
+        return false;
+    }
+
+    // consumed block is given back to prefetch thread
+    m_free.push_back(std::move(m_current));
+    m_current = std::move(m_ready.front());
+    m_ready.pop_front();
+    m_cv.notify_all();
+
+    return true;
+}
+
+void CSmplReadAheadFile::StartPrefetch() {
+    if (!m_nPrefetchDepth)
+        return;
+
+    m_bStop = false;
+    m_bEOF  = false;
+    m_thread = std::thread(&CSmplReadAheadFile::PrefetchRoutine, this);
+}
+
+void CSmplReadAheadFile::StopPrefetch() {
+    if (!m_thread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStop = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+
+    m_free.splice(m_free.end(), m_ready);
+}
+
+void CSmplReadAheadFile::PrefetchRoutine() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_bStop && !m_bEOF) {
+        if (m_ready.size() >= m_nPrefetchDepth) {
+            m_cv.wait(lock);
+            continue;
+        }
+
+        Block block;
+        if (!m_free.empty()) {
+            block = std::move(m_free.front());
+            m_free.pop_front();
+        }
+
+        lock.unlock();
+        block.data.resize(m_nBlockSize);
+        block.size = fread(block.data.data(), 1, m_nBlockSize, m_file);
+        lock.lock();
+
+        m_bEOF = block.size < m_nBlockSize;
+        if (block.size)
+            m_ready.push_back(std::move(block));
+        else
+            m_free.push_back(std::move(block));
+        m_cv.notify_all();
+    }
+}
+
 CSmplYUVReader::CSmplYUVReader()
         : m_ColorFormat(MFX_FOURCC_YV12),
           m_files(),
+          m_readers(),
+          m_nPrefetchDepth(0),
+          m_nPreloadFrames(0),
+          m_chromaBuf(),
           shouldShift10BitsHigh(false),
           m_bInited(false) {}
 
@@ -135,6 +295,7 @@ mfxStatus CSmplYUVReader::Init(std::list<std::string> inputs,
         MSDK_FOPEN(f, (*it).c_str(), "rb");
         MSDK_CHECK_POINTER(f, MFX_ERR_NULL_PTR);
     }
+    m_readers.resize(m_files.size());
 
     m_ColorFormat = ColorFormat;
 
@@ -148,6 +309,8 @@ CSmplYUVReader::~CSmplYUVReader() {
 }
 
 void CSmplYUVReader::Close() {
+    // prefetch threads have to be stopped before files are closed
+    m_readers.clear();
     for (mfxU32 i = 0; i < m_files.size(); i++) {
         fclose(m_files[i]);
     }
@@ -157,10 +320,28 @@ void CSmplYUVReader::Close() {
 
 void CSmplYUVReader::Reset() {
     for (mfxU32 i = 0; i < m_files.size(); i++) {
-        fseek(m_files[i], 0, SEEK_SET);
+        if (m_readers[i])
+            m_readers[i]->Seek(0);
+        else
+            fseek(m_files[i], 0, SEEK_SET);
     }
 }
 
+void CSmplYUVReader::SetPrefetchDepth(mfxU32 depth) {
+    m_nPrefetchDepth = depth;
+}
+
+void CSmplYUVReader::SetPreloadFrames(mfxU32 nFrames) {
+    m_nPreloadFrames = nFrames;
+}
+
+size_t CSmplYUVReader::ReadData(mfxU32 vid, void* dst, size_t size, size_t count) {
+    if (!m_readers[vid])
+        return fread(dst, size, count, m_files[vid]);
+
+    return m_readers[vid]->Read((mfxU8*)dst, size * count) / size;
+}
+
 mfxStatus CSmplYUVReader::SkipNframesFromBeginning(mfxU16 w,
                                                    mfxU16 h,
                                                    mfxU32 viewId,
@@ -174,7 +355,9 @@ mfxStatus CSmplYUVReader::SkipNframesFromBeginning(mfxU16 w,
         return MFX_ERR_UNSUPPORTED;
     }
 
-    if (0 != fseek(m_files[viewId], frameLength * nframes, SEEK_SET))
+    int res = m_readers[viewId] ? m_readers[viewId]->Seek(frameLength * nframes)
+                                : fseek(m_files[viewId], frameLength * nframes, SEEK_SET);
+    if (0 != res)
         return MFX_ERR_MORE_DATA;
 
     return MFX_ERR_NONE;
@@ -196,7 +379,7 @@ mfxStatus CSmplYUVReader::LoadNextFrame(mfxFrameSurface1* pSurface) {
 
     mfxU32 vid = pInfo.FrameId.ViewId;
 
-    if (vid > m_files.size()) {
+    if (vid >= m_files.size()) {
         return MFX_ERR_UNSUPPORTED;
     }
 
@@ -209,6 +392,16 @@ mfxStatus CSmplYUVReader::LoadNextFrame(mfxFrameSurface1* pSurface) {
         h = pInfo.Height;
     }
 
+    if (!m_readers[vid]) {
+        // whole frame is read at once if its size is known
+        mfxU32 frameLength = 0;
+        if (MFX_ERR_NONE != GetFrameLength(w, h, m_ColorFormat, frameLength))
+            frameLength = CSmplReadAheadFile::DEFAULT_BLOCK_SIZE;
+        m_readers[vid].reset(new CSmplReadAheadFile(m_files[vid], frameLength, m_nPrefetchDepth));
+        if (m_nPreloadFrames)
+            m_readers[vid]->Preload((size_t)frameLength * m_nPreloadFrames);
+    }
+
     mfxU32 nBytesPerPixel = (pInfo.FourCC == MFX_FOURCC_P010 || pInfo.FourCC == MFX_FOURCC_P210 ||
                              pInfo.FourCC == MFX_FOURCC_P016 || pInfo.FourCC == MFX_FOURCC_I010)
                                 ? 2
@@ -230,7 +423,7 @@ mfxStatus CSmplYUVReader::LoadNextFrame(mfxFrameSurface1* pSurface) {
                 ptr   = ptr + pInfo.CropX * 4 + pInfo.CropY * pData.Pitch;
 
                 for (i = 0; i < h; i++) {
-                    nBytesRead = (mfxU32)fread(ptr + i * pitch, 1, 4 * w, m_files[vid]);
+                    nBytesRead = (mfxU32)ReadData(vid, ptr + i * pitch, 1, 4 * w);
 
                     if ((mfxU32)4 * w != nBytesRead) {
                         return MFX_ERR_MORE_DATA;
@@ -245,7 +438,7 @@ mfxStatus CSmplYUVReader::LoadNextFrame(mfxFrameSurface1* pSurface) {
                             : pData.U + pInfo.CropX + pInfo.CropY * pData.Pitch;
 
                 for (i = 0; i < h; i++) {
-                    nBytesRead = (mfxU32)fread(ptr + i * pitch, 2, w, m_files[vid]);
+                    nBytesRead = (mfxU32)ReadData(vid, ptr + i * pitch, 2, w);
 
                     if ((mfxU32)w != nBytesRead) {
                         return MFX_ERR_MORE_DATA;
@@ -262,7 +455,7 @@ mfxStatus CSmplYUVReader::LoadNextFrame(mfxFrameSurface1* pSurface) {
                       pInfo.CropX * 4 + pInfo.CropY * pData.Pitch;
 
                 for (i = 0; i < h; i++) {
-                    nBytesRead = (mfxU32)fread(ptr + i * pitch, 1, 4 * w, m_files[vid]);
+                    nBytesRead = (mfxU32)ReadData(vid, ptr + i * pitch, 1, 4 * w);
 
                     if ((mfxU32)4 * w != nBytesRead) {
                         return MFX_ERR_MORE_DATA;
@@ -291,7 +484,7 @@ mfxStatus CSmplYUVReader::LoadNextFrame(mfxFrameSurface1* pSurface) {
 
         // read luminance plane
         for (i = 0; i < h; i++) {
-            nBytesRead = (mfxU32)fread(ptr + i * pitch, nBytesPerPixel, w, m_files[vid]);
+            nBytesRead = (mfxU32)ReadData(vid, ptr + i * pitch, nBytesPerPixel, w);
 
             if (w != nBytesRead) {
                 return MFX_ERR_MORE_DATA;
@@ -314,50 +507,33 @@ mfxStatus CSmplYUVReader::LoadNextFrame(mfxFrameSurface1* pSurface) {
             case MFX_FOURCC_I420:
             case MFX_FOURCC_YV12:
                 switch (pInfo.FourCC) {
-                    case MFX_FOURCC_NV12:
-                        mfxU32 j, dstOffset[2];
+                    case MFX_FOURCC_NV12: {
                         w /= 2;
                         h /= 2;
                         ptr = pData.UV + pInfo.CropX + (pInfo.CropY / 2) * pitch;
 
-                        if (m_ColorFormat == MFX_FOURCC_I420) {
-                            dstOffset[0] = 0;
-                            dstOffset[1] = 1;
-                        }
-                        else {
-                            dstOffset[0] = 1;
-                            dstOffset[1] = 0;
-                        }
-
-                        // load first chroma plane: U (input == I420) or V (input == YV12)
+                        // both chroma planes are read at once and interleaved:
+                        // U plane goes first in I420 input, V plane goes first in YV12 input
+                        mfxU32 planeSize = (mfxU32)w * h;
                         try {
-                            std::vector<mfxU8> buf(w);
-                            for (i = 0; i < h; i++) {
-                                nBytesRead = (mfxU32)fread(&buf[0], 1, w, m_files[vid]);
-                                if (w != nBytesRead) {
-                                    return MFX_ERR_MORE_DATA;
-                                }
-                                for (j = 0; j < w; j++) {
-                                    ptr[i * pitch + j * 2 + dstOffset[0]] = buf[j];
-                                }
-                            }
-
-                            // load second chroma plane: V (input == I420) or U (input == YV12)
-                            for (i = 0; i < h; i++) {
-                                nBytesRead = (mfxU32)fread(&buf[0], 1, w, m_files[vid]);
-
-                                if (w != nBytesRead) {
-                                    return MFX_ERR_MORE_DATA;
-                                }
-                                for (j = 0; j < w; j++) {
-                                    ptr[i * pitch + j * 2 + dstOffset[1]] = buf[j];
-                                }
-                            }
+                            m_chromaBuf.resize(2 * planeSize);
                         }
                         catch (...) {
                             return MFX_ERR_MEMORY_ALLOC;
                         }
+                        nBytesRead = (mfxU32)ReadData(vid, m_chromaBuf.data(), 1, 2 * planeSize);
+                        if (2 * planeSize != nBytesRead) {
+                            return MFX_ERR_MORE_DATA;
+                        }
+
+                        const mfxU8* pU = m_chromaBuf.data();
+                        const mfxU8* pV = pU + planeSize;
+                        if (m_ColorFormat == MFX_FOURCC_YV12) {
+                            std::swap(pU, pV);
+                        }
+                        GetFrameCopyKernels()->MergeUV(pU, w, pV, w, ptr, pitch, w, h);
                         break;
+                    }
                     case MFX_FOURCC_YV12:
                     case MFX_FOURCC_I420:
                         w /= 2;
@@ -374,14 +550,14 @@ mfxStatus CSmplYUVReader::LoadNextFrame(mfxFrameSurface1* pSurface) {
                         }
 
                         for (i = 0; i < h; i++) {
-                            nBytesRead = (mfxU32)fread(ptr + i * pitch, 1, w, m_files[vid]);
+                            nBytesRead = (mfxU32)ReadData(vid, ptr + i * pitch, 1, w);
 
                             if (w != nBytesRead) {
                                 return MFX_ERR_MORE_DATA;
                             }
                         }
                         for (i = 0; i < h; i++) {
-                            nBytesRead = (mfxU32)fread(ptr2 + i * pitch, 1, w, m_files[vid]);
+                            nBytesRead = (mfxU32)ReadData(vid, ptr2 + i * pitch, 1, w);
 
                             if (w != nBytesRead) {
                                 return MFX_ERR_MORE_DATA;
@@ -401,14 +577,14 @@ mfxStatus CSmplYUVReader::LoadNextFrame(mfxFrameSurface1* pSurface) {
                 ptr2 = pData.V + (pInfo.CropX / 2) + (pInfo.CropY / 2) * pitch;
 
                 for (i = 0; i < h; i++) {
-                    nBytesRead = (mfxU32)fread(ptr + i * pitch, 1, w, m_files[vid]);
+                    nBytesRead = (mfxU32)ReadData(vid, ptr + i * pitch, 1, w);
 
                     if (w != nBytesRead) {
                         return MFX_ERR_MORE_DATA;
                     }
                 }
                 for (i = 0; i < h; i++) {
-                    nBytesRead = (mfxU32)fread(ptr2 + i * pitch, 1, w, m_files[vid]);
+                    nBytesRead = (mfxU32)ReadData(vid, ptr2 + i * pitch, 1, w);
 
                     if (w != nBytesRead) {
                         return MFX_ERR_MORE_DATA;
@@ -424,7 +600,7 @@ mfxStatus CSmplYUVReader::LoadNextFrame(mfxFrameSurface1* pSurface) {
                 }
                 ptr = pData.UV + pInfo.CropX + (pInfo.CropY / 2) * pitch;
                 for (i = 0; i < h; i++) {
-                    nBytesRead = (mfxU32)fread(ptr + i * pitch, nBytesPerPixel, w, m_files[vid]);
+                    nBytesRead = (mfxU32)ReadData(vid, ptr + i * pitch, nBytesPerPixel, w);
 
                     if (w != nBytesRead) {
                         return MFX_ERR_MORE_DATA;
@@ -460,8 +636,15 @@ mfxStatus CSmplYUVReader::LoadNextFrame(mfxFrameSurface1* pSurface,
     MSDK_CHECK_POINTER(pSurface, MFX_ERR_NULL_PTR);
 
     mfxU32 vid = pSurface->Info.FrameId.ViewId;
+    if (vid >= m_files.size()) {
+        return MFX_ERR_UNSUPPORTED;
+    }
 
-    int nBytesRead = static_cast<int>(fread(buf_read, 1, bytes_to_read, m_files[vid]));
+    if (!m_readers[vid]) {
+        m_readers[vid].reset(new CSmplReadAheadFile(m_files[vid], bytes_to_read, m_nPrefetchDepth));
+    }
+
+    int nBytesRead = static_cast<int>(ReadData(vid, buf_read, 1, bytes_to_read));
 
     if (bytes_to_read != nBytesRead) {
         return MFX_ERR_MORE_DATA;
@@ -513,7 +696,8 @@ CSmplBitstreamWriter::CSmplBitstreamWriter()
           m_bSkipWriting(false),
           m_fSource(NULL),
           m_bInited(false),
-          m_sFile() {}
+          m_sFile(),
+          m_nWriteBufferSize(0) {}
 
 CSmplBitstreamWriter::~CSmplBitstreamWriter() {
     Close();
@@ -539,6 +723,11 @@ mfxStatus CSmplBitstreamWriter::Init(const char* strFileName) {
     MSDK_FOPEN(m_fSource, strFileName, "wb+");
     MSDK_CHECK_POINTER(m_fSource, MFX_ERR_NULL_PTR);
 
+    // buffer can be set only before first operation on the file
+    if (m_nWriteBufferSize && setvbuf(m_fSource, NULL, _IOFBF, m_nWriteBufferSize)) {
+        printf("WARNING: failed to set write buffer size of %s\n", strFileName);
+    }
+
     m_sFile = std::string(strFileName);
     //set init state to true in case of success
     m_bInited = true;
@@ -553,6 +742,17 @@ mfxStatus CSmplBitstreamWriter::Reset() {
     return Init(m_sFile.c_str());
 }
 
+mfxStatus CSmplBitstreamWriter::SetWriteBufferSize(mfxU32 size) {
+    m_nWriteBufferSize = size;
+
+    // buffer of opened file can be changed only until something is written to it
+    if (m_fSource && m_nWriteBufferSize && 0 == ftell(m_fSource)) {
+        if (setvbuf(m_fSource, NULL, _IOFBF, m_nWriteBufferSize))
+            return MFX_ERR_UNKNOWN;
+    }
+    return MFX_ERR_NONE;
+}
+
 mfxStatus CSmplBitstreamWriter::WriteNextFrame(mfxBitstream* pMfxBitstream,
                                                bool isPrint,
                                                bool isCompleteFrame) {
@@ -812,6 +1012,350 @@ mfxStatus CSmplBitstreamReader::ReadNextFrame(mfxBitstream* pBS) {
     return MFX_ERR_NONE;
 }
 
+CSmplBitstreamMappedReader::CSmplBitstreamMappedReader()
+        : CSmplBitstreamReader(),
+          m_hMapping(NULL),
+          m_pMappedData(NULL),
+          m_nFileSize(0),
+          m_nPos(0),
+          m_pOwnData(NULL),
+          m_nOwnMaxLength(0),
+          m_bOwnDataFromFile(false) {}
+
+CSmplBitstreamMappedReader::~CSmplBitstreamMappedReader() {
+    Close();
+}
+
+void CSmplBitstreamMappedReader::Close() {
+    if (m_hMapping) {
+        msdk_file_unmap(m_hMapping);
+        m_hMapping = NULL;
+    }
+    m_pMappedData      = NULL;
+    m_nFileSize        = 0;
+    m_nPos             = 0;
+    m_pOwnData         = NULL;
+    m_nOwnMaxLength    = 0;
+    m_bOwnDataFromFile = false;
+
+    CSmplBitstreamReader::Close();
+}
+
+void CSmplBitstreamMappedReader::Reset() {
+    if (!m_hMapping) {
+        CSmplBitstreamReader::Reset();
+        return;
+    }
+
+    m_nPos = 0;
+}
+
+mfxStatus CSmplBitstreamMappedReader::Init(const char* strFileName) {
+    MSDK_CHECK_POINTER(strFileName, MFX_ERR_NULL_PTR);
+    if (!strlen(strFileName))
+        return MFX_ERR_NONE;
+
+    Close();
+
+    m_hMapping = msdk_file_map(strFileName, &m_pMappedData, &m_nFileSize);
+    if (!m_hMapping) {
+        printf("WARNING: failed to map %s to memory, file will be read\n", strFileName);
+        return CSmplBitstreamReader::Init(strFileName);
+    }
+
+    m_bInited = true;
+    return MFX_ERR_NONE;
+}
+
+mfxStatus CSmplBitstreamMappedReader::ReadNextFrame(mfxBitstream* pBS) {
+    if (!m_hMapping)
+        return CSmplBitstreamReader::ReadNextFrame(pBS);
+
+    if (!m_bInited)
+        return MFX_ERR_NOT_INITIALIZED;
+
+    MSDK_CHECK_POINTER(pBS, MFX_ERR_NULL_PTR);
+
+    // Not enough memory to read new chunk of data
+    if (pBS->MaxLength == pBS->DataLength)
+        return MFX_ERR_NOT_ENOUGH_BUFFER;
+
+    bool isWindow = pBS->Data >= m_pMappedData && pBS->Data < m_pMappedData + m_nFileSize;
+    if (!isWindow) {
+        // buffer could be reallocated by the caller since last call
+        if (pBS->Data != m_pOwnData) {
+            m_bOwnDataFromFile = false;
+        }
+        m_pOwnData      = pBS->Data;
+        m_nOwnMaxLength = pBS->MaxLength;
+    }
+
+    // find where unused data of bitstream is located in the file, if it is followed by unread data
+    mfxU64 dataPos        = 0;
+    bool isFollowedByFile = false;
+    if (0 == pBS->DataLength) {
+        dataPos          = m_nPos;
+        isFollowedByFile = true;
+    }
+    else if (isWindow) {
+        dataPos          = (mfxU64)(pBS->Data + pBS->DataOffset - m_pMappedData);
+        isFollowedByFile = dataPos + pBS->DataLength == m_nPos;
+    }
+    else if (m_bOwnDataFromFile && pBS->DataLength <= m_nPos) {
+        dataPos          = m_nPos - pBS->DataLength;
+        isFollowedByFile = true;
+    }
+
+    if (!isFollowedByFile) {
+        return CopyNextChunk(pBS);
+    }
+
+    // window has the same size as own buffer, so unused data always fits into own buffer
+    mfxU64 windowEnd  = std::min(dataPos + m_nOwnMaxLength, m_nFileSize);
+    mfxU32 nBytesRead = (mfxU32)(windowEnd - m_nPos);
+
+    pBS->Data          = m_pMappedData + dataPos;
+    pBS->DataOffset    = 0;
+    pBS->DataLength    = (mfxU32)(windowEnd - dataPos);
+    pBS->MaxLength     = m_nOwnMaxLength;
+    m_nPos             = windowEnd;
+    m_bOwnDataFromFile = false;
+
+    if (m_nPos == m_nFileSize) {
+        pBS->DataFlag |= MFX_BITSTREAM_EOS;
+    }
+
+    if (0 == nBytesRead) {
+        return MFX_ERR_MORE_DATA;
+    }
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus CSmplBitstreamMappedReader::CopyNextChunk(mfxBitstream* pBS) {
+    MSDK_CHECK_POINTER(m_pOwnData, MFX_ERR_NOT_ENOUGH_BUFFER);
+
+    // window never exceeds own buffer, so unused data fits into it
+    memmove(m_pOwnData, pBS->Data + pBS->DataOffset, pBS->DataLength);
+    pBS->Data       = m_pOwnData;
+    pBS->MaxLength  = m_nOwnMaxLength;
+    pBS->DataOffset = 0;
+
+    mfxU32 nBytesRead =
+        (mfxU32)std::min((mfxU64)(pBS->MaxLength - pBS->DataLength), m_nFileSize - m_nPos);
+    memcpy(pBS->Data + pBS->DataLength, m_pMappedData + m_nPos, nBytesRead);
+    m_nPos += nBytesRead;
+    m_bOwnDataFromFile = true;
+
+    if (m_nPos == m_nFileSize) {
+        pBS->DataFlag |= MFX_BITSTREAM_EOS;
+    }
+
+    if (0 == nBytesRead) {
+        return MFX_ERR_MORE_DATA;
+    }
+
+    pBS->DataLength += nBytesRead;
+
+    return MFX_ERR_NONE;
+}
+
+std::mutex CSmplSharedInput::s_RegistryMutex;
+std::map<std::string, std::weak_ptr<CSmplSharedInput>> CSmplSharedInput::s_Registry;
+
+CSmplSharedInput::CSmplSharedInput()
+        : m_mutex(),
+          m_fSource(NULL),
+          m_nFileChunk(0),
+          m_Chunks(),
+          m_RetainedChunks(),
+          m_nRequests(0),
+          m_nReads(0) {}
+
+CSmplSharedInput::~CSmplSharedInput() {
+    if (m_fSource) {
+        fclose(m_fSource);
+        m_fSource = NULL;
+    }
+}
+
+std::shared_ptr<CSmplSharedInput> CSmplSharedInput::Open(const char* strFileName) {
+    if (!strFileName)
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(s_RegistryMutex);
+
+    std::shared_ptr<CSmplSharedInput> pInput = s_Registry[strFileName].lock();
+    if (pInput)
+        return pInput;
+
+    pInput.reset(new CSmplSharedInput());
+    if (MFX_ERR_NONE != pInput->Init(strFileName)) {
+        s_Registry.erase(strFileName);
+        return nullptr;
+    }
+
+    s_Registry[strFileName] = pInput;
+    return pInput;
+}
+
+mfxStatus CSmplSharedInput::Init(const char* strFileName) {
+    MSDK_FOPEN(m_fSource, strFileName, "rb");
+    MSDK_CHECK_POINTER(m_fSource, MFX_ERR_NULL_PTR);
+    return MFX_ERR_NONE;
+}
+
+mfxStatus CSmplSharedInput::GetChunk(mfxU64 nChunk, Chunk& chunk) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_nRequests++;
+
+    if (nChunk < m_Chunks.size()) {
+        chunk = m_Chunks[nChunk].lock();
+        if (chunk)
+            return MFX_ERR_NONE;
+    }
+
+    // chunk was released by all readers, read it again
+    if (nChunk != m_nFileChunk) {
+        // fseek offset is limited to long, so file is skipped by chunks
+        if (nChunk < m_nFileChunk) {
+            rewind(m_fSource);
+            m_nFileChunk = 0;
+        }
+        for (; m_nFileChunk < nChunk; m_nFileChunk++) {
+            if (fseek(m_fSource, CHUNK_SIZE, SEEK_CUR))
+                return MFX_ERR_UNDEFINED_BEHAVIOR;
+        }
+    }
+
+    std::shared_ptr<std::vector<mfxU8>> pData(new std::vector<mfxU8>(CHUNK_SIZE));
+    size_t nBytesRead = fread(pData->data(), 1, pData->size(), m_fSource);
+    pData->resize(nBytesRead);
+    m_nFileChunk++;
+    m_nReads++;
+
+    if (nChunk >= m_Chunks.size())
+        m_Chunks.resize(nChunk + 1);
+    m_Chunks[nChunk] = pData;
+
+    m_RetainedChunks.push_back(pData);
+    if (m_RetainedChunks.size() > RETAINED_CHUNKS)
+        m_RetainedChunks.pop_front();
+
+    chunk = pData;
+    return MFX_ERR_NONE;
+}
+
+mfxU64 CSmplSharedInput::GetNumRequests() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_nRequests;
+}
+
+mfxU64 CSmplSharedInput::GetNumReads() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_nReads;
+}
+
+CSmplBitstreamSharedReader::CSmplBitstreamSharedReader()
+        : CSmplBitstreamReader(),
+          m_pInput(),
+          m_pChunk(),
+          m_nChunk(0),
+          m_nChunkPos(0) {}
+
+CSmplBitstreamSharedReader::~CSmplBitstreamSharedReader() {
+    Close();
+}
+
+void CSmplBitstreamSharedReader::Close() {
+    m_pChunk.reset();
+    m_pInput.reset();
+    m_nChunk    = 0;
+    m_nChunkPos = 0;
+
+    CSmplBitstreamReader::Close();
+}
+
+void CSmplBitstreamSharedReader::Reset() {
+    if (!m_bInited)
+        return;
+
+    m_pChunk.reset();
+    m_nChunk    = 0;
+    m_nChunkPos = 0;
+}
+
+mfxStatus CSmplBitstreamSharedReader::Init(const char* strFileName) {
+    MSDK_CHECK_POINTER(strFileName, MFX_ERR_NULL_PTR);
+    if (!strlen(strFileName))
+        return MFX_ERR_NONE;
+
+    Close();
+
+    m_pInput = CSmplSharedInput::Open(strFileName);
+    MSDK_CHECK_POINTER(m_pInput, MFX_ERR_NULL_PTR);
+
+    m_bInited = true;
+    return MFX_ERR_NONE;
+}
+
+mfxStatus CSmplBitstreamSharedReader::ReadNextFrame(mfxBitstream* pBS) {
+    if (!m_bInited)
+        return MFX_ERR_NOT_INITIALIZED;
+
+    MSDK_CHECK_POINTER(pBS, MFX_ERR_NULL_PTR);
+
+    // Not enough memory to read new chunk of data
+    if (pBS->MaxLength == pBS->DataLength)
+        return MFX_ERR_NOT_ENOUGH_BUFFER;
+
+    memmove(pBS->Data, pBS->Data + pBS->DataOffset, pBS->DataLength);
+    pBS->DataOffset = 0;
+
+    mfxU32 nBytesRead = 0;
+    bool bEOS         = false;
+    while (pBS->DataLength + nBytesRead < pBS->MaxLength) {
+        if (!m_pChunk) {
+            mfxStatus sts = m_pInput->GetChunk(m_nChunk, m_pChunk);
+            MSDK_CHECK_STATUS(sts, "m_pInput->GetChunk failed");
+        }
+
+        size_t nCopy = std::min((size_t)(pBS->MaxLength - pBS->DataLength - nBytesRead),
+                                m_pChunk->size() - m_nChunkPos);
+        if (nCopy) {
+            memcpy(pBS->Data + pBS->DataLength + nBytesRead, m_pChunk->data() + m_nChunkPos, nCopy);
+            m_nChunkPos += nCopy;
+            nBytesRead += (mfxU32)nCopy;
+        }
+
+        if (m_nChunkPos < m_pChunk->size())
+            break;
+
+        // short chunk is the last one in the file
+        if (m_pChunk->size() < CSmplSharedInput::CHUNK_SIZE) {
+            bEOS = true;
+            break;
+        }
+
+        m_pChunk.reset();
+        m_nChunk++;
+        m_nChunkPos = 0;
+    }
+
+    if (bEOS) {
+        pBS->DataFlag |= MFX_BITSTREAM_EOS;
+    }
+
+    if (0 == nBytesRead) {
+        return MFX_ERR_MORE_DATA;
+    }
+
+    pBS->DataLength += nBytesRead;
+
+    return MFX_ERR_NONE;
+}
+
 mfxU32 CJPEGFrameReader::FindMarker(mfxBitstream* pBS,
                                     mfxU32 startOffset,
                                     CJPEGFrameReader::JPEGMarker marker) {
@@ -1018,6 +1562,39 @@ void CIVFFrameWriter::Close() {
     CSmplBitstreamWriter::Close();
 }
 
+CSmplAlignedBuffer::~CSmplAlignedBuffer() {
+    msdk_aligned_free(m_pData);
+}
+
+bool CSmplAlignedBuffer::Append(const void* src, size_t size) {
+    if (size > m_nCapacity - m_nSize) {
+        // capacity is doubled, so frames of the same size are packed without reallocation
+        size_t capacity = std::max(m_nSize + size, 2 * m_nCapacity);
+        capacity        = (capacity + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+
+        mfxU8* pData = (mfxU8*)msdk_aligned_malloc(capacity, ALIGNMENT);
+        if (!pData)
+            return false;
+        if (m_nSize)
+            memcpy(pData, m_pData, m_nSize);
+        msdk_aligned_free(m_pData);
+
+        m_pData     = pData;
+        m_nCapacity = capacity;
+    }
+
+    if (size)
+        memcpy(m_pData + m_nSize, src, size);
+    m_nSize += size;
+    return true;
+}
+
+void CSmplAlignedBuffer::Swap(CSmplAlignedBuffer& other) {
+    std::swap(m_pData, other.m_pData);
+    std::swap(m_nSize, other.m_nSize);
+    std::swap(m_nCapacity, other.m_nCapacity);
+}
+
 CSmplYUVWriter::CSmplYUVWriter()
         : m_fDest(NULL),
           m_fDestMVC(NULL),
@@ -1025,7 +1602,20 @@ CSmplYUVWriter::CSmplYUVWriter()
           m_bIsMultiView(false),
           m_numCreatedFiles(0),
           m_sFile(),
-          m_nViews(0){};
+          m_nViews(0),
+          m_bBatching(false),
+          m_bAsync(false),
+          m_frameBuf(),
+          m_shiftBuf(),
+          m_chromaBuf(),
+          m_pendingBuf(),
+          m_pendingFile(NULL),
+          m_bPending(false),
+          m_bStopWriter(false),
+          m_writeStatus(MFX_ERR_NONE),
+          m_writeMutex(),
+          m_writeCV(),
+          m_writerThread(){};
 
 mfxStatus CSmplYUVWriter::Init(const char* strFileName, const mfxU32 numViews) {
     MSDK_CHECK_POINTER(strFileName, MFX_ERR_NULL_PTR);
@@ -1056,6 +1646,10 @@ mfxStatus CSmplYUVWriter::Init(const char* strFileName, const mfxU32 numViews) {
         }
     }
 
+    if (m_bAsync) {
+        m_writerThread = std::thread(&CSmplYUVWriter::WriterRoutine, this);
+    }
+
     m_bInited = true;
 
     return MFX_ERR_NONE;
@@ -1073,6 +1667,9 @@ CSmplYUVWriter::~CSmplYUVWriter() {
 }
 
 void CSmplYUVWriter::Close() {
+    // frame passed to writer thread is written before files are closed
+    StopWriterThread();
+
     if (m_fDest) {
         fclose(m_fDest);
         m_fDest = NULL;
@@ -1158,7 +1755,116 @@ mfxStatus GetChromaSize(const mfxFrameInfo& pInfo, mfxU32& ChromaW, mfxU32& Chro
 // Size of temp buffer for shifting operation
 #define SHIFT_OP_BUFF_SIZE 8192 * 4
 
+void CSmplYUVWriter::SetFrameBatching(bool bEnable, bool bAsync) {
+    m_bBatching = bEnable;
+    m_bAsync    = bEnable && bAsync;
+}
+
 mfxStatus CSmplYUVWriter::WriteNextFrame(mfxFrameSurface1* pSurface) {
+    return WriteFrame(pSurface, false);
+}
+
+mfxStatus CSmplYUVWriter::WriteNextFrameI420(mfxFrameSurface1* pSurface) {
+    return WriteFrame(pSurface, true);
+}
+
+mfxStatus CSmplYUVWriter::WriteFrame(mfxFrameSurface1* pSurface, bool bI420) {
+    if (!m_bBatching)
+        return bI420 ? PackNextFrameI420(pSurface) : PackNextFrame(pSurface);
+
+    m_frameBuf.Clear();
+
+    mfxStatus sts = bI420 ? PackNextFrameI420(pSurface) : PackNextFrame(pSurface);
+    if (MFX_ERR_NONE != sts)
+        return sts;
+
+    // file pointers were checked while packing
+    FILE* dstFile = m_bIsMultiView ? m_fDestMVC[pSurface->Info.FrameId.ViewId] : m_fDest;
+    return CommitFrame(dstFile);
+}
+
+size_t CSmplYUVWriter::WriteData(const void* src, size_t size, size_t count, FILE* dst) {
+    if (!m_bBatching)
+        return fwrite(src, size, count, dst);
+
+    return m_frameBuf.Append(src, size * count) ? count : 0;
+}
+
+mfxStatus CSmplYUVWriter::CommitFrame(FILE* dst) {
+    if (!m_bAsync) {
+        MSDK_CHECK_NOT_EQUAL(fwrite(m_frameBuf.GetData(), 1, m_frameBuf.GetSize(), dst),
+                             m_frameBuf.GetSize(),
+                             MFX_ERR_UNDEFINED_BEHAVIOR);
+        return MFX_ERR_NONE;
+    }
+
+    // buffer of previous frame is reused after the frame is written
+    mfxStatus sts = WaitPendingFrame();
+    MSDK_CHECK_STATUS(sts, "writing of previous frame failed");
+
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        m_frameBuf.Swap(m_pendingBuf);
+        m_pendingFile = dst;
+        m_bPending    = true;
+    }
+    m_writeCV.notify_all();
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus CSmplYUVWriter::WaitPendingFrame() {
+    std::unique_lock<std::mutex> lock(m_writeMutex);
+    m_writeCV.wait(lock, [this]() {
+        return !m_bPending;
+    });
+
+    mfxStatus sts = m_writeStatus;
+    m_writeStatus = MFX_ERR_NONE;
+    return sts;
+}
+
+void CSmplYUVWriter::StopWriterThread() {
+    if (!m_writerThread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        m_bStopWriter = true;
+    }
+    m_writeCV.notify_all();
+    m_writerThread.join();
+
+    if (MFX_ERR_NONE != m_writeStatus)
+        printf("ERROR: failed to write frame to %s\n", m_sFile.c_str());
+
+    m_bStopWriter = false;
+    m_writeStatus = MFX_ERR_NONE;
+}
+
+void CSmplYUVWriter::WriterRoutine() {
+    std::unique_lock<std::mutex> lock(m_writeMutex);
+    for (;;) {
+        m_writeCV.wait(lock, [this]() {
+            return m_bPending || m_bStopWriter;
+        });
+        // pending frame is written before stop
+        if (!m_bPending)
+            break;
+
+        lock.unlock();
+        size_t nWritten =
+            fwrite(m_pendingBuf.GetData(), 1, m_pendingBuf.GetSize(), m_pendingFile);
+        lock.lock();
+
+        if (nWritten != m_pendingBuf.GetSize())
+            m_writeStatus = MFX_ERR_UNDEFINED_BEHAVIOR;
+        m_bPending = false;
+        m_writeCV.notify_all();
+    }
+}
+
+mfxStatus CSmplYUVWriter::PackNextFrame(mfxFrameSurface1* pSurface) {
     MSDK_CHECK_ERROR(m_bInited, false, MFX_ERR_NOT_INITIALIZED);
     MSDK_CHECK_POINTER(pSurface, MFX_ERR_NULL_PTR);
 
@@ -1171,7 +1877,10 @@ mfxStatus CSmplYUVWriter::WriteNextFrame(mfxFrameSurface1* pSurface) {
     mfxU32 shiftSizeLuma   = 16 - pInfo.BitDepthLuma;
     mfxU32 shiftSizeChroma = 16 - pInfo.BitDepthChroma;
     // Temporary buffer to convert MS to no-MS format
-    std::vector<mfxU16> tmp(SHIFT_OP_BUFF_SIZE);
+    if (m_shiftBuf.size() < SHIFT_OP_BUFF_SIZE)
+        m_shiftBuf.resize(SHIFT_OP_BUFF_SIZE);
+    std::vector<mfxU16>& tmp = m_shiftBuf;
+    const FrameCopyKernels* kernels = GetFrameCopyKernels();
 
     if (!m_bIsMultiView) {
         MSDK_CHECK_POINTER(m_fDest, MFX_ERR_NULL_PTR);
@@ -1195,10 +1904,10 @@ mfxStatus CSmplYUVWriter::WriteNextFrame(mfxFrameSurface1* pSurface) {
         case MFX_FOURCC_NV16:
             for (i = 0; i < pInfo.CropH; i++) {
                 MSDK_CHECK_NOT_EQUAL(
-                    fwrite(pData.Y + (pInfo.CropY * pData.Pitch + pInfo.CropX) + i * pData.Pitch,
-                           1,
-                           pInfo.CropW,
-                           dstFile),
+                    WriteData(pData.Y + (pInfo.CropY * pData.Pitch + pInfo.CropX) + i * pData.Pitch,
+                              1,
+                              pInfo.CropW,
+                              dstFile),
                     pInfo.CropW,
                     MFX_ERR_UNDEFINED_BEHAVIOR);
             }
@@ -1211,17 +1920,18 @@ mfxStatus CSmplYUVWriter::WriteNextFrame(mfxFrameSurface1* pSurface) {
                                  i * pData.Pitch;
                 if (pInfo.Shift) {
                     // Bits will be shifted to the lower position
-                    for (int idx = 0; idx < pInfo.CropW * 2; idx++) {
-                        tmp[idx] = ((mfxU16*)pBuffer)[idx] >> shiftSizeLuma;
-                    }
+                    kernels->ShiftRight16((mfxU16*)pBuffer,
+                                          tmp.data(),
+                                          pInfo.CropW * 2,
+                                          shiftSizeLuma);
 
                     MSDK_CHECK_NOT_EQUAL(
-                        fwrite(((const mfxU8*)tmp.data()), 4, pInfo.CropW, dstFile),
+                        WriteData(((const mfxU8*)tmp.data()), 4, pInfo.CropW, dstFile),
                         pInfo.CropW,
                         MFX_ERR_UNDEFINED_BEHAVIOR);
                 }
                 else {
-                    MSDK_CHECK_NOT_EQUAL(fwrite(pBuffer, 4, pInfo.CropW, dstFile),
+                    MSDK_CHECK_NOT_EQUAL(WriteData(pBuffer, 4, pInfo.CropW, dstFile),
                                          pInfo.CropW,
                                          MFX_ERR_UNDEFINED_BEHAVIOR);
                 }
@@ -1233,7 +1943,7 @@ mfxStatus CSmplYUVWriter::WriteNextFrame(mfxFrameSurface1* pSurface) {
             mfxU8* pBuffer = (mfxU8*)pData.Y410;
             for (i = 0; i < pInfo.CropH; i++) {
                 MSDK_CHECK_NOT_EQUAL(
-                    fwrite(
+                    WriteData(
                         pBuffer + (pInfo.CropY * pData.Pitch + pInfo.CropX * 4) + i * pData.Pitch,
                         4,
                         pInfo.CropW,
@@ -1248,7 +1958,7 @@ mfxStatus CSmplYUVWriter::WriteNextFrame(mfxFrameSurface1* pSurface) {
             for (i = 0; i < pInfo.CropH; i++) {
                 mfxU8* pBuffer = ((mfxU8*)pData.U) + (pInfo.CropY * pData.Pitch + pInfo.CropX * 8) +
                                  i * pData.Pitch;
-                MSDK_CHECK_NOT_EQUAL(fwrite(pBuffer, 8, pInfo.CropW, dstFile),
+                MSDK_CHECK_NOT_EQUAL(WriteData(pBuffer, 8, pInfo.CropW, dstFile),
                                      pInfo.CropW,
                                      MFX_ERR_UNDEFINED_BEHAVIOR);
             }
@@ -1259,7 +1969,7 @@ mfxStatus CSmplYUVWriter::WriteNextFrame(mfxFrameSurface1* pSurface) {
             for (i = 0; i < pInfo.CropH; i++) {
                 mfxU16* shortPtr = (mfxU16*)(pData.Y + (pInfo.CropY * pData.Pitch + pInfo.CropX) +
                                              i * pData.Pitch);
-                MSDK_CHECK_NOT_EQUAL(fwrite(shortPtr, 1, (mfxU32)pInfo.CropW * 2, dstFile),
+                MSDK_CHECK_NOT_EQUAL(WriteData(shortPtr, 1, (mfxU32)pInfo.CropW * 2, dstFile),
                                      (mfxU32)pInfo.CropW * 2,
                                      MFX_ERR_UNDEFINED_BEHAVIOR);
             }
@@ -1273,16 +1983,14 @@ mfxStatus CSmplYUVWriter::WriteNextFrame(mfxFrameSurface1* pSurface) {
                 if (pInfo.Shift) {
                     // Convert MS-P*1* to P*1* and write
                     // Bits will be shifted to the lower position
-                    for (int idx = 0; idx < pInfo.CropW; idx++) {
-                        tmp[idx] = shortPtr[idx] >> shiftSizeLuma;
-                    }
+                    kernels->ShiftRight16(shortPtr, tmp.data(), pInfo.CropW, shiftSizeLuma);
 
-                    MSDK_CHECK_NOT_EQUAL(fwrite(&tmp[0], 1, (mfxU32)pInfo.CropW * 2, dstFile),
+                    MSDK_CHECK_NOT_EQUAL(WriteData(&tmp[0], 1, (mfxU32)pInfo.CropW * 2, dstFile),
                                          (mfxU32)pInfo.CropW * 2,
                                          MFX_ERR_UNDEFINED_BEHAVIOR);
                 }
                 else {
-                    MSDK_CHECK_NOT_EQUAL(fwrite(shortPtr, 1, (mfxU32)pInfo.CropW * 2, dstFile),
+                    MSDK_CHECK_NOT_EQUAL(WriteData(shortPtr, 1, (mfxU32)pInfo.CropW * 2, dstFile),
                                          (mfxU32)pInfo.CropW * 2,
                                          MFX_ERR_UNDEFINED_BEHAVIOR);
                 }
@@ -1305,21 +2013,21 @@ mfxStatus CSmplYUVWriter::WriteNextFrame(mfxFrameSurface1* pSurface) {
         case MFX_FOURCC_YV12: {
             for (i = 0; i < ChromaH; i++) {
                 MSDK_CHECK_NOT_EQUAL(
-                    fwrite(pData.V + (pInfo.CropY * pData.Pitch / 2 + pInfo.CropX / 2) +
-                               i * pData.Pitch,
-                           1,
-                           ChromaW,
-                           dstFile),
+                    WriteData(pData.V + (pInfo.CropY * pData.Pitch / 2 + pInfo.CropX / 2) +
+                                  i * pData.Pitch,
+                              1,
+                              ChromaW,
+                              dstFile),
                     ChromaW,
                     MFX_ERR_UNDEFINED_BEHAVIOR);
             }
             for (i = 0; i < ChromaH; i++) {
                 MSDK_CHECK_NOT_EQUAL(
-                    fwrite(pData.U + (pInfo.CropY * pData.Pitch / 2 + pInfo.CropX / 2) +
-                               i * pData.Pitch / 2,
-                           1,
-                           ChromaW,
-                           dstFile),
+                    WriteData(pData.U + (pInfo.CropY * pData.Pitch / 2 + pInfo.CropX / 2) +
+                                  i * pData.Pitch / 2,
+                              1,
+                              ChromaW,
+                              dstFile),
                     ChromaW,
                     MFX_ERR_UNDEFINED_BEHAVIOR);
             }
@@ -1329,21 +2037,21 @@ mfxStatus CSmplYUVWriter::WriteNextFrame(mfxFrameSurface1* pSurface) {
         case MFX_FOURCC_I422: {
             for (i = 0; i < ChromaH; i++) {
                 MSDK_CHECK_NOT_EQUAL(
-                    fwrite(pData.U + (pInfo.CropY * pData.Pitch / 2 + pInfo.CropX / 2) +
-                               i * pData.Pitch / 2,
-                           1,
-                           ChromaW,
-                           dstFile),
+                    WriteData(pData.U + (pInfo.CropY * pData.Pitch / 2 + pInfo.CropX / 2) +
+                                  i * pData.Pitch / 2,
+                              1,
+                              ChromaW,
+                              dstFile),
                     ChromaW,
                     MFX_ERR_UNDEFINED_BEHAVIOR);
             }
             for (i = 0; i < ChromaH; i++) {
                 MSDK_CHECK_NOT_EQUAL(
-                    fwrite(pData.V + (pInfo.CropY * pData.Pitch / 2 + pInfo.CropX / 2) +
-                               i * pData.Pitch / 2,
-                           1,
-                           ChromaW,
-                           dstFile),
+                    WriteData(pData.V + (pInfo.CropY * pData.Pitch / 2 + pInfo.CropX / 2) +
+                                  i * pData.Pitch / 2,
+                              1,
+                              ChromaW,
+                              dstFile),
                     ChromaW,
                     MFX_ERR_UNDEFINED_BEHAVIOR);
             }
@@ -1352,10 +2060,11 @@ mfxStatus CSmplYUVWriter::WriteNextFrame(mfxFrameSurface1* pSurface) {
         case MFX_FOURCC_NV12: {
             for (i = 0; i < ChromaH; i++) {
                 MSDK_CHECK_NOT_EQUAL(
-                    fwrite(pData.UV + (pInfo.CropY * pData.Pitch + pInfo.CropX) + i * pData.Pitch,
-                           1,
-                           ChromaW,
-                           dstFile),
+                    WriteData(
+                        pData.UV + (pInfo.CropY * pData.Pitch + pInfo.CropX) + i * pData.Pitch,
+                        1,
+                        ChromaW,
+                        dstFile),
                     ChromaW,
                     MFX_ERR_UNDEFINED_BEHAVIOR);
             }
@@ -1364,7 +2073,7 @@ mfxStatus CSmplYUVWriter::WriteNextFrame(mfxFrameSurface1* pSurface) {
         case MFX_FOURCC_NV16: {
             for (i = 0; i < ChromaH; i++) {
                 MSDK_CHECK_NOT_EQUAL(
-                    fwrite(
+                    WriteData(
                         pData.UV + (pInfo.CropY * pData.Pitch / 2 + pInfo.CropX) + i * pData.Pitch,
                         1,
                         ChromaW,
@@ -1380,17 +2089,19 @@ mfxStatus CSmplYUVWriter::WriteNextFrame(mfxFrameSurface1* pSurface) {
             mfxU32 basePtr = (pInfo.CropY * chPitch + pInfo.CropX / 2);
 
             for (i = 0; i < ChromaH; i++) {
-                MSDK_CHECK_NOT_EQUAL(fwrite(pData.U + basePtr + i * chPitch, 1, ChromaW, dstFile),
-                                     ChromaW,
-                                     MFX_ERR_UNDEFINED_BEHAVIOR);
+                MSDK_CHECK_NOT_EQUAL(
+                    WriteData(pData.U + basePtr + i * chPitch, 1, ChromaW, dstFile),
+                    ChromaW,
+                    MFX_ERR_UNDEFINED_BEHAVIOR);
             }
 
             basePtr = (pInfo.CropY * chPitch + pInfo.CropX / 2);
 
             for (i = 0; i < ChromaH; i++) {
-                MSDK_CHECK_NOT_EQUAL(fwrite(pData.V + basePtr + i * chPitch, 1, ChromaW, dstFile),
-                                     ChromaW,
-                                     MFX_ERR_UNDEFINED_BEHAVIOR);
+                MSDK_CHECK_NOT_EQUAL(
+                    WriteData(pData.V + basePtr + i * chPitch, 1, ChromaW, dstFile),
+                    ChromaW,
+                    MFX_ERR_UNDEFINED_BEHAVIOR);
             }
             break;
         }
@@ -1404,16 +2115,14 @@ mfxStatus CSmplYUVWriter::WriteNextFrame(mfxFrameSurface1* pSurface) {
                 if (pInfo.Shift) {
                     // Convert MS-P*1* to P*1* and write
                     // Bits will be shifted to the lower position
-                    for (mfxU32 idx = 0; idx < ChromaW; idx++) {
-                        tmp[idx] = shortPtr[idx] >> shiftSizeChroma;
-                    }
+                    kernels->ShiftRight16(shortPtr, tmp.data(), ChromaW, shiftSizeChroma);
 
-                    MSDK_CHECK_NOT_EQUAL(fwrite(&tmp[0], 1, ChromaW * 2, dstFile),
+                    MSDK_CHECK_NOT_EQUAL(WriteData(&tmp[0], 1, ChromaW * 2, dstFile),
                                          (mfxU32)ChromaW * 2,
                                          MFX_ERR_UNDEFINED_BEHAVIOR);
                 }
                 else {
-                    MSDK_CHECK_NOT_EQUAL(fwrite(shortPtr, 1, ChromaW * 2, dstFile),
+                    MSDK_CHECK_NOT_EQUAL(WriteData(shortPtr, 1, ChromaW * 2, dstFile),
                                          ChromaW * 2,
                                          MFX_ERR_UNDEFINED_BEHAVIOR);
                 }
@@ -1431,7 +2140,7 @@ mfxStatus CSmplYUVWriter::WriteNextFrame(mfxFrameSurface1* pSurface) {
             ptr = ptr + pInfo.CropX + pInfo.CropY * pData.Pitch;
 
             for (i = 0; i < ChromaH; i++) {
-                MSDK_CHECK_NOT_EQUAL(fwrite(ptr + i * pData.Pitch, 1, 4 * ChromaW, dstFile),
+                MSDK_CHECK_NOT_EQUAL(WriteData(ptr + i * pData.Pitch, 1, 4 * ChromaW, dstFile),
                                      4 * ChromaW,
                                      MFX_ERR_UNDEFINED_BEHAVIOR);
             }
@@ -1446,14 +2155,14 @@ mfxStatus CSmplYUVWriter::WriteNextFrame(mfxFrameSurface1* pSurface) {
     return MFX_ERR_NONE;
 }
 
-mfxStatus CSmplYUVWriter::WriteNextFrameI420(mfxFrameSurface1* pSurface) {
+mfxStatus CSmplYUVWriter::PackNextFrameI420(mfxFrameSurface1* pSurface) {
     MSDK_CHECK_ERROR(m_bInited, false, MFX_ERR_NOT_INITIALIZED);
     MSDK_CHECK_POINTER(pSurface, MFX_ERR_NULL_PTR);
 
     mfxFrameInfo& pInfo = pSurface->Info;
     mfxFrameData& pData = pSurface->Data;
 
-    mfxU32 i, j;
+    mfxU32 i;
     mfxU32 vid = pInfo.FrameId.ViewId;
 
     if (!m_bIsMultiView) {
@@ -1475,7 +2184,7 @@ mfxStatus CSmplYUVWriter::WriteNextFrameI420(mfxFrameSurface1* pSurface) {
             for (i = 0; i < pInfo.CropH; i++) {
                 if (!m_bIsMultiView) {
                     MSDK_CHECK_NOT_EQUAL(
-                        fwrite(
+                        WriteData(
                             pData.Y + (pInfo.CropY * pData.Pitch + pInfo.CropX) + i * pData.Pitch,
                             1,
                             pInfo.CropW,
@@ -1485,7 +2194,7 @@ mfxStatus CSmplYUVWriter::WriteNextFrameI420(mfxFrameSurface1* pSurface) {
                 }
                 else {
                     MSDK_CHECK_NOT_EQUAL(
-                        fwrite(
+                        WriteData(
                             pData.Y + (pInfo.CropY * pData.Pitch + pInfo.CropX) + i * pData.Pitch,
                             1,
                             pInfo.CropW,
@@ -1508,21 +2217,21 @@ mfxStatus CSmplYUVWriter::WriteNextFrameI420(mfxFrameSurface1* pSurface) {
             for (i = 0; i < ChromaH; i++) {
                 if (!m_bIsMultiView) {
                     MSDK_CHECK_NOT_EQUAL(
-                        fwrite(pData.U + (pInfo.CropY * pData.Pitch / 2 + pInfo.CropX / 2) +
-                                   i * pData.Pitch / 2,
-                               1,
-                               ChromaW,
-                               m_fDest),
+                        WriteData(pData.U + (pInfo.CropY * pData.Pitch / 2 + pInfo.CropX / 2) +
+                                      i * pData.Pitch / 2,
+                                  1,
+                                  ChromaW,
+                                  m_fDest),
                         (mfxU32)pInfo.CropW / 2,
                         MFX_ERR_UNDEFINED_BEHAVIOR);
                 }
                 else {
                     MSDK_CHECK_NOT_EQUAL(
-                        fwrite(pData.U + (pInfo.CropY * pData.Pitch / 2 + pInfo.CropX / 2) +
-                                   i * pData.Pitch / 2,
-                               1,
-                               ChromaW,
-                               m_fDestMVC[vid]),
+                        WriteData(pData.U + (pInfo.CropY * pData.Pitch / 2 + pInfo.CropX / 2) +
+                                      i * pData.Pitch / 2,
+                                  1,
+                                  ChromaW,
+                                  m_fDestMVC[vid]),
                         (mfxU32)pInfo.CropW / 2,
                         MFX_ERR_UNDEFINED_BEHAVIOR);
                 }
@@ -1530,21 +2239,21 @@ mfxStatus CSmplYUVWriter::WriteNextFrameI420(mfxFrameSurface1* pSurface) {
             for (i = 0; i < ChromaH; i++) {
                 if (!m_bIsMultiView) {
                     MSDK_CHECK_NOT_EQUAL(
-                        fwrite(pData.V + (pInfo.CropY * pData.Pitch / 2 + pInfo.CropX / 2) +
-                                   i * pData.Pitch / 2,
-                               1,
-                               ChromaW,
-                               m_fDest),
+                        WriteData(pData.V + (pInfo.CropY * pData.Pitch / 2 + pInfo.CropX / 2) +
+                                      i * pData.Pitch / 2,
+                                  1,
+                                  ChromaW,
+                                  m_fDest),
                         (mfxU32)pInfo.CropW / 2,
                         MFX_ERR_UNDEFINED_BEHAVIOR);
                 }
                 else {
                     MSDK_CHECK_NOT_EQUAL(
-                        fwrite(pData.V + (pInfo.CropY * pData.Pitch / 2 + pInfo.CropX / 2) +
-                                   i * pData.Pitch / 2,
-                               1,
-                               ChromaW,
-                               m_fDestMVC[vid]),
+                        WriteData(pData.V + (pInfo.CropY * pData.Pitch / 2 + pInfo.CropX / 2) +
+                                      i * pData.Pitch / 2,
+                                  1,
+                                  ChromaW,
+                                  m_fDestMVC[vid]),
                         (mfxU32)pInfo.CropW / 2,
                         MFX_ERR_UNDEFINED_BEHAVIOR);
                 }
@@ -1552,54 +2261,31 @@ mfxStatus CSmplYUVWriter::WriteNextFrameI420(mfxFrameSurface1* pSurface) {
             break;
         }
         case MFX_FOURCC_NV12: {
-            for (i = 0; i < ChromaH; i++) {
-                for (j = 0; j < ChromaW; j += 2) {
-                    if (!m_bIsMultiView) {
-                        MSDK_CHECK_NOT_EQUAL(
-                            fwrite(pData.UV + (pInfo.CropY * pData.Pitch / 2 + pInfo.CropX) +
-                                       i * pData.Pitch + j,
-                                   1,
-                                   1,
-                                   m_fDest),
-                            1,
-                            MFX_ERR_UNDEFINED_BEHAVIOR);
-                    }
-                    else {
-                        MSDK_CHECK_NOT_EQUAL(
-                            fwrite(pData.UV + (pInfo.CropY * pData.Pitch / 2 + pInfo.CropX) +
-                                       i * pData.Pitch + j,
-                                   1,
-                                   1,
-                                   m_fDestMVC[vid]),
-                            1,
-                            MFX_ERR_UNDEFINED_BEHAVIOR);
-                    }
-                }
+            // chroma is split to U and V planes which are written at once
+            FILE* dstFile    = m_bIsMultiView ? m_fDestMVC[vid] : m_fDest;
+            mfxU32 planeW    = ChromaW / 2;
+            mfxU32 planeSize = planeW * ChromaH;
+            try {
+                m_chromaBuf.resize(2 * planeSize);
             }
-            for (i = 0; i < ChromaH; i++) {
-                for (j = 1; j < ChromaW; j += 2) {
-                    if (!m_bIsMultiView) {
-                        MSDK_CHECK_NOT_EQUAL(
-                            fwrite(pData.UV + (pInfo.CropY * pData.Pitch / 2 + pInfo.CropX) +
-                                       i * pData.Pitch + j,
-                                   1,
-                                   1,
-                                   m_fDest),
-                            1,
-                            MFX_ERR_UNDEFINED_BEHAVIOR);
-                    }
-                    else {
-                        MSDK_CHECK_NOT_EQUAL(
-                            fwrite(pData.UV + (pInfo.CropY * pData.Pitch / 2 + pInfo.CropX) +
-                                       i * pData.Pitch + j,
-                                   1,
-                                   1,
-                                   m_fDestMVC[vid]),
-                            1,
-                            MFX_ERR_UNDEFINED_BEHAVIOR);
-                    }
-                }
+            catch (...) {
+                return MFX_ERR_MEMORY_ALLOC;
             }
+
+            mfxU8* pU = m_chromaBuf.data();
+            mfxU8* pV = pU + planeSize;
+            GetFrameCopyKernels()->SplitUV(pData.UV +
+                                               (pInfo.CropY * pData.Pitch / 2 + pInfo.CropX),
+                                           pData.Pitch,
+                                           pU,
+                                           planeW,
+                                           pV,
+                                           planeW,
+                                           planeW,
+                                           ChromaH);
+            MSDK_CHECK_NOT_EQUAL(WriteData(m_chromaBuf.data(), 1, 2 * planeSize, dstFile),
+                                 2 * planeSize,
+                                 MFX_ERR_UNDEFINED_BEHAVIOR);
             break;
         }
         default: {
@@ -2429,6 +3115,40 @@ mfxStatus msdk_opt_read(const char* string, std::wstring& value) {
     return MFX_ERR_NONE;
 }
 
+// list of CPU indices in the format of Linux cpulist, e.g. "0-3,8,10-11"
+template <>
+mfxStatus msdk_opt_read(const char* string, std::vector<mfxU32>& value) {
+    value.clear();
+    const char* pos = string;
+    while (*pos) {
+        char* stopCharacter;
+        unsigned long first = strtoul(pos, &stopCharacter, 10);
+        unsigned long last  = first;
+        if (stopCharacter == pos || !isdigit((unsigned char)*pos))
+            return MFX_ERR_UNKNOWN;
+
+        if (*stopCharacter == '-') {
+            pos  = stopCharacter + 1;
+            last = strtoul(pos, &stopCharacter, 10);
+            if (stopCharacter == pos || !isdigit((unsigned char)*pos) || last < first)
+                return MFX_ERR_UNKNOWN;
+        }
+        if (last >= MSDK_MAX_CPUS)
+            return MFX_ERR_UNKNOWN;
+
+        for (unsigned long cpu = first; cpu <= last; cpu++) {
+            value.push_back((mfxU32)cpu);
+        }
+
+        if (*stopCharacter == ',' && stopCharacter[1])
+            stopCharacter++;
+        else if (*stopCharacter)
+            return MFX_ERR_UNKNOWN;
+        pos = stopCharacter;
+    }
+    return value.empty() ? MFX_ERR_UNKNOWN : MFX_ERR_NONE;
+}
+
 mfxStatus msdk_opt_read(char* string, mfxPriority& value);
 
 bool IsDecodeCodecSupported(mfxU32 codecFormat) {
@@ -2659,6 +3379,172 @@ mfxI32 getMonitorType(char* str) {
     return MFX_MONITOR_MAXNUMBER;
 }
 
+CSmplBitstreamPreloadedReader::CSmplBitstreamPreloadedReader()
+        : CSmplBitstreamReader(),
+          m_pSource(),
+          m_nMaxSize(0),
+          m_data(),
+          m_frames(),
+          m_bCompleteFrames(false),
+          m_bWholeFile(false),
+          m_nPos(0),
+          m_nFrame(0) {}
+
+CSmplBitstreamPreloadedReader::~CSmplBitstreamPreloadedReader() {
+    Close();
+}
+
+void CSmplBitstreamPreloadedReader::SetSource(std::unique_ptr<CSmplBitstreamReader>& source,
+                                              mfxU64 nMaxSize) {
+    m_pSource  = std::move(source);
+    m_nMaxSize = nMaxSize;
+}
+
+void CSmplBitstreamPreloadedReader::Close() {
+    if (m_pSource)
+        m_pSource->Close();
+    m_data.clear();
+    m_data.shrink_to_fit();
+    m_frames.clear();
+    m_bCompleteFrames = false;
+    m_bWholeFile      = false;
+    m_nPos            = 0;
+    m_nFrame          = 0;
+
+    CSmplBitstreamReader::Close();
+}
+
+void CSmplBitstreamPreloadedReader::Reset() {
+    m_nPos   = 0;
+    m_nFrame = 0;
+}
+
+// returns offset of the last 00 00 01 start code together with zero bytes before it, 0 if
+// there is no start code after the beginning of data
+static size_t FindLastStartCode(const std::vector<mfxU8>& data) {
+    for (size_t i = data.size(); i >= 3; i--) {
+        if (data[i - 1] == 1 && !data[i - 2] && !data[i - 3]) {
+            size_t pos = i - 3;
+            while (pos && !data[pos - 1])
+                pos--;
+            return pos;
+        }
+    }
+    return 0;
+}
+
+mfxStatus CSmplBitstreamPreloadedReader::Init(const char* strFileName) {
+    MSDK_CHECK_POINTER(strFileName, MFX_ERR_NULL_PTR);
+    if (!strlen(strFileName))
+        return MFX_ERR_NONE;
+
+    Close();
+
+    if (!m_pSource)
+        m_pSource.reset(new CSmplBitstreamReader());
+
+    mfxStatus sts = m_pSource->Init(strFileName);
+    MSDK_CHECK_STATUS(sts, "m_pSource->Init failed");
+
+    mfxBitstreamWrapper bs(CHUNK_SIZE);
+    for (;;) {
+        if (m_nMaxSize && m_data.size() >= m_nMaxSize)
+            break;
+
+        bs.DataOffset = 0;
+        bs.DataLength = 0;
+        bs.DataFlag   = 0;
+        sts           = m_pSource->ReadNextFrame(&bs);
+        if (MFX_ERR_NOT_ENOUGH_BUFFER == sts) {
+            bs.Extend(2 * bs.MaxLength);
+            continue;
+        }
+        if (MFX_ERR_MORE_DATA == sts || (MFX_ERR_NONE == sts && !bs.DataLength)) {
+            m_bWholeFile = true;
+            break;
+        }
+        MSDK_CHECK_STATUS(sts, "m_pSource->ReadNextFrame failed");
+
+        m_bCompleteFrames = !!(bs.DataFlag & MFX_BITSTREAM_COMPLETE_FRAME);
+        size_t size       = bs.DataLength;
+        if (m_nMaxSize && m_data.size() + size > m_nMaxSize) {
+            // frame which doesn't fit is dropped, at least one frame is kept
+            if (m_bCompleteFrames && !m_frames.empty())
+                break;
+            if (!m_bCompleteFrames)
+                size = (size_t)(m_nMaxSize - m_data.size());
+        }
+
+        m_frames.push_back(m_data.size());
+        m_data.insert(m_data.end(), bs.Data + bs.DataOffset, bs.Data + bs.DataOffset + size);
+
+        // the last chunk may be cut too, then the end of data isn't the end of stream
+        if ((bs.DataFlag & MFX_BITSTREAM_EOS) && size == bs.DataLength) {
+            m_bWholeFile = true;
+            break;
+        }
+    }
+    // stream which doesn't fit is cut at the last start code, so when input is looped the
+    // truncated NAL unit isn't joined to the beginning of the stream. Data without start codes
+    // is cut at the limit
+    if (!m_bWholeFile && !m_bCompleteFrames) {
+        size_t size = FindLastStartCode(m_data);
+        if (size) {
+            m_data.resize(size);
+            while (!m_frames.empty() && m_frames.back() >= size)
+                m_frames.pop_back();
+        }
+    }
+
+    // all data is in memory
+    m_pSource->Close();
+
+    m_bInited = true;
+    return MFX_ERR_NONE;
+}
+
+mfxStatus CSmplBitstreamPreloadedReader::ReadNextFrame(mfxBitstream* pBS) {
+    if (!m_bInited)
+        return MFX_ERR_NOT_INITIALIZED;
+
+    MSDK_CHECK_POINTER(pBS, MFX_ERR_NULL_PTR);
+
+    if (m_nPos == m_data.size())
+        return MFX_ERR_MORE_DATA;
+
+    size_t nCopy = m_data.size() - m_nPos;
+    if (m_bCompleteFrames) {
+        if (m_nFrame + 1 < m_frames.size())
+            nCopy = m_frames[m_nFrame + 1] - m_nPos;
+        // check if bitstream has enough space to hold the frame
+        if (nCopy > pBS->MaxLength - pBS->DataLength)
+            return MFX_ERR_NOT_ENOUGH_BUFFER;
+    }
+    else {
+        // Not enough memory to read new chunk of data
+        if (pBS->MaxLength == pBS->DataLength)
+            return MFX_ERR_NOT_ENOUGH_BUFFER;
+        nCopy = std::min(nCopy, (size_t)(pBS->MaxLength - pBS->DataLength));
+    }
+
+    memmove(pBS->Data, pBS->Data + pBS->DataOffset, pBS->DataLength);
+    pBS->DataOffset = 0;
+    if (m_bCompleteFrames) {
+        pBS->DataFlag = MFX_BITSTREAM_COMPLETE_FRAME;
+        m_nFrame++;
+    }
+
+    memcpy(pBS->Data + pBS->DataLength, m_data.data() + m_nPos, nCopy);
+    pBS->DataLength += (mfxU32)nCopy;
+    m_nPos += nCopy;
+
+    if (m_bWholeFile && m_nPos == m_data.size()) {
+        pBS->DataFlag |= MFX_BITSTREAM_EOS;
+    }
+
+    return MFX_ERR_NONE;
+}
+
 CH264FrameReader::CH264FrameReader()
         : CSmplBitstreamReader(),
           m_processedBS(0),
@@ -2668,10 +3554,15 @@ CH264FrameReader::CH264FrameReader()
           m_frame(0),
           m_plainBuffer(0),
           m_plainBufferSize(0),
-          m_outBS() {}
+          m_outBS(),
+          m_bInPlace(false) {}
 
 CH264FrameReader::~CH264FrameReader() {}
 
+void CH264FrameReader::SetInPlaceSplitting(bool bEnable) {
+    m_bInPlace = bEnable;
+}
+
 void CH264FrameReader::Close() {
     CSmplBitstreamReader::Close();
 
@@ -2694,7 +3585,9 @@ mfxStatus CH264FrameReader::Init(const char* strFileName) {
 
     m_originalBS.Extend(1024 * 1024);
 
-    m_pNALSplitter.reset(new ProtectedLibrary::AVC_Spl());
+    ProtectedLibrary::AVC_Spl* pSplitter = new ProtectedLibrary::AVC_Spl();
+    pSplitter->SetInPlace(m_bInPlace);
+    m_pNALSplitter.reset(pSplitter);
 
     m_frame           = 0;
     m_plainBuffer     = 0;
@@ -2718,13 +3611,29 @@ mfxStatus CH264FrameReader::ReadNextFrame(mfxBitstream* pBS) {
     }
 
     do {
-        sts = PrepareNextFrame(m_isEndOfStream ? NULL : &m_originalBS, &m_processedBS);
+        // in-place splitter completes the last frame by end of stream flag
+        if (m_bInPlace && m_isEndOfStream)
+            m_originalBS.DataFlag |= MFX_BITSTREAM_EOS;
+        sts = PrepareNextFrame((m_isEndOfStream && !m_bInPlace) ? NULL : &m_originalBS,
+                               &m_processedBS);
 
         if (sts == MFX_ERR_MORE_DATA) {
             if (m_isEndOfStream) {
                 break;
             }
 
+            // in-place splitter keeps incomplete frame in input buffer, so it should fit there
+            if (m_bInPlace && m_originalBS.DataLength == m_originalBS.MaxLength) {
+                mfxBitstreamWrapper extended(2 * m_originalBS.MaxLength);
+                memcpy(extended.Data,
+                       m_originalBS.Data + m_originalBS.DataOffset,
+                       m_originalBS.DataLength);
+                extended.DataLength = m_originalBS.DataLength;
+                extended.DataFlag   = m_originalBS.DataFlag;
+                extended.TimeStamp  = m_originalBS.TimeStamp;
+                m_originalBS        = std::move(extended);
+            }
+
             sts = CSmplBitstreamReader::ReadNextFrame(&m_originalBS);
             if (sts == MFX_ERR_MORE_DATA)
                 m_isEndOfStream = true;
@@ -2761,6 +3670,22 @@ mfxStatus CH264FrameReader::PrepareNextFrame(mfxBitstream* in, mfxBitstream** ou
             return sts;
     }
 
+    // in-place frame is copied to output bitstream before input buffer is changed
+    if (m_bInPlace) {
+        m_outBS            = {};
+        m_outBS.Data       = m_frame->Data;
+        m_outBS.DataLength = m_frame->DataLength;
+        m_outBS.MaxLength  = m_frame->DataLength;
+        m_outBS.DataFlag   = MFX_BITSTREAM_COMPLETE_FRAME;
+        m_outBS.TimeStamp  = m_frame->TimeStamp;
+
+        m_pNALSplitter->ResetCurrentState();
+        m_frame = NULL;
+
+        *out = &m_outBS;
+        return sts;
+    }
+
     if (m_plainBufferSize < m_frame->DataLength) {
         if (NULL != m_plainBuffer) {
             free(m_plainBuffer);
@@ -2793,24 +3718,60 @@ mfxStatus CH264FrameReader::PrepareNextFrame(mfxBitstream* in, mfxBitstream** ou
 // 1 ms provides better result in range [0..5] ms
 #define DEVICE_WAIT_TIME 1
 
-// This function either performs synchronization using provided syncpoint, or just waits for predefined time if syncpoint is already 0 (this usually happens if syncpoint was already processed)
-void WaitForDeviceToBecomeFree(MFXVideoSession& session,
-                               mfxSyncPoint& syncPoint,
-                               mfxStatus& currentStatus) {
-    // Wait 1ms will be probably enough to device release
-    if (syncPoint) {
-        mfxStatus stsSync = session.SyncOperation(syncPoint, DEVICE_WAIT_TIME);
-        if (MFX_ERR_NONE == stsSync) {
+CDeviceBusyWaiter::CDeviceBusyWaiter() : m_numEvents(0), m_timeLost(0) {}
+
+mfxStatus CDeviceBusyWaiter::Wait(mfxU32 attempt, const std::function<mfxStatus()>& syncOldest) {
+    mfxU64 start  = msdk_time_get_monotonic_ns();
+    mfxStatus sts = syncOldest ? syncOldest() : MFX_ERR_NOT_FOUND;
+    if (MFX_ERR_NOT_FOUND == sts) {
+        BackOff(attempt);
+        sts = MFX_ERR_NONE;
+    }
+
+    m_numEvents++;
+    m_timeLost += msdk_time_get_monotonic_ns() - start;
+    return sts;
+}
+
+mfxStatus CDeviceBusyWaiter::Wait(mfxU32 attempt,
+                                  MFXVideoSession& session,
+                                  mfxSyncPoint& syncPoint) {
+    return Wait(attempt, [&]() {
+        if (!syncPoint)
+            return MFX_ERR_NOT_FOUND;
+
+        mfxStatus sts = session.SyncOperation(syncPoint, DEVICE_WAIT_TIME);
+        if (MFX_ERR_NONE == sts) {
             // retire completed sync point (otherwise we may start active polling)
             syncPoint = NULL;
         }
-        else if (stsSync < 0) {
-            currentStatus = stsSync;
-        }
-    }
-    else {
-        MSDK_SLEEP(DEVICE_WAIT_TIME);
+        return (sts < MFX_ERR_NONE) ? sts : MFX_ERR_NONE;
+    });
+}
+
+void CDeviceBusyWaiter::BackOff(mfxU32 attempt) {
+    // device is usually released within microseconds, so short busy periods don't pay for
+    // timer slack of a sleep
+    if (attempt < SPIN_ATTEMPTS) {
+        std::this_thread::yield();
+        return;
     }
+
+    mfxU32 shift = std::min(attempt - SPIN_ATTEMPTS, 31u);
+    mfxU64 sleep = std::min((mfxU64)MIN_SLEEP_TIME << shift, (mfxU64)MAX_SLEEP_TIME);
+    msdk_time_sleep_until_ns(msdk_time_get_monotonic_ns() + sleep * 1000);
+}
+
+void CDeviceBusyWaiter::PrintStatistics(const char* prefix) const {
+    mfxU64 numEvents = m_numEvents;
+    if (!numEvents)
+        return;
+    mfxU64 timeLost = m_timeLost;
+    printf("%s events:%llu, time lost:%.3lfms (avg %.3lfus)\n",
+           prefix,
+           (unsigned long long int)numEvents,
+           (double)timeLost / 1e6,
+           (double)timeLost / numEvents / 1e3);
 }
 
 mfxU16 FourCCToChroma(mfxU32 fourCC) {
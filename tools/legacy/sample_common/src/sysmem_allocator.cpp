@@ -12,6 +12,7 @@
 #define ID_BUFFER             MFX_MAKEFOURCC('B', 'U', 'F', 'F')
 #define ID_FRAME              MFX_MAKEFOURCC('F', 'R', 'M', 'E')
 #define ALIGN_TO_PAGE_SIZE(p) (((uint64_t)p + 4095) & (~(uint64_t)4095))
+#define SLAB_ARENA_SIZE       (64 * 1024 * 1024)
 
 SysMemFrameAllocator::SysMemFrameAllocator()
         : m_pBufferAllocator(0),
@@ -22,10 +23,12 @@ SysMemFrameAllocator::~SysMemFrameAllocator() {
 }
 
 mfxStatus SysMemFrameAllocator::Init(mfxAllocatorParams* pParams) {
+    SysMemAllocatorParams defaultParams;
+    SysMemAllocatorParams* pSysMemParams = &defaultParams;
+
     // check if any params passed from application
     if (pParams) {
-        SysMemAllocatorParams* pSysMemParams = 0;
-        pSysMemParams                        = dynamic_cast<SysMemAllocatorParams*>(pParams);
+        pSysMemParams = dynamic_cast<SysMemAllocatorParams*>(pParams);
         if (!pSysMemParams)
             return MFX_ERR_NOT_INITIALIZED;
 
@@ -35,7 +38,12 @@ mfxStatus SysMemFrameAllocator::Init(mfxAllocatorParams* pParams) {
 
     // if buffer allocator wasn't passed from application create own
     if (!m_pBufferAllocator) {
-        m_pBufferAllocator = new SysMemBufferAllocator;
+        if (SYSMEM_BACKEND_SLAB == pSysMemParams->backend)
+            m_pBufferAllocator = new SlabBufferAllocator(pSysMemParams->hugePages,
+                                                         pSysMemParams->numaNode,
+                                                         pSysMemParams->bZeroFill);
+        else
+            m_pBufferAllocator = new SysMemBufferAllocator;
         if (!m_pBufferAllocator)
             return MFX_ERR_MEMORY_ALLOC;
 
@@ -254,6 +262,21 @@ mfxStatus SysMemFrameAllocator::GetFrameHDL(mfxMemId /*mid*/, mfxHDL* /*handle*/
     return MFX_ERR_UNSUPPORTED;
 }
 
+mfxStatus SysMemFrameAllocator::GetStats(SysMemAllocatorStats* stats) {
+    if (!stats)
+        return MFX_ERR_NULL_PTR;
+
+    if (!m_pBufferAllocator)
+        return MFX_ERR_NOT_INITIALIZED;
+
+    SysMemBufferAllocator* pAllocator = dynamic_cast<SysMemBufferAllocator*>(m_pBufferAllocator);
+    if (!pAllocator)
+        return MFX_ERR_UNSUPPORTED;
+
+    *stats = pAllocator->GetStats();
+    return MFX_ERR_NONE;
+}
+
 mfxStatus SysMemFrameAllocator::CheckRequestType(mfxFrameAllocRequest* request) {
     mfxStatus sts = BaseFrameAllocator::CheckRequestType(request);
     if (MFX_ERR_NONE != sts)
@@ -266,9 +289,9 @@ mfxStatus SysMemFrameAllocator::CheckRequestType(mfxFrameAllocRequest* request)
 }
 
 mfxMemId* SysMemFrameAllocator::GetMidHolder(mfxMemId mid) {
-    for (auto resp : m_vResp) {
-        mfxMemId* it = std::find(resp->mids, resp->mids + resp->NumFrameActual, mid);
-        if (it != resp->mids + resp->NumFrameActual)
+    for (auto& resp : m_vResp) {
+        mfxMemId* it = std::find(resp.mids, resp.mids + resp.NumFrameActual, mid);
+        if (it != resp.mids + resp.NumFrameActual)
             return it;
     }
     return nullptr;
@@ -432,7 +455,7 @@ mfxStatus SysMemFrameAllocator::AllocImpl(mfxFrameAllocRequest* request,
     response->NumFrameActual = (mfxU16)numAllocated;
     response->mids           = mids.release();
 
-    m_vResp.push_back(response);
+    m_vResp.push_back(*response);
     return MFX_ERR_NONE;
 }
 
@@ -455,14 +478,22 @@ mfxStatus SysMemFrameAllocator::ReleaseResponse(mfxFrameAllocResponse* response)
         }
     }
 
-    m_vResp.erase(std::remove(m_vResp.begin(), m_vResp.end(), response), m_vResp.end());
+    m_vResp.erase(std::remove_if(m_vResp.begin(),
+                                 m_vResp.end(),
+                                 [response](const mfxFrameAllocResponse& resp) {
+                                     return resp.mids == response->mids;
+                                 }),
+                  m_vResp.end());
     delete[] response->mids;
     response->mids = 0;
 
     return sts;
 }
 
-SysMemBufferAllocator::SysMemBufferAllocator() {}
+SysMemBufferAllocator::SysMemBufferAllocator()
+        : m_numAllocs(0),
+          m_allocTime(0),
+          m_reservedBytes(0) {}
 
 SysMemBufferAllocator::~SysMemBufferAllocator() {}
 
@@ -473,6 +504,7 @@ mfxStatus SysMemBufferAllocator::AllocBuffer(mfxU32 nbytes, mfxU16 type, mfxMemI
     if (0 == (type & MFX_MEMTYPE_SYSTEM_MEMORY))
         return MFX_ERR_UNSUPPORTED;
 
+    auto start         = std::chrono::steady_clock::now();
     mfxU32 header_size = ALIGN_TO_PAGE_SIZE(sizeof(sBuffer));
     mfxU8* buffer_ptr  = (mfxU8*)calloc(header_size + ALIGN_TO_PAGE_SIZE(nbytes), 1);
 
@@ -484,6 +516,9 @@ mfxStatus SysMemBufferAllocator::AllocBuffer(mfxU32 nbytes, mfxU16 type, mfxMemI
     bs->type    = type;
     bs->nbytes  = nbytes;
     *mid        = (mfxHDL)bs;
+
+    m_reservedBytes += header_size + ALIGN_TO_PAGE_SIZE(nbytes);
+    CountAlloc(start);
     return MFX_ERR_NONE;
 }
 
@@ -516,6 +551,109 @@ mfxStatus SysMemBufferAllocator::FreeBuffer(mfxMemId mid) {
     if (!bs || ID_BUFFER != bs->id)
         return MFX_ERR_INVALID_HANDLE;
 
+    m_reservedBytes -= ALIGN_TO_PAGE_SIZE(sizeof(sBuffer)) + ALIGN_TO_PAGE_SIZE(bs->nbytes);
     free(bs);
     return MFX_ERR_NONE;
 }
+
+SysMemAllocatorStats SysMemBufferAllocator::GetStats() const {
+    SysMemAllocatorStats stats;
+    stats.numAllocs     = m_numAllocs;
+    stats.allocTime     = m_allocTime;
+    stats.reservedBytes = m_reservedBytes;
+    stats.rssBytes      = msdk_get_rss();
+    return stats;
+}
+
+void SysMemBufferAllocator::CountAlloc(std::chrono::steady_clock::time_point start) {
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    m_allocTime += std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    m_numAllocs++;
+}
+
+SlabBufferAllocator::SlabBufferAllocator(msdk_huge_pages hugePages,
+                                         mfxI32 numaNode,
+                                         bool bZeroFill)
+        : SysMemBufferAllocator(),
+          m_hugePages(hugePages),
+          m_numaNode(numaNode),
+          m_bZeroFill(bZeroFill),
+          m_mutex(),
+          m_arenas(),
+          m_freeBlocks() {}
+
+SlabBufferAllocator::~SlabBufferAllocator() {
+    for (auto& arena : m_arenas)
+        msdk_large_free(arena.base, arena.size);
+}
+
+mfxU8* SlabBufferAllocator::TakeBlock(size_t blockSize) {
+    auto it = m_freeBlocks.find(blockSize);
+    if (it != m_freeBlocks.end() && !it->second.empty()) {
+        mfxU8* block = (mfxU8*)it->second.back();
+        it->second.pop_back();
+        if (m_bZeroFill)
+            memset(block, 0, blockSize);
+        return block;
+    }
+
+    if (m_arenas.empty() || m_arenas.back().size - m_arenas.back().used < blockSize) {
+        // arenas are multiple of huge page, so that explicit huge pages can back them
+        size_t size = (std::max(blockSize, (size_t)SLAB_ARENA_SIZE) + MSDK_HUGE_PAGE_SIZE - 1) &
+                      ~((size_t)MSDK_HUGE_PAGE_SIZE - 1);
+        Arena arena;
+        arena.base = (mfxU8*)msdk_large_alloc(size, m_hugePages, m_numaNode);
+        arena.size = size;
+        arena.used = 0;
+        if (!arena.base)
+            return NULL;
+
+        m_arenas.push_back(arena);
+        m_reservedBytes += size;
+    }
+
+    Arena& arena = m_arenas.back();
+    mfxU8* block = arena.base + arena.used;
+    arena.used += blockSize;
+    return block;
+}
+
+mfxStatus SlabBufferAllocator::AllocBuffer(mfxU32 nbytes, mfxU16 type, mfxMemId* mid) {
+    if (!mid)
+        return MFX_ERR_NULL_PTR;
+
+    if (0 == (type & MFX_MEMTYPE_SYSTEM_MEMORY))
+        return MFX_ERR_UNSUPPORTED;
+
+    auto start    = std::chrono::steady_clock::now();
+    mfxU8* buffer = NULL;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        buffer = TakeBlock(ALIGN_TO_PAGE_SIZE(sizeof(sBuffer)) + ALIGN_TO_PAGE_SIZE(nbytes));
+    }
+    if (!buffer)
+        return MFX_ERR_MEMORY_ALLOC;
+
+    sBuffer* bs = (sBuffer*)buffer;
+    bs->id      = ID_BUFFER;
+    bs->type    = type;
+    bs->nbytes  = nbytes;
+    *mid        = (mfxHDL)bs;
+
+    CountAlloc(start);
+    return MFX_ERR_NONE;
+}
+
+mfxStatus SlabBufferAllocator::FreeBuffer(mfxMemId mid) {
+    sBuffer* bs = (sBuffer*)mid;
+    if (!bs || ID_BUFFER != bs->id)
+        return MFX_ERR_INVALID_HANDLE;
+
+    // released mid must not be locked anymore
+    bs->id           = 0;
+    size_t blockSize = ALIGN_TO_PAGE_SIZE(sizeof(sBuffer)) + ALIGN_TO_PAGE_SIZE(bs->nbytes);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_freeBlocks[blockSize].push_back(bs);
+    return MFX_ERR_NONE;
+}
@@ -0,0 +1,71 @@
+/*############################################################################
+  # Copyright (C) 2005 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include "mfx_samples_config.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+
+    #include "vm/file_defs.h"
+
+    #include <windows.h>
+
+struct msdk_file_mapping {
+    HANDLE mapping;
+    LPVOID view;
+};
+
+msdk_file_map_handle msdk_file_map(const char* file_name, mfxU8** data, mfxU64* size) {
+    if (!file_name || !data || !size)
+        return NULL;
+
+    HANDLE file = CreateFileA(file_name,
+                              GENERIC_READ,
+                              FILE_SHARE_READ,
+                              NULL,
+                              OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN,
+                              NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart <= 0 ||
+        (mfxU64)fileSize.QuadPart > (mfxU64)SIZE_MAX) {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    HANDLE mapping = CreateFileMapping(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    // mapping holds its own reference to the file
+    CloseHandle(file);
+    if (!mapping)
+        return NULL;
+
+    LPVOID view = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        return NULL;
+    }
+
+    msdk_file_mapping* handle = new msdk_file_mapping;
+    handle->mapping           = mapping;
+    handle->view              = view;
+
+    *data = (mfxU8*)view;
+    *size = (mfxU64)fileSize.QuadPart;
+    return (msdk_file_map_handle)handle;
+}
+
+void msdk_file_unmap(msdk_file_map_handle handle) {
+    if (!handle)
+        return;
+    msdk_file_mapping* mapping = (msdk_file_mapping*)handle;
+    UnmapViewOfFile(mapping->view);
+    CloseHandle(mapping->mapping);
+    delete mapping;
+}
+
+#endif // #if defined(_WIN32) || defined(_WIN64)
@@ -0,0 +1,62 @@
+/*############################################################################
+  # Copyright (C) 2005 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#if !defined(_WIN32) && !defined(_WIN64)
+
+    #include <fcntl.h>
+    #include <stdint.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #include "vm/file_defs.h"
+
+struct msdk_file_mapping {
+    void* addr;
+    size_t size;
+};
+
+msdk_file_map_handle msdk_file_map(const char* file_name, mfxU8** data, mfxU64* size) {
+    if (!file_name || !data || !size)
+        return NULL;
+
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || (mfxU64)st.st_size > (mfxU64)SIZE_MAX) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t len = (size_t)st.st_size;
+    void* addr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    // mapping holds its own reference to the file
+    close(fd);
+    if (addr == MAP_FAILED)
+        return NULL;
+
+    // data is read once from the beginning to the end, so aggressive readahead pays off
+    posix_madvise(addr, len, POSIX_MADV_SEQUENTIAL);
+
+    msdk_file_mapping* mapping = new msdk_file_mapping;
+    mapping->addr              = addr;
+    mapping->size              = len;
+
+    *data = (mfxU8*)addr;
+    *size = (mfxU64)len;
+    return (msdk_file_map_handle)mapping;
+}
+
+void msdk_file_unmap(msdk_file_map_handle handle) {
+    if (!handle)
+        return;
+    msdk_file_mapping* mapping = (msdk_file_mapping*)handle;
+    munmap(mapping->addr, mapping->size);
+    delete mapping;
+}
+
+#endif // #if !defined(_WIN32) && !defined(_WIN64)
@@ -0,0 +1,67 @@
+/*############################################################################
+  # Copyright (C) 2005 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include "mfx_samples_config.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+
+    #include "vm/memory_defs.h"
+
+    #include <malloc.h>
+    #include <windows.h>
+    // psapi functions are exported by kernel32 starting from Windows 7
+    #include <psapi.h>
+
+static LPVOID AllocPages(SIZE_T size, DWORD type, mfxI32 numa_node) {
+    if (numa_node < 0)
+        return VirtualAlloc(NULL, size, type, PAGE_READWRITE);
+    return VirtualAllocExNuma(GetCurrentProcess(),
+                              NULL,
+                              size,
+                              type,
+                              PAGE_READWRITE,
+                              (DWORD)numa_node);
+}
+
+void* msdk_large_alloc(size_t size, msdk_huge_pages huge_pages, mfxI32 numa_node) {
+    if (!size)
+        return NULL;
+
+    const DWORD type = MEM_RESERVE | MEM_COMMIT;
+    LPVOID addr      = NULL;
+    // large pages need SeLockMemoryPrivilege, there is no transparent mode on Windows
+    SIZE_T large_page = GetLargePageMinimum();
+    if (huge_pages == MSDK_HUGE_PAGES_EXPLICIT && large_page && !(size % large_page))
+        addr = AllocPages(size, type | MEM_LARGE_PAGES, numa_node);
+
+    if (!addr)
+        addr = AllocPages(size, type, numa_node);
+
+    return addr;
+}
+
+void msdk_large_free(void* ptr, size_t /*size*/) {
+    if (ptr)
+        VirtualFree(ptr, 0, MEM_RELEASE);
+}
+
+void* msdk_aligned_malloc(size_t size, size_t alignment) {
+    return _aligned_malloc(size, alignment);
+}
+
+void msdk_aligned_free(void* ptr) {
+    _aligned_free(ptr);
+}
+
+mfxU64 msdk_get_rss(void) {
+    PROCESS_MEMORY_COUNTERS counters = {};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+
+    return (mfxU64)counters.WorkingSetSize;
+}
+
+#endif // #if defined(_WIN32) || defined(_WIN64)
@@ -0,0 +1,95 @@
+/*############################################################################
+  # Copyright (C) 2005 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#if !defined(_WIN32) && !defined(_WIN64)
+
+    #include <stdio.h>
+    #include <stdlib.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+    #include "vm/memory_defs.h"
+
+    #ifndef MPOL_BIND
+        #define MPOL_BIND 2
+    #endif
+
+// numa policy is set through the system call to not depend on libnuma
+static void BindToNode(void* addr, size_t size, mfxI32 numa_node) {
+    #if defined(SYS_mbind)
+    const size_t bits = 8 * sizeof(unsigned long);
+    unsigned long mask[1024 / (8 * sizeof(unsigned long))] = {};
+    if (numa_node < 0 || (size_t)numa_node >= bits * (sizeof(mask) / sizeof(mask[0])))
+        return;
+
+    mask[numa_node / bits] = 1UL << (numa_node % bits);
+    // binding is a hint for placement, memory stays usable if the node isn't available
+    syscall(SYS_mbind, addr, size, MPOL_BIND, mask, bits * (sizeof(mask) / sizeof(mask[0])), 0);
+    #endif
+}
+
+void* msdk_large_alloc(size_t size, msdk_huge_pages huge_pages, mfxI32 numa_node) {
+    if (!size)
+        return NULL;
+
+    void* addr = MAP_FAILED;
+    #if defined(MAP_HUGETLB)
+    if (huge_pages == MSDK_HUGE_PAGES_EXPLICIT && !(size % MSDK_HUGE_PAGE_SIZE))
+        addr = mmap(NULL,
+                    size,
+                    PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                    -1,
+                    0);
+    #endif
+    if (addr == MAP_FAILED) {
+        addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (addr == MAP_FAILED)
+            return NULL;
+
+    #if defined(MADV_HUGEPAGE)
+        // reserved pool may be exhausted, so ask for transparent pages instead
+        if (huge_pages != MSDK_HUGE_PAGES_OFF)
+            madvise(addr, size, MADV_HUGEPAGE);
+    #endif
+    }
+
+    // pages are not touched yet, so they are placed according to the policy on the first fault
+    BindToNode(addr, size, numa_node);
+    return addr;
+}
+
+void msdk_large_free(void* ptr, size_t size) {
+    if (ptr)
+        munmap(ptr, size);
+}
+
+void* msdk_aligned_malloc(size_t size, size_t alignment) {
+    void* ptr = NULL;
+    if (posix_memalign(&ptr, alignment, size))
+        return NULL;
+    return ptr;
+}
+
+void msdk_aligned_free(void* ptr) {
+    free(ptr);
+}
+
+mfxU64 msdk_get_rss(void) {
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (!file)
+        return 0;
+
+    unsigned long long size = 0, resident = 0;
+    int read                = fscanf(file, "%llu %llu", &size, &resident);
+    fclose(file);
+    if (read != 2)
+        return 0;
+
+    return (mfxU64)resident * (mfxU64)sysconf(_SC_PAGESIZE);
+}
+
+#endif // #if !defined(_WIN32) && !defined(_WIN64)
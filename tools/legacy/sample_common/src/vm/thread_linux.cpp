@@ -8,13 +8,22 @@
 
     #include <sched.h>
     #include <stdio.h> // setrlimit
+    #include <string.h>
     #include <sys/syscall.h>
     #include <unistd.h>
+    #include <algorithm>
     #include <new> // std::bad_alloc
 
     #include "sample_utils.h"
     #include "vm/thread_defs.h"
 
+    #ifndef MPOL_DEFAULT
+        #define MPOL_DEFAULT 0
+    #endif
+    #ifndef MPOL_PREFERRED
+        #define MPOL_PREFERRED 1
+    #endif
+
 MSDKSemaphore::MSDKSemaphore(mfxStatus& sts, mfxU32 count) : msdkSemaphoreHandle(count) {
     sts     = MFX_ERR_NONE;
     int res = pthread_cond_init(&m_semaphore, NULL);
@@ -319,4 +328,89 @@ mfxU32 msdk_get_current_pid() {
     return syscall(SYS_getpid);
 }
 
+mfxStatus msdk_thread_get_affinity(std::vector<mfxU32>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set))
+        return MFX_ERR_UNKNOWN;
+
+    cpus.clear();
+    for (mfxU32 cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set))
+            cpus.push_back(cpu);
+    }
+    return MFX_ERR_NONE;
+}
+
+mfxStatus msdk_thread_set_affinity(const std::vector<mfxU32>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (mfxU32 cpu : cpus) {
+        if (cpu >= CPU_SETSIZE)
+            return MFX_ERR_UNSUPPORTED;
+        CPU_SET(cpu, &set);
+    }
+    // fails if none of the CPUs is available to the process
+    return sched_setaffinity(0, sizeof(set), &set) ? MFX_ERR_UNSUPPORTED : MFX_ERR_NONE;
+}
+
+// numa policy is set through the system call to not depend on libnuma
+mfxStatus msdk_thread_set_numa_node(mfxI32 node) {
+    #if defined(SYS_set_mempolicy)
+    if (node < 0)
+        return syscall(SYS_set_mempolicy, MPOL_DEFAULT, NULL, 0) ? MFX_ERR_UNKNOWN : MFX_ERR_NONE;
+
+    const size_t bits = 8 * sizeof(unsigned long);
+    unsigned long mask[1024 / (8 * sizeof(unsigned long))] = {};
+    if ((size_t)node >= bits * (sizeof(mask) / sizeof(mask[0])))
+        return MFX_ERR_UNSUPPORTED;
+
+    mask[node / bits] = 1UL << (node % bits);
+    // preferred policy falls back to other nodes when the node runs out of memory
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, bits * (sizeof(mask) / sizeof(mask[0]))))
+        return MFX_ERR_UNSUPPORTED;
+    return MFX_ERR_NONE;
+    #else
+    return (node < 0) ? MFX_ERR_NONE : MFX_ERR_UNSUPPORTED;
+    #endif
+}
+
+static mfxStatus ReadCpuList(const char* path, std::vector<mfxU32>& list) {
+    char buf[4096] = {};
+    FILE* file     = fopen(path, "r");
+    if (!file)
+        return MFX_ERR_NOT_FOUND;
+
+    bool read = fgets(buf, sizeof(buf), file) != NULL;
+    fclose(file);
+    if (!read)
+        return MFX_ERR_UNKNOWN;
+
+    buf[strcspn(buf, "\n")] = 0;
+    // list of node without CPUs is empty
+    if (!buf[0]) {
+        list.clear();
+        return MFX_ERR_NOT_FOUND;
+    }
+    return msdk_opt_read(buf, list);
+}
+
+mfxU32 msdk_get_numa_node_count() {
+    std::vector<mfxU32> nodes;
+    // kernels without NUMA support have no node directory, the system is a single node then
+    if (MFX_ERR_NONE != ReadCpuList("/sys/devices/system/node/online", nodes))
+        return 1;
+    return *std::max_element(nodes.begin(), nodes.end()) + 1;
+}
+
+mfxStatus msdk_get_numa_node_cpus(mfxU32 node, std::vector<mfxU32>& cpus) {
+    char path[128] = {};
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", (unsigned int)node);
+    mfxStatus sts = ReadCpuList(path, cpus);
+    // without NUMA support all CPUs available to the process belong to node 0
+    if (MFX_ERR_NOT_FOUND == sts && node == 0 && msdk_get_numa_node_count() == 1)
+        return msdk_thread_get_affinity(cpus);
+    return sts;
+}
+
 #endif // #if !defined(_WIN32) && !defined(_WIN64)
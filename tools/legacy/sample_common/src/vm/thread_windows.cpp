@@ -127,4 +127,63 @@ mfxU32 msdk_get_current_pid() {
     return GetCurrentProcessId();
 }
 
+// CPU index is group * bits of KAFFINITY + number of the processor in the group
+static const mfxU32 GROUP_SIZE = 8 * sizeof(KAFFINITY);
+
+static void GroupAffinityToCpus(const GROUP_AFFINITY& affinity, std::vector<mfxU32>& cpus) {
+    cpus.clear();
+    for (mfxU32 i = 0; i < GROUP_SIZE; i++) {
+        if (affinity.Mask & ((KAFFINITY)1 << i))
+            cpus.push_back(affinity.Group * GROUP_SIZE + i);
+    }
+}
+
+mfxStatus msdk_thread_get_affinity(std::vector<mfxU32>& cpus) {
+    GROUP_AFFINITY affinity = {};
+    if (!GetThreadGroupAffinity(GetCurrentThread(), &affinity))
+        return MFX_ERR_UNKNOWN;
+
+    GroupAffinityToCpus(affinity, cpus);
+    return MFX_ERR_NONE;
+}
+
+mfxStatus msdk_thread_set_affinity(const std::vector<mfxU32>& cpus) {
+    if (cpus.empty())
+        return MFX_ERR_UNSUPPORTED;
+
+    // thread can run on processors of a single group only
+    GROUP_AFFINITY affinity = {};
+    affinity.Group          = (WORD)(cpus[0] / GROUP_SIZE);
+    for (mfxU32 cpu : cpus) {
+        if (cpu / GROUP_SIZE != affinity.Group)
+            return MFX_ERR_UNSUPPORTED;
+        affinity.Mask |= (KAFFINITY)1 << (cpu % GROUP_SIZE);
+    }
+    return SetThreadGroupAffinity(GetCurrentThread(), &affinity, NULL) ? MFX_ERR_NONE
+                                                                       : MFX_ERR_UNSUPPORTED;
+}
+
+mfxStatus msdk_thread_set_numa_node(mfxI32 node) {
+    // memory is allocated on the node of the processor the thread runs on by default,
+    // so affinity to CPUs of the node is enough
+    (void)node;
+    return MFX_ERR_NONE;
+}
+
+mfxU32 msdk_get_numa_node_count() {
+    ULONG highest = 0;
+    if (!GetNumaHighestNodeNumber(&highest))
+        return 1;
+    return (mfxU32)highest + 1;
+}
+
+mfxStatus msdk_get_numa_node_cpus(mfxU32 node, std::vector<mfxU32>& cpus) {
+    GROUP_AFFINITY affinity = {};
+    if (node > 0xFFFF || !GetNumaNodeProcessorMaskEx((USHORT)node, &affinity))
+        return MFX_ERR_NOT_FOUND;
+
+    GroupAffinityToCpus(affinity, cpus);
+    return cpus.empty() ? MFX_ERR_NOT_FOUND : MFX_ERR_NONE;
+}
+
 #endif // #if defined(_WIN32) || defined(_WIN64)
@@ -17,6 +17,8 @@
         #include <x86intrin.h>
     #endif
 
+    #define MSDK_TIME_NSEC 1000000000ull
+
 msdk_tick msdk_time_get_tick(void) {
     LARGE_INTEGER t1;
 
@@ -41,4 +43,39 @@ mfxU64 rdtsc() {
     #endif
 }
 
+mfxU64 msdk_time_get_monotonic_ns(void) {
+    LARGE_INTEGER t, f;
+
+    QueryPerformanceCounter(&t);
+    QueryPerformanceFrequency(&f);
+    // seconds and remainder are scaled separately, so counter * 1e9 doesn't overflow
+    mfxU64 ticks = (mfxU64)t.QuadPart, freq = (mfxU64)f.QuadPart;
+    return ticks / freq * MSDK_TIME_NSEC + ticks % freq * MSDK_TIME_NSEC / freq;
+}
+
+void msdk_time_sleep_until_ns(mfxU64 deadline) {
+    mfxU64 now = msdk_time_get_monotonic_ns();
+    if (deadline <= now)
+        return;
+
+    // waitable timer takes only relative time in 100ns units for this clock
+    LARGE_INTEGER due;
+    due.QuadPart = -(LONGLONG)((deadline - now) / 100);
+
+    HANDLE t = NULL;
+    #if defined(CREATE_WAITABLE_TIMER_HIGH_RESOLUTION)
+    t = CreateWaitableTimerEx(NULL,
+                              NULL,
+                              CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+                              TIMER_ALL_ACCESS);
+    #endif
+    if (!t)
+        t = CreateWaitableTimer(NULL, TRUE, NULL);
+    if (!t)
+        return;
+    if (SetWaitableTimer(t, &due, 0, NULL, NULL, 0))
+        WaitForSingleObject(t, INFINITE);
+    CloseHandle(t);
+}
+
 #endif // #if defined(_WIN32) || defined(_WIN64)
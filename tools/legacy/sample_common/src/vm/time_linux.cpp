@@ -6,7 +6,9 @@
 
 #if !defined(_WIN32) && !defined(_WIN64)
 
+    #include <errno.h>
     #include <sys/time.h>
+    #include <time.h>
     #include "vm/time_defs.h"
 
     #if !defined(__i386__) && !defined(__x86_64__)
@@ -16,7 +18,8 @@
         #include <x86intrin.h>
     #endif
 
-    #define MSDK_TIME_MHZ 1000000
+    #define MSDK_TIME_MHZ  1000000
+    #define MSDK_TIME_NSEC 1000000000ull
 
 msdk_tick msdk_time_get_tick(void) {
     struct timeval tv;
@@ -41,4 +44,21 @@ mfxU64 rdtsc(void) {
     return result;
 }
 
+mfxU64 msdk_time_get_monotonic_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (mfxU64)ts.tv_sec * MSDK_TIME_NSEC + (mfxU64)ts.tv_nsec;
+}
+
+void msdk_time_sleep_until_ns(mfxU64 deadline) {
+    struct timespec ts;
+
+    ts.tv_sec  = (time_t)(deadline / MSDK_TIME_NSEC);
+    ts.tv_nsec = (long)(deadline % MSDK_TIME_NSEC);
+    // deadline is absolute, so sleep interrupted by signal is just restarted
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
 #endif // #if !defined(_WIN32) && !defined(_WIN64)
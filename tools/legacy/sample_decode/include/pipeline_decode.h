@@ -14,14 +14,18 @@
     #include <dxva2api.h>
 #endif
 
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <vector>
 #include "decode_render.h"
+#include "frame_pacer.h"
 #include "hw_device.h"
 #include "mfx_buffering.h"
 
 #include "base_allocator.h"
 #include "sample_utils.h"
+#include "time_statistics.h"
 #include "vpl_implementation_loader.h"
 
 #include "mfxplugin.h"
@@ -33,6 +37,7 @@
 #include "vpl/mfxvp8.h"
 
 #include "general_allocator.h"
+#include "sysmem_allocator.h"
 
 #if defined(_WIN64) || defined(_WIN32)
     #include "vpl/mfxadapter.h"
@@ -50,6 +55,8 @@ enum MemType {
 
 enum eWorkMode { MODE_PERFORMANCE, MODE_RENDERING, MODE_FILE_DUMP };
 
+#define MSDK_MAX_DELIVER_DEPTH 256
+
 enum eDecoderPostProc { MODE_DECODER_POSTPROC_AUTO = 0x1, MODE_DECODER_POSTPROC_FORCE = 0x2 };
 
 // the default api version is the latest one
@@ -65,6 +72,8 @@ struct sInputParams {
     bool bIsMVC; // true if Multi-View Codec is in use
     bool bLowLat; // low latency mode
     bool bCalLat; // latency calculation
+    std::string strLatencyReport; // name of CSV and JSON files with latency of decoding stages
+    bool bInPlaceSplit; // split frames in input buffer of complete frame reader
     bool bUseFullColorRange; //whether to use full color range
     mfxU16 nMaxFPS; // limits overall fps
     mfxU32 nWallCell;
@@ -92,6 +101,15 @@ struct sInputParams {
     mfxU16 eDeinterlace;
     mfxU16 ScalingMode;
     bool outI420;
+    bool bBatchWrite; // write each output frame by single call
+    bool bAsyncWrite; // write output frames in a separate thread
+    mfxU32 nDeliverDepth; // frames decoder may run ahead of writing output
+    mfxU32 nDeliverThreads; // workers writing output frames in decoding order
+    bool bSlabAlloc; // allocate system memory surfaces from slab arenas
+    mfxU16 nHugePages; // msdk_huge_pages mode of slab arenas
+    bool bBindNuma; // bind slab arenas to nNumaNode
+    mfxU32 nNumaNode;
+    mfxU32 nFramePoolSize; // MB of released surfaces kept for reuse after decoder reset
 
     bool bPerfMode;
     bool bRenderWin;
@@ -141,6 +159,33 @@ struct sInputParams {
     bool bIsFullscreen = false;
 };
 
+enum DecodeLatencyStage {
+    DECODE_LATENCY_INPUT = 0, // bitstream data of frame is read till it is submitted to decoder
+    DECODE_LATENCY_DECODE, // submission till decoded frame is synced
+    DECODE_LATENCY_DELIVER, // sync till frame is written or rendered
+    DECODE_LATENCY_TOTAL, // bitstream data is read till frame is delivered
+    DECODE_LATENCY_STAGE_COUNT
+};
+
+// latency of decoding stages of every frame
+class CDecodeLatencyStat : public CStageLatencyStat {
+public:
+    CDecodeLatencyStat();
+
+    // accounts stages of frame, delivered 0 means frame isn't delivered (performance mode)
+    void AddFrame(const msdkFrameSurface& surface, msdk_tick delivered);
+    // perFrame prints decode latency of every frame, it's kept only if KeepDeltas was called
+    // for DECODE_LATENCY_DECODE stage
+    void PrintStatistics(bool perFrame);
+
+protected:
+    void AddMeasurement(DecodeLatencyStage stage, msdk_tick start, msdk_tick end);
+
+private:
+    CDecodeLatencyStat(const CDecodeLatencyStat&);
+    void operator=(const CDecodeLatencyStat&);
+};
+
 struct CPipelineStatistics {
     CPipelineStatistics()
             : m_input_count(0),
@@ -149,7 +194,9 @@ struct CPipelineStatistics {
               m_tick_overall(0),
               m_tick_fread(0),
               m_tick_fwrite(0),
-              m_timer_overall(m_tick_overall) {}
+              m_timer_overall(m_tick_overall),
+              m_tick_read(0),
+              m_latencyStat() {}
     virtual ~CPipelineStatistics() {}
 
     mfxU32 m_input_count; // number of received incoming packets (frames or bitstreams)
@@ -162,6 +209,9 @@ struct CPipelineStatistics {
 
     CAutoTimer m_timer_overall; // timer which corresponds to m_tick_overall
 
+    msdk_tick m_tick_read; // when the last bitstream data was read, arrival time of its frames
+    CDecodeLatencyStat m_latencyStat;
+
 private:
     CPipelineStatistics(const CPipelineStatistics&);
     void operator=(const CPipelineStatistics&);
@@ -181,6 +231,7 @@ public:
     void SetMultiView();
     virtual void PrintLibInfo();
     virtual void PrintStreamInfo();
+    void PrintAllocatorStats();
     mfxU64 GetTotalBytesProcessed() {
         return totalBytesProcessed + m_mfxBS.DataOffset;
     }
@@ -234,7 +285,15 @@ protected: // functions
      * @return MFX_ERR_UNKNOWN An error has occurred.
      */
     virtual mfxStatus SyncOutputSurface(mfxU32 wait);
-    virtual mfxStatus DeliverOutput(mfxFrameSurface1* frame);
+    // waits after MFX_WRN_DEVICE_BUSY, delivers the oldest frame in flight if there is one
+    mfxStatus WaitForDevice(mfxU32 attempt);
+    // writes frame in the turn given by ticket, surface is mapped before waiting for the turn,
+    // so several delivery workers map surfaces in parallel
+    virtual mfxStatus DeliverOutput(mfxFrameSurface1* frame, mfxU64 ticket);
+    virtual mfxStatus WriteOutput(mfxFrameSurface1* frame);
+    mfxU64 TakeDeliverTicket();
+    void WaitDeliverTurn(mfxU64 ticket);
+    void PassDeliverTurn();
     virtual void PrintPerFrameStat(bool force = false);
 
     virtual void DeliverLoop();
@@ -257,6 +316,7 @@ protected: // variables
 
     GeneralAllocator* m_pGeneralAllocator;
     mfxAllocatorParams* m_pmfxAllocatorParams;
+    SysMemAllocatorParams m_sysMemAllocParams; // used if all surfaces are in system memory
     MemType m_memType; // memory type of surfaces to use
     bool m_bExternalAlloc; // use memory allocator as external for Media SDK
     bool m_bDecOutSysmem; // use system memory between Decoder and VPP, if false - video memory
@@ -273,6 +333,12 @@ protected: // variables
     MSDKEvent* m_pDeliveredEvent; // to signal when output surfaces will be processed
     mfxStatus m_error; // error returned by DeliverOutput method
     bool m_bStopDeliverLoop;
+    mfxU32 m_nDeliverThreads; // threads running DeliverLoop, 0 - output is delivered in place
+    mfxU32 m_nDeliverDepth; // max frames waiting for delivery, 0 - limited by surfaces only
+    mfxU64 m_nDeliverTicket; // order number of the next frame taken for delivery
+    mfxU64 m_nDeliverTurn; // order number of the frame which is written next
+    std::mutex m_deliverMutex;
+    std::condition_variable m_deliverCV;
 
     eWorkMode m_eWorkMode; // work mode for the pipeline
     bool m_bIsMVC; // enables MVC mode (need to support several files as an output)
@@ -294,9 +360,10 @@ protected: // variables
     bool m_bVppIsUsed;
     bool m_bVppFullColorRange;
     bool m_bSoftRobustFlag;
-    std::vector<msdk_tick> m_vLatency;
+    std::string m_latencyReportName;
 
-    FPSLimiter m_fpsLimiter;
+    CFramePacer m_framePacer;
+    CDeviceBusyWaiter m_busyWaiter;
 
     mfxExtVPPVideoSignalInfo m_VppVideoSignalInfo;
     std::vector<mfxExtBuffer*> m_VppSurfaceExtParams;
@@ -0,0 +1,11 @@
+/*############################################################################
+  # Copyright (C) 2005 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+int sample_decode_main(int argc, char* argv[]);
+
+int main(int argc, char* argv[]) {
+    return sample_decode_main(argc, argv);
+}
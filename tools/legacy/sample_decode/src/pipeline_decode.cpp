@@ -59,6 +59,7 @@ CDecodingPipeline::CDecodingPipeline()
           m_mfxVppVideoParams(),
           m_pGeneralAllocator(NULL),
           m_pmfxAllocatorParams(NULL),
+          m_sysMemAllocParams(),
           m_memType(SYSTEM_MEMORY),
           m_bExternalAlloc(false),
           m_bDecOutSysmem(false),
@@ -72,6 +73,12 @@ CDecodingPipeline::CDecodingPipeline()
           m_pDeliveredEvent(NULL),
           m_error(MFX_ERR_NONE),
           m_bStopDeliverLoop(false),
+          m_nDeliverThreads(0),
+          m_nDeliverDepth(0),
+          m_nDeliverTicket(0),
+          m_nDeliverTurn(0),
+          m_deliverMutex(),
+          m_deliverCV(),
           m_eWorkMode(MODE_PERFORMANCE),
           m_bIsMVC(false),
           m_bIsVideoWall(false),
@@ -89,8 +96,9 @@ CDecodingPipeline::CDecodingPipeline()
           m_bVppIsUsed(false),
           m_bVppFullColorRange(false),
           m_bSoftRobustFlag(false),
-          m_vLatency(),
-          m_fpsLimiter(),
+          m_latencyReportName(),
+          m_framePacer(),
+          m_busyWaiter(),
           m_VppVideoSignalInfo({}),
           m_VppSurfaceExtParams(),
           m_ContentLight({}),
@@ -122,8 +130,6 @@ CDecodingPipeline::CDecodingPipeline()
           m_bResetFileReader(false),
           m_fullscreen(false),
           m_verSessionInit(API_2X) {
-    // reserve some space to reduce dynamic reallocation impact on pipeline execution
-    m_vLatency.reserve(1000);
     m_VppVideoSignalInfo.Header.BufferId = MFX_EXTBUFF_VPP_VIDEO_SIGNAL_INFO;
     m_VppVideoSignalInfo.Header.BufferSz = sizeof(m_VppVideoSignalInfo);
 }
@@ -273,11 +279,13 @@ mfxStatus CDecodingPipeline::Init(sInputParams* pParams) {
     // create reader that supports completeframe mode for latency oriented scenarios
     if (pParams->bLowLat || pParams->bCalLat) {
         switch (pParams->videoType) {
-            case MFX_CODEC_AVC:
-                m_FileReader.reset(new CH264FrameReader());
+            case MFX_CODEC_AVC: {
+                CH264FrameReader* pReader = new CH264FrameReader();
+                pReader->SetInPlaceSplitting(pParams->bInPlaceSplit);
+                m_FileReader.reset(pReader);
                 m_bIsCompleteFrame = true;
                 m_bPrintLatency    = pParams->bCalLat;
-                break;
+            } break;
             case MFX_CODEC_JPEG:
                 m_FileReader.reset(new CJPEGFrameReader());
                 m_bIsCompleteFrame = true;
@@ -307,6 +315,15 @@ mfxStatus CDecodingPipeline::Init(sInputParams* pParams) {
         }
     }
 
+    // stages are timestamped for every codec, -calc_latency also needs complete frame reader
+    m_latencyReportName = pParams->strLatencyReport;
+    if (m_bPrintLatency || !m_latencyReportName.empty()) {
+        m_latencyStat.Enable();
+    }
+    if (m_bPrintLatency) {
+        m_latencyStat.KeepDeltas(DECODE_LATENCY_DECODE);
+    }
+
     if (pParams->fourcc)
         m_fourcc = pParams->fourcc;
 
@@ -542,7 +559,7 @@ mfxStatus CDecodingPipeline::Init(sInputParams* pParams) {
 #endif
     }
 
-    m_fpsLimiter.Reset(pParams->nMaxFPS);
+    m_framePacer.Reset(pParams->nMaxFPS);
 
     // create decoder
     m_pmfxDEC = new MFXVideoDECODE(m_mfxSession);
@@ -565,6 +582,7 @@ mfxStatus CDecodingPipeline::Init(sInputParams* pParams) {
 
     if (m_eWorkMode == MODE_FILE_DUMP) {
         // prepare YUV file writer
+        m_FileWriter.SetFrameBatching(pParams->bBatchWrite, pParams->bAsyncWrite);
         sts = m_FileWriter.Init(pParams->strDstFile, pParams->numViews);
         MSDK_CHECK_STATUS(sts, "m_FileWriter.Init failed");
     }
@@ -573,8 +591,26 @@ mfxStatus CDecodingPipeline::Init(sInputParams* pParams) {
         return MFX_ERR_UNSUPPORTED;
     }
 
+    if (m_eWorkMode == MODE_RENDERING) {
+        // frames are rendered by single thread, queue is limited only by surfaces
+        m_nDeliverThreads = 1;
+        m_nDeliverDepth   = 0;
+    }
+    else if (m_eWorkMode == MODE_FILE_DUMP) {
+        m_nDeliverThreads = pParams->nDeliverThreads;
+        m_nDeliverDepth   = pParams->nDeliverDepth;
+    }
+
+    if (pParams->bSlabAlloc) {
+        m_sysMemAllocParams.backend   = SYSMEM_BACKEND_SLAB;
+        m_sysMemAllocParams.hugePages = (msdk_huge_pages)pParams->nHugePages;
+        m_sysMemAllocParams.numaNode  = pParams->bBindNuma ? (mfxI32)pParams->nNumaNode : -1;
+    }
+
     sts = CreateAllocator();
     MSDK_CHECK_STATUS(sts, "CreateAllocator failed");
+    if (pParams->nFramePoolSize)
+        m_pGeneralAllocator->SetFramePoolLimit((mfxU64)pParams->nFramePoolSize << 20);
 
     // in case of HW accelerated decode frames must be allocated prior to decoder initialization
     sts = AllocFrames();
@@ -1245,6 +1281,8 @@ mfxStatus CDecodingPipeline::AllocFrames() {
         // Add surfaces for rendering smoothness
         Request.NumFrameSuggested += m_nMaxFps / 3;
     }
+    // decoder runs ahead of delivery workers, surfaces of queued frames are still in use
+    Request.NumFrameSuggested += (mfxU16)m_nDeliverDepth;
 
     if (m_bVppIsUsed) {
         // respecify memory type between Decoder and VPP
@@ -1283,7 +1321,8 @@ mfxStatus CDecodingPipeline::AllocFrames() {
         // The number of surfaces for vpp output
         // Need to add one more surface in render mode if AsyncDepth == 1
         nVppSurfNum = VppRequest[1].NumFrameSuggested +
-                      (m_eWorkMode == MODE_RENDERING ? m_mfxVideoParams.AsyncDepth == 1 : 0);
+                      (m_eWorkMode == MODE_RENDERING ? m_mfxVideoParams.AsyncDepth == 1 : 0) +
+                      (mfxU16)m_nDeliverDepth;
 
         // prepare allocation request
         Request.NumFrameSuggested = Request.NumFrameMin = nSurfNum;
@@ -1473,6 +1512,11 @@ mfxStatus CDecodingPipeline::CreateAllocator() {
 #endif
     }
     else {
+        if (SYSMEM_BACKEND_SLAB == m_sysMemAllocParams.backend) {
+            m_pmfxAllocatorParams = new SysMemAllocatorParams(m_sysMemAllocParams);
+            MSDK_CHECK_POINTER(m_pmfxAllocatorParams, MFX_ERR_MEMORY_ALLOC);
+        }
+
         sts = m_mfxSession.SetFrameAllocator(m_pGeneralAllocator);
         MSDK_CHECK_STATUS(sts, "m_mfxSession.SetFrameAllocator failed");
         m_bExternalAlloc = true;
@@ -1609,55 +1653,87 @@ mfxStatus CDecodingPipeline::ResetDecoder(sInputParams* pParams) {
     return MFX_ERR_NONE;
 }
 
-mfxStatus CDecodingPipeline::DeliverOutput(mfxFrameSurface1* frame) {
-    CAutoTimer timer_fwrite(m_tick_fwrite);
-
+mfxStatus CDecodingPipeline::DeliverOutput(mfxFrameSurface1* frame, mfxU64 ticket) {
     mfxStatus res = MFX_ERR_NONE, sts = MFX_ERR_NONE;
+    bool bLocked  = false;
+
+    // mapping of video memory is the heavy part of writing, it doesn't wait for the turn
+    if (frame && m_bExternalAlloc && m_eWorkMode == MODE_FILE_DUMP) {
+        res     = m_pGeneralAllocator->Lock(m_pGeneralAllocator->pthis,
+                                            frame->Data.MemId,
+                                            &(frame->Data));
+        bLocked = (MFX_ERR_NONE == res);
+    }
 
+    WaitDeliverTurn(ticket);
     if (!frame) {
-        return MFX_ERR_NULL_PTR;
+        res = MFX_ERR_NULL_PTR;
+    }
+    else if (MFX_ERR_NONE == res) {
+        res = WriteOutput(frame);
+    }
+    PassDeliverTurn();
+
+    if (bLocked) {
+        sts = m_pGeneralAllocator->Unlock(m_pGeneralAllocator->pthis,
+                                          frame->Data.MemId,
+                                          &(frame->Data));
+        if ((MFX_ERR_NONE == res) && (MFX_ERR_NONE != sts)) {
+            res = sts;
+        }
     }
 
+    return res;
+}
+
+mfxStatus CDecodingPipeline::WriteOutput(mfxFrameSurface1* frame) {
+    CAutoTimer timer_fwrite(m_tick_fwrite);
+
+    mfxStatus res = MFX_ERR_NONE, sts = MFX_ERR_NONE;
+
     if (m_bResetFileWriter) {
         sts = m_FileWriter.Reset();
         MSDK_CHECK_STATUS(sts, "");
         m_bResetFileWriter = false;
     }
 
-    if (m_bExternalAlloc) {
-        if (m_eWorkMode == MODE_FILE_DUMP) {
-            res = m_pGeneralAllocator->Lock(m_pGeneralAllocator->pthis,
-                                            frame->Data.MemId,
-                                            &(frame->Data));
-            if (MFX_ERR_NONE == res) {
-                res = m_bOutI420 ? m_FileWriter.WriteNextFrameI420(frame)
-                                 : m_FileWriter.WriteNextFrame(frame);
-                sts = m_pGeneralAllocator->Unlock(m_pGeneralAllocator->pthis,
-                                                  frame->Data.MemId,
-                                                  &(frame->Data));
-            }
-            if ((MFX_ERR_NONE == res) && (MFX_ERR_NONE != sts)) {
-                res = sts;
-            }
-        }
-        else if (m_eWorkMode == MODE_RENDERING) {
+    if (m_bExternalAlloc && m_eWorkMode == MODE_RENDERING) {
 #if D3D_SURFACES_SUPPORT
-            res = m_d3dRender.RenderFrame(frame, m_pGeneralAllocator);
+        res = m_d3dRender.RenderFrame(frame, m_pGeneralAllocator);
 #elif LIBVA_SUPPORT
-            res = m_hwdev->RenderFrame(frame, m_pGeneralAllocator);
+        res = m_hwdev->RenderFrame(frame, m_pGeneralAllocator);
 #endif
-        }
     }
     else {
         res = m_bOutI420 ? m_FileWriter.WriteNextFrameI420(frame)
                          : m_FileWriter.WriteNextFrame(frame);
     }
 
-    m_fpsLimiter.Work();
+    m_framePacer.Work();
 
     return res;
 }
 
+mfxU64 CDecodingPipeline::TakeDeliverTicket() {
+    std::lock_guard<std::mutex> lock(m_deliverMutex);
+    return m_nDeliverTicket++;
+}
+
+void CDecodingPipeline::WaitDeliverTurn(mfxU64 ticket) {
+    std::unique_lock<std::mutex> lock(m_deliverMutex);
+    m_deliverCV.wait(lock, [&] {
+        return m_nDeliverTurn == ticket;
+    });
+}
+
+void CDecodingPipeline::PassDeliverTurn() {
+    {
+        std::lock_guard<std::mutex> lock(m_deliverMutex);
+        m_nDeliverTurn++;
+    }
+    m_deliverCV.notify_all();
+}
+
 void CDecodingPipeline::DeliverLoop(void) {
     while (!m_bStopDeliverLoop) {
         m_pDeliverOutputSemaphore->Wait();
@@ -1667,14 +1743,27 @@ void CDecodingPipeline::DeliverLoop(void) {
         if (MFX_ERR_NONE != m_error) {
             continue;
         }
-        msdkOutputSurface* pCurrentDeliveredSurface = m_DeliveredSurfacesPool.GetSurface();
+        msdkOutputSurface* pCurrentDeliveredSurface = NULL;
+        mfxU64 ticket                               = 0;
+        {
+            // surface and its turn are taken together, so frames are written in decoding order
+            std::lock_guard<std::mutex> lock(m_deliverMutex);
+            pCurrentDeliveredSurface = m_DeliveredSurfacesPool.GetSurface();
+            ticket                   = m_nDeliverTicket++;
+        }
         if (!pCurrentDeliveredSurface) {
+            // turn is passed anyway, otherwise workers with later tickets never finish
+            DeliverOutput(NULL, ticket);
             m_error = MFX_ERR_NULL_PTR;
             continue;
         }
         mfxFrameSurface1* frame = &(pCurrentDeliveredSurface->surface->frame);
 
-        m_error = DeliverOutput(frame);
+        mfxStatus sts = DeliverOutput(frame, ticket);
+        if (MFX_ERR_NONE != sts) {
+            m_error = sts;
+        }
+        m_latencyStat.AddFrame(*pCurrentDeliveredSurface->surface, msdk_time_get_tick());
         ReturnSurfaceToBuffers(pCurrentDeliveredSurface);
 
         pCurrentDeliveredSurface = NULL;
@@ -1732,32 +1821,46 @@ mfxStatus CDecodingPipeline::SyncOutputSurface(mfxU32 wait) {
     if (MFX_WRN_IN_EXECUTION == sts) {
         return sts;
     }
+    if (MFX_ERR_NONE == sts && m_nDeliverThreads && m_synced_count >= m_nFrames) {
+        // requested number of frames is already queued for delivery
+        ReturnSurfaceToBuffers(m_pCurrentOutputSurface);
+        m_pCurrentOutputSurface = NULL;
+        return sts;
+    }
     if (MFX_ERR_NONE == sts) {
         // we got completely decoded frame - pushing it to the delivering thread...
         ++m_synced_count;
-        if (m_bPrintLatency) {
-            m_vLatency.push_back(m_timer_overall.Sync() - m_pCurrentOutputSurface->surface->submit);
+        if (m_latencyStat.IsEnabled()) {
+            m_pCurrentOutputSurface->surface->synced = msdk_time_get_tick();
         }
-        else {
+        if (!m_bPrintLatency) {
             PrintPerFrameStat();
         }
 
         if (m_eWorkMode == MODE_PERFORMANCE) {
             m_output_count = m_synced_count;
-            m_fpsLimiter.Work();
+            m_framePacer.Work();
+            m_latencyStat.AddFrame(*m_pCurrentOutputSurface->surface, 0);
             ReturnSurfaceToBuffers(m_pCurrentOutputSurface);
         }
-        else if (m_eWorkMode == MODE_FILE_DUMP) {
-            sts = DeliverOutput(&(m_pCurrentOutputSurface->surface->frame));
+        else if (!m_nDeliverThreads) {
+            sts = DeliverOutput(&(m_pCurrentOutputSurface->surface->frame), TakeDeliverTicket());
             if (MFX_ERR_NONE != sts) {
                 sts = MFX_ERR_UNKNOWN;
             }
             else {
                 m_output_count = m_synced_count;
             }
+            m_latencyStat.AddFrame(*m_pCurrentOutputSurface->surface, msdk_time_get_tick());
             ReturnSurfaceToBuffers(m_pCurrentOutputSurface);
         }
-        else if (m_eWorkMode == MODE_RENDERING) {
+        else {
+            // decoder runs ahead of writing output by no more than depth of delivery queue,
+            // m_synced_count already includes this frame
+            while (m_nDeliverDepth && m_synced_count - m_output_count > m_nDeliverDepth &&
+                   MFX_ERR_NONE == m_error) {
+                m_pDeliveredEvent->TimedWait(MSDK_DEC_WAIT_INTERVAL);
+            }
             m_DeliveredSurfacesPool.AddSurface(m_pCurrentOutputSurface);
             m_pDeliveredEvent->Reset();
             m_pDeliverOutputSemaphore->Post();
@@ -1768,6 +1871,14 @@ mfxStatus CDecodingPipeline::SyncOutputSurface(mfxU32 wait) {
     return sts;
 }
 
+mfxStatus CDecodingPipeline::WaitForDevice(mfxU32 attempt) {
+    return m_busyWaiter.Wait(attempt, [this]() {
+        mfxStatus sts = SyncOutputSurface(MSDK_DEC_WAIT_INTERVAL);
+        // no frames in flight, nothing to wait for but the device itself
+        return (MFX_ERR_MORE_DATA == sts) ? MFX_ERR_NOT_FOUND : sts;
+    });
+}
+
 mfxStatus CDecodingPipeline::RunDecoding() {
     mfxFrameSurface1* pOutSurface    = NULL;
     mfxBitstream* pBitstream         = &m_mfxBS;
@@ -1775,13 +1886,19 @@ mfxStatus CDecodingPipeline::RunDecoding() {
     bool bErrIncompatibleVideoParams = false;
     CTimeInterval<> decodeTimer(m_bIsCompleteFrame);
     time_t start_time = time(0);
-    std::thread deliverThread;
+    std::vector<std::thread> deliverThreads;
 
-    if (m_eWorkMode == MODE_RENDERING) {
+    if (m_nDeliverThreads) {
+        // workers of the previous run were stopped by the same flag, closed rendering window
+        // stops decoding anyway
+        if (m_eWorkMode == MODE_FILE_DUMP)
+            m_bStopDeliverLoop = false;
         m_pDeliverOutputSemaphore = new MSDKSemaphore(sts);
         m_pDeliveredEvent         = new MSDKEvent(sts, false, false);
 
-        deliverThread = std::thread(&CDecodingPipeline::DeliverLoop, this);
+        for (mfxU32 i = 0; i < m_nDeliverThreads; i++) {
+            deliverThreads.emplace_back(&CDecodingPipeline::DeliverLoop, this);
+        }
     }
 
     while (((sts == MFX_ERR_NONE) || (MFX_ERR_MORE_DATA == sts) || (MFX_ERR_MORE_SURFACE == sts)) &&
@@ -1795,6 +1912,9 @@ mfxStatus CDecodingPipeline::RunDecoding() {
             ((MFX_ERR_MORE_DATA == sts) || (m_bIsCompleteFrame && !pBitstream->DataLength))) {
             CAutoTimer timer_fread(m_tick_fread);
             sts = m_FileReader->ReadNextFrame(pBitstream); // read more data to input bit stream
+            if (MFX_ERR_NONE == sts) {
+                m_tick_read = msdk_time_get_tick();
+            }
 
             if (MFX_ERR_MORE_DATA == sts) {
                 sts = MFX_ERR_NONE;
@@ -1850,10 +1970,10 @@ mfxStatus CDecodingPipeline::RunDecoding() {
                 // we stuck with no free surface available, now we will sync...
                 sts = SyncOutputSurface(MSDK_DEC_WAIT_INTERVAL);
                 if (MFX_ERR_MORE_DATA == sts) {
-                    if ((m_eWorkMode == MODE_PERFORMANCE) || (m_eWorkMode == MODE_FILE_DUMP)) {
+                    if ((m_eWorkMode == MODE_PERFORMANCE) || !m_nDeliverThreads) {
                         sts = MFX_ERR_NOT_FOUND;
                     }
-                    else if (m_eWorkMode == MODE_RENDERING) {
+                    else {
                         if (m_synced_count != m_output_count) {
                             sts = m_pDeliveredEvent->TimedWait(MSDK_DEC_WAIT_INTERVAL);
                         }
@@ -1893,10 +2013,12 @@ mfxStatus CDecodingPipeline::RunDecoding() {
         }
 
         if ((MFX_ERR_NONE == sts) || (MFX_ERR_MORE_DATA == sts) || (MFX_ERR_MORE_SURFACE == sts)) {
-            if (m_bIsCompleteFrame) {
-                m_pCurrentFreeSurface->submit = m_timer_overall.Sync();
+            if (m_latencyStat.IsEnabled()) {
+                m_pCurrentFreeSurface->arrival = m_tick_read;
+                m_pCurrentFreeSurface->submit  = msdk_time_get_tick();
             }
             pOutSurface = NULL;
+            mfxU32 nBusyAttempt = 0;
             do {
                 mfxExtDecodeErrorReport* errorReport = nullptr;
                 if (pBitstream) {
@@ -1936,17 +2058,10 @@ mfxStatus CDecodingPipeline::RunDecoding() {
                         //in low latency mode device busy leads to increasing of latency
                         //printf("Warning : latency increased due to MFX_WRN_DEVICE_BUSY\n");
                     }
-                    mfxStatus _sts = SyncOutputSurface(MSDK_DEC_WAIT_INTERVAL);
+                    mfxStatus _sts = WaitForDevice(nBusyAttempt++);
                     // note: everything except MFX_ERR_NONE are errors at this point
-                    if (MFX_ERR_NONE == _sts) {
-                        sts = MFX_WRN_DEVICE_BUSY;
-                    }
-                    else {
+                    if (MFX_ERR_NONE != _sts) {
                         sts = _sts;
-                        if (MFX_ERR_MORE_DATA == sts) {
-                            // we can't receive MFX_ERR_MORE_DATA and have no output - that's a bug
-                            sts = MFX_WRN_DEVICE_BUSY; //MFX_ERR_NOT_FOUND;
-                        }
                     }
                 }
             } while (MFX_WRN_DEVICE_BUSY == sts);
@@ -1982,7 +2097,8 @@ mfxStatus CDecodingPipeline::RunDecoding() {
                 if (sts)
                     MSDK_PRINT_WRN_MSG(sts, "SyncOutputSurface failed")
 
-                while (m_synced_count != m_output_count) {
+                // worker which failed doesn't deliver the rest of frames
+                while (m_synced_count != m_output_count && MFX_ERR_NONE == m_error) {
                     m_pDeliveredEvent->Wait();
                 }
                 break;
@@ -2028,6 +2144,7 @@ mfxStatus CDecodingPipeline::RunDecoding() {
         if (MFX_ERR_NONE == sts) {
             if (m_bVppIsUsed) {
                 if (m_pCurrentFreeVppSurface) {
+                    mfxU32 nBusyAttempt = 0;
                     do {
                         if ((m_pCurrentFreeVppSurface->frame.Info.CropW == 0) ||
                             (m_pCurrentFreeVppSurface->frame.Info.CropH == 0)) {
@@ -2060,8 +2177,11 @@ mfxStatus CDecodingPipeline::RunDecoding() {
                                                           &(m_pCurrentFreeOutputSurface->syncp));
 
                         if (MFX_WRN_DEVICE_BUSY == sts) {
-                            MSDK_SLEEP(
-                                1); // just wait and then repeat the same call to RunFrameVPPAsync
+                            // wait and then repeat the same call to RunFrameVPPAsync
+                            mfxStatus _sts = WaitForDevice(nBusyAttempt++);
+                            if (MFX_ERR_NONE != _sts) {
+                                sts = _sts;
+                            }
                         }
                     } while (MFX_WRN_DEVICE_BUSY == sts);
 
@@ -2074,6 +2194,10 @@ mfxStatus CDecodingPipeline::RunDecoding() {
                         break;
                     }
 
+                    // latency of frame is measured from its decoding
+                    m_pCurrentFreeVppSurface->arrival = FindUsedSurface(pOutSurface)->arrival;
+                    m_pCurrentFreeVppSurface->submit  = FindUsedSurface(pOutSurface)->submit;
+
                     m_UsedVppSurfacesPool.AddSurface(m_pCurrentFreeVppSurface);
                     msdk_atomic_inc16(&(m_pCurrentFreeVppSurface->render_lock));
 
@@ -2108,41 +2232,31 @@ mfxStatus CDecodingPipeline::RunDecoding() {
     }
 
     PrintPerFrameStat(true);
+    m_framePacer.PrintStatistics("\nPacing:");
+    m_busyWaiter.PrintStatistics("Device busy:");
 
-    if (m_bPrintLatency && m_vLatency.size() > 0) {
-        unsigned int frame_idx = 0;
-        msdk_tick sum          = 0;
-        for (std::vector<msdk_tick>::iterator it = m_vLatency.begin(); it != m_vLatency.end();
-             ++it) {
-            sum += *it;
-            printf("Frame %4d, latency=%5.5f ms\n",
-                   ++frame_idx,
-                   (double)(CTimer::ConvertToSeconds(*it) * 1000));
-        }
-        printf("\nLatency summary:\n");
-        printf(
-            "\nAVG=%5.5f ms, MAX=%5.5f ms, MIN=%5.5f ms",
-            (double)CTimer::ConvertToSeconds((msdk_tick)((mfxF64)sum / m_vLatency.size())) * 1000,
-            (double)CTimer::ConvertToSeconds(
-                *std::max_element(m_vLatency.begin(), m_vLatency.end())) *
-                1000,
-            (double)CTimer::ConvertToSeconds(
-                *std::min_element(m_vLatency.begin(), m_vLatency.end())) *
-                1000);
-    }
-
-    if (m_eWorkMode == MODE_RENDERING) {
+    if (m_nDeliverThreads) {
         m_bStopDeliverLoop = true;
 
-        m_pDeliverOutputSemaphore->Post();
-
-        if (deliverThread.joinable())
-            deliverThread.join();
+        for (size_t i = 0; i < deliverThreads.size(); i++) {
+            m_pDeliverOutputSemaphore->Post();
+        }
+        for (auto& deliverThread : deliverThreads) {
+            if (deliverThread.joinable())
+                deliverThread.join();
+        }
     }
 
     MSDK_SAFE_DELETE(m_pDeliverOutputSemaphore);
     MSDK_SAFE_DELETE(m_pDeliveredEvent);
 
+    if (m_latencyStat.IsEnabled()) {
+        m_latencyStat.PrintStatistics(m_bPrintLatency);
+        if (!m_latencyReportName.empty()) {
+            m_latencyStat.WriteReport(m_latencyReportName);
+        }
+    }
+
     // exit in case of other errors
     MSDK_CHECK_STATUS(sts, "Unexpected error!!");
 
@@ -2154,6 +2268,28 @@ mfxStatus CDecodingPipeline::RunDecoding() {
     return sts; // ERR_NONE or ERR_INCOMPATIBLE_VIDEO_PARAM
 }
 
+void CDecodingPipeline::PrintAllocatorStats() {
+    if (!m_pGeneralAllocator)
+        return;
+
+    FramePoolStats poolStats = m_pGeneralAllocator->GetFramePoolStats();
+    if (poolStats.hits || poolStats.misses)
+        printf("Frame pool: %llu hits, %llu misses, %llu evictions\n",
+               (unsigned long long)poolStats.hits,
+               (unsigned long long)poolStats.misses,
+               (unsigned long long)poolStats.evictions);
+
+    SysMemAllocatorStats stats = {};
+    if (MFX_ERR_NONE != m_pGeneralAllocator->GetSysMemStats(&stats) || !stats.numAllocs)
+        return;
+
+    printf("System memory surfaces: %llu allocations in %.3f ms, reserved %.1f MB, RSS %.1f MB\n",
+           (unsigned long long)stats.numAllocs,
+           stats.allocTime / 1000.0,
+           stats.reservedBytes / (1024.0 * 1024.0),
+           stats.rssBytes / (1024.0 * 1024.0));
+}
+
 void CDecodingPipeline::PrintLibInfo() {
     mfxStatus sts = m_mfxSession.PrintLibInfo(m_pLoader.get());
     if (sts != MFX_ERR_NONE)
@@ -2224,3 +2360,71 @@ void CDecodingPipeline::PrintStreamInfo() {
 
     return;
 }
+
+static const char* const DecodeLatencyStageNames[DECODE_LATENCY_STAGE_COUNT] = { "Input",
+                                                                                 "Decode",
+                                                                                 "Deliver",
+                                                                                 "Total" };
+
+CDecodeLatencyStat::CDecodeLatencyStat()
+        : CStageLatencyStat(DecodeLatencyStageNames, DECODE_LATENCY_STAGE_COUNT) {}
+
+void CDecodeLatencyStat::AddFrame(const msdkFrameSurface& surface, msdk_tick delivered) {
+    if (!m_bEnabled || !surface.submit)
+        return;
+
+    // with stream reader bitstream data of several frames is read at once, so input stage
+    // of frame starts when the data containing its end was read
+    msdk_tick start = surface.arrival ? surface.arrival : surface.submit;
+    msdk_tick end   = delivered ? delivered : surface.synced;
+
+    if (surface.arrival)
+        AddMeasurement(DECODE_LATENCY_INPUT, surface.arrival, surface.submit);
+    AddMeasurement(DECODE_LATENCY_DECODE, surface.submit, surface.synced);
+    if (delivered)
+        AddMeasurement(DECODE_LATENCY_DELIVER, surface.synced, delivered);
+    AddMeasurement(DECODE_LATENCY_TOTAL, start, end);
+}
+
+void CDecodeLatencyStat::AddMeasurement(DecodeLatencyStage stage, msdk_tick start, msdk_tick end) {
+    mfxF64 delta = (end > start) ? CTimer::ConvertToSeconds(end - start) : 0;
+    CStageLatencyStat::AddMeasurement(stage, delta);
+}
+
+void CDecodeLatencyStat::PrintStatistics(bool perFrame) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    CTimeStatisticsReal& decode = m_stages[DECODE_LATENCY_DECODE];
+    if (perFrame) {
+        const std::vector<mfxF64>& deltas = decode.GetDeltas();
+        for (size_t i = 0; i < deltas.size(); i++) {
+            printf("Frame %4d, latency=%5.5f ms\n", (int)(i + 1), (double)deltas[i]);
+        }
+    }
+
+    // all values are in ms
+    printf("\nLatency summary:\n");
+    for (mfxU32 i = 0; i < DECODE_LATENCY_STAGE_COUNT; i++) {
+        CTimeStatisticsReal& stage = m_stages[i];
+        if (!stage.GetNumMeasurements())
+            continue;
+
+        printf("%-8s frames:%llu avg:%.3lf p50:%.3lf p90:%.3lf p99:%.3lf p99.9:%.3lf max:%.3lf\n",
+               DecodeLatencyStageNames[i],
+               (unsigned long long int)stage.GetNumMeasurements(),
+               (double)stage.GetAvgTime(false),
+               (double)stage.GetPercentile(GetReportPercentile(0).Value, false),
+               (double)stage.GetPercentile(GetReportPercentile(1).Value, false),
+               (double)stage.GetPercentile(GetReportPercentile(2).Value, false),
+               (double)stage.GetPercentile(GetReportPercentile(3).Value, false),
+               (double)stage.GetMaxTime(false));
+    }
+
+    // decoding latency in the format printed before stages were split
+    if (decode.GetNumMeasurements()) {
+        printf("\nAVG=%5.5f ms, MAX=%5.5f ms, MIN=%5.5f ms\n",
+               (double)decode.GetAvgTime(false),
+               (double)decode.GetMaxTime(false),
+               (double)decode.GetMinTime(false));
+    }
+}
@@ -100,6 +100,11 @@ void PrintHelp(char* strAppName, const char* strErrorMessage) {
     printf("   [-p016] - pipeline output format: P010, output file format: P016\n");
     printf("   [-y216] - pipeline output format: Y216, output file format: Y216\n");
     printf("   [-y416] - pipeline output format: Y416, output file format: Y416\n");
+    printf("   [-batch_write] - pack each output frame into one buffer and write it at once\n");
+    printf("   [-async_write] - same as -batch_write, and write frames in a separate thread\n");
+    printf("   [-deliver_queue n] - let decoder run ahead of writing output by up to n frames\n");
+    printf(
+        "   [-deliver_threads n] - map output surfaces by n threads, frames are written in decoding order\n");
     printf("\n");
 #if D3D_SURFACES_SUPPORT
     printf("   [-d3d]                    - work with d3d9 surfaces\n");
@@ -139,10 +144,21 @@ void PrintHelp(char* strAppName, const char* strErrorMessage) {
         "   [-low_latency]            - configures decoder for low latency mode (supported only for H.264 and JPEG codec)\n");
     printf(
         "   [-calc_latency]           - calculates latency during decoding and prints log (supported only for H.264 and JPEG codec)\n");
+    printf(
+        "   [-latency_report name]    - measure input, decode and delivery latency of every frame (any codec), print percentiles and write them to name.csv and name.json\n");
+    printf(
+        "   [-split_in_place]         - with -low_latency or -calc_latency split H.264 frames without copying them\n");
     printf(
         "   [-async]                  - depth of asynchronous pipeline. default value is 4. must be between 1 and 20\n");
     printf("   [-gpucopy::<on,off>] Enable or disable GPU copy mode\n");
     printf("   [-robust:soft]            - GPU hang recovery by inserting an IDR frame\n");
+    printf(
+        "   [-slab_alloc]             - allocate system memory surfaces from reusable arenas without zeroing\n");
+    printf(
+        "   [-huge_pages:<thp,explicit>] - back arenas of -slab_alloc by transparent or reserved 2 MB pages\n");
+    printf("   [-numa_node n]            - bind arenas of -slab_alloc to NUMA node n\n");
+    printf(
+        "   [-frame_pool size]        - keep up to size MB of released surfaces for reuse after decoder reset\n");
     printf("   [-timeout]                - timeout in seconds\n");
     printf("   [-dec_postproc force/auto] - resize after decoder using direct pipe\n");
     printf("                  force: instruct to use decoder-based post processing\n");
@@ -355,6 +371,9 @@ mfxStatus ParseInputString(char* strInput[], mfxU32 nArgNum, sInputParams* pPara
                 }
             }
         }
+        else if (msdk_match(strInput[i], "-split_in_place")) {
+            pParams->bInPlaceSplit = true;
+        }
         else if (msdk_match(strInput[i], "-jpeg_rotate")) {
             if (MFX_CODEC_JPEG != pParams->videoType)
                 return MFX_ERR_UNSUPPORTED;
@@ -387,6 +406,14 @@ mfxStatus ParseInputString(char* strInput[], mfxU32 nArgNum, sInputParams* pPara
                 }
             }
         }
+        else if (msdk_match(strInput[i], "-latency_report")) {
+            if (i + 1 >= nArgNum) {
+                PrintHelp(strInput[0], "Not enough parameters for -latency_report key");
+                return MFX_ERR_UNSUPPORTED;
+            }
+            i++;
+            pParams->strLatencyReport = strInput[i];
+        }
         else if (msdk_match(strInput[i], "-async")) {
             if (i + 1 >= nArgNum) {
                 PrintHelp(strInput[0], "Not enough parameters for -async key");
@@ -397,6 +424,39 @@ mfxStatus ParseInputString(char* strInput[], mfxU32 nArgNum, sInputParams* pPara
                 return MFX_ERR_UNSUPPORTED;
             }
         }
+        else if (msdk_match(strInput[i], "-slab_alloc")) {
+            pParams->bSlabAlloc = true;
+        }
+        else if (msdk_match(strInput[i], "-huge_pages:thp")) {
+            pParams->bSlabAlloc = true;
+            pParams->nHugePages = MSDK_HUGE_PAGES_TRANSPARENT;
+        }
+        else if (msdk_match(strInput[i], "-huge_pages:explicit")) {
+            pParams->bSlabAlloc = true;
+            pParams->nHugePages = MSDK_HUGE_PAGES_EXPLICIT;
+        }
+        else if (msdk_match(strInput[i], "-numa_node")) {
+            if (i + 1 >= nArgNum) {
+                PrintHelp(strInput[0], "Not enough parameters for -numa_node key");
+                return MFX_ERR_UNSUPPORTED;
+            }
+            if (MFX_ERR_NONE != msdk_opt_read(strInput[++i], pParams->nNumaNode)) {
+                PrintHelp(strInput[0], "numa_node is invalid");
+                return MFX_ERR_UNSUPPORTED;
+            }
+            pParams->bSlabAlloc = true;
+            pParams->bBindNuma  = true;
+        }
+        else if (msdk_match(strInput[i], "-frame_pool")) {
+            if (i + 1 >= nArgNum) {
+                PrintHelp(strInput[0], "Not enough parameters for -frame_pool key");
+                return MFX_ERR_UNSUPPORTED;
+            }
+            if (MFX_ERR_NONE != msdk_opt_read(strInput[++i], pParams->nFramePoolSize)) {
+                PrintHelp(strInput[0], "frame_pool is invalid");
+                return MFX_ERR_UNSUPPORTED;
+            }
+        }
         else if (msdk_match(strInput[i], "-timeout")) {
             if (i + 1 >= nArgNum) {
                 PrintHelp(strInput[0], "Not enough parameters for -timeout key");
@@ -726,6 +786,35 @@ mfxStatus ParseInputString(char* strInput[], mfxU32 nArgNum, sInputParams* pPara
         else if (msdk_match(strInput[i], "-y416")) {
             pParams->fourcc = MFX_FOURCC_Y416;
         }
+        else if (msdk_match(strInput[i], "-batch_write")) {
+            pParams->bBatchWrite = true;
+        }
+        else if (msdk_match(strInput[i], "-async_write")) {
+            pParams->bBatchWrite = true;
+            pParams->bAsyncWrite = true;
+        }
+        else if (msdk_match(strInput[i], "-deliver_queue")) {
+            if (i + 1 >= nArgNum) {
+                PrintHelp(strInput[0], "Not enough parameters for -deliver_queue key");
+                return MFX_ERR_UNSUPPORTED;
+            }
+            if (MFX_ERR_NONE != msdk_opt_read(strInput[++i], pParams->nDeliverDepth) ||
+                !pParams->nDeliverDepth || pParams->nDeliverDepth > MSDK_MAX_DELIVER_DEPTH) {
+                PrintHelp(strInput[0], "deliver_queue is invalid");
+                return MFX_ERR_UNSUPPORTED;
+            }
+        }
+        else if (msdk_match(strInput[i], "-deliver_threads")) {
+            if (i + 1 >= nArgNum) {
+                PrintHelp(strInput[0], "Not enough parameters for -deliver_threads key");
+                return MFX_ERR_UNSUPPORTED;
+            }
+            if (MFX_ERR_NONE != msdk_opt_read(strInput[++i], pParams->nDeliverThreads) ||
+                !pParams->nDeliverThreads || pParams->nDeliverThreads > MSDK_MAX_DELIVER_DEPTH) {
+                PrintHelp(strInput[0], "deliver_threads is invalid");
+                return MFX_ERR_UNSUPPORTED;
+            }
+        }
         else if (msdk_match(strInput[i], "-i:null")) {
             ;
         }
@@ -826,6 +915,14 @@ mfxStatus ParseInputString(char* strInput[], mfxU32 nArgNum, sInputParams* pPara
         pParams->nAsyncDepth = 4; //set by default;
     }
 
+    // every delivery thread needs a queued frame to work on
+    if (pParams->nDeliverThreads && pParams->nDeliverDepth < pParams->nDeliverThreads) {
+        pParams->nDeliverDepth = pParams->nDeliverThreads;
+    }
+    else if (pParams->nDeliverDepth && !pParams->nDeliverThreads) {
+        pParams->nDeliverThreads = 1;
+    }
+
     if (!pParams->bUseHWLib) { // Intel® VPL cpu plugin
         pParams->nAsyncDepth = 1;
     }
@@ -840,7 +937,7 @@ mfxStatus ParseInputString(char* strInput[], mfxU32 nArgNum, sInputParams* pPara
     return MFX_ERR_NONE;
 }
 
-int main(int argc, char* argv[]) {
+int sample_decode_main(int argc, char* argv[]) {
     sInputParams Params = {}; // input parameters from command line
     CDecodingPipeline
         Pipeline; // pipeline for decoding, includes input file reader, decoder and output file writer
@@ -908,6 +1005,7 @@ int main(int argc, char* argv[]) {
     }
 
     printf("\nDecoding finished\n");
+    Pipeline.PrintAllocatorStats();
 
     return 0;
 }
@@ -0,0 +1,185 @@
+/*############################################################################
+  # Copyright (C) 2005 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "gtest/gtest.h"
+#include "pipeline_decode.h"
+
+mfxStatus ParseInputString(char* strInput[], mfxU32 nArgNum, sInputParams* pParams);
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace {
+struct parse_result {
+    mfxStatus status;
+    sInputParams params;
+};
+
+// ParseInputString expects non-const char*
+parse_result parse(std::vector<std::string> opts) {
+    opts.insert(opts.begin(), { "exe_name", "h264", "-i", "in.h264" });
+    std::vector<char*> args;
+    for (auto& opt : opts) {
+        args.push_back(&opt[0]);
+    }
+
+    parse_result result = {};
+    testing::internal::CaptureStdout();
+    result.status = ParseInputString(&args[0], (mfxU32)args.size(), &result.params);
+    testing::internal::GetCapturedStdout();
+    return result;
+}
+
+// records frame order of written frames, the order is checked by the test
+class TestPipeline : public CDecodingPipeline {
+public:
+    using CDecodingPipeline::DeliverOutput;
+    using CDecodingPipeline::TakeDeliverTicket;
+
+    mfxStatus WriteOutput(mfxFrameSurface1* frame) override {
+        // no lock, writing is serialized by delivery turns
+        frames.push_back(frame->Data.FrameOrder);
+        return MFX_ERR_NONE;
+    }
+
+    std::vector<mfxU32> frames;
+};
+} // namespace
+
+TEST(Decode_CLI, OptionDeliverThreads) {
+    auto result = parse({ "-deliver_threads", "3" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.params.nDeliverThreads, 3u);
+    // every thread needs a queued frame
+    EXPECT_EQ(result.params.nDeliverDepth, 3u);
+
+    result = parse({ "-deliver_threads", "2", "-deliver_queue", "8" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.params.nDeliverThreads, 2u);
+    EXPECT_EQ(result.params.nDeliverDepth, 8u);
+}
+
+TEST(Decode_CLI, OptionDeliverQueue) {
+    auto result = parse({ "-deliver_queue", "4" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.params.nDeliverDepth, 4u);
+    EXPECT_EQ(result.params.nDeliverThreads, 1u);
+
+    result = parse({});
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.params.nDeliverDepth, 0u);
+    EXPECT_EQ(result.params.nDeliverThreads, 0u);
+}
+
+TEST(Decode_CLI, OptionDeliverInvalid) {
+    EXPECT_EQ(parse({ "-deliver_queue", "0" }).status, MFX_ERR_UNSUPPORTED);
+    EXPECT_EQ(parse({ "-deliver_queue", "4x" }).status, MFX_ERR_UNSUPPORTED);
+    EXPECT_EQ(parse({ "-deliver_queue", std::to_string(MSDK_MAX_DELIVER_DEPTH + 1) }).status,
+              MFX_ERR_UNSUPPORTED);
+    EXPECT_EQ(parse({ "-deliver_threads", "0" }).status, MFX_ERR_UNSUPPORTED);
+    EXPECT_EQ(parse({ "-deliver_threads" }).status, MFX_ERR_UNSUPPORTED);
+}
+
+TEST(Decode_Deliver, ThreadsWriteInTicketOrder) {
+    const mfxU32 numFrames  = 200;
+    const mfxU32 numThreads = 4;
+    std::vector<mfxFrameSurface1> surfaces(numFrames);
+    for (mfxU32 i = 0; i < numFrames; i++)
+        surfaces[i].Data.FrameOrder = i;
+
+    TestPipeline pipeline;
+    std::vector<std::thread> threads;
+    for (mfxU32 t = 0; t < numThreads; t++) {
+        threads.emplace_back([&, t]() {
+            // threads come to their turns in random order
+            std::mt19937 rand(t);
+            for (;;) {
+                mfxU64 ticket = pipeline.TakeDeliverTicket();
+                if (ticket >= numFrames)
+                    break;
+                std::this_thread::sleep_for(std::chrono::microseconds(rand() % 200));
+                EXPECT_EQ(pipeline.DeliverOutput(&surfaces[ticket], ticket), MFX_ERR_NONE);
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    ASSERT_EQ(pipeline.frames.size(), numFrames);
+    for (mfxU32 i = 0; i < numFrames; i++)
+        EXPECT_EQ(pipeline.frames[i], i);
+}
+
+TEST(Decode_Deliver, MissingFramePassesTurn) {
+    mfxFrameSurface1 surface = {};
+    surface.Data.FrameOrder  = 1;
+
+    TestPipeline pipeline;
+    mfxU64 first  = pipeline.TakeDeliverTicket();
+    mfxU64 second = pipeline.TakeDeliverTicket();
+    // the later frame waits for the turn of the missing one
+    std::thread waiter([&]() {
+        EXPECT_EQ(pipeline.DeliverOutput(&surface, second), MFX_ERR_NONE);
+    });
+    EXPECT_EQ(pipeline.DeliverOutput(nullptr, first), MFX_ERR_NULL_PTR);
+    waiter.join();
+
+    ASSERT_EQ(pipeline.frames.size(), 1u);
+    EXPECT_EQ(pipeline.frames[0], 1u);
+}
+
+TEST(Decode_LatencyStat, StagesOfFrames) {
+    const msdk_tick ms = CTimer::GetFrequency() / 1000;
+    CDecodeLatencyStat stat;
+    stat.Enable();
+    stat.KeepDeltas(DECODE_LATENCY_DECODE);
+
+    // frame of stream reader is delivered, frame of complete frame reader has no arrival time
+    // and isn't delivered in performance mode, frame which wasn't submitted isn't accounted
+    msdkFrameSurface surface = {};
+    surface.arrival          = 1 * ms;
+    surface.submit           = 3 * ms;
+    surface.synced           = 7 * ms;
+    stat.AddFrame(surface, 8 * ms);
+    surface.arrival = 0;
+    surface.submit  = 10 * ms;
+    surface.synced  = 12 * ms;
+    stat.AddFrame(surface, 0);
+    surface.submit = 0;
+    stat.AddFrame(surface, 20 * ms);
+
+    EXPECT_EQ(stat.GetStage(DECODE_LATENCY_INPUT).GetNumMeasurements(), 1u);
+    EXPECT_EQ(stat.GetStage(DECODE_LATENCY_DECODE).GetNumMeasurements(), 2u);
+    EXPECT_EQ(stat.GetStage(DECODE_LATENCY_DELIVER).GetNumMeasurements(), 1u);
+    EXPECT_EQ(stat.GetStage(DECODE_LATENCY_TOTAL).GetNumMeasurements(), 2u);
+    EXPECT_NEAR(stat.GetStage(DECODE_LATENCY_INPUT).GetAvgTime(false), 2, 1e-6);
+    EXPECT_NEAR(stat.GetStage(DECODE_LATENCY_DELIVER).GetAvgTime(false), 1, 1e-6);
+    EXPECT_NEAR(stat.GetStage(DECODE_LATENCY_TOTAL).GetMaxTime(false), 7, 1e-6);
+    EXPECT_NEAR(stat.GetStage(DECODE_LATENCY_TOTAL).GetMinTime(false), 2, 1e-6);
+
+    testing::internal::CaptureStdout();
+    stat.PrintStatistics(true);
+    std::string out = testing::internal::GetCapturedStdout();
+    EXPECT_NE(out.find("Frame    1, latency=4.00000 ms\nFrame    2, latency=2.00000 ms\n"),
+              std::string::npos);
+    EXPECT_NE(out.find("Deliver  frames:1 avg:1.000 p50:1.000 p90:1.000 p99:1.000 p99.9:1.000 "
+                       "max:1.000\n"),
+              std::string::npos);
+    EXPECT_NE(out.find("AVG=3.00000 ms, MAX=4.00000 ms, MIN=2.00000 ms"), std::string::npos);
+
+    // per-frame latency is printed only for -calc_latency
+    testing::internal::CaptureStdout();
+    stat.PrintStatistics(false);
+    out = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(out.find("Frame"), std::string::npos);
+}
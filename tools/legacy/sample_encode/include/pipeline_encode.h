@@ -15,6 +15,8 @@
 #endif
 
 #include "base_allocator.h"
+#include "frame_pacer.h"
+#include "free_list_pool.h"
 #include "sample_utils.h"
 #include "time_statistics.h"
 
@@ -142,6 +144,7 @@ struct sInputParams {
     bool dispFullSearch;
 
     std::list<std::string> InputFiles;
+    mfxU16 nPrefetchDepth; // number of input frames read ahead by separate thread
 
     sPluginParams pluginParams;
 
@@ -315,8 +318,27 @@ public:
     virtual CTimeStatistics& GetFileStatistics() {
         return m_statFile;
     }
+    // time spent blocked in SyncOperation of the oldest task
+    virtual CTimeStatisticsReal& GetSyncWaitStatistics() {
+        return m_statSyncWait;
+    }
+    mfxU32 GetNumTasksInExecution() const;
+    // average and max number of tasks in execution seen by SynchronizeFirstTask
+    mfxF64 GetAvgOccupancy() const {
+        return m_nSyncCalls ? (mfxF64)m_nTotalOccupancy / m_nSyncCalls : 0;
+    }
+    mfxU32 GetMaxOccupancy() const {
+        return m_nMaxOccupancy;
+    }
+    virtual void PrintStatistics(const char* prefix);
     virtual void Close();
     virtual void SetGpuHangRecoveryFlag();
+    // max number of tasks following the oldest one, which are polled without waiting. Done
+    // task keeps a copy of its output till older ones are written and is given back to the
+    // pool at once, so slow frame doesn't hold completed ones. 0 - tasks are synchronized
+    // and written one by one in submission order
+    // should be called after Init
+    virtual void SetReorderWindow(mfxU32 nTasks);
     virtual void ClearTasks();
 
     msdk_tick firstOut_total;
@@ -328,17 +350,50 @@ protected:
     CEncTaskPool(CEncTaskPool const&)                  = delete;
     const CEncTaskPool& operator=(CEncTaskPool const&) = delete;
 
+    // handed out task, or output of task which is done while older ones are in execution
+    struct SubmittedTask {
+        mfxU32 index; // index of the task, CFreeList::INVALID_INDEX once it's retired
+        mfxU32 output; // slot of m_outputs which keeps data of retired task
+        void* pWriter;
+        mfxBitstream bs; // output of retired task
+    };
+
     sTask* m_pTasks;
     mfxU32 m_nPoolSize;
     mfxU32 m_nTaskBufferStart;
+    // task is taken from the free list when GetFreeTask hands it out and is returned again
+    // till caller sets its sync point, so sync of older tasks can't give it to other frame
+    CFreeList m_freeTasks;
+    // handed out tasks in submission order, the last one may be not submitted yet. Besides
+    // tasks of the pool it holds at most reorder window of retired ones
+    CFixedQueue<SubmittedTask> m_submitted;
+    // buffers for output of retired tasks, one per task preallocated by the size of task
+    // bitstream, so retiring doesn't allocate memory
+    std::vector<std::vector<mfxU8>> m_outputs;
+    CFreeList m_freeOutputs;
+    // output bitstreams alternate by submission order, as tasks are retired out of order
+    void* m_pWriter;
+    void* m_pOtherWriter;
+    mfxU64 m_nHandedOut;
 
     bool m_bGpuHangRecovery;
+    mfxU32 m_nReorderWindow;
 
     MFXVideoSession* m_pmfxSession;
 
     CTimeStatistics m_statOverall;
     CTimeStatistics m_statFile;
+    CTimeStatisticsReal m_statSyncWait;
+    mfxU64 m_nSyncCalls;
+    mfxU64 m_nTotalOccupancy;
+    mfxU32 m_nMaxOccupancy;
+    mfxU64 m_nWritten; // number of written tasks
+    mfxU64 m_nRetired; // tasks given back to the pool while older ones were in execution
     virtual mfxU32 GetFreeTaskIndex();
+    bool IsInExecution(const SubmittedTask& task) const;
+    mfxU32 RetireCompletedTasks();
+    mfxStatus WriteFirstTask();
+    mfxStatus WriteCompletedTasks();
 };
 
 /* This class implements a pipeline with 2 mfx components: vpp (video preprocessing) and encode */
@@ -447,7 +502,8 @@ protected:
     CTimeStatisticsReal m_statOverall;
     CTimeStatisticsReal m_statFile;
 
-    FPSLimiter m_fpsLimiter;
+    CFramePacer m_framePacer;
+    CDeviceBusyWaiter m_busyWaiter;
 
     eAPIVersion m_verSessionInit;
     bool m_bReadByFrame;
@@ -496,6 +552,8 @@ protected:
     virtual void LoadNextControl(mfxEncodeCtrl*& pCtrl, mfxU32 encSurfIdx);
 
     virtual mfxStatus GetFreeTask(sTask** ppTask);
+    // waits after MFX_WRN_DEVICE_BUSY, completes the oldest task in flight if there is one
+    virtual mfxStatus WaitForDevice(mfxU32 attempt);
     virtual MFXVideoSession& GetFirstSession() {
         return m_mfxSession;
     }
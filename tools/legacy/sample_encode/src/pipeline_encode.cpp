@@ -84,7 +84,16 @@ CEncTaskPool::CEncTaskPool()
     m_pmfxSession      = NULL;
     m_nTaskBufferStart = 0;
     m_nPoolSize        = 0;
+    m_pWriter          = NULL;
+    m_pOtherWriter     = NULL;
+    m_nHandedOut       = 0;
     m_bGpuHangRecovery = false;
+    m_nReorderWindow   = 0;
+    m_nSyncCalls       = 0;
+    m_nTotalOccupancy  = 0;
+    m_nMaxOccupancy    = 0;
+    m_nWritten         = 0;
+    m_nRetired         = 0;
 }
 
 CEncTaskPool::~CEncTaskPool() {
@@ -116,11 +125,26 @@ mfxStatus CEncTaskPool::Init(MFXVideoSession* pmfxSession,
     if (pOtherWriter && (0 != nPoolSize % 2))
         return MFX_ERR_UNDEFINED_BEHAVIOR;
 
-    m_pmfxSession = pmfxSession;
-    m_nPoolSize   = nPoolSize;
+    m_pmfxSession    = pmfxSession;
+    m_nPoolSize      = nPoolSize;
+    m_pWriter        = pWriter;
+    m_pOtherWriter   = pOtherWriter;
+    m_nHandedOut     = 0;
+    m_nReorderWindow = nPoolSize;
+
+    m_nSyncCalls      = 0;
+    m_nTotalOccupancy = 0;
+    m_nMaxOccupancy   = 0;
+    m_nWritten        = 0;
+    m_nRetired        = 0;
+    m_statSyncWait.ResetStatistics();
 
     m_pTasks = new sTask[m_nPoolSize];
     MSDK_CHECK_POINTER(m_pTasks, MFX_ERR_MEMORY_ALLOC);
+    m_freeTasks.Init(m_nPoolSize);
+    m_submitted.Init(2 * m_nPoolSize);
+    m_outputs.assign(m_nPoolSize, std::vector<mfxU8>(nBufferSize));
+    m_freeOutputs.Init(m_nPoolSize);
 
     mfxStatus sts = MFX_ERR_NONE;
 
@@ -150,12 +174,32 @@ mfxStatus CEncTaskPool::SynchronizeFirstTask(mfxU32 syncOpTimeout) {
     mfxStatus sts = MFX_ERR_NONE;
     bool bGpuHang = false;
 
-    // non-null sync point indicates that task is in execution
-    if (NULL != m_pTasks[m_nTaskBufferStart].EncSyncP) {
+    mfxU32 occupancy = GetNumTasksInExecution();
+    m_nTotalOccupancy += occupancy;
+    m_nSyncCalls++;
+    m_nMaxOccupancy = std::max(m_nMaxOccupancy, occupancy);
+
+    mfxU32 nRetired = RetireCompletedTasks();
+
+    if (!m_submitted.empty() && CFreeList::INVALID_INDEX == m_submitted.front().index) {
+        // output of the oldest task is kept already
+        sts = WriteCompletedTasks();
+        MSDK_CHECK_STATUS(sts, "WriteCompletedTasks failed");
+    }
+    else if (nRetired) {
+        // caller can submit new frames while the oldest one is still in execution
+        sts = MFX_ERR_NONE;
+    }
+    // the oldest task is not in execution only if it's handed out for submission and nothing
+    // else is in flight
+    else if (!m_submitted.empty() && IsInExecution(m_submitted.front())) {
+        m_nTaskBufferStart = m_submitted.front().index;
         int iteration = 0;
         do {
+            m_statSyncWait.StartTimeMeasurement();
             sts =
                 m_pmfxSession->SyncOperation(m_pTasks[m_nTaskBufferStart].EncSyncP, syncOpTimeout);
+            m_statSyncWait.StopTimeMeasurement();
 
             msdk_tick stop = time_get_tick();
 
@@ -178,25 +222,15 @@ mfxStatus CEncTaskPool::SynchronizeFirstTask(mfxU32 syncOpTimeout) {
             // MFX_WRN_IN_EXECUTION has to be reported
             MSDK_CHECK_NOERROR_STATUS_NO_RET(sts, "SyncOperation fail or timeout");
 
-            if (MFX_ERR_NONE == sts) {
+            // tasks are cleared after GPU hang, nothing is left to write
+            if (MFX_ERR_NONE == sts && !bGpuHang) {
                 lastOut_total += stop - lastOut_start;
 
-                m_statFile.StartTimeMeasurement();
-                sts = m_pTasks[m_nTaskBufferStart].WriteBitstream();
-                m_statFile.StopTimeMeasurement();
-                MSDK_CHECK_STATUS(sts, "m_pTasks[m_nTaskBufferStart].WriteBitstream failed");
-
-                sts = m_pTasks[m_nTaskBufferStart].Reset();
-                MSDK_CHECK_STATUS(sts, "m_pTasks[m_nTaskBufferStart].Reset failed");
+                sts = WriteFirstTask();
+                MSDK_CHECK_STATUS(sts, "WriteFirstTask failed");
 
-                // move task buffer start to the next executing task
-                // the first transform frame to the right with non zero sync point
-                for (mfxU32 i = 0; i < m_nPoolSize; i++) {
-                    m_nTaskBufferStart = (m_nTaskBufferStart + 1) % m_nPoolSize;
-                    if (NULL != m_pTasks[m_nTaskBufferStart].EncSyncP) {
-                        break;
-                    }
-                }
+                sts = WriteCompletedTasks();
+                MSDK_CHECK_STATUS(sts, "WriteCompletedTasks failed");
             }
             else if (MFX_ERR_NONE_PARTIAL_OUTPUT == sts) {
                 m_statFile.StartTimeMeasurement();
@@ -237,21 +271,137 @@ mfxStatus CEncTaskPool::SynchronizeFirstTask(mfxU32 syncOpTimeout) {
     return bGpuHang ? MFX_ERR_GPU_HANG : sts;
 }
 
-mfxU32 CEncTaskPool::GetFreeTaskIndex() {
-    mfxU32 off = 0;
+mfxU32 CEncTaskPool::RetireCompletedTasks() {
+    // tasks behind the oldest one are polled without waiting (e.g. with MFE they are done in
+    // batches), output of done ones is copied and tasks are given back to the pool. Tasks in
+    // execution, partial output and errors are left to blocking sync of the oldest task
+    mfxU32 nRetired = 0;
+    for (mfxU32 i = 1; i <= m_nReorderWindow && i < m_submitted.size(); i++) {
+        SubmittedTask& submitted = m_submitted[i];
+        if (!IsInExecution(submitted) || !m_freeOutputs.GetNumFree())
+            continue;
+
+        sTask& task = m_pTasks[submitted.index];
+        if (MFX_ERR_NONE != m_pmfxSession->SyncOperation(task.EncSyncP, 0))
+            continue;
+
+        // buffer grows only if task bitstream was extended after Init
+        submitted.output           = m_freeOutputs.Acquire();
+        std::vector<mfxU8>& output = m_outputs[submitted.output];
+        if (output.size() < task.mfxBS.DataLength)
+            output.resize(task.mfxBS.DataLength);
+        std::copy(task.mfxBS.Data + task.mfxBS.DataOffset,
+                  task.mfxBS.Data + task.mfxBS.DataOffset + task.mfxBS.DataLength,
+                  output.begin());
+        submitted.pWriter        = task.pWriter;
+        submitted.bs             = task.mfxBS;
+        submitted.bs.Data        = output.data();
+        submitted.bs.DataOffset  = 0;
+        submitted.bs.MaxLength   = submitted.bs.DataLength;
+        submitted.bs.NumExtParam = 0;
+        submitted.bs.ExtParam    = NULL;
+
+        task.Reset();
+        m_freeTasks.Release(submitted.index);
+        submitted.index = CFreeList::INVALID_INDEX;
+        nRetired++;
+    }
+    m_nRetired += nRetired;
+    return nRetired;
+}
 
-    if (m_pTasks) {
-        for (off = 0; off < m_nPoolSize; off++) {
-            if (NULL == m_pTasks[(m_nTaskBufferStart + off) % m_nPoolSize].EncSyncP) {
+mfxStatus CEncTaskPool::WriteFirstTask() {
+    SubmittedTask& submitted = m_submitted.front();
+    mfxStatus sts            = MFX_ERR_NONE;
+
+    m_statFile.StartTimeMeasurement();
+    if (CFreeList::INVALID_INDEX == submitted.index) {
+        if (submitted.pWriter)
+            sts = ((CSmplBitstreamWriter*)submitted.pWriter)->WriteNextFrame(&submitted.bs);
+    }
+    else {
+        sts = m_pTasks[m_nTaskBufferStart].WriteBitstream();
+    }
+    m_statFile.StopTimeMeasurement();
+    MSDK_CHECK_STATUS(sts, "WriteBitstream failed");
+
+    if (CFreeList::INVALID_INDEX != submitted.index) {
+        sts = m_pTasks[m_nTaskBufferStart].Reset();
+        MSDK_CHECK_STATUS(sts, "m_pTasks[m_nTaskBufferStart].Reset failed");
+        m_freeTasks.Release(m_nTaskBufferStart);
+    }
+    else {
+        m_freeOutputs.Release(submitted.output);
+    }
+    m_submitted.pop_front();
+    m_nWritten++;
+
+    // move task buffer start to the next executing task
+    if (!m_submitted.empty() && CFreeList::INVALID_INDEX != m_submitted.front().index)
+        m_nTaskBufferStart = m_submitted.front().index;
+    return MFX_ERR_NONE;
+}
+
+mfxStatus CEncTaskPool::WriteCompletedTasks() {
+    // retired tasks and tasks which are done by now are written in submission order
+    for (mfxU32 i = 0; i < m_nReorderWindow && !m_submitted.empty(); i++) {
+        const SubmittedTask& submitted = m_submitted.front();
+        if (IsInExecution(submitted)) {
+            if (MFX_ERR_NONE != m_pmfxSession->SyncOperation(m_pTasks[submitted.index].EncSyncP,
+                                                             0))
                 break;
-            }
+            lastOut_total += time_get_tick() - lastOut_start;
+        }
+        else if (CFreeList::INVALID_INDEX != submitted.index) {
+            break; // not submitted yet
         }
+
+        mfxStatus sts = WriteFirstTask();
+        MSDK_CHECK_STATUS(sts, "WriteFirstTask failed");
     }
+    return MFX_ERR_NONE;
+}
 
-    if (off >= m_nPoolSize)
+bool CEncTaskPool::IsInExecution(const SubmittedTask& task) const {
+    return CFreeList::INVALID_INDEX != task.index && NULL != m_pTasks[task.index].EncSyncP;
+}
+
+mfxU32 CEncTaskPool::GetNumTasksInExecution() const {
+    mfxU32 nTasks = 0;
+    for (mfxU32 i = 0; i < m_submitted.size(); i++) {
+        if (IsInExecution(m_submitted[i]))
+            nTasks++;
+    }
+    return nTasks;
+}
+
+mfxU32 CEncTaskPool::GetFreeTaskIndex() {
+    if (!m_pTasks)
         return m_nPoolSize;
 
-    return (m_nTaskBufferStart + off) % m_nPoolSize;
+    // task which isn't submitted yet is returned again, e.g. after device busy or more data
+    if (!m_submitted.empty()) {
+        const SubmittedTask& last = m_submitted.back();
+        if (CFreeList::INVALID_INDEX != last.index && !IsInExecution(last))
+            return last.index;
+    }
+
+    mfxU32 index = m_freeTasks.Acquire();
+    if (index == CFreeList::INVALID_INDEX)
+        return m_nPoolSize;
+
+    SubmittedTask submitted = {};
+    submitted.index         = index;
+    submitted.output        = CFreeList::INVALID_INDEX;
+    if (!m_submitted.push_back(submitted)) {
+        m_freeTasks.Release(index, true);
+        return m_nPoolSize;
+    }
+
+    if (m_pOtherWriter)
+        m_pTasks[index].pWriter = (m_nHandedOut % 2) ? m_pOtherWriter : m_pWriter;
+    m_nHandedOut++;
+    return index;
 }
 
 mfxStatus CEncTaskPool::GetFreeTask(sTask** ppTask) {
@@ -278,21 +428,52 @@ void CEncTaskPool::Close() {
     }
 
     MSDK_SAFE_DELETE_ARRAY(m_pTasks);
+    m_freeTasks.Close();
+    m_submitted.clear();
+    m_outputs.clear();
+    m_freeOutputs.Close();
 
     m_pmfxSession      = NULL;
     m_nTaskBufferStart = 0;
     m_nPoolSize        = 0;
+    m_nHandedOut       = 0;
 }
 
 void CEncTaskPool::SetGpuHangRecoveryFlag() {
     m_bGpuHangRecovery = true;
 }
 
+void CEncTaskPool::SetReorderWindow(mfxU32 nTasks) {
+    m_nReorderWindow = std::min(nTasks, m_nPoolSize);
+    // at most reorder window of retired tasks waits for older ones
+    m_outputs.resize(m_nReorderWindow);
+    m_freeOutputs.Init(m_nReorderWindow);
+}
+
+void CEncTaskPool::PrintStatistics(const char* prefix) {
+    if (!m_nSyncCalls)
+        return;
+    printf("%s occupancy avg:%.1lf max:%u of %u, written:%llu(%llu retired early), "
+           "sync wait:%.3lfms(avg %.3lfms)\n",
+           prefix,
+           (double)GetAvgOccupancy(),
+           m_nMaxOccupancy,
+           m_nPoolSize,
+           (unsigned long long int)m_nWritten,
+           (unsigned long long int)m_nRetired,
+           (double)m_statSyncWait.GetTotalTime(false),
+           (double)m_statSyncWait.GetAvgTime(false));
+}
+
 void CEncTaskPool::ClearTasks() {
     for (size_t i = 0; i < m_nPoolSize; i++) {
         m_pTasks[i].Reset();
     }
     m_nTaskBufferStart = 0;
+    m_freeTasks.ReleaseAll();
+    m_submitted.clear();
+    m_freeOutputs.ReleaseAll();
+    m_nHandedOut = 0;
 }
 
 mfxStatus sTask::Init(mfxU32 nBufferSize, mfxU32 nCodecID, void* pwriter, bool bHWLib) {
@@ -1359,7 +1540,8 @@ CEncodingPipeline::CEncodingPipeline()
           m_bPartialOutput(false),
           m_statOverall(),
           m_statFile(),
-          m_fpsLimiter(),
+          m_framePacer(),
+          m_busyWaiter(),
           m_verSessionInit(API_2X),
           m_bReadByFrame(false) {
 }
@@ -1857,6 +2039,7 @@ mfxStatus CEncodingPipeline::Init(sInputParams* pParams) {
     // Preparing readers and writers
     if (!isV4L2InputEnabled) {
         // prepare input file reader
+        m_FileReader.SetPrefetchDepth(pParams->nPrefetchDepth);
         sts = m_FileReader.Init(pParams->InputFiles, pParams->FileInputFourCC, readerShift);
         MSDK_CHECK_STATUS(sts, "m_FileReader.Init failed");
     }
@@ -1867,7 +2050,7 @@ mfxStatus CEncodingPipeline::Init(sInputParams* pParams) {
     // set memory type
     m_memType  = pParams->memType;
     m_nPerfOpt = pParams->nPerfOpt;
-    m_fpsLimiter.Reset(pParams->nMaxFPS);
+    m_framePacer.Reset(pParams->nMaxFPS);
 
     m_bSoftRobustFlag = pParams->bSoftRobustFlag;
 
@@ -2004,6 +2187,9 @@ void CEncodingPipeline::Close() {
         mfxF64 ProcDeltaTime = m_statOverall.GetDeltaTime() - m_statFile.GetDeltaTime() -
                                m_TaskPool.GetFileStatistics().GetDeltaTime();
         printf("Encoding fps: %.0f\n", m_FileWriters.first->m_nProcessedFramesNum / ProcDeltaTime);
+        m_framePacer.PrintStatistics("Pacing:");
+        m_busyWaiter.PrintStatistics("Device busy:");
+        m_TaskPool.PrintStatistics("Task pool:");
 
         if (m_bPartialOutput) {
             const msdk_tick freq = time_get_frequency();
@@ -2162,6 +2348,9 @@ mfxStatus CEncodingPipeline::ResetMFXComponents(sInputParams* pParams) {
 
     if (m_bSoftRobustFlag)
         m_TaskPool.SetGpuHangRecoveryFlag();
+    // partial output of a later task can't be written before the oldest one is done
+    if (pParams->PartialOutputMode)
+        m_TaskPool.SetReorderWindow(0);
 
     sts = FillBuffers();
     MSDK_CHECK_STATUS(sts, "FillBuffers failed");
@@ -2250,7 +2439,7 @@ mfxStatus CEncodingPipeline::GetFreeTask(sTask** ppTask) {
     if (MFX_ERR_NOT_FOUND == sts) {
         sts = m_TaskPool.SynchronizeFirstTask(m_nSyncOpTimeout);
         if (MFX_ERR_NONE == sts) {
-            m_fpsLimiter.Work();
+            m_framePacer.Work();
         }
         if (sts == MFX_ERR_GPU_HANG && m_bSoftRobustFlag) {
             m_TaskPool.ClearTasks();
@@ -2267,6 +2456,24 @@ mfxStatus CEncodingPipeline::GetFreeTask(sTask** ppTask) {
     return sts;
 }
 
+mfxStatus CEncodingPipeline::WaitForDevice(mfxU32 attempt) {
+    // with GPU hang recovery failed sync clears all tasks including the one being submitted,
+    // so there it only backs off
+    if (m_bSoftRobustFlag)
+        return m_busyWaiter.Wait(attempt);
+
+    // task being submitted is kept by the pool, so sync only retires older ones and returns
+    // MFX_ERR_NOT_FOUND if nothing else is in flight, then the waiter backs off
+
+    return m_busyWaiter.Wait(attempt, [this]() {
+        mfxStatus sts = m_TaskPool.SynchronizeFirstTask(m_nSyncOpTimeout);
+        if (MFX_ERR_NONE == sts) {
+            m_framePacer.Work();
+        }
+        return sts;
+    });
+}
+
 mfxStatus CEncodingPipeline::ConfigTCBRCTest(mfxFrameSurface1* pSurf) {
     mfxStatus sts = MFX_ERR_NONE;
     if (m_bTCBRCFileMode && pSurf) {
@@ -2410,6 +2617,7 @@ mfxStatus CEncodingPipeline::Run() {
         // perform preprocessing if required
         if (m_pmfxVPP) {
             bVppMultipleOutput = false; // reset the flag before a call to VPP
+            mfxU32 nBusyAttempt = 0;
             for (;;) {
                 sts = m_pmfxVPP->RunFrameVPPAsync(
                     skipLoadingNextFrame ? NULL : &m_pVppSurfaces[nVppSurfIdx],
@@ -2419,8 +2627,11 @@ mfxStatus CEncodingPipeline::Run() {
 
                 if (MFX_ERR_NONE < sts && !VppSyncPoint) // repeat the call if warning and no output
                 {
-                    if (MFX_WRN_DEVICE_BUSY == sts)
-                        MSDK_SLEEP(1); // wait if device is busy
+                    if (MFX_WRN_DEVICE_BUSY == sts) {
+                        // wait if device is busy
+                        sts = WaitForDevice(nBusyAttempt++);
+                        MSDK_CHECK_STATUS(sts, "WaitForDevice failed");
+                    }
                 }
                 else if (MFX_ERR_NONE < sts && VppSyncPoint) {
                     sts = MFX_ERR_NONE; // ignore warnings if output is available
@@ -2455,6 +2666,7 @@ mfxStatus CEncodingPipeline::Run() {
             VppSyncPoint = NULL;
         }
 
+        mfxU32 nBusyAttempt = 0;
         for (;;) {
             if (!m_bQPFileMode)
                 InsertIDR(pCurrentTask->encCtrl, m_bInsertIDR);
@@ -2478,8 +2690,11 @@ mfxStatus CEncodingPipeline::Run() {
             if (MFX_ERR_NONE < sts &&
                 !pCurrentTask->EncSyncP) // repeat the call if warning and no output
             {
-                if (MFX_WRN_DEVICE_BUSY == sts)
-                    MSDK_SLEEP(1); // wait if device is busy
+                if (MFX_WRN_DEVICE_BUSY == sts) {
+                    // wait if device is busy
+                    sts = WaitForDevice(nBusyAttempt++);
+                    MSDK_CHECK_STATUS(sts, "WaitForDevice failed");
+                }
             }
             else if (MFX_ERR_NONE < sts && pCurrentTask->EncSyncP) {
                 sts = MFX_ERR_NONE; // ignore warnings if output is available
@@ -2518,6 +2733,7 @@ mfxStatus CEncodingPipeline::Run() {
             nEncSurfIdx = GetFreeSurface(m_pEncSurfaces, m_EncResponse.NumFrameActual);
             MSDK_CHECK_ERROR(nEncSurfIdx, MSDK_INVALID_SURF_IDX, MFX_ERR_MEMORY_ALLOC);
 
+            mfxU32 nBusyAttempt = 0;
             for (;;) {
                 sts = m_pmfxVPP->RunFrameVPPAsync(NULL,
                                                   &m_pEncSurfaces[nEncSurfIdx],
@@ -2526,8 +2742,11 @@ mfxStatus CEncodingPipeline::Run() {
 
                 if (MFX_ERR_NONE < sts && !VppSyncPoint) // repeat the call if warning and no output
                 {
-                    if (MFX_WRN_DEVICE_BUSY == sts)
-                        MSDK_SLEEP(1); // wait if device is busy
+                    if (MFX_WRN_DEVICE_BUSY == sts) {
+                        // wait if device is busy
+                        sts = WaitForDevice(nBusyAttempt++);
+                        MSDK_CHECK_STATUS(sts, "WaitForDevice failed");
+                    }
                 }
                 else if (MFX_ERR_NONE < sts && VppSyncPoint) {
                     sts = MFX_ERR_NONE; // ignore warnings if output is available
@@ -2554,6 +2773,7 @@ mfxStatus CEncodingPipeline::Run() {
                 VppSyncPoint = NULL;
             }
 
+            nBusyAttempt = 0;
             for (;;) {
                 if (!m_bQPFileMode)
                     InsertIDR(pCurrentTask->encCtrl, m_bInsertIDR);
@@ -2567,8 +2787,11 @@ mfxStatus CEncodingPipeline::Run() {
                 if (MFX_ERR_NONE < sts &&
                     !pCurrentTask->EncSyncP) // repeat the call if warning and no output
                 {
-                    if (MFX_WRN_DEVICE_BUSY == sts)
-                        MSDK_SLEEP(1); // wait if device is busy
+                    if (MFX_WRN_DEVICE_BUSY == sts) {
+                        // wait if device is busy
+                        sts = WaitForDevice(nBusyAttempt++);
+                        MSDK_CHECK_STATUS(sts, "WaitForDevice failed");
+                    }
                 }
                 else if (MFX_ERR_NONE < sts && pCurrentTask->EncSyncP) {
                     sts = MFX_ERR_NONE; // ignore warnings if output is available
@@ -2599,6 +2822,7 @@ mfxStatus CEncodingPipeline::Run() {
         sts = GetFreeTask(&pCurrentTask);
         MSDK_BREAK_ON_ERROR(sts);
 
+        mfxU32 nBusyAttempt = 0;
         for (;;) {
             if (!m_bQPFileMode)
                 InsertIDR(pCurrentTask->encCtrl, m_bInsertIDR);
@@ -2612,8 +2836,11 @@ mfxStatus CEncodingPipeline::Run() {
             if (MFX_ERR_NONE < sts &&
                 !pCurrentTask->EncSyncP) // repeat the call if warning and no output
             {
-                if (MFX_WRN_DEVICE_BUSY == sts)
-                    MSDK_SLEEP(1); // wait if device is busy
+                if (MFX_WRN_DEVICE_BUSY == sts) {
+                    // wait if device is busy
+                    sts = WaitForDevice(nBusyAttempt++);
+                    MSDK_CHECK_STATUS(sts, "WaitForDevice failed");
+                }
             }
             else if (MFX_ERR_NONE < sts && pCurrentTask->EncSyncP) {
                 sts = MFX_ERR_NONE; // ignore warnings if output is available
@@ -2642,7 +2869,7 @@ mfxStatus CEncodingPipeline::Run() {
     while (MFX_ERR_NONE == sts) {
         sts = m_TaskPool.SynchronizeFirstTask(m_nSyncOpTimeout);
         if (MFX_ERR_NONE == sts) {
-            m_fpsLimiter.Work();
+            m_framePacer.Work();
         }
         if (sts == MFX_ERR_GPU_HANG && m_bSoftRobustFlag) {
             m_bInsertIDR = true;
@@ -84,6 +84,8 @@ mfxStatus CResourcesPool::InitTaskPools(CSmplBitstreamWriter* pWriter,
                                                      bUseHWLib);
 
         MSDK_CHECK_STATUS(sts, "m_resources[i].TaskPool.Init failed");
+        // slices of all regions are written one frame per sync in the same order
+        m_resources[i].TaskPool.SetReorderWindow(0);
     }
     return MFX_ERR_NONE;
 }
@@ -396,6 +398,7 @@ void CRegionEncodingPipeline::Close() {
         printf("Frame number: %u   \r", (unsigned int)frameNum);
         printf("\nEncode fps: %.2lf\n",
                (double)(m_timeAll ? frameNum * ((double)time_get_frequency()) / m_timeAll : 0.0));
+        m_busyWaiter.PrintStatistics("Device busy:");
     }
 
     DeallocateExtMVCBuffers();
@@ -530,6 +533,7 @@ mfxStatus CRegionEncodingPipeline::Run() {
             sts = m_resources.GetFreeTask(regId, &pCurrentTask);
             MSDK_CHECK_STATUS(sts, "m_resources.GetFreeTask failed");
 
+            mfxU32 nBusyAttempt = 0;
             for (;;) {
                 timeCurStart = time_get_tick();
                 // at this point surface for encoder contains a frame from a file
@@ -549,8 +553,10 @@ mfxStatus CRegionEncodingPipeline::Run() {
                 if (MFX_ERR_NONE < sts &&
                     !pCurrentTask->EncSyncP) // repeat the call if warning and no output
                 {
-                    if (MFX_WRN_DEVICE_BUSY == sts)
-                        MSDK_SLEEP(1); // wait if device is busy
+                    if (MFX_WRN_DEVICE_BUSY == sts) {
+                        // wait if device is busy, tasks of all regions are synced together only
+                        m_busyWaiter.Wait(nBusyAttempt++);
+                    }
                 }
                 else if (MFX_ERR_NONE < sts && pCurrentTask->EncSyncP) {
                     sts = MFX_ERR_NONE; // ignore warnings if output is available
@@ -591,6 +597,7 @@ mfxStatus CRegionEncodingPipeline::Run() {
             sts = m_resources.GetFreeTask(regId, &pCurrentTask);
             MSDK_CHECK_STATUS(sts, "m_resources.GetFreeTask failed");
 
+            mfxU32 nBusyAttempt = 0;
             for (;;) {
                 timeCurStart = time_get_tick();
 
@@ -605,8 +612,10 @@ mfxStatus CRegionEncodingPipeline::Run() {
                 if (MFX_ERR_NONE < sts &&
                     !pCurrentTask->EncSyncP) // repeat the call if warning and no output
                 {
-                    if (MFX_WRN_DEVICE_BUSY == sts)
-                        MSDK_SLEEP(1); // wait if device is busy
+                    if (MFX_WRN_DEVICE_BUSY == sts) {
+                        // wait if device is busy, tasks of all regions are synced together only
+                        m_busyWaiter.Wait(nBusyAttempt++);
+                    }
                 }
                 else if (MFX_ERR_NONE < sts && pCurrentTask->EncSyncP) {
                     sts = MFX_ERR_NONE; // ignore warnings if output is available
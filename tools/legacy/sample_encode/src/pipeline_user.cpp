@@ -346,6 +346,7 @@ mfxStatus CUserPipeline::Run() {
             RotateSyncPoint = NULL;
         }
 
+        mfxU32 nBusyAttempt = 0;
         for (;;) {
             InsertIDR(pCurrentTask->encCtrl, m_bInsertIDR);
             m_bInsertIDR = false;
@@ -358,8 +359,11 @@ mfxStatus CUserPipeline::Run() {
             if (MFX_ERR_NONE < sts &&
                 !pCurrentTask->EncSyncP) // repeat the call if warning and no output
             {
-                if (MFX_WRN_DEVICE_BUSY == sts)
-                    MSDK_SLEEP(1); // wait if device is busy
+                if (MFX_WRN_DEVICE_BUSY == sts) {
+                    // wait if device is busy
+                    sts = WaitForDevice(nBusyAttempt++);
+                    MSDK_CHECK_STATUS(sts, "WaitForDevice failed");
+                }
             }
             else if (MFX_ERR_NONE < sts && pCurrentTask->EncSyncP) {
                 sts = MFX_ERR_NONE; // ignore warnings if output is available
@@ -387,6 +391,7 @@ mfxStatus CUserPipeline::Run() {
         sts = GetFreeTask(&pCurrentTask);
         MSDK_BREAK_ON_ERROR(sts);
 
+        mfxU32 nBusyAttempt = 0;
         for (;;) {
             InsertIDR(pCurrentTask->encCtrl, m_bInsertIDR);
             m_bInsertIDR = false;
@@ -399,8 +404,11 @@ mfxStatus CUserPipeline::Run() {
             if (MFX_ERR_NONE < sts &&
                 !pCurrentTask->EncSyncP) // repeat the call if warning and no output
             {
-                if (MFX_WRN_DEVICE_BUSY == sts)
-                    MSDK_SLEEP(1); // wait if device is busy
+                if (MFX_WRN_DEVICE_BUSY == sts) {
+                    // wait if device is busy
+                    sts = WaitForDevice(nBusyAttempt++);
+                    MSDK_CHECK_STATUS(sts, "WaitForDevice failed");
+                }
             }
             else if (MFX_ERR_NONE < sts && pCurrentTask->EncSyncP) {
                 sts = MFX_ERR_NONE; // ignore warnings if output is available
@@ -149,6 +149,8 @@ void PrintHelp(char* strAppName, const char* strErrorMessage, ...) {
     printf(
         "   [-async]                 - depth of asynchronous pipeline. default value is 4. must be between 1 and 20.\n");
     printf("   [-gpucopy::<on,off>] Enable or disable GPU copy mode\n");
+    printf(
+        "   [-prefetch N]            - read N input frames ahead from separate thread. by default input is read by encoding thread\n");
     printf("   [-robust:soft]           - Recovery from GPU hang by inserting an IDR\n");
     printf("   [-vbr]                   - variable bitrate control\n");
     printf("   [-cbr]                   - constant bitrate control\n");
@@ -1108,6 +1110,14 @@ mfxStatus ParseInputString(char* strInput[], mfxU32 nArgNum, sInputParams* pPara
                 return MFX_ERR_UNSUPPORTED;
             }
         }
+        else if (msdk_match(strInput[i], "-prefetch")) {
+            VAL_CHECK(i + 1 >= nArgNum, i, strInput[i]);
+
+            if (MFX_ERR_NONE != msdk_opt_read(strInput[++i], pParams->nPrefetchDepth)) {
+                PrintHelp(strInput[0], "Prefetch depth is invalid");
+                return MFX_ERR_UNSUPPORTED;
+            }
+        }
         else if (msdk_match(strInput[i], "-CodecLevel")) {
             VAL_CHECK(i + 1 >= nArgNum, i, strInput[i]);
             if (MFX_ERR_NONE != msdk_opt_read(strInput[++i], pParams->CodecLevel)) {
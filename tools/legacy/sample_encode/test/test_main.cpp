@@ -0,0 +1,230 @@
+/*############################################################################
+  # Copyright (C) 2005 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include <set>
+#include <vector>
+#include "gtest/gtest.h"
+#include "pipeline_encode.h"
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace {
+// task is done when it's synced with non-zero timeout or marked done by the test
+class TestSession : public MFXVideoSession {
+public:
+    mfxStatus SyncOperation(mfxSyncPoint syncp, mfxU32 wait) override {
+        if (wait)
+            done.insert(syncp);
+        return done.count(syncp) ? MFX_ERR_NONE : MFX_WRN_IN_EXECUTION;
+    }
+
+    std::set<mfxSyncPoint> done;
+};
+
+// records the first byte of each written bitstream, it is the frame number
+class TestWriter : public CSmplBitstreamWriter {
+public:
+    using CSmplBitstreamWriter::WriteNextFrame;
+    mfxStatus WriteNextFrame(mfxBitstream* pMfxBitstream, bool, bool) override {
+        frames.push_back(pMfxBitstream->Data[pMfxBitstream->DataOffset]);
+        return MFX_ERR_NONE;
+    }
+
+    std::vector<mfxU8> frames;
+};
+
+// records written bitstreams and buffers they were written from
+class ContentWriter : public CSmplBitstreamWriter {
+public:
+    using CSmplBitstreamWriter::WriteNextFrame;
+    mfxStatus WriteNextFrame(mfxBitstream* pMfxBitstream, bool, bool) override {
+        const mfxU8* data = pMfxBitstream->Data + pMfxBitstream->DataOffset;
+        frames.emplace_back(data, data + pMfxBitstream->DataLength);
+        buffers.insert(pMfxBitstream->Data);
+        return MFX_ERR_NONE;
+    }
+
+    std::vector<std::vector<mfxU8>> frames;
+    std::set<const mfxU8*> buffers;
+};
+
+mfxSyncPoint TestSyncPoint(mfxU8 frame) {
+    return reinterpret_cast<mfxSyncPoint>((size_t)frame + 1);
+}
+
+void SubmitTask(sTask* task, mfxU8 frame) {
+    task->mfxBS.Data[0]    = frame;
+    task->mfxBS.DataLength = 1;
+    task->EncSyncP         = TestSyncPoint(frame);
+}
+} // namespace
+
+TEST(Encode_TaskPool, DeviceBusyWithOneTaskInFlight) {
+    TestSession session;
+    TestWriter writer;
+    CEncTaskPool pool;
+    ASSERT_EQ(pool.Init(&session, &writer, 4, 1024, MFX_CODEC_AVC), MFX_ERR_NONE);
+
+    sTask* task = nullptr;
+    ASSERT_EQ(pool.GetFreeTask(&task), MFX_ERR_NONE);
+    SubmitTask(task, 0);
+
+    // frame 1 gets device busy, the waiter syncs frame 0 and then backs off, as only the
+    // task being submitted is left
+    ASSERT_EQ(pool.GetFreeTask(&task), MFX_ERR_NONE);
+    sTask* busyTask = task;
+    CDeviceBusyWaiter waiter;
+    auto syncOldest = [&]() {
+        return pool.SynchronizeFirstTask(1000);
+    };
+    EXPECT_EQ(waiter.Wait(0, syncOldest), MFX_ERR_NONE);
+    EXPECT_EQ(pool.SynchronizeFirstTask(1000), MFX_ERR_NOT_FOUND);
+    EXPECT_EQ(waiter.Wait(1, syncOldest), MFX_ERR_NONE);
+
+    // the task is kept for frame 1, written frame doesn't hand it out again
+    ASSERT_EQ(pool.GetFreeTask(&task), MFX_ERR_NONE);
+    EXPECT_EQ(task, busyTask);
+    SubmitTask(task, 1);
+    ASSERT_EQ(pool.GetFreeTask(&task), MFX_ERR_NONE);
+    EXPECT_NE(task, busyTask);
+    SubmitTask(task, 2);
+
+    while (MFX_ERR_NONE == pool.SynchronizeFirstTask(1000)) {
+    }
+    EXPECT_EQ(writer.frames, (std::vector<mfxU8>{ 0, 1, 2 }));
+}
+
+TEST(Encode_TaskPool, FullPoolWritesInSubmissionOrder) {
+    TestSession session;
+    TestWriter writer;
+    CEncTaskPool pool;
+    ASSERT_EQ(pool.Init(&session, &writer, 2, 1024, MFX_CODEC_AVC), MFX_ERR_NONE);
+
+    sTask* task = nullptr;
+    for (mfxU8 frame = 0; frame < 6; frame++) {
+        mfxStatus sts = pool.GetFreeTask(&task);
+        if (MFX_ERR_NOT_FOUND == sts) {
+            ASSERT_EQ(pool.SynchronizeFirstTask(1000), MFX_ERR_NONE);
+            sts = pool.GetFreeTask(&task);
+        }
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+        SubmitTask(task, frame);
+    }
+    while (MFX_ERR_NONE == pool.SynchronizeFirstTask(1000)) {
+    }
+    EXPECT_EQ(writer.frames, (std::vector<mfxU8>{ 0, 1, 2, 3, 4, 5 }));
+}
+
+TEST(Encode_TaskPool, SlowFrameDoesntHoldCompletedTasks) {
+    TestSession session;
+    TestWriter writer;
+    CEncTaskPool pool;
+    ASSERT_EQ(pool.Init(&session, &writer, 4, 1024, MFX_CODEC_AVC), MFX_ERR_NONE);
+
+    sTask* task = nullptr;
+    for (mfxU8 frame = 0; frame < 4; frame++) {
+        ASSERT_EQ(pool.GetFreeTask(&task), MFX_ERR_NONE);
+        SubmitTask(task, frame);
+    }
+    ASSERT_EQ(pool.GetFreeTask(&task), MFX_ERR_NOT_FOUND);
+
+    // frames 1-3 are done before frame 0, their tasks are given back without waiting for it
+    for (mfxU8 frame = 1; frame < 4; frame++)
+        session.done.insert(TestSyncPoint(frame));
+    EXPECT_EQ(pool.SynchronizeFirstTask(1000), MFX_ERR_NONE);
+    EXPECT_EQ(session.done.count(TestSyncPoint(0)), 0u);
+    EXPECT_TRUE(writer.frames.empty());
+    EXPECT_EQ(pool.GetNumTasksInExecution(), 1u);
+
+    for (mfxU8 frame = 4; frame < 7; frame++) {
+        ASSERT_EQ(pool.GetFreeTask(&task), MFX_ERR_NONE);
+        SubmitTask(task, frame);
+    }
+    while (MFX_ERR_NONE == pool.SynchronizeFirstTask(1000)) {
+    }
+    EXPECT_EQ(writer.frames, (std::vector<mfxU8>{ 0, 1, 2, 3, 4, 5, 6 }));
+}
+
+TEST(Encode_TaskPool, RetiredTasksKeepOutputBitstreamsAlternating) {
+    TestSession session;
+    TestWriter writer;
+    TestWriter otherWriter;
+    CEncTaskPool pool;
+    ASSERT_EQ(pool.Init(&session, &writer, 4, 1024, MFX_CODEC_AVC, &otherWriter), MFX_ERR_NONE);
+
+    sTask* task = nullptr;
+    for (mfxU8 frame = 0; frame < 12; frame++) {
+        mfxStatus sts = pool.GetFreeTask(&task);
+        if (MFX_ERR_NOT_FOUND == sts) {
+            // the oldest frame is the slow one, odd frames are done first
+            for (mfxU8 done = 1; done < frame; done += 2)
+                session.done.insert(TestSyncPoint(done));
+            ASSERT_EQ(pool.SynchronizeFirstTask(1000), MFX_ERR_NONE);
+            sts = pool.GetFreeTask(&task);
+        }
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+        SubmitTask(task, frame);
+    }
+    while (MFX_ERR_NONE == pool.SynchronizeFirstTask(1000)) {
+    }
+    EXPECT_EQ(writer.frames, (std::vector<mfxU8>{ 0, 2, 4, 6, 8, 10 }));
+    EXPECT_EQ(otherWriter.frames, (std::vector<mfxU8>{ 1, 3, 5, 7, 9, 11 }));
+}
+
+TEST(Encode_TaskPool, ZeroReorderWindowSyncsInOrder) {
+    TestSession session;
+    TestWriter writer;
+    CEncTaskPool pool;
+    ASSERT_EQ(pool.Init(&session, &writer, 4, 1024, MFX_CODEC_AVC), MFX_ERR_NONE);
+    pool.SetReorderWindow(0);
+
+    sTask* task = nullptr;
+    for (mfxU8 frame = 0; frame < 4; frame++) {
+        ASSERT_EQ(pool.GetFreeTask(&task), MFX_ERR_NONE);
+        SubmitTask(task, frame);
+    }
+    session.done.insert(TestSyncPoint(1));
+    EXPECT_EQ(pool.SynchronizeFirstTask(1000), MFX_ERR_NONE);
+    EXPECT_EQ(writer.frames, (std::vector<mfxU8>{ 0 }));
+}
+
+TEST(Encode_TaskPool, RetiredTasksReuseOutputBuffers) {
+    TestSession session;
+    ContentWriter writer;
+    CEncTaskPool pool;
+    ASSERT_EQ(pool.Init(&session, &writer, 4, 1024, MFX_CODEC_AVC), MFX_ERR_NONE);
+
+    // frame 9 is bigger than the buffer size, as if task bitstream was extended
+    std::vector<std::vector<mfxU8>> frames;
+    sTask* task = nullptr;
+    for (mfxU8 frame = 0; frame < 20; frame++) {
+        mfxStatus sts = pool.GetFreeTask(&task);
+        if (MFX_ERR_NOT_FOUND == sts) {
+            // the oldest frame is the slow one, others are retired
+            for (mfxU8 done = 1; done < frame; done++)
+                session.done.insert(TestSyncPoint(done));
+            ASSERT_EQ(pool.SynchronizeFirstTask(1000), MFX_ERR_NONE);
+            sts = pool.GetFreeTask(&task);
+        }
+        ASSERT_EQ(sts, MFX_ERR_NONE);
+        std::vector<mfxU8> data(frame == 9 ? 3000 : 100 + frame * 10);
+        for (size_t i = 0; i < data.size(); i++)
+            data[i] = (mfxU8)(frame + i);
+        task->mfxBS.Extend((mfxU32)data.size());
+        std::copy(data.begin(), data.end(), task->mfxBS.Data);
+        task->mfxBS.DataLength = (mfxU32)data.size();
+        task->EncSyncP         = TestSyncPoint(frame);
+        frames.push_back(data);
+    }
+    while (MFX_ERR_NONE == pool.SynchronizeFirstTask(1000)) {
+    }
+    EXPECT_EQ(writer.frames, frames);
+    // 4 task bitstreams and 4 buffers for retired output, frame 9 reallocates one of them
+    EXPECT_LE(writer.buffers.size(), 9u);
+}
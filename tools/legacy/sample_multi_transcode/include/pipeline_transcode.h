@@ -9,9 +9,11 @@
 
 #include <stddef.h>
 
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <ctime>
+#include <deque>
 #include <future>
 #include <iomanip>
 #include <iostream>
@@ -19,9 +21,12 @@
 #include <map>
 #include <memory>
 #include <mutex>
+#include <thread>
 #include <vector>
 
 #include "base_allocator.h"
+#include "frame_pacer.h"
+#include "free_list_pool.h"
 #include "mfx_multi_vpp.h"
 #include "rotate_plugin_api.h"
 #include "sample_defs.h"
@@ -35,6 +40,7 @@
 #include "plugin_utils.h"
 #include "preset_manager.h"
 #include "sample_defs.h"
+#include "smt_scheduler.h"
 #include "smt_tracer.h"
 #include "vpl/mfxdispatcher.h"
 #include "vpl/mfxjpeg.h"
@@ -78,6 +84,8 @@ enum MemoryModel {
 
 static const mfxU32 DecoderTargetID = 100;
 static const mfxU32 DecoderPoolID   = 10;
+// file buffer size of output written by AsyncBitstreamWriter
+static const mfxU32 AsyncWriteBufferSize = 4 * 1024 * 1024;
 class CascadeScalerConfig {
 public:
     class TargetDescriptor {
@@ -158,10 +166,10 @@ struct ExtendedSurface {
 };
 
 struct ExtendedBS {
-    bool IsFree = true;
     mfxBitstreamWrapper Bitstream;
     mfxSyncPoint Syncp     = nullptr;
     PreEncAuxBuffer* pCtrl = nullptr;
+    msdk_tick SubmitTime   = 0; // when processing of the frame was started
 };
 
 class CIOStat : public CTimeStatistics {
@@ -242,58 +250,196 @@ protected:
     std::string bufDir;
 };
 
+enum LatencyStage {
+    LATENCY_STAGE_DECODE = 0,
+    LATENCY_STAGE_VPP,
+    LATENCY_STAGE_ENCODE, // submission of frame to encoder
+    LATENCY_STAGE_SYNC, // waiting for encoded frame
+    LATENCY_STAGE_WRITE,
+    LATENCY_STAGE_COUNT
+};
+
+// latency percentiles of session stages, collected for the whole run in histograms,
+// measurements may come from different threads (e.g. async bitstream writer)
+class CLatencyStat : public CStageLatencyStat {
+public:
+    CLatencyStat();
+
+    void SetOutputFile(FILE* file);
+
+    void PrintStatistics(mfxU32 numPipelineid);
+    // writes <name>_ID_<N>.csv and <name>_ID_<N>.json
+    void DumpStatistics(const std::string& name, mfxU32 numPipelineid);
+
+protected:
+    FILE* m_ofile;
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(CLatencyStat);
+};
+
+// accounts time from construction to destruction, for stage functions with several exits
+class CLatencyScope {
+public:
+    CLatencyScope(CLatencyStat& stat, LatencyStage stage)
+            : m_stat(stat),
+              m_stage(stage),
+              m_start(stat.IsEnabled() ? msdk_time_get_tick() : 0) {}
+    ~CLatencyScope() {
+        if (m_start) {
+            mfxF64 delta = CTimeStatistics::ConvertToSeconds(msdk_time_get_tick() - m_start);
+            m_stat.AddMeasurement(m_stage, delta);
+        }
+    }
+
+private:
+    CLatencyStat& m_stat;
+    LatencyStage m_stage;
+    msdk_tick m_start;
+
+    DISALLOW_COPY_AND_ASSIGN(CLatencyScope);
+};
+
+// number of frames in flight between submission and sync, which keeps the device fed without
+// buffering more frames than needed. It's the number of frames completed during the latency of
+// a frame going through empty pipeline plus one. Frames submitted to busy pipeline wait in
+// queues, so the pipeline is drained once per epoch to observe unloaded latency again.
+class CSyncWindow {
+public:
+    CSyncWindow();
+
+    void Init(mfxU32 maxWindow);
+    mfxU32 GetWindow() const {
+        return m_nWindow;
+    }
+
+    // numFrames completions observed at once, submitTime is of the last submitted of them
+    void AddCompletions(msdk_tick submitTime, mfxU32 numFrames, msdk_tick observeTime);
+    // caller syncs all frames in flight and calls Drained() when it's true
+    bool IsDrainRequired() const;
+    void Drained();
+
+    static const mfxU32 EPOCH_FRAMES = 256;
+
+protected:
+    mfxU32 m_nMaxWindow;
+    mfxU32 m_nWindow;
+    mfxU32 m_nEpochFrames;
+    mfxF64 m_MinLatency; // minimal frame latency in the epoch, seconds
+    mfxF64 m_Interval; // average interval between completions, seconds
+    msdk_tick m_LastCompletion;
+};
+
 class ExtendedBSStore {
 public:
-    explicit ExtendedBSStore(mfxU32 size) {
-        m_pExtBS.resize(size);
+    explicit ExtendedBSStore(mfxU32 size) : m_pool(), m_mutex(), m_cvRelease() {
+        m_pool.Init(size);
     }
     virtual ~ExtendedBSStore() {
-        m_pExtBS.clear();
+        m_pool.Close();
     }
-    ExtendedBS* GetNext() {
-        for (mfxU32 i = 0; i < m_pExtBS.size(); i++) {
-            if (m_pExtBS[i].IsFree) {
-                m_pExtBS[i].IsFree = false;
-                return &m_pExtBS[i];
-            }
+    mfxU32 GetSize() const {
+        return m_pool.GetSize();
+    }
+    // bitstreams may be released by the writer thread, so caller can wait up to msec for free one
+    ExtendedBS* GetNext(mfxU32 msec = 0) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        ExtendedBS* pBS = m_pool.Acquire();
+        if (!pBS && msec) {
+            m_cvRelease.wait_for(lock, std::chrono::milliseconds(msec), [&] {
+                return (pBS = m_pool.Acquire()) != NULL;
+            });
         }
-        return NULL;
+        return pBS;
     }
     void Release(ExtendedBS* pBS) {
-        for (mfxU32 i = 0; i < m_pExtBS.size(); i++) {
-            if (&m_pExtBS[i] == pBS) {
-                m_pExtBS[i].IsFree = true;
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            if (!m_pool.Release(pBS))
                 return;
-            }
         }
+        m_cvRelease.notify_one();
         return;
     }
     void ReleaseAll() {
-        for (mfxU32 i = 0; i < m_pExtBS.size(); i++) {
-            m_pExtBS[i].IsFree = true;
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            m_pool.ReleaseAll();
         }
+        m_cvRelease.notify_all();
         return;
     }
     void FlushAll() {
-        for (mfxU32 i = 0; i < m_pExtBS.size(); i++) {
-            m_pExtBS[i].Bitstream.DataLength = 0;
-            m_pExtBS[i].Bitstream.DataOffset = 0;
+        std::lock_guard<std::mutex> guard(m_mutex);
+        for (mfxU32 i = 0; i < m_pool.GetSize(); i++) {
+            m_pool[i].Bitstream.DataLength = 0;
+            m_pool[i].Bitstream.DataOffset = 0;
         }
         return;
     }
 
 protected:
-    std::vector<ExtendedBS> m_pExtBS;
+    CFreeListPool<ExtendedBS> m_pool;
+    std::mutex m_mutex;
+    std::condition_variable m_cvRelease;
 
 private:
     DISALLOW_COPY_AND_ASSIGN(ExtendedBSStore);
 };
 
+// wakes up threads which wait for a free surface in pipeline pools
+// surfaces can be also unlocked by the library without any notification, so waiting
+// thread should re-check its pool after limited time even if nothing was signaled
+class SurfaceReleaseNotifier {
+public:
+    SurfaceReleaseNotifier() : m_mutex(), m_cv(), m_nReleaseCount(0) {}
+
+    mfxU64 GetReleaseCount() {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        return m_nReleaseCount;
+    }
+
+    void NotifyRelease() {
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            m_nReleaseCount++;
+        }
+        m_cv.notify_all();
+    }
+
+    // returns when NotifyRelease was called after releaseCount was taken or msec is expired
+    void WaitForRelease(mfxU64 releaseCount, mfxU32 msec) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait_for(lock, std::chrono::milliseconds(msec), [&] {
+            return m_nReleaseCount != releaseCount;
+        });
+    }
+
+protected:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    mfxU64 m_nReleaseCount;
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(SurfaceReleaseNotifier);
+};
+
+// per pool state of free surface search
+struct SurfacePoolState {
+    mfxU32 NextIdx  = 0; // search for free surface starts from the surface after last taken one
+    mfxU64 WaitTime = 0; // overall time spent waiting for a free surface, us
+};
+
 class CTranscodingPipeline;
 // thread safety buffer heterogeneous pipeline
 // only for join sessions
+// surfaces are passed through bounded ring, which has one producer (decoder) and one consumer
+// (encoder), so GetSurface/ReleaseSurface don't take any locks, producer side is synchronized
+// with CancelBuffering/ReleaseSurfaceAll only
 class SafetySurfaceBuffer {
 public:
+    enum { RING_SIZE = 256 }; // must be power of 2
+
     //this is used only for sanity check
     mfxU32 TargetID       = 0;
     ProlongStatus Prolong = NormalFrame;
@@ -315,15 +461,22 @@ public:
     mfxStatus ReleaseSurface(mfxFrameSurface1* pSurf);
     mfxStatus ReleaseSurfaceAll();
     void CancelBuffering();
+    // notifier of the pipeline which owns surfaces passed through this buffer
+    void SetReleaseNotifier(SurfaceReleaseNotifier* pNotifier);
 
     SafetySurfaceBuffer* m_pNext;
 
 protected:
     std::mutex m_mutex;
-    std::list<SurfaceDescriptor> m_SList;
+    // Locked of descriptor is reference count of the consumer, descriptors are freed in order
+    // of insertion, the one released out of order is skipped when head reaches it
+    std::vector<SurfaceDescriptor> m_Ring;
+    std::atomic<mfxU32> m_nHead; // first not released descriptor, moved by consumer
+    std::atomic<mfxU32> m_nTail; // next descriptor to be filled, moved by producer
     bool m_IsBufferingAllowed;
     MSDKEvent* pRelEvent;
     MSDKEvent* pInsEvent;
+    SurfaceReleaseNotifier* m_pReleaseNotifier;
 
 private:
     DISALLOW_COPY_AND_ASSIGN(SafetySurfaceBuffer);
@@ -357,9 +510,71 @@ private:
     DISALLOW_COPY_AND_ASSIGN(FileBitstreamProcessor);
 };
 
+// writes encoded frames in separate thread, so slow storage doesn't stall encoder submission
+// written bitstreams are returned to the store
+class AsyncBitstreamWriter {
+public:
+    AsyncBitstreamWriter(FileBitstreamProcessor* pBSProcessor,
+                         ExtendedBSStore* pBSStore,
+                         mfxU32 targetID,
+                         bool isParallelEncoding);
+    virtual ~AsyncBitstreamWriter();
+
+    mfxStatus Start();
+    void Stop();
+    // queues synchronized bitstream for writing, returns error of previous writes if any
+    mfxStatus PutBS(ExtendedBS* pBS, mfxU32 frameNum);
+    // queues count bitstreams of consecutive frames starting from firstFrameNum at once
+    mfxStatus PutBS(ExtendedBS* const* ppBS, mfxU32 count, mfxU32 firstFrameNum);
+    // waits until all queued bitstreams are written
+    mfxStatus Flush();
+
+    void SetOutputFile(FILE* file);
+    void PrintStatistics(mfxU32 numPipelineid);
+    void ResetStatistics();
+    // write time of every frame is also accounted in session latency statistics if set
+    void SetLatencyStat(CLatencyStat* pLatencyStat);
+    // writing of every frame is recorded as WRITE_BS event of target thread if set
+    void SetTracer(SMTTracer* pTracer);
+
+protected:
+    struct WriteTask {
+        ExtendedBS* pBS;
+        mfxU32 FrameNum;
+    };
+
+    void WriteRoutine();
+
+    FileBitstreamProcessor* m_pBSProcessor;
+    ExtendedBSStore* m_pBSStore;
+    mfxU32 m_TargetID;
+    bool m_bParallelEncoding;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cvPut; // task is queued or writer is stopped
+    std::condition_variable m_cvDone; // queued tasks are written
+    std::deque<WriteTask> m_Queue;
+    mfxU32 m_nInProgress; // tasks taken by writer thread, but not written yet
+    bool m_bStop;
+    mfxStatus m_Status;
+    std::thread m_Thread;
+
+    // statistics are guarded by m_mutex
+    CIOStat m_WriteStatistics; // time of writing one frame
+    mfxU32 m_nMaxQueueDepth;
+    mfxU64 m_nQueueDepthSum;
+    mfxU64 m_nQueueDepthSamples;
+    FILE* m_ofile;
+    CLatencyStat* m_pLatencyStat;
+    SMTTracer* m_pTracer;
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(AsyncBitstreamWriter);
+};
+
 typedef std::vector<mfxFrameSurface1*> SurfPointersArray;
 typedef std::vector<PreEncAuxBuffer> PreEncAuxArray;
-typedef std::list<ExtendedBS*> BSList;
+typedef CFixedQueue<ExtendedBS*> BSList;
 
 // Bitstream is external via BitstreamProcessor
 class CTranscodingPipeline {
@@ -413,6 +628,17 @@ public:
     bool IsOverlayUsed();
     size_t GetRobustFlag();
     eAPIVersion GetVersionOfSessionInitAPI();
+    // prints stage latency percentiles of the whole run and dumps them to files if requested
+    void PrintLatencyStatistics();
+    // prints late frames and drift of frame rate limit, if it is set
+    void PrintPacingStatistics();
+    // prints number of MFX_WRN_DEVICE_BUSY events and time spent waiting in them
+    void PrintBusyStatistics();
+    // only self-contained transcoding pipeline can run as cooperative task, pipelines connected
+    // with other sessions block waiting for them
+    bool IsCooperativeCapable();
+    // in cooperative mode Run() returns after every frame and continues on the next call
+    void SetCooperativeMode(bool bCooperative);
 
     std::string GetSessionText() {
         std::stringstream ss;
@@ -479,6 +705,9 @@ protected:
     virtual mfxStatus Decode();
     virtual mfxStatus Encode();
     virtual mfxStatus Transcode();
+    // waits after MFX_WRN_DEVICE_BUSY, in cooperative mode runs a step of another session
+    // instead of backing off
+    void WaitForDevice(mfxU32 attempt);
     virtual mfxStatus DecodeOneFrame(ExtendedSurface* pExtSurface);
     virtual mfxStatus CreateBlackFrame(ExtendedSurface* pExtSurface);
     virtual mfxStatus DecodeLastFrame(ExtendedSurface* pExtSurface);
@@ -516,6 +745,11 @@ protected:
 
     mfxFrameSurface1* GetFreeSurface(bool isDec, mfxU64 timeout);
     mfxFrameSurface1* GetFreeSurfaceForCS(bool isDec, mfxU64 timeout, mfxU32 ID);
+    mfxFrameSurface1* WaitForFreeSurface(SurfPointersArray& workArray,
+                                         SurfacePoolState& poolState,
+                                         SMTTracer::ThreadType thType,
+                                         mfxU32 thID,
+                                         mfxU64 timeout);
     mfxU32 GetFreeSurfacesCount(bool isDec);
     PreEncAuxBuffer* GetFreePreEncAuxBuffer();
     void SetEncCtrlRT(ExtendedSurface& extSurface, bool bInsertIDR);
@@ -536,6 +770,16 @@ protected:
 
     mfxStatus AllocateSufficientBuffer(mfxBitstreamWrapper* pBS);
     mfxStatus PutBS();
+    // waits for the frame up to timeout, 0 only checks if it's ready (MFX_WRN_IN_EXECUTION)
+    mfxStatus SyncBS(ExtendedBS* pBS, mfxU32 timeout);
+    // passes first numFrames synced bitstreams of m_BSPool to adaptive sync window
+    void AddSyncCompletions(mfxU32 numFrames);
+    // writes first numFrames synchronized bitstreams of m_BSPool and releases them
+    mfxStatus WriteBS(mfxU32 numFrames);
+    // writes bitstreams from the front of m_BSPool which are already encoded, doesn't wait
+    mfxStatus PutCompletedBS();
+    // writes encoded frames after submission of a new one according to sync mode
+    mfxStatus PutOutputBS();
 
     mfxStatus DumpSurface2File(mfxFrameSurface1* pSurface);
     mfxStatus ReplaceBlackSurface(mfxFrameSurface1* pSurface);
@@ -602,6 +846,11 @@ protected:
 
     std::map<mfxU32, SurfPointersArray> m_CSSurfacePools;
 
+    SurfacePoolState m_DecPoolState;
+    SurfacePoolState m_EncPoolState;
+    std::map<mfxU32, SurfacePoolState> m_CSPoolStates;
+    SurfaceReleaseNotifier m_SurfaceReleaseNotifier;
+
     mfxU16 m_EncSurfaceType; // actual type of encoder surface pool
     mfxU16 m_DecSurfaceType; // actual type of decoder surface pool
 
@@ -696,14 +945,39 @@ protected:
 
     // pointer to already extended bs processor
     FileBitstreamProcessor* m_pBSProcessor;
+    // output is written from separate thread if set
+    std::unique_ptr<AsyncBitstreamWriter> m_pBSWriter;
 
-    msdk_tick m_nReqFrameTime; // time required to transcode one frame
+    CFramePacer m_FramePacer; // limits transcoding frame rate
+    CDeviceBusyWaiter m_BusyWaiter;
 
     mfxU32 statisticsWindowSize; // Sliding window size for Statistics
     mfxU32 m_nOutputFramesNum;
 
     CIOStat inputStatistics;
     CIOStat outputStatistics;
+    CLatencyStat m_LatencyStat;
+    std::string m_LatencyDumpName;
+
+    bool m_bSyncDrain; // write all completed frames each time a frame is submitted
+    bool m_bAdaptiveSync; // frames in flight are limited by m_SyncWindow instead of async depth
+    CSyncWindow m_SyncWindow;
+    std::vector<ExtendedBS*> m_WriteBatch; // completed bitstreams passed to m_pBSWriter at once
+
+    // Transcode() loop state, it is kept between calls while Transcode() yields in cooperative
+    // mode and is reset when it finishes
+    struct TranscodeLoopState {
+        bool bInProgress              = false;
+        ExtendedSurface DecExtSurface = {};
+        ExtendedSurface VppExtSurface = {};
+        bool bNeedDecodedFrames       = true; // indicates if we need to decode frames
+        bool bEndOfFile               = false;
+        bool bLastCycle               = false;
+        bool shouldReadNextFrame      = true;
+        time_t start                  = 0;
+    };
+    bool m_bCooperative;
+    TranscodeLoopState m_TranscodeState;
 
     bool shouldUseGreedyFormula;
 
@@ -774,7 +1048,7 @@ private:
     DISALLOW_COPY_AND_ASSIGN(CTranscodingPipeline);
 };
 
-struct ThreadTranscodeContext {
+struct ThreadTranscodeContext : public CSchedulerTask {
     // Pointer to the session's pipeline
     std::unique_ptr<CTranscodingPipeline> pPipeline;
     // Pointer to bitstream handling object
@@ -794,20 +1068,61 @@ struct ThreadTranscodeContext {
 
     // Thread handle
     std::future<void> handle;
+    // Receives the context when the session is finished
+    CCompletionQueue<ThreadTranscodeContext>* pCompletion = nullptr;
+    std::chrono::system_clock::time_point start_time;
+
+    // CPUs and NUMA node of the session, empty and negative if it isn't pinned
+    std::vector<mfxU32> cpuAffinity;
+    mfxI32 numaNode = -1;
+
+    bool IsPinned() const {
+        return !cpuAffinity.empty() || numaNode >= 0;
+    }
+
+    // pins calling thread, threads it creates inherit the placement
+    mfxStatus ApplyPlacement() {
+        if (numaNode >= 0) {
+            mfxStatus sts = msdk_thread_set_numa_node(numaNode);
+            MSDK_CHECK_STATUS(sts, "msdk_thread_set_numa_node failed");
+        }
+        if (!cpuAffinity.empty()) {
+            mfxStatus sts = msdk_thread_set_affinity(cpuAffinity);
+            MSDK_CHECK_STATUS(sts, "msdk_thread_set_affinity failed");
+        }
+        return MFX_ERR_NONE;
+    }
 
     void TranscodeRoutine() {
-        using namespace std::chrono;
-        MSDK_CHECK_POINTER_NO_RET(pPipeline);
+        // placement failure isn't fatal, session just runs where OS schedules it
+        if (IsPinned())
+            ApplyPlacement();
+        StartRoutine();
+        while (Step()) {
+        }
+    }
+
+    // session can be run by StartRoutine() and then Step() calls on scheduler threads
+    void StartRoutine() {
         transcodingSts = MFX_ERR_NONE;
+        start_time     = std::chrono::system_clock::now();
+    }
 
-        auto start_time = system_clock::now();
-        while (MFX_ERR_NONE == transcodingSts) {
-            transcodingSts = pPipeline->Run();
-        }
+    // runs pipeline until it finishes or yields, returns false when session is finished
+    bool Step() override {
+        transcodingSts = pPipeline ? pPipeline->Run() : MFX_ERR_NULL_PTR;
+        if (MFX_ERR_NONE == transcodingSts)
+            return true;
+
+        using namespace std::chrono;
         working_time = duration_cast<duration<mfxF64>>(system_clock::now() - start_time).count();
 
         MSDK_IGNORE_MFX_STS(transcodingSts, MFX_WRN_VALUE_NOT_CHANGED);
-        numTransFrames = pPipeline->GetProcessFrames();
+        if (pPipeline)
+            numTransFrames = pPipeline->GetProcessFrames();
+        if (pCompletion)
+            pCompletion->Signal(this);
+        return false;
     }
 };
 } // namespace TranscodingSample
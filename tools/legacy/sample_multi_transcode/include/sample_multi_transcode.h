@@ -59,6 +59,7 @@ protected:
                                            CTranscodingPipeline* pParentPipeline);
     virtual mfxStatus VerifyCrossSessionsOptions();
     virtual mfxStatus CreateSafetyBuffers();
+    virtual mfxStatus PlaceSessions();
     CascadeScalerConfig& CreateCascadeScalerConfig();
     virtual void DoTranscoding();
     virtual void DoRobustTranscoding();
@@ -96,6 +97,10 @@ protected:
     SMTTracer m_Tracer;
     std::shared_ptr<CSmplBitstreamWriter> m_GlobalBitstreamWriter{};
 
+    // runs cooperative sessions if -sched is set, other sessions have own threads
+    std::unique_ptr<CSessionScheduler> m_pScheduler;
+    CCompletionQueue<ThreadTranscodeContext> m_Completion;
+
 private:
     DISALLOW_COPY_AND_ASSIGN(Launcher);
 
@@ -87,6 +87,11 @@ protected:
     FILE* statisticsLogFile;
     //store a name of a Logfile
     std::string DumpLogFileName;
+    bool bLatencyStatistics;
+    std::string LatencyDumpFileName;
+    bool bCooperativeScheduler;
+    mfxU32 nSchedulerThreads;
+    bool bAutoAffinity;
     mfxU32 m_nTimeout;
     mfxU32 m_surface_wait_interval;
     bool bRobustFlag;
@@ -128,6 +128,8 @@ typedef struct sInputParams {
     bool CascadeScaler;
     bool EnableTracing;
     mfxU32 TraceBufferSize;
+    bool TraceStreaming;
+    SMTTracer::TraceFormat TraceFormat;
     SMTTracer::LatencyType LatencyType;
     bool ParallelEncoding;
 
@@ -171,6 +173,8 @@ typedef struct sInputParams {
     bool dispFullSearch;
 
     mfxU16 nThreadsNum; // number of internal session threads number
+    std::vector<mfxU32> CpuAffinity; // CPUs to run the session on, empty - no pinning
+    mfxI32 nNumaNode; // NUMA node for the session CPUs and memory, negative - no pinning
     bool bRobustFlag; // Robust transcoding mode. Allows auto-recovery after hardware errors
     bool bSoftRobustFlag;
 
@@ -178,6 +182,10 @@ typedef struct sInputParams {
     mfxU32 DecodeId; // type of input coded video
 
     std::string strSrcFile; // source bitstream file
+    bool bMappedInput; // read source bitstream through memory mapping
+    bool bSharedInput; // share source bitstream data with other sessions reading the same file
+    mfxU32 nPreloadSize; // MB of source bitstream or number of raw frames kept in memory
+    mfxU32 nFramePoolSize; // MB of released surfaces kept by session allocator for reuse
     std::string strDstFile; // destination bitstream file
     std::string strDumpVppCompFile; // VPP composition output dump file
     std::string dump_file;
@@ -220,6 +228,9 @@ typedef struct sInputParams {
     mfxU16 ScalingMode;
 
     mfxU16 nAsyncDepth; // asyncronous queue
+    mfxU16 nAsyncWriteDepth; // queue depth of output writer thread, 0 - write in encoding thread
+    bool bSyncDrain; // write all already encoded frames together, without waiting
+    bool bAdaptiveSync; // limit frames in flight by observed latency, up to nAsyncDepth
 
     PipelineMode eMode;
     PipelineMode eModeExt;
@@ -273,9 +284,15 @@ typedef struct sInputParams {
 
     mfxU32 nTimeout; // how long transcoding works in seconds
     mfxU32 nFPS; // limit transcoding to the number of frames per second
+    mfxU32 nFPSDenom; // denominator of rational frame rate limit, e.g. 60000/1001
 
     mfxU32 statisticsWindowSize;
     FILE* statisticsLogFile;
+    bool bLatencyStatistics; // collect per-stage latency percentiles
+    std::string LatencyDumpFileName;
+    bool bCooperativeScheduler; // run sessions as cooperative tasks on a thread pool
+    mfxU32 nSchedulerThreads; // 0 - number of CPU cores
+    bool bAutoAffinity; // place sessions without -affinity/-numa round robin
 
     bool bLABRC; // use look ahead bitrate control algorithm
     mfxU16 nLADepth; // depth of the look ahead bitrate control  algorithm
@@ -426,6 +443,8 @@ typedef struct sInputParams {
               CascadeScaler(false),
               EnableTracing(false),
               TraceBufferSize(0),
+              TraceStreaming(false),
+              TraceFormat(SMTTracer::TraceFormat::JSON),
               LatencyType(SMTTracer::LatencyType::DEFAULT),
               ParallelEncoding(false),
               bIsJoin(false),
@@ -459,11 +478,17 @@ typedef struct sInputParams {
               adapterNum(-1),
               dispFullSearch(DEF_DISP_FULLSEARCH),
               nThreadsNum(0),
+              CpuAffinity(),
+              nNumaNode(-1),
               bRobustFlag(false),
               bSoftRobustFlag(false),
               EncodeId(0),
               DecodeId(0),
               strSrcFile(),
+              bMappedInput(false),
+              bSharedInput(false),
+              nPreloadSize(0),
+              nFramePoolSize(0),
               strDstFile(),
               strDumpVppCompFile(),
               dump_file(),
@@ -496,6 +521,9 @@ typedef struct sInputParams {
               fieldProcessingMode(FC_NONE),
               ScalingMode(0),
               nAsyncDepth(0),
+              nAsyncWriteDepth(0),
+              bSyncDrain(false),
+              bAdaptiveSync(false),
               eMode(Native),
               eModeExt(Native),
               FrameNumberPreference(0),
@@ -536,8 +564,14 @@ typedef struct sInputParams {
               encoderPluginParams(),
               nTimeout(0),
               nFPS(0),
+              nFPSDenom(1),
               statisticsWindowSize(0),
               statisticsLogFile(nullptr),
+              bLatencyStatistics(false),
+              LatencyDumpFileName(),
+              bCooperativeScheduler(false),
+              nSchedulerThreads(0),
+              bAutoAffinity(false),
               bLABRC(false),
               nLADepth(0),
               bEnableExtLA(false),
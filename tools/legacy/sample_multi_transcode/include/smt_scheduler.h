@@ -0,0 +1,112 @@
+/*############################################################################
+  # Copyright (C) 2005 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef __SMT_SCHEDULER_H__
+#define __SMT_SCHEDULER_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "vpl/mfxdefs.h"
+
+namespace TranscodingSample {
+// cooperative task, Step() does a bounded piece of work (e.g. one frame) and returns true while
+// there is more work to do
+class CSchedulerTask {
+public:
+    virtual ~CSchedulerTask() {}
+    virtual bool Step() = 0;
+};
+
+// fixed pool of worker threads running cooperative tasks. Every worker has its own queue of
+// tasks, it takes them from the front and puts a task back to the end after each step, so its
+// tasks are served round robin. Worker with empty queue steals from the end of other queues.
+class CSessionScheduler {
+public:
+    CSessionScheduler();
+    virtual ~CSessionScheduler();
+
+    // starts nThreads workers, 0 means number of CPU cores
+    mfxStatus Init(mfxU32 nThreads);
+    // stops workers, tasks which are not completed yet are dropped
+    void Close();
+
+    void Submit(CSchedulerTask* pTask);
+
+    // may be called from Step() instead of sleeping, e.g. while device is busy: runs one step of
+    // another queued task on the calling worker. Returns false if nothing was run.
+    bool RunPendingStep();
+
+    mfxU32 GetNumThreads() const {
+        return (mfxU32)m_workers.size();
+    }
+
+    // scheduler which owns calling thread, nullptr if it isn't a worker thread
+    static CSessionScheduler* GetCurrent();
+
+protected:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<CSchedulerTask*> tasks;
+        std::thread thread;
+    };
+
+    void WorkerRoutine(mfxU32 id);
+    CSchedulerTask* Pop(mfxU32 id);
+    void Push(mfxU32 id, CSchedulerTask* pTask);
+    void RunStep(mfxU32 id, CSchedulerTask* pTask);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::atomic<mfxU32> m_nQueued; // tasks in all queues
+    std::atomic<mfxU32> m_nIdle; // workers waiting for tasks
+    std::atomic<mfxU32> m_nNextWorker;
+    std::atomic<bool> m_bStop;
+    std::mutex m_mutex;
+    std::condition_variable m_cvWork;
+
+private:
+    CSessionScheduler(const CSessionScheduler&)            = delete;
+    CSessionScheduler& operator=(const CSessionScheduler&) = delete;
+};
+
+// sessions report their completion here, so launcher waits for it instead of polling
+template <class T>
+class CCompletionQueue {
+public:
+    CCompletionQueue() : m_mutex(), m_cvCompleted(), m_completed() {}
+
+    void Signal(T* pItem) {
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            m_completed.push_back(pItem);
+        }
+        m_cvCompleted.notify_one();
+    }
+
+    // waits for the next completed item
+    T* Wait() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cvCompleted.wait(lock, [&] {
+            return !m_completed.empty();
+        });
+        T* pItem = m_completed.front();
+        m_completed.pop_front();
+        return pItem;
+    }
+
+protected:
+    std::mutex m_mutex;
+    std::condition_variable m_cvCompleted;
+    std::deque<T*> m_completed;
+};
+} // namespace TranscodingSample
+
+#endif
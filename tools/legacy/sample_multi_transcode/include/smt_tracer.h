@@ -8,12 +8,15 @@
 #define __SMT_TRACER_H__
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <fstream>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "vpl/mfxdefs.h"
@@ -31,13 +34,21 @@ public:
 
     enum class LatencyType { DEFAULT, E2E, ENC };
 
+    //binary trace is compact and fast to write, use ConvertBinaryTrace to view it
+    enum class TraceFormat { JSON, BINARY };
+
     SMTTracer();
     ~SMTTracer();
 
+    //in streaming mode events are written to the file during processing, so trace length
+    //isn't limited by buffer size, but flow links and latency statistics are not generated
     void Init(const PipelineType type,
               const mfxU32 numOfChannels,
               const LatencyType latency,
-              const mfxU32 TraceBufferSize);
+              const mfxU32 TraceBufferSize,
+              const bool streaming     = false,
+              const TraceFormat format = TraceFormat::JSON);
+    bool IsEnabled() const;
     void BeginEvent(const ThreadType thType,
                     const mfxU32 thID,
                     const EventName name,
@@ -58,7 +69,16 @@ public:
     void AfterDecodeSync();
     void AfterEncodeSync();
 
+    //converts binary trace to JSON trace, perfetto mode writes JSON object format, which is
+    //accepted by Perfetto UI as well as by chrome://tracing
+    static bool ConvertBinaryTrace(const std::string& binaryFileName,
+                                   const std::string& jsonFileName,
+                                   bool perfetto);
+
 private:
+    //unit tests write events directly to check binary trace against JSON trace
+    friend class SMTTracerTest;
+
     class Event {
     public:
         EventType EvType; //duration, flow, counter
@@ -69,6 +89,7 @@ private:
         mfxU64 InID; //unique dependency ID, e.g. surface pointer
         mfxU64 OutID;
         mfxU64 TS; //time stamp
+        mfxU64 Order; //time stamp in ns, used to merge events from different threads
         Event()
                 : EvType(EventType::DurationStart),
                   ThType(ThreadType::DEC),
@@ -77,10 +98,27 @@ private:
                   EvID(0),
                   InID(0),
                   OutID(0),
-                  TS(0) {}
+                  TS(0),
+                  Order(0) {}
     };
     using EventIt = std::vector<Event>::iterator;
 
+    //each thread records events to its own chunk without locking, full chunk is handed over
+    //to the tracer for saving or streaming and replaced by a new one
+    using Chunk = std::unique_ptr<std::vector<Event>>;
+
+    class ThreadBuffer {
+    public:
+        Chunk Current; //null if trace buffer is exhausted
+        mfxU64 NumOfDroppedEvents = 0;
+    };
+
+    class ThreadBufferRef {
+    public:
+        mfxU32 TracerID      = 0;
+        ThreadBuffer* Buffer = nullptr;
+    };
+
     class TimeInterval {
     public:
         TimeInterval(mfxU64 ts, mfxU64 duration);
@@ -96,6 +134,11 @@ private:
                   const void* inID,
                   const void* outID);
     mfxU64 GetCurrentTS();
+    ThreadBuffer* GetThreadBuffer();
+    Chunk NewChunk(bool unlimited);
+    void MergeThreadBuffers();
+    void StreamEvents();
+    void StopStreaming();
 
     //log generation functions
     void AdjustOverlappingEvents();
@@ -115,6 +158,8 @@ private:
     EventIt FindEndOfPreviosDurationEvent(EventIt it);
     EventIt FindEventInThread(EventIt first, EventType type);
 
+    void WriteTraceHeader(std::ofstream& trace_file);
+    void WriteEvents(std::ofstream& trace_file, const std::vector<Event>& events);
     void WriteEvent(std::ofstream& trace_file, const Event ev);
     void WriteDurationEvent(std::ofstream& trace_file, const Event ev);
     void WriteFlowEvent(std::ofstream& trace_file, const Event ev);
@@ -136,9 +181,11 @@ private:
     const mfxU32 MaxTraceBufferSizeInMBytes = 128;
 
     bool Enabled                = false;
+    TraceFormat Format          = TraceFormat::JSON;
+    mfxU64 LastBinaryTS         = 0; //binary trace stores time stamp delta to previous event
     PipelineType TypeOfPipeline = PipelineType::unknown;
     mfxU32 EvID                 = 0;
-    std::vector<Event> Log;
+    std::vector<Event> Log; //merged events of all threads, filled at save time
     std::vector<Event> AddonLog;
     std::map<mfxU32, std::vector<TimeInterval>> E2ELatency;
     std::map<mfxU32, std::vector<TimeInterval>> EncLatency;
@@ -146,6 +193,25 @@ private:
     mfxU64 TimeBase    = 0; //moment of time when tracer has been created
 
     std::mutex TracerMutex;
+
+    static const size_t EventsPerChunk = 4096;
+    static std::atomic<mfxU32> NumOfTracers;
+    static thread_local ThreadBufferRef CachedThreadBuffer;
+    mfxU32 TracerID = 0;
+    std::mutex BufferMutex; //guards members below, taken once per chunk by recording threads
+    std::vector<std::unique_ptr<ThreadBuffer>> ThreadBuffers;
+    std::vector<Chunk> FullChunks; //in order of completion
+    std::vector<Chunk> FreeChunks; //written chunks for reuse in streaming mode
+    size_t NumOfChunks    = 0;
+    size_t MaxNumOfChunks = 0;
+
+    bool Streaming          = false;
+    bool StreamingCompleted = false;
+    std::string StreamFileName;
+    std::ofstream StreamFile;
+    std::condition_variable StreamSync{};
+    std::thread StreamThread;
+
     LatencyType TypeOfLatency = LatencyType::DEFAULT;
     int NumOfChannels         = 0; //this is "N" in 1toN
     int NumOfActiveDecoders   = 0;
@@ -15,6 +15,7 @@
 #include <cstring>
 #include <memory>
 #include <set>
+#include "frame_copy.h"
 #include "mfx_itt_trace.h"
 #include "pipeline_transcode.h"
 #include "sample_utils.h"
@@ -158,11 +159,20 @@ CTranscodingPipeline::CTranscodingPipeline()
           m_MaxFramesForTranscode(0xFFFFFFFF),
           m_MaxFramesForEncode(0),
           m_pBSProcessor(NULL),
-          m_nReqFrameTime(0),
+          m_FramePacer(),
+          m_BusyWaiter(),
           statisticsWindowSize(0),
           m_nOutputFramesNum(0),
           inputStatistics(),
           outputStatistics(),
+          m_LatencyStat(),
+          m_LatencyDumpName(),
+          m_bSyncDrain(false),
+          m_bAdaptiveSync(false),
+          m_SyncWindow(),
+          m_WriteBatch(),
+          m_bCooperative(false),
+          m_TranscodeState(),
           shouldUseGreedyFormula(false),
           m_ROIData(),
           m_nSubmittedFramesNum(0),
@@ -274,9 +284,7 @@ mfxStatus CTranscodingPipeline::DecodePreInit(sInputParams* pParams) {
         m_bOwnMVCSeqDescMemory = false;
     }
 
-    if (pParams->nFPS) {
-        this->m_nReqFrameTime = 1000000 / pParams->nFPS;
-    }
+    m_FramePacer.Reset(pParams->nFPS, pParams->nFPSDenom);
 
     return sts;
 
@@ -612,6 +620,7 @@ mfxStatus CTranscodingPipeline::CreateBlackFrame(ExtendedSurface* pExtSurface) {
 
 mfxStatus CTranscodingPipeline::DecodeOneFrame(ExtendedSurface* pExtSurface) {
     MFX_ITT_TASK("DecodeOneFrame");
+    CLatencyScope latencyScope(m_LatencyStat, LATENCY_STAGE_DECODE);
     MSDK_CHECK_POINTER(pExtSurface, MFX_ERR_NULL_PTR);
 
     mfxStatus sts                 = MFX_ERR_MORE_SURFACE;
@@ -626,6 +635,7 @@ mfxStatus CTranscodingPipeline::DecodeOneFrame(ExtendedSurface* pExtSurface) {
 
     CTimer DevBusyTimer;
     DevBusyTimer.Start();
+    mfxU32 nBusyAttempt = 0;
     while (MFX_ERR_MORE_DATA == sts || MFX_ERR_MORE_SURFACE == sts || MFX_ERR_NONE < sts) {
         if (m_rawInput) {
             m_ScalerConfig.Tracer->BeginEvent(SMTTracer::ThreadType::DEC,
@@ -661,7 +671,10 @@ mfxStatus CTranscodingPipeline::DecodeOneFrame(ExtendedSurface* pExtSurface) {
                                               SMTTracer::EventName::BUSY,
                                               nullptr,
                                               nullptr);
-            WaitForDeviceToBecomeFree(*m_pmfxSession, m_LastDecSyncPoint, sts);
+            mfxStatus stsWait =
+                m_BusyWaiter.Wait(nBusyAttempt++, *m_pmfxSession, m_LastDecSyncPoint);
+            if (MFX_ERR_NONE != stsWait)
+                sts = stsWait;
             m_ScalerConfig.Tracer->EndEvent(SMTTracer::ThreadType::DEC,
                                             TargetID,
                                             SMTTracer::EventName::BUSY,
@@ -770,6 +783,7 @@ mfxStatus CTranscodingPipeline::DecodeOneFrame(ExtendedSurface* pExtSurface) {
 } // mfxStatus CTranscodingPipeline::DecodeOneFrame(ExtendedSurface *pExtSurface)
 mfxStatus CTranscodingPipeline::DecodeLastFrame(ExtendedSurface* pExtSurface) {
     MFX_ITT_TASK("DecodeLastFrame");
+    CLatencyScope latencyScope(m_LatencyStat, LATENCY_STAGE_DECODE);
     mfxFrameSurface1* pmfxSurface = NULL;
     mfxStatus sts                 = MFX_ERR_MORE_SURFACE;
 
@@ -781,6 +795,7 @@ mfxStatus CTranscodingPipeline::DecodeLastFrame(ExtendedSurface* pExtSurface) {
 
     CTimer DevBusyTimer;
     DevBusyTimer.Start();
+    mfxU32 nBusyAttempt = 0;
     // retrieve the buffered decoded frames
     while (MFX_ERR_MORE_SURFACE == sts || MFX_WRN_DEVICE_BUSY == sts) {
         if (m_rawInput) {
@@ -788,7 +803,10 @@ mfxStatus CTranscodingPipeline::DecodeLastFrame(ExtendedSurface* pExtSurface) {
             sts                   = m_pBSProcessor->GetInputFrame(pExtSurface->pSurface);
         }
         else if (MFX_WRN_DEVICE_BUSY == sts) {
-            WaitForDeviceToBecomeFree(*m_pmfxSession, m_LastDecSyncPoint, sts);
+            mfxStatus stsWait =
+                m_BusyWaiter.Wait(nBusyAttempt++, *m_pmfxSession, m_LastDecSyncPoint);
+            if (MFX_ERR_NONE != stsWait)
+                sts = stsWait;
         }
 
         if (!m_rawInput) {
@@ -842,6 +860,7 @@ mfxStatus CTranscodingPipeline::VPPOneFrame(ExtendedSurface* pSurfaceIn,
                                             ExtendedSurface* pExtSurface,
                                             mfxU32 ID) {
     MFX_ITT_TASK("VPPOneFrame");
+    CLatencyScope latencyScope(m_LatencyStat, LATENCY_STAGE_VPP);
     MSDK_CHECK_POINTER(pExtSurface, MFX_ERR_NULL_PTR);
     mfxFrameSurface1* out_surface = NULL;
     mfxStatus sts                 = MFX_ERR_NONE;
@@ -895,6 +914,7 @@ mfxStatus CTranscodingPipeline::VPPOneFrame(ExtendedSurface* pSurfaceIn,
             ID; //we need it only for debug, after exit from this function, this ID will be set one more time
     }
 
+    mfxU32 nBusyAttempt = 0;
     for (;;) {
         if (m_MemoryModel == GENERAL_ALLOC || m_MemoryModel == VISIBLE_INT_ALLOC) {
             if (TargetID == DecoderTargetID && desc.CascadeScaler) {
@@ -955,7 +975,7 @@ mfxStatus CTranscodingPipeline::VPPOneFrame(ExtendedSurface* pSurfaceIn,
                                                           nullptr);
                     }
 
-                    MSDK_SLEEP(1); // wait if device is busy
+                    WaitForDevice(nBusyAttempt++); // wait if device is busy
 
                     if (TargetID == DecoderTargetID && desc.CascadeScaler) {
                         m_ScalerConfig.Tracer->EndEvent(SMTTracer::ThreadType::CSVPP,
@@ -988,6 +1008,7 @@ mfxStatus CTranscodingPipeline::VPPOneFrame(ExtendedSurface* pSurfaceIn,
 
 mfxStatus CTranscodingPipeline::EncodeOneFrame(ExtendedSurface* pExtSurface,
                                                mfxBitstreamWrapper* pBS) {
+    CLatencyScope latencyScope(m_LatencyStat, LATENCY_STAGE_ENCODE);
     mfxStatus sts = MFX_ERR_NONE;
 
     if (!pBS->Data) {
@@ -995,6 +1016,7 @@ mfxStatus CTranscodingPipeline::EncodeOneFrame(ExtendedSurface* pExtSurface,
         MSDK_CHECK_STATUS(sts, "AllocateSufficientBuffer failed");
     }
 
+    mfxU32 nBusyAttempt = 0;
     for (;;) {
         if (m_bTCBRCFileMode && pExtSurface->pSurface) {
             sts = ConfigTCBRCTest(pExtSurface->pSurface);
@@ -1026,7 +1048,7 @@ mfxStatus CTranscodingPipeline::EncodeOneFrame(ExtendedSurface* pExtSurface,
                                                   SMTTracer::EventName::BUSY,
                                                   nullptr,
                                                   nullptr);
-                MSDK_SLEEP(TIME_TO_SLEEP); // wait if device is busy
+                WaitForDevice(nBusyAttempt++); // wait if device is busy
                 m_ScalerConfig.Tracer->EndEvent(SMTTracer::ThreadType::ENC,
                                                 TargetID,
                                                 SMTTracer::EventName::BUSY,
@@ -1119,6 +1141,26 @@ bool CTranscodingPipeline::IsOverlayUsed() {
     return m_bUseOverlay;
 }
 
+bool CTranscodingPipeline::IsCooperativeCapable() {
+    return m_bDecodeEnable && m_bEncodeEnable && !m_pBuffer;
+}
+
+void CTranscodingPipeline::SetCooperativeMode(bool bCooperative) {
+    m_bCooperative = bCooperative && IsCooperativeCapable();
+}
+
+void CTranscodingPipeline::WaitForDevice(mfxU32 attempt) {
+    CSessionScheduler* pScheduler = CSessionScheduler::GetCurrent();
+    if (!m_bCooperative || !pScheduler) {
+        m_BusyWaiter.Wait(attempt);
+        return;
+    }
+
+    m_BusyWaiter.Wait(attempt, [pScheduler]() {
+        return pScheduler->RunPendingStep() ? MFX_ERR_NONE : MFX_ERR_NOT_FOUND;
+    });
+}
+
 mfxStatus CTranscodingPipeline::Decode() {
     mfxStatus sts = MFX_ERR_NONE;
 
@@ -1163,8 +1205,6 @@ mfxStatus CTranscodingPipeline::Decode() {
         if (bLastCycle)
             SetNumFramesForReset(0);
 
-        msdk_tick nBeginTime = msdk_time_get_tick(); // microseconds.
-
         if (shouldReadNextFrame) {
             if (!bEndOfFile) {
                 if (!m_bUseOverlay) {
@@ -1204,6 +1244,9 @@ mfxStatus CTranscodingPipeline::Decode() {
                     ((0 == m_nProcessedFramesNum % statisticsWindowSize) || bEndOfFile)) {
                     inputStatistics.PrintStatistics(GetPipelineID());
                     inputStatistics.ResetStatistics();
+                    if (m_LatencyStat.IsEnabled()) {
+                        m_LatencyStat.PrintStatistics(GetPipelineID());
+                    }
                 }
             }
             if (sts == MFX_ERR_MORE_DATA && (m_pmfxVPP.get()) && !m_rawInput) {
@@ -1439,6 +1482,8 @@ mfxStatus CTranscodingPipeline::Decode() {
                 HandlePossibleGpuHang(sts);
                 MSDK_CHECK_ERR_NONE_STATUS(sts, MFX_ERR_ABORTED, "SyncOperation failed");
                 frontSurface.Syncp = NULL;
+                // completed tasks may unlock surfaces of this pipeline
+                m_SurfaceReleaseNotifier.NotifyRelease();
             }
         }
 
@@ -1450,10 +1495,7 @@ mfxStatus CTranscodingPipeline::Decode() {
             break;
         }
 
-        msdk_tick nFrameTime = msdk_time_get_tick() - nBeginTime;
-        if (nFrameTime < m_nReqFrameTime) {
-            MSDK_USLEEP((mfxU32)(m_nReqFrameTime - nFrameTime));
-        }
+        m_FramePacer.Work();
         if (++m_nProcessedFramesNum >= m_MaxFramesForTranscode) {
             break;
         }
@@ -1482,7 +1524,6 @@ mfxStatus CTranscodingPipeline::Encode() {
 
     bool shouldReadNextFrame = true;
     while (MFX_ERR_NONE == sts || MFX_ERR_MORE_DATA == sts) {
-        msdk_tick nBeginTime = msdk_time_get_tick(); // microseconds
         if (shouldReadNextFrame) {
             if (isQuit) {
                 // We're here because one of decoders has reported that there're no any more frames ready.
@@ -1620,7 +1661,7 @@ mfxStatus CTranscodingPipeline::Encode() {
 
         curBuffer = m_pBuffer;
 
-        pBS = m_pBSStore->GetNext();
+        pBS = m_pBSStore->GetNext(m_pBSWriter ? GetSyncOpTimeout() : 0);
         if (!pBS)
             return MFX_ERR_NOT_FOUND;
 
@@ -1629,6 +1670,10 @@ mfxStatus CTranscodingPipeline::Encode() {
         mfxU32 NumFramesForReset =
             m_pParentPipeline ? m_pParentPipeline->GetNumFramesForReset() : 0;
         if (NumFramesForReset && !(m_nProcessedFramesNum % NumFramesForReset)) {
+            if (m_pBSWriter) {
+                mfxStatus sts_flush = m_pBSWriter->Flush();
+                MSDK_CHECK_STATUS(sts_flush, "m_pBSWriter->Flush failed");
+            }
             m_pBSProcessor->ResetOutput();
         }
 
@@ -1724,10 +1769,18 @@ mfxStatus CTranscodingPipeline::Encode() {
             (statisticsWindowSize && (m_nProcessedFramesNum >= m_MaxFramesForTranscode))) {
             outputStatistics.PrintStatistics(GetPipelineID());
             outputStatistics.ResetStatistics();
+            if (m_pBSWriter) {
+                m_pBSWriter->PrintStatistics(GetPipelineID());
+                m_pBSWriter->ResetStatistics();
+            }
+            if (m_LatencyStat.IsEnabled()) {
+                m_LatencyStat.PrintStatistics(GetPipelineID());
+            }
         }
 
-        m_BSPool.back()->Syncp = VppExtSurface.Syncp;
-        m_BSPool.back()->pCtrl = VppExtSurface.pAuxCtrl;
+        m_BSPool.back()->Syncp      = VppExtSurface.Syncp;
+        m_BSPool.back()->pCtrl      = VppExtSurface.pAuxCtrl;
+        m_BSPool.back()->SubmitTime = msdk_time_get_tick();
 
         /* Actually rendering... if enabled
          * SYNC have not done by driver !!! */
@@ -1770,19 +1823,16 @@ mfxStatus CTranscodingPipeline::Encode() {
         }
 
         if ((m_nVPPCompMode != VppCompOnly) || (m_nVPPCompMode == VppCompOnlyEncode)) {
-            if (m_BSPool.size() == m_AsyncDepth) {
-                sts = PutBS();
-                MSDK_CHECK_STATUS(sts, "PutBS failed");
-            }
-            else {
+            // frame pacing waits only after something is written
+            mfxU32 nOutputFramesNum = m_nOutputFramesNum;
+            sts                     = PutOutputBS();
+            MSDK_CHECK_STATUS(sts, "PutOutputBS failed");
+            if (m_nOutputFramesNum == nOutputFramesNum) {
                 continue;
             }
         } // if (m_nVPPCompMode != VppCompOnly)
 
-        msdk_tick nFrameTime = msdk_time_get_tick() - nBeginTime;
-        if (nFrameTime < m_nReqFrameTime) {
-            MSDK_USLEEP((mfxU32)(m_nReqFrameTime - nFrameTime));
-        }
+        m_FramePacer.Work();
     }
     MSDK_IGNORE_MFX_STS(sts, MFX_ERR_MORE_DATA);
 
@@ -1796,6 +1846,11 @@ mfxStatus CTranscodingPipeline::Encode() {
         }
     }
 
+    if (MFX_ERR_NONE == sts && m_pBSWriter) {
+        sts = m_pBSWriter->Flush();
+        MSDK_CHECK_STATUS(sts, "m_pBSWriter->Flush failed");
+    }
+
     // Clean up decoder buffers to avoid locking them (if some decoder still have some data to decode, but does not have enough surfaces)
     if (m_nVPPCompMode != 0) {
         // Composition case - we have to clean up all buffers (all of them have data from decoders)
@@ -1995,16 +2050,24 @@ void CTranscodingPipeline::SetEncCtrlRT(ExtendedSurface& extSurface, bool bInser
 }
 
 mfxStatus CTranscodingPipeline::Transcode() {
-    mfxStatus sts                 = MFX_ERR_NONE;
-    ExtendedSurface DecExtSurface = { 0 };
-    ExtendedSurface VppExtSurface = { 0 };
-    ExtendedBS* pBS               = NULL;
-    bool bNeedDecodedFrames       = true; // indicates if we need to decode frames
-    bool bEndOfFile               = false;
-    bool bLastCycle               = false;
-    bool shouldReadNextFrame      = true;
-
-    time_t start = time(0);
+    mfxStatus sts   = MFX_ERR_NONE;
+    ExtendedBS* pBS = NULL;
+
+    // in cooperative mode the loop returns MFX_ERR_NONE after each frame and continues from
+    // the same state on the next call
+    if (!m_TranscodeState.bInProgress) {
+        m_TranscodeState             = TranscodeLoopState();
+        m_TranscodeState.bInProgress = true;
+        m_TranscodeState.start       = time(0);
+    }
+    ExtendedSurface& DecExtSurface = m_TranscodeState.DecExtSurface;
+    ExtendedSurface& VppExtSurface = m_TranscodeState.VppExtSurface;
+    bool& bNeedDecodedFrames       = m_TranscodeState.bNeedDecodedFrames;
+    bool& bEndOfFile               = m_TranscodeState.bEndOfFile;
+    bool& bLastCycle               = m_TranscodeState.bLastCycle;
+    bool& shouldReadNextFrame      = m_TranscodeState.shouldReadNextFrame;
+    time_t& start                  = m_TranscodeState.start;
+
     while (MFX_ERR_NONE == sts) {
         msdk_tick nBeginTime = msdk_time_get_tick(); // microseconds.
 
@@ -2025,6 +2088,10 @@ mfxStatus CTranscodingPipeline::Transcode() {
                         m_bInsertIDR = true;
 
                         m_pBSProcessor->ResetInput();
+                        if (m_pBSWriter) {
+                            mfxStatus sts_flush = m_pBSWriter->Flush();
+                            MSDK_CHECK_STATUS(sts_flush, "m_pBSWriter->Flush failed");
+                        }
                         m_pBSProcessor->ResetOutput();
                         bNeedDecodedFrames = true;
 
@@ -2126,6 +2193,9 @@ mfxStatus CTranscodingPipeline::Transcode() {
             {
                 VppExtSurface.pSurface = NULL; // to get buffered ENC frames
             }
+            else if (m_bCooperative) {
+                return MFX_ERR_NONE; // get next frame from Decode on the next call
+            }
             else {
                 continue; // go get next frame from Decode
             }
@@ -2134,7 +2204,7 @@ mfxStatus CTranscodingPipeline::Transcode() {
         MSDK_CHECK_STATUS(sts, "Unexpected error!!");
 
         // encode frame
-        pBS = m_pBSStore->GetNext();
+        pBS = m_pBSStore->GetNext(m_pBSWriter ? GetSyncOpTimeout() : 0);
         if (!pBS)
             return MFX_ERR_NOT_FOUND;
 
@@ -2179,6 +2249,8 @@ mfxStatus CTranscodingPipeline::Transcode() {
                 break;
             }
             sts = MFX_ERR_NONE;
+            if (m_bCooperative)
+                return sts;
             continue;
         }
 
@@ -2198,23 +2270,29 @@ mfxStatus CTranscodingPipeline::Transcode() {
                         : -1);
                 inputStatistics.ResetStatistics();
                 outputStatistics.ResetStatistics();
+                if (m_pBSWriter) {
+                    m_pBSWriter->PrintStatistics(GetPipelineID());
+                    m_pBSWriter->ResetStatistics();
+                }
+                if (m_LatencyStat.IsEnabled()) {
+                    m_LatencyStat.PrintStatistics(GetPipelineID());
+                }
             }
         }
         else if (0 == (m_nProcessedFramesNum - 1) % 100) {
             printf(".");
         }
 
-        m_BSPool.back()->Syncp = VppExtSurface.Syncp;
+        m_BSPool.back()->Syncp      = VppExtSurface.Syncp;
+        m_BSPool.back()->SubmitTime = nBeginTime;
 
-        if (m_BSPool.size() == m_AsyncDepth) {
-            sts = PutBS();
-            MSDK_CHECK_STATUS(sts, "PutBS failed");
-        }
+        sts = PutOutputBS();
+        MSDK_CHECK_STATUS(sts, "PutOutputBS failed");
 
-        msdk_tick nFrameTime = msdk_time_get_tick() - nBeginTime;
-        if (nFrameTime < m_nReqFrameTime) {
-            MSDK_USLEEP((mfxU32)(m_nReqFrameTime - nFrameTime));
-        }
+        m_FramePacer.Work();
+
+        if (m_bCooperative)
+            return MFX_ERR_NONE;
     }
     MSDK_IGNORE_MFX_STS(sts, MFX_ERR_MORE_DATA);
 
@@ -2226,6 +2304,11 @@ mfxStatus CTranscodingPipeline::Transcode() {
         }
     }
 
+    if (MFX_ERR_NONE == sts && m_pBSWriter) {
+        sts = m_pBSWriter->Flush();
+        MSDK_CHECK_STATUS(sts, "m_pBSWriter->Flush failed");
+    }
+
     if (MFX_ERR_NONE == sts)
         sts = MFX_WRN_VALUE_NOT_CHANGED;
 
@@ -2233,52 +2316,134 @@ mfxStatus CTranscodingPipeline::Transcode() {
 } // mfxStatus CTranscodingPipeline::Transcode()
 
 mfxStatus CTranscodingPipeline::PutBS() {
-    mfxStatus sts            = MFX_ERR_NONE;
     ExtendedBS* pBitstreamEx = m_BSPool.front();
     MSDK_CHECK_POINTER(pBitstreamEx, MFX_ERR_NULL_PTR);
 
+    mfxStatus sts = SyncBS(pBitstreamEx, GetSyncOpTimeout());
+    MSDK_CHECK_STATUS(sts, "SyncBS failed");
+    AddSyncCompletions(1);
+
+    return WriteBS(1);
+} //mfxStatus CTranscodingPipeline::PutBS()
+
+mfxStatus CTranscodingPipeline::SyncBS(ExtendedBS* pBitstreamEx, mfxU32 timeout) {
     // get result coded stream, synchronize only if we still have sync point
-    if (pBitstreamEx->Syncp) {
+    if (!pBitstreamEx->Syncp)
+        return MFX_ERR_NONE;
+
+    mfxStatus sts = MFX_ERR_NONE;
+    if (!timeout) {
+        // frame which isn't ready is left as is, probing isn't traced as waiting
+        sts = m_pmfxSession->SyncOperation(pBitstreamEx->Syncp, 0);
+        if (MFX_WRN_IN_EXECUTION == sts)
+            return sts;
+    }
+    else {
+        CLatencyScope latencyScope(m_LatencyStat, LATENCY_STAGE_SYNC);
         m_ScalerConfig.Tracer->BeginEvent(SMTTracer::ThreadType::ENC,
                                           TargetID,
                                           SMTTracer::EventName::SYNC,
                                           pBitstreamEx->Syncp,
                                           nullptr);
-        sts = m_pmfxSession->SyncOperation(pBitstreamEx->Syncp, GetSyncOpTimeout());
+        sts = m_pmfxSession->SyncOperation(pBitstreamEx->Syncp, timeout);
 
         m_ScalerConfig.Tracer->EndEvent(SMTTracer::ThreadType::ENC,
                                         TargetID,
                                         SMTTracer::EventName::SYNC,
                                         pBitstreamEx->Syncp,
                                         nullptr);
-        m_ScalerConfig.Tracer->AfterEncodeSync();
-        HandlePossibleGpuHang(sts);
-        MSDK_CHECK_ERR_NONE_STATUS(sts, MFX_ERR_ABORTED, "Encode: SyncOperation failed");
-        if (m_pSurfaceUtilizationSynchronizer && m_MemoryModel != GENERAL_ALLOC) {
-            m_pSurfaceUtilizationSynchronizer->NotifyFreeCome();
-        }
+    }
+    m_ScalerConfig.Tracer->AfterEncodeSync();
+    HandlePossibleGpuHang(sts);
+    MSDK_CHECK_ERR_NONE_STATUS(sts, MFX_ERR_ABORTED, "Encode: SyncOperation failed");
+    // encoded frame releases its input surface
+    m_SurfaceReleaseNotifier.NotifyRelease();
+    if (m_pSurfaceUtilizationSynchronizer && m_MemoryModel != GENERAL_ALLOC) {
+        m_pSurfaceUtilizationSynchronizer->NotifyFreeCome();
     }
 
-    m_nOutputFramesNum++;
+    // sync point isn't valid after successful synchronization
+    pBitstreamEx->Syncp = nullptr;
 
-    //--- Time measurements
-    if (statisticsWindowSize) {
-        outputStatistics.StopTimeMeasurementWithCheck();
+    return MFX_ERR_NONE;
+} //mfxStatus CTranscodingPipeline::SyncBS()
+
+void CTranscodingPipeline::AddSyncCompletions(mfxU32 numFrames) {
+    if (!m_bAdaptiveSync)
+        return;
+
+    // completions observed by one probe are one sample, latency of the last submitted frame
+    // is the closest to the time it actually completed
+    msdk_tick submitTime = 0;
+    mfxU32 numNew        = 0;
+    for (mfxU32 i = 0; i < numFrames; i++) {
+        ExtendedBS* pBitstreamEx = m_BSPool[i];
+        if (!pBitstreamEx->SubmitTime)
+            continue;
+        submitTime               = pBitstreamEx->SubmitTime;
+        pBitstreamEx->SubmitTime = 0;
+        numNew++;
+    }
+    if (numNew)
+        m_SyncWindow.AddCompletions(submitTime, numNew, msdk_time_get_tick());
+}
+
+mfxStatus CTranscodingPipeline::WriteBS(mfxU32 numFrames) {
+    mfxStatus sts = MFX_ERR_NONE;
+    if (numFrames > m_BSPool.size())
+        return MFX_ERR_UNDEFINED_BEHAVIOR;
+
+    m_nOutputFramesNum += numFrames;
+
+    //--- Time measurements, interval is split between frames written at once
+    if (statisticsWindowSize && numFrames) {
+        outputStatistics.StopTimeMeasurementWithCheck(numFrames);
         outputStatistics.StartTimeMeasurement();
     }
 
+    if (m_pBSWriter) {
+        m_WriteBatch.clear();
+        for (mfxU32 i = 0; i < numFrames; i++) {
+            ExtendedBS* pBitstreamEx = m_BSPool.front();
+            m_BSPool.pop_front();
+
+            // aux buffer is not needed for writing, so it can be reused right away
+            UnPreEncAuxBuffer(pBitstreamEx->pCtrl);
+            pBitstreamEx->pCtrl = nullptr;
+            m_WriteBatch.push_back(pBitstreamEx);
+        }
+        if (m_WriteBatch.empty())
+            return sts;
+
+        // bitstreams are queued at once, so writer thread wakes up once for all of them
+        sts = m_pBSWriter->PutBS(m_WriteBatch.data(),
+                                 (mfxU32)m_WriteBatch.size(),
+                                 m_nOutputFramesNum - numFrames + 1);
+        MSDK_CHECK_STATUS(sts, "m_pBSWriter->PutBS failed");
+        return sts;
+    }
+
+    if (!numFrames)
+        return sts;
+
     m_ScalerConfig.Tracer->BeginEvent(SMTTracer::ThreadType::ENC,
                                       TargetID,
                                       SMTTracer::EventName::WRITE_BS,
                                       nullptr,
                                       nullptr);
-    if (!m_ScalerConfig.ParallelEncodingRequired) {
-        sts = m_pBSProcessor->ProcessOutputBitstream(&pBitstreamEx->Bitstream);
-    }
-    else {
-        sts = m_pBSProcessor->ProcessOutputBitstream(&pBitstreamEx->Bitstream,
-                                                     TargetID,
-                                                     m_nOutputFramesNum);
+    {
+        CLatencyScope latencyScope(m_LatencyStat, LATENCY_STAGE_WRITE);
+        mfxU32 frameNum = m_nOutputFramesNum - numFrames + 1;
+        for (mfxU32 i = 0; i < numFrames && MFX_ERR_NONE == sts; i++, frameNum++) {
+            if (!m_ScalerConfig.ParallelEncodingRequired) {
+                sts = m_pBSProcessor->ProcessOutputBitstream(&m_BSPool[i]->Bitstream);
+            }
+            else {
+                sts = m_pBSProcessor->ProcessOutputBitstream(&m_BSPool[i]->Bitstream,
+                                                             TargetID,
+                                                             frameNum);
+            }
+        }
     }
     m_ScalerConfig.Tracer->EndEvent(SMTTracer::ThreadType::ENC,
                                     TargetID,
@@ -2287,17 +2452,60 @@ mfxStatus CTranscodingPipeline::PutBS() {
                                     nullptr);
     MSDK_CHECK_STATUS(sts, "m_pBSProcessor->ProcessOutputBitstream failed");
 
-    UnPreEncAuxBuffer(pBitstreamEx->pCtrl);
+    for (mfxU32 i = 0; i < numFrames; i++) {
+        ExtendedBS* pBitstreamEx = m_BSPool.front();
+        UnPreEncAuxBuffer(pBitstreamEx->pCtrl);
 
-    pBitstreamEx->Bitstream.DataLength = 0;
-    pBitstreamEx->Bitstream.DataOffset = 0;
+        pBitstreamEx->Bitstream.DataLength = 0;
+        pBitstreamEx->Bitstream.DataOffset = 0;
 
-    if (m_BSPool.size())
         m_BSPool.pop_front();
-    m_pBSStore->Release(pBitstreamEx);
+        m_pBSStore->Release(pBitstreamEx);
+    }
 
     return sts;
-} //mfxStatus CTranscodingPipeline::PutBS()
+} //mfxStatus CTranscodingPipeline::WriteBS()
+
+mfxStatus CTranscodingPipeline::PutCompletedBS() {
+    // frames are written in order, so probing stops at the first frame which isn't ready
+    mfxU32 numCompleted = 0;
+    while (numCompleted < m_BSPool.size()) {
+        mfxStatus sts = SyncBS(m_BSPool[numCompleted], 0);
+        if (MFX_WRN_IN_EXECUTION == sts)
+            break;
+        MSDK_CHECK_STATUS(sts, "SyncBS failed");
+        numCompleted++;
+    }
+    AddSyncCompletions(numCompleted);
+
+    return WriteBS(numCompleted);
+} //mfxStatus CTranscodingPipeline::PutCompletedBS()
+
+mfxStatus CTranscodingPipeline::PutOutputBS() {
+    mfxStatus sts = MFX_ERR_NONE;
+    if (m_bSyncDrain || m_bAdaptiveSync) {
+        sts = PutCompletedBS();
+        MSDK_CHECK_STATUS(sts, "PutCompletedBS failed");
+    }
+
+    mfxU32 window = m_AsyncDepth;
+    if (m_bAdaptiveSync) {
+        window = m_SyncWindow.GetWindow();
+        if (m_SyncWindow.IsDrainRequired()) {
+            while (m_BSPool.size()) {
+                sts = PutBS();
+                MSDK_CHECK_STATUS(sts, "PutBS failed");
+            }
+            m_SyncWindow.Drained();
+        }
+    }
+
+    while (m_BSPool.size() >= window) {
+        sts = PutBS();
+        MSDK_CHECK_STATUS(sts, "PutBS failed");
+    }
+    return sts;
+} //mfxStatus CTranscodingPipeline::PutOutputBS()
 
 mfxStatus CTranscodingPipeline::ReplaceBlackSurface(mfxFrameSurface1* pSurf) {
     mfxStatus sts = MFX_ERR_NONE;
@@ -2438,24 +2646,18 @@ mfxStatus CTranscodingPipeline::I420toBS(mfxFrameSurface1* pSurface, mfxBitstrea
     mfxU16 w     = info.CropW;
     mfxU16 h     = info.CropH;
 
-    for (mfxU16 i = 0; i < h; i++) {
-        MSDK_MEMCPY(pBS->Data + pBS->DataLength, w, data.Y + i * pitch, w);
-        pBS->DataLength += w;
-    }
+    CopyPlane(data.Y, pitch, pBS->Data + pBS->DataLength, w, w, h);
+    pBS->DataLength += w * h;
 
     pitch /= 2;
     w /= 2;
     h /= 2;
 
-    for (mfxU16 i = 0; i < h; i++) {
-        MSDK_MEMCPY(pBS->Data + pBS->DataLength, w, data.U + i * pitch, w);
-        pBS->DataLength += w;
-    }
+    CopyPlane(data.U, pitch, pBS->Data + pBS->DataLength, w, w, h);
+    pBS->DataLength += w * h;
 
-    for (mfxU16 i = 0; i < h; i++) {
-        MSDK_MEMCPY(pBS->Data + pBS->DataLength, w, data.V + i * pitch, w);
-        pBS->DataLength += w;
-    }
+    CopyPlane(data.V, pitch, pBS->Data + pBS->DataLength, w, w, h);
+    pBS->DataLength += w * h;
 
     return MFX_ERR_NONE;
 }
@@ -2468,26 +2670,28 @@ mfxStatus CTranscodingPipeline::NV12asI420toBS(mfxFrameSurface1* pSurface,
         pBS->Extend(pBS->DataLength + (int)(info.CropH * info.CropW * 3 / 2));
     }
 
-    for (mfxU16 i = 0; i < info.CropH; i++) {
-        MSDK_MEMCPY(pBS->Data + pBS->DataLength,
-                    info.CropW,
-                    data.Y + (info.CropY * data.Pitch + info.CropX) + i * data.Pitch,
-                    info.CropW);
-        pBS->DataLength += info.CropW;
-    }
+    CopyPlane(data.Y + (info.CropY * data.Pitch + info.CropX),
+              data.Pitch,
+              pBS->Data + pBS->DataLength,
+              info.CropW,
+              info.CropW,
+              info.CropH);
+    pBS->DataLength += info.CropW * info.CropH;
 
     mfxU16 h = info.CropH / 2;
-    mfxU16 w = info.CropW;
-
-    for (mfxU16 offset = 0; offset < 2; offset++) {
-        for (mfxU16 i = 0; i < h; i++) {
-            for (mfxU16 j = offset; j < w; j += 2) {
-                pBS->Data[pBS->DataLength] =
-                    *(data.UV + (info.CropY * data.Pitch / 2 + info.CropX) + i * data.Pitch + j);
-                pBS->DataLength++;
-            }
-        }
-    }
+    mfxU16 w = info.CropW / 2;
+
+    mfxU8* pU = pBS->Data + pBS->DataLength;
+    mfxU8* pV = pU + w * h;
+    GetFrameCopyKernels()->SplitUV(data.UV + (info.CropY * data.Pitch / 2 + info.CropX),
+                                   data.Pitch,
+                                   pU,
+                                   w,
+                                   pV,
+                                   w,
+                                   w,
+                                   h);
+    pBS->DataLength += 2 * w * h;
 
     return MFX_ERR_NONE;
 }
@@ -2499,21 +2703,21 @@ mfxStatus CTranscodingPipeline::NV12toBS(mfxFrameSurface1* pSurface, mfxBitstrea
         pBS->Extend(pBS->DataLength + (int)(info.CropH * info.CropW * 3 / 2));
     }
 
-    for (mfxU16 i = 0; i < info.CropH; i++) {
-        MSDK_MEMCPY(pBS->Data + pBS->DataLength,
-                    info.CropW,
-                    data.Y + (info.CropY * data.Pitch + info.CropX) + i * data.Pitch,
-                    info.CropW);
-        pBS->DataLength += info.CropW;
-    }
+    CopyPlane(data.Y + (info.CropY * data.Pitch + info.CropX),
+              data.Pitch,
+              pBS->Data + pBS->DataLength,
+              info.CropW,
+              info.CropW,
+              info.CropH);
+    pBS->DataLength += info.CropW * info.CropH;
 
-    for (mfxU16 i = 0; i < info.CropH / 2; i++) {
-        MSDK_MEMCPY(pBS->Data + pBS->DataLength,
-                    info.CropW,
-                    data.UV + (info.CropY * data.Pitch + info.CropX) + i * data.Pitch,
-                    info.CropW);
-        pBS->DataLength += info.CropW;
-    }
+    CopyPlane(data.UV + (info.CropY * data.Pitch + info.CropX),
+              data.Pitch,
+              pBS->Data + pBS->DataLength,
+              info.CropW,
+              info.CropW,
+              info.CropH / 2);
+    pBS->DataLength += info.CropW * (info.CropH / 2);
 
     return MFX_ERR_NONE;
 }
@@ -2525,13 +2729,13 @@ mfxStatus CTranscodingPipeline::RGB4toBS(mfxFrameSurface1* pSurface, mfxBitstrea
         pBS->Extend(pBS->DataLength + (int)(info.CropH * info.CropW * 4));
     }
 
-    for (mfxU16 i = 0; i < info.CropH; i++) {
-        MSDK_MEMCPY(pBS->Data + pBS->DataLength,
-                    info.CropW * 4,
-                    data.B + (info.CropY * data.Pitch + info.CropX * 4) + i * data.Pitch,
-                    info.CropW * 4);
-        pBS->DataLength += info.CropW * 4;
-    }
+    CopyPlane(data.B + (info.CropY * data.Pitch + info.CropX * 4),
+              data.Pitch,
+              pBS->Data + pBS->DataLength,
+              info.CropW * 4,
+              info.CropW * 4,
+              info.CropH);
+    pBS->DataLength += info.CropW * 4 * info.CropH;
 
     return MFX_ERR_NONE;
 }
@@ -2543,13 +2747,13 @@ mfxStatus CTranscodingPipeline::YUY2toBS(mfxFrameSurface1* pSurface, mfxBitstrea
         pBS->Extend(pBS->DataLength + (int)(info.CropH * info.CropW * 4));
     }
 
-    for (mfxU16 i = 0; i < info.CropH; i++) {
-        MSDK_MEMCPY(pBS->Data + pBS->DataLength,
-                    info.CropW * 2,
-                    data.Y + (info.CropY * data.Pitch + info.CropX / 2 * 4) + i * data.Pitch,
-                    info.CropW * 2);
-        pBS->DataLength += info.CropW * 2;
-    }
+    CopyPlane(data.Y + (info.CropY * data.Pitch + info.CropX / 2 * 4),
+              data.Pitch,
+              pBS->Data + pBS->DataLength,
+              info.CropW * 2,
+              info.CropW * 2,
+              info.CropH);
+    pBS->DataLength += info.CropW * 2 * info.CropH;
 
     return MFX_ERR_NONE;
 }
@@ -4220,6 +4424,14 @@ mfxStatus CTranscodingPipeline::Init(sInputParams* pParams,
         outputStatistics.SetDumpName(pParams->DumpLogFileName + "_output");
     }
 
+    if (pParams->bLatencyStatistics) {
+        m_LatencyStat.Enable();
+        if (pParams->statisticsLogFile) {
+            m_LatencyStat.SetOutputFile(pParams->statisticsLogFile);
+        }
+        m_LatencyDumpName = pParams->LatencyDumpFileName;
+    }
+
     // if no statistic-window is passed but overall stat-log exist:
     // is requested, set statisticsWindowSize to m_MaxFramesForTranscode
     if ((pParams->statisticsLogFile || !pParams->DumpLogFileName.empty()) &&
@@ -4227,7 +4439,31 @@ mfxStatus CTranscodingPipeline::Init(sInputParams* pParams,
         statisticsWindowSize = m_MaxFramesForTranscode;
 
     if (m_bEncodeEnable) {
-        m_pBSStore.reset(new ExtendedBSStore(m_AsyncDepth));
+        // writer thread holds up to nAsyncWriteDepth bitstreams in addition to encoder ones
+        m_pBSStore.reset(new ExtendedBSStore(m_AsyncDepth + pParams->nAsyncWriteDepth));
+        m_BSPool.Init(m_pBSStore->GetSize());
+        m_WriteBatch.reserve(m_pBSStore->GetSize());
+
+        m_bSyncDrain    = pParams->bSyncDrain;
+        m_bAdaptiveSync = pParams->bAdaptiveSync;
+        if (m_bAdaptiveSync)
+            m_SyncWindow.Init(m_AsyncDepth);
+
+        if (pParams->nAsyncWriteDepth && Sink != pParams->eMode) {
+            m_pBSWriter.reset(new AsyncBitstreamWriter(m_pBSProcessor,
+                                                       m_pBSStore.get(),
+                                                       TargetID,
+                                                       m_ScalerConfig.ParallelEncodingRequired));
+            if (pParams->statisticsLogFile) {
+                m_pBSWriter->SetOutputFile(pParams->statisticsLogFile);
+            }
+            if (m_LatencyStat.IsEnabled()) {
+                m_pBSWriter->SetLatencyStat(&m_LatencyStat);
+            }
+            m_pBSWriter->SetTracer(m_ScalerConfig.Tracer);
+            sts = m_pBSWriter->Start();
+            MSDK_CHECK_STATUS(sts, "m_pBSWriter->Start failed");
+        }
     }
 
     // Determine processing mode
@@ -4298,6 +4534,16 @@ mfxStatus CTranscodingPipeline::Init(sInputParams* pParams,
 
     m_pBuffer = pBuffer;
 
+    // decoder of heterogeneous pipeline is woken up when its surfaces are released by encoders
+    if (m_pBuffer && m_bDecodeEnable && !m_bEncodeEnable) {
+        m_pBuffer->SetReleaseNotifier(&m_SurfaceReleaseNotifier);
+        if (0 == m_nVPPCompMode) {
+            for (SafetySurfaceBuffer* buf = m_pBuffer->m_pNext; buf != NULL; buf = buf->m_pNext) {
+                buf->SetReleaseNotifier(&m_SurfaceReleaseNotifier);
+            }
+        }
+    }
+
     m_initPar.Version.Major = 2;
     m_initPar.Version.Minor = 2;
 
@@ -4645,46 +4891,11 @@ mfxStatus CTranscodingPipeline::CompleteInit() {
     return sts;
 } // mfxStatus CTranscodingPipeline::CompleteInit()
 mfxFrameSurface1* CTranscodingPipeline::GetFreeSurface(bool isDec, mfxU64 timeout) {
-    mfxFrameSurface1* pSurf = NULL;
-
-    CTimer t;
-    t.Start();
-    do {
-        {
-            std::lock_guard<std::mutex> lock(m_mStopSession);
-            if (m_bForceStop) {
-                printf("WARNING: m_bForceStop is set, returning NULL ptr from GetFreeSurface\n");
-                break;
-            }
-        }
-
-        SurfPointersArray& workArray = isDec ? m_pSurfaceDecPool : m_pSurfaceEncPool;
-
-        int available =
-            (int)std::count_if(workArray.begin(), workArray.end(), [](mfxFrameSurface1* s) {
-                return s->Data.Locked == 0;
-            });
-        m_ScalerConfig.Tracer->AddCounterEvent(
-            isDec ? SMTTracer::ThreadType::DEC : SMTTracer::ThreadType::ENC,
-            TargetID,
-            SMTTracer::EventName::UNDEF,
-            available);
-
-        for (mfxU32 i = 0; i < workArray.size(); i++) {
-            if (!workArray[i]->Data.Locked) {
-                pSurf = workArray[i];
-                break;
-            }
-        }
-        if (pSurf) {
-            break;
-        }
-        else {
-            MSDK_SLEEP(TIME_TO_SLEEP);
-        }
-    } while (t.GetTime() < timeout / 1000);
-
-    return pSurf;
+    return WaitForFreeSurface(isDec ? m_pSurfaceDecPool : m_pSurfaceEncPool,
+                              isDec ? m_DecPoolState : m_EncPoolState,
+                              isDec ? SMTTracer::ThreadType::DEC : SMTTracer::ThreadType::ENC,
+                              TargetID,
+                              timeout);
 } // mfxFrameSurface1* CTranscodingPipeline::GetFreeSurface(bool isDec)
 
 mfxFrameSurface1* CTranscodingPipeline::GetFreeSurfaceForCS(bool isDec, mfxU64 timeout, mfxU32 ID) {
@@ -4692,7 +4903,21 @@ mfxFrameSurface1* CTranscodingPipeline::GetFreeSurfaceForCS(bool isDec, mfxU64 t
         return GetFreeSurface(isDec, timeout);
     }
 
+    auto desc = m_ScalerConfig.GetDesc(ID);
+    return WaitForFreeSurface(m_CSSurfacePools[desc.PoolID],
+                              m_CSPoolStates[desc.PoolID],
+                              SMTTracer::ThreadType::CSVPP,
+                              desc.PoolID,
+                              timeout);
+}
+
+mfxFrameSurface1* CTranscodingPipeline::WaitForFreeSurface(SurfPointersArray& workArray,
+                                                           SurfacePoolState& poolState,
+                                                           SMTTracer::ThreadType thType,
+                                                           mfxU32 thID,
+                                                           mfxU64 timeout) {
     mfxFrameSurface1* pSurf = NULL;
+    SMTTracer* pTracer      = m_ScalerConfig.Tracer;
 
     CTimer t;
     t.Start();
@@ -4705,30 +4930,41 @@ mfxFrameSurface1* CTranscodingPipeline::GetFreeSurfaceForCS(bool isDec, mfxU64 t
             }
         }
 
-        auto desc                    = m_ScalerConfig.GetDesc(ID);
-        SurfPointersArray& workArray = m_CSSurfacePools[desc.PoolID];
+        // take release counter before the scan, so release which happens during the scan
+        // is not missed by the following wait
+        mfxU64 releaseCount = m_SurfaceReleaseNotifier.GetReleaseCount();
 
-        int available =
-            (int)std::count_if(workArray.begin(), workArray.end(), [](mfxFrameSurface1* s) {
-                return s->Data.Locked == 0;
-            });
-        m_ScalerConfig.Tracer->AddCounterEvent(SMTTracer::ThreadType::CSVPP,
-                                               desc.PoolID,
-                                               SMTTracer::EventName::UNDEF,
-                                               available);
-
-        for (mfxU32 i = 0; i < workArray.size(); i++) {
-            if (!workArray[i]->Data.Locked) {
-                pSurf = workArray[i];
+        if (pTracer->IsEnabled()) {
+            int available =
+                (int)std::count_if(workArray.begin(), workArray.end(), [](mfxFrameSurface1* s) {
+                    return s->Data.Locked == 0;
+                });
+            pTracer->AddCounterEvent(thType, thID, SMTTracer::EventName::UNDEF, available);
+        }
+
+        // surfaces are usually released in the order they were taken, so the search starts
+        // right after the last taken surface and typically ends on the first check
+        mfxU32 size = (mfxU32)workArray.size();
+        for (mfxU32 i = 0; i < size; i++) {
+            mfxU32 idx = (poolState.NextIdx + i) % size;
+            if (!workArray[idx]->Data.Locked) {
+                pSurf             = workArray[idx];
+                poolState.NextIdx = (idx + 1) % size;
                 break;
             }
         }
         if (pSurf) {
             break;
         }
-        else {
-            MSDK_SLEEP(TIME_TO_SLEEP);
-        }
+
+        CTimer waitTimer;
+        waitTimer.Start();
+        m_SurfaceReleaseNotifier.WaitForRelease(releaseCount, TIME_TO_SLEEP);
+        poolState.WaitTime += (mfxU64)(waitTimer.GetTime() * 1000000);
+        pTracer->AddCounterEvent(thType,
+                                 thID,
+                                 SMTTracer::EventName::SURF_WAIT,
+                                 poolState.WaitTime);
     } while (t.GetTime() < timeout / 1000);
 
     return pSurf;
@@ -4781,12 +5017,13 @@ void CTranscodingPipeline::HandlePossibleGpuHang(mfxStatus& sts) {
     if (sts == MFX_ERR_GPU_HANG && m_bSoftGpuHangRecovery) {
         printf("[WARNING] GPU hang happened. Inserting an IDR and continuing transcoding.\n");
         m_bInsertIDR = true;
-        for (BSList::iterator it = m_BSPool.begin(); it != m_BSPool.end(); it++) {
-            (*it)->IsFree               = true;
-            (*it)->Bitstream.DataOffset = 0;
-            (*it)->Bitstream.DataLength = 0;
+        while (!m_BSPool.empty()) {
+            ExtendedBS* pBS           = m_BSPool.front();
+            pBS->Bitstream.DataOffset = 0;
+            pBS->Bitstream.DataLength = 0;
+            m_BSPool.pop_front();
+            m_pBSStore->Release(pBS);
         }
-        m_BSPool.clear();
         sts = MFX_ERR_NONE;
     }
 }
@@ -4849,6 +5086,8 @@ size_t CTranscodingPipeline::GetRobustFlag() {
 }
 
 void CTranscodingPipeline::Close() {
+    m_pBSWriter.reset();
+
     m_pmfxDEC.reset();
 
     m_pmfxENC.reset();
@@ -4892,6 +5131,28 @@ void CTranscodingPipeline::Close() {
 
 } // void CTranscodingPipeline::Close()
 
+void CTranscodingPipeline::PrintLatencyStatistics() {
+    if (!m_LatencyStat.IsEnabled())
+        return;
+
+    m_LatencyStat.PrintStatistics(GetPipelineID());
+    if (!m_LatencyDumpName.empty()) {
+        m_LatencyStat.DumpStatistics(m_LatencyDumpName, GetPipelineID());
+    }
+}
+
+void CTranscodingPipeline::PrintPacingStatistics() {
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "Pacing[%u]:", (unsigned int)GetPipelineID());
+    m_FramePacer.PrintStatistics(prefix);
+}
+
+void CTranscodingPipeline::PrintBusyStatistics() {
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "Device busy[%u]:", (unsigned int)GetPipelineID());
+    m_BusyWaiter.PrintStatistics(prefix);
+}
+
 eAPIVersion CTranscodingPipeline::GetVersionOfSessionInitAPI() {
     return m_verSessionInit;
 }
@@ -4939,6 +5200,10 @@ mfxStatus CTranscodingPipeline::Reset() {
     }
 
     // Release output bitstram pools
+    if (m_pBSWriter) {
+        sts = m_pBSWriter->Flush();
+        MSDK_CHECK_STATUS(sts, "m_pBSWriter->Flush failed");
+    }
     m_BSPool.clear();
     m_pBSStore->ReleaseAll();
     m_pBSStore->FlushAll();
@@ -5032,6 +5297,10 @@ mfxStatus CTranscodingPipeline::Reset(VPLImplementationLoader* mfxLoader) {
     }
 
     // Release output bitstram pools
+    if (m_pBSWriter) {
+        sts = m_pBSWriter->Flush();
+        MSDK_CHECK_STATUS(sts, "m_pBSWriter->Flush failed");
+    }
     m_BSPool.clear();
     m_pBSStore->ReleaseAll();
     m_pBSStore->FlushAll();
@@ -5155,6 +5424,9 @@ mfxStatus CTranscodingPipeline::Run() {
     std::stringstream ss;
     if (m_bDecodeEnable && m_bEncodeEnable) {
         sts = Transcode();
+        // MFX_ERR_NONE means Transcode() yielded, otherwise it starts from scratch next time
+        if (MFX_ERR_NONE != sts)
+            m_TranscodeState.bInProgress = false;
         ss << "CTranscodingPipeline::Run::Transcode() [" << GetSessionText() << "] failed";
         MSDK_CHECK_STATUS(sts, ss.str());
     }
@@ -5192,10 +5464,13 @@ SafetySurfaceBuffer::SafetySurfaceBuffer(SafetySurfaceBuffer* pNext)
         : TargetID(0),
           m_pNext(pNext),
           m_mutex(),
-          m_SList(),
+          m_Ring(RING_SIZE),
+          m_nHead(0),
+          m_nTail(0),
           m_IsBufferingAllowed(true),
           pRelEvent(nullptr),
-          pInsEvent(nullptr) {
+          pInsEvent(nullptr),
+          m_pReleaseNotifier(nullptr) {
     mfxStatus sts = MFX_ERR_NONE;
     pRelEvent     = new MSDKEvent(sts, false, false);
     MSDK_CHECK_POINTER_NO_RET(pRelEvent);
@@ -5211,8 +5486,8 @@ SafetySurfaceBuffer::~SafetySurfaceBuffer() {
 } //SafetySurfaceBuffer::~SafetySurfaceBuffer()
 
 mfxU32 SafetySurfaceBuffer::GetLength() {
-    std::lock_guard<std::mutex> guard(m_mutex);
-    return (mfxU32)m_SList.size();
+    mfxU32 head = m_nHead.load(std::memory_order_acquire);
+    return m_nTail.load(std::memory_order_acquire) - head;
 }
 
 mfxStatus SafetySurfaceBuffer::WaitForSurfaceRelease(mfxU32 msec) {
@@ -5224,68 +5499,84 @@ mfxStatus SafetySurfaceBuffer::WaitForSurfaceInsertion(mfxU32 msec) {
 }
 
 void SafetySurfaceBuffer::AddSurface(ExtendedSurface Surf) {
-    bool isBufferingAllowed = false;
-
-    {
-        std::lock_guard<std::mutex> guard(m_mutex);
+    std::unique_lock<std::mutex> lock(m_mutex);
 
-        isBufferingAllowed = m_IsBufferingAllowed;
-        if (isBufferingAllowed) {
-            SurfaceDescriptor sDescriptor;
-            // Locked is used to signal when we can free surface
-            sDescriptor.Locked     = 1;
-            sDescriptor.ExtSurface = Surf;
+    mfxU32 tail = m_nTail.load(std::memory_order_relaxed);
 
-            if (Surf.pSurface) {
-                IncreaseReference(*Surf.pSurface);
-            }
+    // ring is full, wait until consumer releases something
+    while (m_IsBufferingAllowed && tail - m_nHead.load(std::memory_order_acquire) >= RING_SIZE) {
+        lock.unlock();
+        pRelEvent->TimedWait(TIME_TO_SLEEP);
+        lock.lock();
+    }
 
-            m_SList.push_back(sDescriptor);
-        }
+    if (!m_IsBufferingAllowed) {
+        return;
     }
 
-    if (isBufferingAllowed) {
-        pInsEvent->Signal();
+    SurfaceDescriptor& sDescriptor = m_Ring[tail & (RING_SIZE - 1)];
+    // Locked is used to signal when we can free surface
+    sDescriptor.Locked     = 1;
+    sDescriptor.ExtSurface = Surf;
+
+    if (Surf.pSurface) {
+        IncreaseReference(*Surf.pSurface);
     }
 
+    m_nTail.store(tail + 1, std::memory_order_release);
+    lock.unlock();
+
+    pInsEvent->Signal();
+
 } // SafetySurfaceBuffer::AddSurface(mfxFrameSurface1 *pSurf)
 
 mfxStatus SafetySurfaceBuffer::GetSurface(ExtendedSurface& Surf) {
-    std::lock_guard<std::mutex> guard(m_mutex);
+    mfxU32 head = m_nHead.load(std::memory_order_acquire);
 
     // no ready surfaces
-    if (0 == m_SList.size()) {
+    if (head == m_nTail.load(std::memory_order_acquire)) {
         MSDK_ZERO_MEMORY(Surf)
         return MFX_ERR_MORE_SURFACE;
     }
 
-    SurfaceDescriptor sDescriptor = m_SList.front();
-
-    Surf = sDescriptor.ExtSurface;
+    Surf = m_Ring[head & (RING_SIZE - 1)].ExtSurface;
 
     return MFX_ERR_NONE;
 
 } // SafetySurfaceBuffer::GetSurface()
 
 mfxStatus SafetySurfaceBuffer::ReleaseSurface(mfxFrameSurface1* pSurf) {
-    std::unique_lock<std::mutex> lock(m_mutex);
+    mfxU32 head = m_nHead.load(std::memory_order_acquire);
+    mfxU32 tail = m_nTail.load(std::memory_order_acquire);
 
-    std::list<SurfaceDescriptor>::iterator it;
-    for (it = m_SList.begin(); it != m_SList.end(); it++) {
-        if (pSurf == it->ExtSurface.pSurface) {
-            it->Locked--;
-            if (it->ExtSurface.pSurface)
-                DecreaseReference(*it->ExtSurface.pSurface);
-            if (0 == it->Locked) {
-                m_SList.erase(it);
-                lock.unlock();
-
-                // event operation should be out of synced context
+    // surfaces are released in order of GetSurface calls, so the first descriptor is the one
+    for (mfxU32 i = head; i != tail; i++) {
+        SurfaceDescriptor& sDescriptor = m_Ring[i & (RING_SIZE - 1)];
+        if (0 == sDescriptor.Locked || pSurf != sDescriptor.ExtSurface.pSurface) {
+            continue;
+        }
+
+        sDescriptor.Locked--;
+        if (sDescriptor.ExtSurface.pSurface)
+            DecreaseReference(*sDescriptor.ExtSurface.pSurface);
+
+        if (0 == sDescriptor.Locked) {
+            mfxU32 newHead = head;
+            while (newHead != tail && 0 == m_Ring[newHead & (RING_SIZE - 1)].Locked) {
+                newHead++;
+            }
+            // fails only if buffer was reset by ReleaseSurfaceAll in the meantime
+            if (newHead != head &&
+                m_nHead.compare_exchange_strong(head, newHead, std::memory_order_release)) {
                 pRelEvent->Signal();
             }
+        }
 
-            return MFX_ERR_NONE;
+        if (m_pReleaseNotifier) {
+            m_pReleaseNotifier->NotifyRelease();
         }
+
+        return MFX_ERR_NONE;
     }
 
     return MFX_ERR_UNKNOWN;
@@ -5294,12 +5585,17 @@ mfxStatus SafetySurfaceBuffer::ReleaseSurface(mfxFrameSurface1* pSurf) {
 mfxStatus SafetySurfaceBuffer::ReleaseSurfaceAll() {
     std::lock_guard<std::mutex> guard(m_mutex);
 
-    m_SList.clear();
+    m_nHead.store(m_nTail.load(std::memory_order_relaxed), std::memory_order_release);
     m_IsBufferingAllowed = true;
     return MFX_ERR_NONE;
 
 } // mfxStatus SafetySurfaceBuffer::ReleaseSurface(mfxFrameSurface1* pSurf)
 
+void SafetySurfaceBuffer::SetReleaseNotifier(SurfaceReleaseNotifier* pNotifier) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_pReleaseNotifier = pNotifier;
+}
+
 void SafetySurfaceBuffer::CancelBuffering() {
     std::lock_guard<std::mutex> guard(m_mutex);
     m_IsBufferingAllowed = false;
@@ -5414,6 +5710,324 @@ bool FileBitstreamProcessor::IsNulOutput() {
     return !m_pFileWriter.get();
 }
 
+AsyncBitstreamWriter::AsyncBitstreamWriter(FileBitstreamProcessor* pBSProcessor,
+                                           ExtendedBSStore* pBSStore,
+                                           mfxU32 targetID,
+                                           bool isParallelEncoding)
+        : m_pBSProcessor(pBSProcessor),
+          m_pBSStore(pBSStore),
+          m_TargetID(targetID),
+          m_bParallelEncoding(isParallelEncoding),
+          m_mutex(),
+          m_cvPut(),
+          m_cvDone(),
+          m_Queue(),
+          m_nInProgress(0),
+          m_bStop(false),
+          m_Status(MFX_ERR_NONE),
+          m_Thread(),
+          m_WriteStatistics("Write"),
+          m_nMaxQueueDepth(0),
+          m_nQueueDepthSum(0),
+          m_nQueueDepthSamples(0),
+          m_ofile(stdout),
+          m_pLatencyStat(nullptr),
+          m_pTracer(nullptr) {}
+
+AsyncBitstreamWriter::~AsyncBitstreamWriter() {
+    Stop();
+}
+
+mfxStatus AsyncBitstreamWriter::Start() {
+    MSDK_CHECK_POINTER(m_pBSProcessor, MFX_ERR_NULL_PTR);
+    MSDK_CHECK_POINTER(m_pBSStore, MFX_ERR_NULL_PTR);
+
+    if (m_Thread.joinable()) {
+        return MFX_ERR_UNDEFINED_BEHAVIOR;
+    }
+
+    try {
+        m_Thread = std::thread(&AsyncBitstreamWriter::WriteRoutine, this);
+    }
+    catch (std::system_error&) {
+        return MFX_ERR_UNKNOWN;
+    }
+    return MFX_ERR_NONE;
+}
+
+void AsyncBitstreamWriter::Stop() {
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_bStop = true;
+    }
+    m_cvPut.notify_one();
+
+    if (m_Thread.joinable()) {
+        m_Thread.join();
+    }
+}
+
+mfxStatus AsyncBitstreamWriter::PutBS(ExtendedBS* pBS, mfxU32 frameNum) {
+    return PutBS(&pBS, 1, frameNum);
+}
+
+mfxStatus AsyncBitstreamWriter::PutBS(ExtendedBS* const* ppBS,
+                                      mfxU32 count,
+                                      mfxU32 firstFrameNum) {
+    MSDK_CHECK_POINTER(ppBS, MFX_ERR_NULL_PTR);
+    for (mfxU32 i = 0; i < count; i++) {
+        MSDK_CHECK_POINTER(ppBS[i], MFX_ERR_NULL_PTR);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        if (m_Status != MFX_ERR_NONE) {
+            for (mfxU32 i = 0; i < count; i++) {
+                m_pBSStore->Release(ppBS[i]);
+            }
+            return m_Status;
+        }
+
+        for (mfxU32 i = 0; i < count; i++) {
+            m_Queue.push_back({ ppBS[i], firstFrameNum + i });
+
+            mfxU32 depth = (mfxU32)m_Queue.size() + m_nInProgress;
+            m_nMaxQueueDepth = std::max(m_nMaxQueueDepth, depth);
+            m_nQueueDepthSum += depth;
+            m_nQueueDepthSamples++;
+        }
+    }
+    m_cvPut.notify_one();
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus AsyncBitstreamWriter::Flush() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cvDone.wait(lock, [&] {
+        return m_Queue.empty() && !m_nInProgress;
+    });
+    return m_Status;
+}
+
+void AsyncBitstreamWriter::WriteRoutine() {
+    std::vector<WriteTask> tasks;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cvPut.wait(lock, [&] {
+                return m_bStop || !m_Queue.empty();
+            });
+            if (m_Queue.empty()) {
+                break; // stopped and nothing to write
+            }
+
+            // take all queued frames at once, they are written one after another without locking
+            tasks.assign(m_Queue.begin(), m_Queue.end());
+            m_Queue.clear();
+            m_nInProgress = (mfxU32)tasks.size();
+        }
+
+        for (WriteTask& task : tasks) {
+            if (m_pTracer) {
+                m_pTracer->BeginEvent(SMTTracer::ThreadType::ENC,
+                                      m_TargetID,
+                                      SMTTracer::EventName::WRITE_BS,
+                                      nullptr,
+                                      nullptr);
+            }
+            msdk_tick startTime = msdk_time_get_tick();
+
+            mfxStatus sts = MFX_ERR_NONE;
+            if (!m_bParallelEncoding) {
+                sts = m_pBSProcessor->ProcessOutputBitstream(&task.pBS->Bitstream);
+            }
+            else {
+                sts = m_pBSProcessor->ProcessOutputBitstream(&task.pBS->Bitstream,
+                                                             m_TargetID,
+                                                             task.FrameNum);
+            }
+            mfxF64 delta = CTimeStatistics::ConvertToSeconds(msdk_time_get_tick() - startTime);
+            if (m_pTracer) {
+                m_pTracer->EndEvent(SMTTracer::ThreadType::ENC,
+                                    m_TargetID,
+                                    SMTTracer::EventName::WRITE_BS,
+                                    nullptr,
+                                    nullptr);
+            }
+
+            task.pBS->Bitstream.DataLength = 0;
+            task.pBS->Bitstream.DataOffset = 0;
+            m_pBSStore->Release(task.pBS);
+
+            std::lock_guard<std::mutex> guard(m_mutex);
+            if (sts != MFX_ERR_NONE && m_Status == MFX_ERR_NONE) {
+                printf("ERROR: writing of output bitstream failed (%d)\n", (int)sts);
+                m_Status = sts;
+            }
+            m_WriteStatistics.AddMeasurement(delta);
+            if (m_pLatencyStat) {
+                m_pLatencyStat->AddMeasurement(LATENCY_STAGE_WRITE, delta);
+            }
+            m_nInProgress--;
+        }
+        tasks.clear();
+
+        m_cvDone.notify_all();
+    }
+
+    m_cvDone.notify_all();
+}
+
+void AsyncBitstreamWriter::SetOutputFile(FILE* file) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_ofile = file;
+    m_WriteStatistics.SetOutputFile(file);
+}
+
+void AsyncBitstreamWriter::PrintStatistics(mfxU32 numPipelineid) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+
+    // write latency in the same format as input/output statistics
+    m_WriteStatistics.PrintStatistics(numPipelineid);
+
+    fprintf(m_ofile,
+            "stat[%u.%llu]: WriteQueue=%d;Depth=%u;MaxDepth=%u;AvgDepth=%.3lf\n",
+            (unsigned int)msdk_get_current_pid(),
+            (unsigned long long int)rdtsc(),
+            (int)numPipelineid,
+            (unsigned int)(m_Queue.size() + m_nInProgress),
+            (unsigned int)m_nMaxQueueDepth,
+            m_nQueueDepthSamples ? (double)m_nQueueDepthSum / m_nQueueDepthSamples : 0.0);
+    fflush(m_ofile);
+}
+
+void AsyncBitstreamWriter::ResetStatistics() {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_WriteStatistics.ResetStatistics();
+    m_nMaxQueueDepth     = 0;
+    m_nQueueDepthSum     = 0;
+    m_nQueueDepthSamples = 0;
+}
+
+void AsyncBitstreamWriter::SetLatencyStat(CLatencyStat* pLatencyStat) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_pLatencyStat = pLatencyStat;
+}
+
+void AsyncBitstreamWriter::SetTracer(SMTTracer* pTracer) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_pTracer = pTracer;
+}
+
+static const char* const LatencyStageNames[LATENCY_STAGE_COUNT] = { "Decode",
+                                                                     "VPP",
+                                                                     "Encode",
+                                                                     "Sync",
+                                                                     "Write" };
+
+CLatencyStat::CLatencyStat()
+        : CStageLatencyStat(LatencyStageNames, LATENCY_STAGE_COUNT),
+          m_ofile(stdout) {}
+
+void CLatencyStat::SetOutputFile(FILE* file) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_ofile = file;
+}
+
+void CLatencyStat::PrintStatistics(mfxU32 numPipelineid) {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    for (int i = 0; i < LATENCY_STAGE_COUNT; i++) {
+        CTimeStatisticsReal& stage = m_stages[i];
+        if (!stage.GetNumMeasurements())
+            continue;
+
+        // print timings in ms, in the same format as input/output statistics
+        fprintf(m_ofile,
+                "stat[%u.%llu]: Latency=%d;Stage=%s;Samples=%lld;Avg=%.3lf;P50=%.3lf;P90=%.3lf;"
+                "P99=%.3lf;P99.9=%.3lf;Max=%.3lf\n",
+                (unsigned int)msdk_get_current_pid(),
+                (unsigned long long int)rdtsc(),
+                (int)numPipelineid,
+                LatencyStageNames[i],
+                (long long int)stage.GetNumMeasurements(),
+                (double)stage.GetAvgTime(false),
+                (double)stage.GetPercentile(GetReportPercentile(0).Value, false),
+                (double)stage.GetPercentile(GetReportPercentile(1).Value, false),
+                (double)stage.GetPercentile(GetReportPercentile(2).Value, false),
+                (double)stage.GetPercentile(GetReportPercentile(3).Value, false),
+                (double)stage.GetMaxTime(false));
+    }
+    fflush(m_ofile);
+}
+
+void CLatencyStat::DumpStatistics(const std::string& name, mfxU32 numPipelineid) {
+    std::stringstream file_name;
+    file_name << name << "_ID_" << numPipelineid;
+
+    std::stringstream session;
+    session << "\"session\":" << numPipelineid << ",";
+    WriteReport(file_name.str(), session.str());
+}
+
+CSyncWindow::CSyncWindow()
+        : m_nMaxWindow(1),
+          m_nWindow(1),
+          m_nEpochFrames(0),
+          m_MinLatency(0),
+          m_Interval(0),
+          m_LastCompletion(0) {}
+
+void CSyncWindow::Init(mfxU32 maxWindow) {
+    // window starts from the async depth until there are measurements
+    m_nMaxWindow     = std::max(maxWindow, 1u);
+    m_nWindow        = m_nMaxWindow;
+    m_nEpochFrames   = 0;
+    m_MinLatency     = 0;
+    m_Interval       = 0;
+    m_LastCompletion = 0;
+}
+
+void CSyncWindow::AddCompletions(msdk_tick submitTime, mfxU32 numFrames, msdk_tick observeTime) {
+    if (!numFrames)
+        return;
+
+    mfxF64 latency = CTimeStatistics::ConvertToSeconds(observeTime - submitTime);
+    // the first frame of the epoch went through empty pipeline
+    if (!m_nEpochFrames || latency < m_MinLatency)
+        m_MinLatency = latency;
+    m_nEpochFrames += numFrames;
+
+    // interval is measured between frames of busy pipeline, so not across the drain. Frames
+    // observed at once share the time since the previous observation and the average gets
+    // the weight of that many samples
+    if (m_LastCompletion) {
+        mfxF64 interval =
+            CTimeStatistics::ConvertToSeconds(observeTime - m_LastCompletion) / numFrames;
+        mfxF64 weight = 1 - std::pow(0.875, (mfxF64)numFrames);
+        m_Interval    = m_Interval ? (1 - weight) * m_Interval + weight * interval : interval;
+    }
+    m_LastCompletion = observeTime;
+
+    // the interval isn't known until the second observation
+    if (m_Interval <= 0)
+        return;
+
+    mfxF64 window = std::ceil(m_MinLatency / m_Interval) + 1;
+    m_nWindow     = (mfxU32)std::min(std::max(window, 1.0), (mfxF64)m_nMaxWindow);
+}
+
+bool CSyncWindow::IsDrainRequired() const {
+    // window of one frame drains the pipeline each time anyway
+    return m_nEpochFrames >= EPOCH_FRAMES && m_nWindow > 1;
+}
+
+void CSyncWindow::Drained() {
+    m_nEpochFrames   = 0;
+    m_LastCompletion = 0;
+}
+
 void CTranscodingPipeline::ModifyParamsUsingPresets(sInputParams& params,
                                                     mfxF64 fps,
                                                     mfxU32 width,
@@ -114,6 +114,16 @@ CTranscodingPipeline* CreatePipeline() {
     return new CTranscodingPipeline;
 }
 
+// keeps up to nPreloadSize MB of the input in memory, 0 reads the file directly
+static void PreloadReader(std::unique_ptr<CSmplBitstreamReader>& reader, mfxU32 nPreloadSize) {
+    if (!nPreloadSize)
+        return;
+
+    std::unique_ptr<CSmplBitstreamPreloadedReader> preloaded(new CSmplBitstreamPreloadedReader());
+    preloaded->SetSource(reader, (mfxU64)nPreloadSize << 20);
+    reader = std::move(preloaded);
+}
+
 mfxStatus Launcher::Init(int argc, char* argv[]) {
     mfxStatus sts;
     mfxU32 i                     = 0;
@@ -484,6 +494,9 @@ mfxStatus Launcher::Init(int argc, char* argv[]) {
     sts = CreateSafetyBuffers();
     MSDK_CHECK_STATUS(sts, "CreateSafetyBuffers failed");
 
+    sts = PlaceSessions();
+    MSDK_CHECK_STATUS(sts, "PlaceSessions failed");
+
     /* One more hint. Example you have 3 dec + 1 enc sessions
     * (enc means vpp_comp call invoked. m_InputParamsArray.size() is 4.
     * You don't need take vpp comp params from last one session as it is enc session.
@@ -507,6 +520,8 @@ mfxStatus Launcher::Init(int argc, char* argv[]) {
         auto pAllocator = std::make_unique<GeneralAllocator>();
         sts             = pAllocator->Init(m_pAllocParams[i].get());
         MSDK_CHECK_STATUS(sts, "pAllocator->Init failed");
+        if (m_InputParamsArray[i].nFramePoolSize)
+            pAllocator->SetFramePoolLimit((mfxU64)m_InputParamsArray[i].nFramePoolSize << 20);
 
         m_pAllocArray.push_back(std::move(pAllocator));
 
@@ -550,15 +565,30 @@ mfxStatus Launcher::Init(int argc, char* argv[]) {
             // YUV reader for RGB4 overlay and raw input
             yuvreader.reset(new CSmplYUVReader());
         }
+        else if (m_InputParamsArray[i].bSharedInput) {
+            reader.reset(new CSmplBitstreamSharedReader());
+        }
+        else if (m_InputParamsArray[i].bMappedInput) {
+            reader.reset(new CSmplBitstreamMappedReader());
+        }
         else {
             reader.reset(new CSmplBitstreamReader());
         }
 
+        if (reader.get()) {
+            PreloadReader(reader, m_InputParamsArray[i].nPreloadSize);
+        }
+        else if (yuvreader.get() && m_InputParamsArray[i].nPreloadSize) {
+            yuvreader->SetPreloadFrames(m_InputParamsArray[i].nPreloadSize);
+        }
+
         if (reader.get()) {
             sts = reader->Init(m_InputParamsArray[i].strSrcFile.c_str());
             if (sts == MFX_ERR_UNSUPPORTED && m_InputParamsArray[i].DecodeId == MFX_CODEC_AV1) {
                 reader.reset(new CSmplBitstreamReader());
+                PreloadReader(reader, m_InputParamsArray[i].nPreloadSize);
                 printf("WARNING: Stream is not IVF, default reader\n");
+                sts = reader->Init(m_InputParamsArray[i].strSrcFile.c_str());
             }
             MSDK_CHECK_STATUS(sts, "reader->Init failed");
             sts = m_pExtBSProcArray.back()->SetReader(reader);
@@ -583,6 +613,9 @@ mfxStatus Launcher::Init(int argc, char* argv[]) {
                     writer->m_BaseEncoderID    = m_CSConfig.Targets[0].TargetID;
                     sts = writer->Init(m_InputParamsArray[i].strDstFile.c_str());
                     MSDK_CHECK_STATUS(sts, "could not create destination file");
+                    if (m_InputParamsArray[i].nAsyncWriteDepth) {
+                        writer->SetWriteBufferSize(AsyncWriteBufferSize);
+                    }
                     m_GlobalBitstreamWriter = std::move(writer);
                 }
                 m_pExtBSProcArray.back()->SetWriter(m_GlobalBitstreamWriter);
@@ -591,6 +624,10 @@ mfxStatus Launcher::Init(int argc, char* argv[]) {
         else if (!msdk_match(m_InputParamsArray[i].strDstFile, "null")) {
             auto writer = std::make_shared<CSmplBitstreamWriter>();
             sts         = writer->Init(m_InputParamsArray[i].strDstFile.c_str());
+            if (m_InputParamsArray[i].nAsyncWriteDepth) {
+                // writer thread is not time critical, so let it write frames in large chunks
+                writer->SetWriteBufferSize(AsyncWriteBufferSize);
+            }
 
             sts = m_pExtBSProcArray.back()->SetWriter(writer);
             MSDK_CHECK_STATUS(sts, "m_pExtBSProcArray.back()->SetWriter failed");
@@ -666,6 +703,20 @@ mfxStatus Launcher::Init(int argc, char* argv[]) {
                 MSDK_CHECK_STATUS(sts, "ConfigureAndEnumImplementations failed");
             }
         }
+
+        pThreadPipeline->cpuAffinity = m_InputParamsArray[i].CpuAffinity;
+        pThreadPipeline->numaNode    = m_InputParamsArray[i].nNumaNode;
+
+        // session is initialized with the placement, so internal threads of the library
+        // (-threads) inherit it and session memory is allocated on the node
+        std::vector<mfxU32> initAffinity;
+        if (pThreadPipeline->IsPinned()) {
+            sts = msdk_thread_get_affinity(initAffinity);
+            MSDK_CHECK_STATUS(sts, "msdk_thread_get_affinity failed");
+            sts = pThreadPipeline->ApplyPlacement();
+            MSDK_CHECK_STATUS(sts, "pThreadPipeline->ApplyPlacement failed");
+        }
+
         sts = pThreadPipeline->pPipeline->Init(&m_InputParamsArray[i],
                                                m_pAllocArray[i].get(),
                                                hdls[i],
@@ -675,6 +726,10 @@ mfxStatus Launcher::Init(int argc, char* argv[]) {
                                                m_pLoader.get(),
                                                CreateCascadeScalerConfig());
 
+        if (pThreadPipeline->IsPinned()) {
+            msdk_thread_set_affinity(initAffinity);
+            msdk_thread_set_numa_node(-1);
+        }
         MSDK_CHECK_STATUS(sts, "pThreadPipeline->pPipeline->Init failed");
 
         if (!pParentPipeline && m_InputParamsArray[i].bIsJoin)
@@ -725,6 +780,20 @@ mfxStatus Launcher::Init(int argc, char* argv[]) {
         }
     }
 
+    if (m_InputParamsArray[0].bCooperativeScheduler) {
+        // synchronized sessions wait for each other, so they can't share worker threads
+        if (m_InputParamsArray[0].forceSyncAllSession == MFX_CODINGOPTION_ON) {
+            printf("WARNING: -sched is ignored for synchronized sessions\n");
+        }
+        else {
+            m_pScheduler.reset(new CSessionScheduler());
+            sts = m_pScheduler->Init(m_InputParamsArray[0].nSchedulerThreads);
+            MSDK_CHECK_STATUS(sts, "m_pScheduler->Init failed");
+            printf("Sessions are scheduled on %u worker threads\n",
+                   (unsigned int)m_pScheduler->GetNumThreads());
+        }
+    }
+
     printf("\n");
 
     return sts;
@@ -755,85 +824,86 @@ void Launcher::DoTranscoding() {
         });
     };
 
-    bool isOverlayUsed = false;
+    bool isOverlayUsed             = false;
+    size_t aliveSessions           = 0;
+    size_t aliveNonOverlaySessions = 0;
     for (const auto& context : m_pThreadContextArray) {
         MSDK_CHECK_POINTER_NO_RET(context);
-        RunTranscodeRoutine(context.get());
-
         MSDK_CHECK_POINTER_NO_RET(context->pPipeline);
-        isOverlayUsed = isOverlayUsed || context->pPipeline->IsOverlayUsed();
     }
 
-    // Transcoding threads waiting cycle
-    bool aliveNonOverlaySessions = true;
-    while (aliveNonOverlaySessions) {
-        aliveNonOverlaySessions = false;
-
-        for (size_t i = 0; i < m_pThreadContextArray.size(); ++i) {
-            if (!m_pThreadContextArray[i]->handle.valid())
-                continue;
-
-            //Payslip interval to check the state of working threads:
-            //such interval is usually a realtime, i.e. for 30 fps this would be 33ms,
-            //66ms typically mean either 1/fps or 2/fps payslip checks.
-            auto waitSts = m_pThreadContextArray[i]->handle.wait_for(std::chrono::milliseconds(66));
-            if (waitSts == std::future_status::ready) {
-                // Invoke get() of the handle just to reset the valid state.
-                // This allows to skip already processed sessions
-                m_pThreadContextArray[i]->handle.get();
-
-                // Session is completed, let's check for its status
-                if (m_pThreadContextArray[i]->transcodingSts < MFX_ERR_NONE) {
-                    // Stop all the sessions if an error happened in one
-                    // But do not stop in robust mode when gpu hang's happened
-                    if (m_pThreadContextArray[i]->transcodingSts != MFX_ERR_GPU_HANG ||
-                        !m_pThreadContextArray[i]->pPipeline->GetRobustFlag()) {
-                        std::cout << "\n\n session " << i << " ["
-                                  << m_pThreadContextArray[i]->pPipeline->GetSessionText()
-                                  << "] failed with status "
-                                  << StatusToString(m_pThreadContextArray[i]->transcodingSts)
-                                  << " shutting down the application..." << std::endl
-                                  << std::endl;
-
-                        for (const auto& context : m_pThreadContextArray) {
-                            context->pPipeline->StopSession();
-                        }
-                    }
-                }
-                else if (m_pThreadContextArray[i]->transcodingSts > MFX_ERR_NONE) {
-                    std::cout << "\n\n session " << i << " ["
-                              << m_pThreadContextArray[i]->pPipeline->GetSessionText()
-                              << "] returned warning status "
-                              << StatusToString(m_pThreadContextArray[i]->transcodingSts)
-                              << std::endl
-                              << std::endl;
-                }
-            }
-            else {
-                aliveNonOverlaySessions = aliveNonOverlaySessions ||
-                                          !m_pThreadContextArray[i]->pPipeline->IsOverlayUsed();
-            }
+    for (const auto& context : m_pThreadContextArray) {
+        context->pCompletion = &m_Completion;
+
+        // sessions report completion to m_Completion, both from scheduler and own threads
+        // pinned sessions keep own thread, scheduler workers run any session
+        bool isCooperative = m_pScheduler && !context->IsPinned() &&
+                             context->pPipeline->IsCooperativeCapable();
+        context->pPipeline->SetCooperativeMode(isCooperative);
+        if (isCooperative) {
+            context->StartRoutine();
+            m_pScheduler->Submit(context.get());
         }
+        else {
+            RunTranscodeRoutine(context.get());
+        }
+
+        aliveSessions++;
+        if (context->pPipeline->IsOverlayUsed())
+            isOverlayUsed = true;
+        else
+            aliveNonOverlaySessions++;
+    }
 
-        // Stop overlay sessions
+    // Transcoding sessions waiting cycle
+    bool overlayStopped = false;
+    while (aliveSessions) {
         // Note: Overlay sessions never stop themselves so they should be forcibly stopped
         // after stopping of all non-overlay sessions
-        if (!aliveNonOverlaySessions && isOverlayUsed) {
-            // Sending stop message
+        if (!aliveNonOverlaySessions && isOverlayUsed && !overlayStopped) {
             for (const auto& context : m_pThreadContextArray) {
                 if (context->pPipeline->IsOverlayUsed()) {
                     context->pPipeline->StopSession();
                 }
             }
+            overlayStopped = true;
+        }
 
-            // Waiting for them to be stopped
-            for (const auto& context : m_pThreadContextArray) {
-                if (!context->handle.valid())
-                    continue;
-
-                context->handle.wait();
+        ThreadTranscodeContext* completed = m_Completion.Wait();
+        aliveSessions--;
+        if (!completed->pPipeline->IsOverlayUsed())
+            aliveNonOverlaySessions--;
+
+        // Invoke get() of the handle just to reset the valid state
+        if (completed->handle.valid())
+            completed->handle.get();
+
+        size_t i = 0;
+        while (i < m_pThreadContextArray.size() && m_pThreadContextArray[i].get() != completed)
+            i++;
+
+        // Session is completed, let's check for its status
+        if (completed->transcodingSts < MFX_ERR_NONE) {
+            // Stop all the sessions if an error happened in one
+            // But do not stop in robust mode when gpu hang's happened
+            if (completed->transcodingSts != MFX_ERR_GPU_HANG ||
+                !completed->pPipeline->GetRobustFlag()) {
+                std::cout << "\n\n session " << i << " [" << completed->pPipeline->GetSessionText()
+                          << "] failed with status " << StatusToString(completed->transcodingSts)
+                          << " shutting down the application..." << std::endl
+                          << std::endl;
+
+                for (const auto& context : m_pThreadContextArray) {
+                    context->pPipeline->StopSession();
+                }
             }
         }
+        else if (completed->transcodingSts > MFX_ERR_NONE) {
+            std::cout << "\n\n session " << i << " [" << completed->pPipeline->GetSessionText()
+                      << "] returned warning status "
+                      << StatusToString(completed->transcodingSts) << std::endl
+                      << std::endl;
+        }
     }
 }
 
@@ -915,6 +985,11 @@ mfxStatus Launcher::ProcessResult() {
                           << SessionStsStr << " (" << StatusToString(transcodingSts) << ") "
                           << workTime << " sec, " << framesNum << " frames, " << std::fixed
                           << std::setprecision(3) << framesNum / workTime << " fps" << std::endl;
+        if (i < m_pAllocArray.size() && m_InputParamsArray[i].nFramePoolSize) {
+            FramePoolStats poolStats = m_pAllocArray[i]->GetFramePoolStats();
+            session_info_sstr << "frame pool: " << poolStats.hits << " hits, " << poolStats.misses
+                              << " misses, " << poolStats.evictions << " evictions" << std::endl;
+        }
         if (i < session_descriptions.size()) {
             session_info_sstr << session_descriptions[i] << std::endl;
         }
@@ -926,6 +1001,9 @@ mfxStatus Launcher::ProcessResult() {
         if (performance_file.is_open()) {
             performance_file << session_info_sstr.str();
         }
+        m_pThreadContextArray[i]->pPipeline->PrintLatencyStatistics();
+        m_pThreadContextArray[i]->pPipeline->PrintPacingStatistics();
+        m_pThreadContextArray[i]->pPipeline->PrintBusyStatistics();
     }
     printf("-------------------------------------------------------------------------------\n");
 
@@ -1402,6 +1480,89 @@ mfxStatus Launcher::CreateSafetyBuffers() {
 
 } // mfxStatus Launcher::CreateSafetyBuffers
 
+mfxStatus Launcher::PlaceSessions() {
+    // sessions without own placement are spread round robin over NUMA nodes or groups of CPUs
+    std::vector<mfxU32> autoSessions;
+    for (mfxU32 i = 0; i < m_InputParamsArray.size(); i++) {
+        if (m_InputParamsArray[i].bAutoAffinity && m_InputParamsArray[i].CpuAffinity.empty() &&
+            m_InputParamsArray[i].nNumaNode < 0)
+            autoSessions.push_back(i);
+    }
+
+    if (!autoSessions.empty()) {
+        std::vector<mfxI32> nodes;
+        std::vector<mfxU32> cpus;
+        for (mfxU32 node = 0; node < msdk_get_numa_node_count(); node++) {
+            // skip nodes with memory only
+            if (MFX_ERR_NONE == msdk_get_numa_node_cpus(node, cpus))
+                nodes.push_back((mfxI32)node);
+        }
+
+        if (nodes.size() > 1) {
+            for (size_t i = 0; i < autoSessions.size(); i++)
+                m_InputParamsArray[autoSessions[i]].nNumaNode = nodes[i % nodes.size()];
+        }
+        else if (MFX_ERR_NONE == msdk_thread_get_affinity(cpus) && !cpus.empty()) {
+            // every session gets own group while there are enough CPUs, the last group takes
+            // the remainder
+            size_t groupSize = std::max<size_t>(cpus.size() / autoSessions.size(), 1);
+            size_t numGroups = std::min(cpus.size() / groupSize, autoSessions.size());
+            for (size_t i = 0; i < autoSessions.size(); i++) {
+                size_t group = i % numGroups;
+                auto first   = cpus.begin() + group * groupSize;
+                auto last    = (group + 1 == numGroups) ? cpus.end() : first + groupSize;
+                m_InputParamsArray[autoSessions[i]].CpuAffinity.assign(first, last);
+            }
+        }
+    }
+
+    // CPUs of the node are narrowed by -affinity
+    for (mfxU32 i = 0; i < m_InputParamsArray.size(); i++) {
+        sInputParams& params = m_InputParamsArray[i];
+        if (params.nNumaNode < 0)
+            continue;
+
+        std::vector<mfxU32> nodeCpus;
+        mfxStatus sts = msdk_get_numa_node_cpus((mfxU32)params.nNumaNode, nodeCpus);
+        if (MFX_ERR_NONE != sts) {
+            printf("error: session %u: NUMA node %d has no CPUs\n", i, (int)params.nNumaNode);
+            return MFX_ERR_UNSUPPORTED;
+        }
+
+        if (params.CpuAffinity.empty()) {
+            params.CpuAffinity = nodeCpus;
+            continue;
+        }
+
+        std::vector<mfxU32> cpus;
+        for (mfxU32 cpu : params.CpuAffinity) {
+            if (std::find(nodeCpus.begin(), nodeCpus.end(), cpu) != nodeCpus.end())
+                cpus.push_back(cpu);
+        }
+        if (cpus.empty()) {
+            printf("error: session %u: -affinity has no CPUs of NUMA node %d\n",
+                   i,
+                   (int)params.nNumaNode);
+            return MFX_ERR_UNSUPPORTED;
+        }
+        params.CpuAffinity = cpus;
+    }
+
+    for (mfxU32 i = 0; i < m_InputParamsArray.size(); i++) {
+        if (m_InputParamsArray[i].CpuAffinity.empty())
+            continue;
+        printf("Session %u is placed on CPUs", i);
+        for (mfxU32 cpu : m_InputParamsArray[i].CpuAffinity)
+            printf(" %u", cpu);
+        if (m_InputParamsArray[i].nNumaNode >= 0)
+            printf(" (NUMA node %d)", (int)m_InputParamsArray[i].nNumaNode);
+        printf("\n");
+    }
+
+    return MFX_ERR_NONE;
+
+} // mfxStatus Launcher::PlaceSessions
+
 CascadeScalerConfig::TargetDescriptor CascadeScalerConfig::GetDesc(mfxU32 id) {
     auto itr = std::find_if(Targets.begin(), Targets.end(), [id](TargetDescriptor& d) {
         return d.TargetID == id;
@@ -1498,7 +1659,9 @@ CascadeScalerConfig& Launcher::CreateCascadeScalerConfig() {
             cfg.Tracer->Init(cfg.type,
                              (mfxU32)cfg.Targets.size(),
                              par.LatencyType,
-                             par.TraceBufferSize);
+                             par.TraceBufferSize,
+                             par.TraceStreaming,
+                             par.TraceFormat);
             break;
         }
     }
@@ -1615,6 +1778,8 @@ bool TranscodingSample::CascadeScalerConfig::SkipFrame(mfxU32 targetID, mfxU32 f
 }
 
 void Launcher::Close() {
+    m_pScheduler.reset();
+
     while (m_pThreadContextArray.size()) {
         m_pThreadContextArray[m_pThreadContextArray.size() - 1].reset();
         m_pThreadContextArray.pop_back();
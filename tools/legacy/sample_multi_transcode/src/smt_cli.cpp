@@ -161,6 +161,15 @@ void PrintHelp() {
     HELP_LINE("                <name>_input_ID_<N>.log");
     HELP_LINE("                or, for output session: <name>_output_ID_<N>.log;");
     HELP_LINE("                <N> - a number of a session.");
+    HELP_LINE("");
+    HELP_LINE("  -stat-latency");
+    HELP_LINE("                Collect decode, VPP, encode, sync and write latency percentiles");
+    HELP_LINE("                (p50/p90/p99/p99.9) of every session, they are printed with -stat");
+    HELP_LINE("                statistics and at the end of the session");
+    HELP_LINE("");
+    HELP_LINE("  -stat-latency-dump <name>");
+    HELP_LINE("                Same as -stat-latency, also write latency percentiles to");
+    HELP_LINE("                <name>_ID_<N>.csv and <name>_ID_<N>.json at the end");
     HELP_LINE("Options:");
     HELP_LINE("");
     HELP_LINE("  -?            Print this help and exit");
@@ -174,6 +183,16 @@ void PrintHelp() {
     HELP_LINE("  -greedy");
     HELP_LINE("                Use greedy formula to calculate number of surfaces");
     HELP_LINE("");
+    HELP_LINE("  -sched <N>");
+    HELP_LINE("                Run sessions as cooperative tasks on N worker threads");
+    HELP_LINE("                (0 - number of CPU cores) instead of a thread per session.");
+    HELP_LINE("                Sessions connected with other sessions keep own thread");
+    HELP_LINE("");
+    HELP_LINE("  -affinity:auto");
+    HELP_LINE("                Place sessions without -affinity and -numa round robin:");
+    HELP_LINE("                over NUMA nodes on multi-node systems, otherwise over");
+    HELP_LINE("                equal groups of CPU cores. Pinned sessions keep own thread");
+    HELP_LINE("");
     HELP_LINE("Pipeline description (general options):");
     HELP_LINE("");
     HELP_LINE("  -i::<h265|h264|mpeg2|vc1|mvc|jpeg|vp9|av1> <file-name>");
@@ -306,6 +325,33 @@ void PrintHelp() {
     HELP_LINE("");
     HELP_LINE("  -async        Depth of asynchronous pipeline. default value 1");
     HELP_LINE("");
+    HELP_LINE("  -async_write <N>");
+    HELP_LINE("                Write output bitstream from separate thread, N is depth of");
+    HELP_LINE("                writer queue. By default output is written by encoding thread");
+    HELP_LINE("");
+    HELP_LINE("  -sync:drain   After each submitted frame write all frames which are already");
+    HELP_LINE("                encoded at once instead of waiting for the oldest one only");
+    HELP_LINE("  -sync:adaptive");
+    HELP_LINE("                Same as -sync:drain, and number of frames in flight is sized");
+    HELP_LINE("                by observed encoding latency, -async sets the upper limit");
+    HELP_LINE("");
+    HELP_LINE("  -mmap_input   Read input bitstream through memory mapping instead of");
+    HELP_LINE("                buffered file reads");
+    HELP_LINE("");
+    HELP_LINE("  -shared_input Read input bitstream once for all sessions with -shared_input");
+    HELP_LINE("                which use the same input file");
+    HELP_LINE("");
+    HELP_LINE("  -preload <N>  Load first N MB of input bitstream (N frames for raw input) to");
+    HELP_LINE("                memory at init and read input from memory only, so the file");
+    HELP_LINE("                system doesn't affect throughput. Use with -timeout to loop");
+    HELP_LINE("                over preloaded input. Bitstream of frame based readers (IVF) is");
+    HELP_LINE("                cut at frame boundary. Raw frames are loaded with the first one");
+    HELP_LINE("");
+    HELP_LINE("  -frame_pool <MB>");
+    HELP_LINE("                Keep up to MB of released surfaces for reuse by following");
+    HELP_LINE("                allocations of the session, makes reset and -robust recovery");
+    HELP_LINE("                cheaper. Disabled by default");
+    HELP_LINE("");
     HELP_LINE("  -join         Join session with other session(s),");
     HELP_LINE("                by default sessions are not joined");
     HELP_LINE("");
@@ -317,6 +363,13 @@ void PrintHelp() {
     HELP_LINE("");
     HELP_LINE("  -threads num  Number of session internal threads to create");
     HELP_LINE("");
+    HELP_LINE("  -affinity <cpulist>");
+    HELP_LINE("                Run the session and its internal threads on the CPUs from");
+    HELP_LINE("                the list, e.g. 0-3,8");
+    HELP_LINE("");
+    HELP_LINE("  -numa <node>  Run the session on CPUs of the NUMA node and allocate its");
+    HELP_LINE("                memory there. CPUs are narrowed by -affinity if it's set");
+    HELP_LINE("");
     HELP_LINE("  -n            Number of frames to transcode");
     HELP_LINE("                (session ends after this number of frames is reached).");
     HELP_LINE("                In decoding sessions (-o::sink) this parameter limits");
@@ -377,8 +430,9 @@ void PrintHelp() {
     HELP_LINE("");
     HELP_LINE("  -vpp::vid     Set vpp output to video memory");
     HELP_LINE("");
-    HELP_LINE("  -fps <frames per second>");
-    HELP_LINE("                Transcoding frame rate limit");
+    HELP_LINE("  -fps <frames per second>[/<denominator>]");
+    HELP_LINE("                Transcoding frame rate limit, rational value like 60000/1001 is");
+    HELP_LINE("                kept exactly. Frames are paced against absolute deadlines");
     HELP_LINE("");
     HELP_LINE("  -pe           Set encoding plugin for this particular session.");
     HELP_LINE("                This setting overrides plugin settings defined by SET clause.");
@@ -834,6 +888,13 @@ void PrintHelp() {
     HELP_LINE("  -trace_buffer_size <x>");
     HELP_LINE("                trace buffer size in MBytes");
     HELP_LINE("");
+    HELP_LINE("  -trace_stream turn on tracing, write trace to file during processing,");
+    HELP_LINE("                trace length is not limited by trace buffer size, flow events");
+    HELP_LINE("                and latency statistics are not generated");
+    HELP_LINE("");
+    HELP_LINE("  -trace_binary turn on tracing, write compact binary trace, use");
+    HELP_LINE("                sample_multi_transcode_trace_convert to convert it to JSON");
+    HELP_LINE("");
     HELP_LINE("  -parallel_encoding");
     HELP_LINE("                use several encoders to encode single bitstream,");
     HELP_LINE("                see readme for more details");
@@ -942,6 +1003,11 @@ CmdProcessor::CmdProcessor()
           statisticsWindowSize(0),
           statisticsLogFile(nullptr),
           DumpLogFileName(),
+          bLatencyStatistics(false),
+          LatencyDumpFileName(),
+          bCooperativeScheduler(false),
+          nSchedulerThreads(0),
+          bAutoAffinity(false),
           m_nTimeout(0),
           m_surface_wait_interval(MSDK_SURFACE_WAIT_INTERVAL),
           bRobustFlag(false),
@@ -1068,6 +1134,35 @@ mfxStatus CmdProcessor::ParseCmdLine(int argc, char* argv[]) {
             }
             DumpLogFileName = argv[0];
         }
+        else if (msdk_match(argv[0], "-stat-latency")) {
+            bLatencyStatistics = true;
+        }
+        else if (msdk_match(argv[0], "-stat-latency-dump")) {
+            --argc;
+            ++argv;
+            if (!argv[0]) {
+                printf("error: no argument given for 'stat-latency-dump' option\n");
+                return MFX_ERR_UNSUPPORTED;
+            }
+            bLatencyStatistics  = true;
+            LatencyDumpFileName = argv[0];
+        }
+        else if (msdk_match(argv[0], "-sched")) {
+            --argc;
+            ++argv;
+            if (!argv[0]) {
+                printf("error: no argument given for 'sched' option\n");
+                return MFX_ERR_UNSUPPORTED;
+            }
+            if (MFX_ERR_NONE != msdk_opt_read(argv[0], nSchedulerThreads)) {
+                printf("error: sched \"%s\" is invalid", argv[0]);
+                return MFX_ERR_UNSUPPORTED;
+            }
+            bCooperativeScheduler = true;
+        }
+        else if (msdk_match(argv[0], "-affinity:auto")) {
+            bAutoAffinity = true;
+        }
         else {
             break;
         }
@@ -1896,6 +1991,14 @@ mfxStatus ParseAdditionalParams(char* argv[],
             return MFX_ERR_UNSUPPORTED;
         }
     }
+    else if (msdk_match(argv[i], "-trace_stream")) {
+        InputParams.EnableTracing  = true;
+        InputParams.TraceStreaming = true;
+    }
+    else if (msdk_match(argv[i], "-trace_binary")) {
+        InputParams.EnableTracing = true;
+        InputParams.TraceFormat   = SMTTracer::TraceFormat::BINARY;
+    }
     else if (msdk_match(argv[i], "-trace::E2E")) {
         InputParams.EnableTracing = true;
         InputParams.LatencyType   = SMTTracer::LatencyType::E2E;
@@ -2372,6 +2475,17 @@ mfxStatus ParseVPPCmdLine(char* argv[],
     return MFX_ERR_MORE_DATA;
 }
 
+// reads decimal number which fits mfxU32, strtoul alone accepts empty string, sign and spaces
+static bool ReadFPSNumber(const char* str, mfxU32& value, char** pEnd) {
+    if (!isdigit((unsigned char)str[0]))
+        return false;
+    unsigned long long number = std::strtoull(str, pEnd, 10);
+    if (number > std::numeric_limits<mfxU32>::max())
+        return false;
+    value = (mfxU32)number;
+    return true;
+}
+
 mfxStatus CmdProcessor::ParseParamsForOneSession(mfxU32 argc, char* argv[]) {
     mfxStatus sts           = MFX_ERR_NONE;
     mfxStatus stsExtBuf     = MFX_ERR_NONE;
@@ -2400,6 +2514,13 @@ mfxStatus CmdProcessor::ParseParamsForOneSession(mfxU32 argc, char* argv[]) {
     //bind to a dump-log-file name
     InputParams.DumpLogFileName = DumpLogFileName;
 
+    InputParams.bLatencyStatistics  = bLatencyStatistics;
+    InputParams.LatencyDumpFileName = LatencyDumpFileName;
+
+    InputParams.bCooperativeScheduler = bCooperativeScheduler;
+    InputParams.nSchedulerThreads     = nSchedulerThreads;
+    InputParams.bAutoAffinity         = bAutoAffinity;
+
     if (msdk_match(argv[0], "set")) {
         if (argc != 3) {
             printf("error: number of arguments for 'set' options is wrong");
@@ -2550,6 +2671,23 @@ mfxStatus CmdProcessor::ParseParamsForOneSession(mfxU32 argc, char* argv[]) {
                 return MFX_ERR_UNSUPPORTED;
             }
         }
+        else if (msdk_match(argv[i], "-affinity")) {
+            VAL_CHECK(i + 1 == argc, i, argv[i]);
+            i++;
+            if (MFX_ERR_NONE != msdk_opt_read(argv[i], InputParams.CpuAffinity)) {
+                PrintError("affinity \"%s\" is invalid", argv[i]);
+                return MFX_ERR_UNSUPPORTED;
+            }
+        }
+        else if (msdk_match(argv[i], "-numa")) {
+            VAL_CHECK(i + 1 == argc, i, argv[i]);
+            i++;
+            if (MFX_ERR_NONE != msdk_opt_read(argv[i], InputParams.nNumaNode) ||
+                InputParams.nNumaNode < 0) {
+                PrintError("numa \"%s\" is invalid", argv[i]);
+                return MFX_ERR_UNSUPPORTED;
+            }
+        }
         else if (msdk_match(argv[i], "-f")) {
             VAL_CHECK(i + 1 == argc, i, argv[i]);
             i++;
@@ -2572,7 +2710,11 @@ mfxStatus CmdProcessor::ParseParamsForOneSession(mfxU32 argc, char* argv[]) {
         else if (msdk_match(argv[i], "-fps")) {
             VAL_CHECK(i + 1 == argc, i, argv[i]);
             i++;
-            if (MFX_ERR_NONE != msdk_opt_read(argv[i], InputParams.nFPS)) {
+            char* pEnd = nullptr;
+            bool valid = ReadFPSNumber(argv[i], InputParams.nFPS, &pEnd);
+            if (valid && *pEnd == '/')
+                valid = ReadFPSNumber(pEnd + 1, InputParams.nFPSDenom, &pEnd);
+            if (!valid || *pEnd || !InputParams.nFPSDenom) {
                 PrintError("FPS limit \"%s\" is invalid", argv[i]);
                 return MFX_ERR_UNSUPPORTED;
             }
@@ -2782,6 +2924,45 @@ mfxStatus CmdProcessor::ParseParamsForOneSession(mfxU32 argc, char* argv[]) {
                 return MFX_ERR_UNSUPPORTED;
             }
         }
+        else if (msdk_match(argv[i], "-sync:drain")) {
+            InputParams.bSyncDrain = true;
+        }
+        else if (msdk_match(argv[i], "-sync:adaptive")) {
+            InputParams.bAdaptiveSync = true;
+        }
+        else if (msdk_match(argv[i], "-async_write")) {
+            VAL_CHECK(i + 1 == argc, i, argv[i]);
+            i++;
+            if (MFX_ERR_NONE != msdk_opt_read(argv[i], InputParams.nAsyncWriteDepth) ||
+                0 == InputParams.nAsyncWriteDepth) {
+                PrintError("async_write \"%s\" is invalid", argv[i]);
+                return MFX_ERR_UNSUPPORTED;
+            }
+        }
+        else if (msdk_match(argv[i], "-mmap_input")) {
+            InputParams.bMappedInput = true;
+        }
+        else if (msdk_match(argv[i], "-shared_input")) {
+            InputParams.bSharedInput = true;
+        }
+        else if (msdk_match(argv[i], "-preload")) {
+            VAL_CHECK(i + 1 == argc, i, argv[i]);
+            i++;
+            if (MFX_ERR_NONE != msdk_opt_read(argv[i], InputParams.nPreloadSize) ||
+                0 == InputParams.nPreloadSize) {
+                PrintError("preload \"%s\" is invalid", argv[i]);
+                return MFX_ERR_UNSUPPORTED;
+            }
+        }
+        else if (msdk_match(argv[i], "-frame_pool")) {
+            VAL_CHECK(i + 1 == argc, i, argv[i]);
+            i++;
+            if (MFX_ERR_NONE != msdk_opt_read(argv[i], InputParams.nFramePoolSize) ||
+                0 == InputParams.nFramePoolSize) {
+                PrintError("frame_pool \"%s\" is invalid", argv[i]);
+                return MFX_ERR_UNSUPPORTED;
+            }
+        }
         else if (msdk_match(argv[i], "-join")) {
             InputParams.bIsJoin = true;
         }
@@ -3399,6 +3580,11 @@ mfxStatus CmdProcessor::VerifyAndCorrectInputParams(TranscodingSample::sInputPar
         return MFX_ERR_UNSUPPORTED;
     }
 
+    if (InputParams.bMappedInput && InputParams.bSharedInput) {
+        PrintError("-mmap_input and -shared_input cannot be used together\n");
+        return MFX_ERR_UNSUPPORTED;
+    }
+
     if (InputParams.nQuality && InputParams.EncodeId && (MFX_CODEC_JPEG != InputParams.EncodeId)) {
         PrintError("-q option is supported only for JPEG encoder\n");
         return MFX_ERR_UNSUPPORTED;
@@ -0,0 +1,166 @@
+/*############################################################################
+  # Copyright (C) 2005 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include "smt_scheduler.h"
+
+#include <algorithm>
+
+namespace TranscodingSample {
+
+namespace {
+thread_local CSessionScheduler* CurrentScheduler = nullptr;
+thread_local mfxU32 CurrentWorker                = 0;
+// RunPendingStep() doesn't nest, so stack depth is bounded and yielded task is resumed soon
+thread_local bool InPendingStep = false;
+} // namespace
+
+CSessionScheduler::CSessionScheduler()
+        : m_workers(),
+          m_nQueued(0),
+          m_nIdle(0),
+          m_nNextWorker(0),
+          m_bStop(false),
+          m_mutex(),
+          m_cvWork() {}
+
+CSessionScheduler::~CSessionScheduler() {
+    Close();
+}
+
+mfxStatus CSessionScheduler::Init(mfxU32 nThreads) {
+    if (!m_workers.empty())
+        return MFX_ERR_UNDEFINED_BEHAVIOR;
+
+    if (!nThreads)
+        nThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    m_bStop = false;
+    // all queues have to exist before any worker starts stealing
+    for (mfxU32 i = 0; i < nThreads; i++) {
+        m_workers.emplace_back(new Worker());
+    }
+    for (mfxU32 i = 0; i < nThreads; i++) {
+        m_workers[i]->thread = std::thread(&CSessionScheduler::WorkerRoutine, this, i);
+    }
+    return MFX_ERR_NONE;
+}
+
+void CSessionScheduler::Close() {
+    if (m_workers.empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_bStop = true;
+    }
+    m_cvWork.notify_all();
+
+    for (auto& worker : m_workers) {
+        if (worker->thread.joinable())
+            worker->thread.join();
+    }
+    m_workers.clear();
+    m_nQueued = 0;
+}
+
+void CSessionScheduler::Submit(CSchedulerTask* pTask) {
+    if (!pTask || m_workers.empty())
+        return;
+
+    Push(m_nNextWorker++ % (mfxU32)m_workers.size(), pTask);
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_cvWork.notify_one();
+}
+
+bool CSessionScheduler::RunPendingStep() {
+    if (CurrentScheduler != this || InPendingStep)
+        return false;
+
+    CSchedulerTask* pTask = Pop(CurrentWorker);
+    if (!pTask)
+        return false;
+
+    InPendingStep = true;
+    RunStep(CurrentWorker, pTask);
+    InPendingStep = false;
+    return true;
+}
+
+CSessionScheduler* CSessionScheduler::GetCurrent() {
+    return CurrentScheduler;
+}
+
+void CSessionScheduler::WorkerRoutine(mfxU32 id) {
+    CurrentScheduler = this;
+    CurrentWorker    = id;
+
+    while (!m_bStop) {
+        CSchedulerTask* pTask = Pop(id);
+        if (pTask) {
+            RunStep(id, pTask);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_nIdle++;
+        m_cvWork.wait(lock, [&] {
+            return m_bStop || m_nQueued > 0;
+        });
+        m_nIdle--;
+    }
+
+    CurrentScheduler = nullptr;
+}
+
+CSchedulerTask* CSessionScheduler::Pop(mfxU32 id) {
+    CSchedulerTask* pTask = nullptr;
+    {
+        Worker& own = *m_workers[id];
+        std::lock_guard<std::mutex> guard(own.mutex);
+        if (!own.tasks.empty()) {
+            pTask = own.tasks.front();
+            own.tasks.pop_front();
+        }
+    }
+
+    // steal the task which would be served last by its worker
+    for (size_t i = 1; !pTask && i < m_workers.size(); i++) {
+        Worker& victim = *m_workers[(id + i) % m_workers.size()];
+        std::lock_guard<std::mutex> guard(victim.mutex);
+        if (!victim.tasks.empty()) {
+            pTask = victim.tasks.back();
+            victim.tasks.pop_back();
+        }
+    }
+
+    if (pTask)
+        m_nQueued--;
+    return pTask;
+}
+
+void CSessionScheduler::Push(mfxU32 id, CSchedulerTask* pTask) {
+    // counter is increased first, so it never goes below the real number of queued tasks and
+    // idle worker can't miss the task
+    m_nQueued++;
+    Worker& worker = *m_workers[id];
+    std::lock_guard<std::mutex> guard(worker.mutex);
+    worker.tasks.push_back(pTask);
+}
+
+void CSessionScheduler::RunStep(mfxU32 id, CSchedulerTask* pTask) {
+    // completed task is dropped, it reports completion itself
+    if (!pTask->Step())
+        return;
+
+    Push(id, pTask);
+
+    // the worker takes its next task right away, wake idle one only if there is more to steal
+    if (m_nIdle && m_nQueued > 1) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_cvWork.notify_one();
+    }
+}
+} // namespace TranscodingSample
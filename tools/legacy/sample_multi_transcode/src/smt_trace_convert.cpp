@@ -0,0 +1,34 @@
+/*############################################################################
+  # Copyright (C) 2005 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+// converts binary trace written by sample_multi_transcode -trace_binary to JSON trace,
+// usage: sample_multi_transcode_trace_convert [-perfetto] <trace.bin> <trace.json>
+
+#include <stdio.h>
+#include <string.h>
+#include "smt_tracer.h"
+
+int main(int argc, char* argv[]) {
+    bool perfetto = false;
+    int first     = 1;
+    if (argc > 1 && !strcmp(argv[1], "-perfetto")) {
+        perfetto = true;
+        first++;
+    }
+
+    if (argc - first != 2) {
+        printf("usage: %s [-perfetto] <trace.bin> <trace.json>\n", argv[0]);
+        printf("  -perfetto   write JSON object format accepted by Perfetto UI\n");
+        return 1;
+    }
+
+    if (!TranscodingSample::SMTTracer::ConvertBinaryTrace(argv[first], argv[first + 1], perfetto)) {
+        printf("[ERROR] failed to convert %s to %s\n", argv[first], argv[first + 1]);
+        return 1;
+    }
+
+    return 0;
+}
@@ -8,15 +8,58 @@
 
 namespace TranscodingSample {
 
+namespace {
+//binary trace is a header followed by records, each record is event type, thread type and
+//event name bytes followed by varints: thread ID, zigzag encoded time stamp delta to previous
+//record, input ID (or counter value), output ID and event ID
+const char BinaryTraceMagic[8]     = { 'S', 'M', 'T', 'T', 'R', 'A', 'C', 'E' };
+const mfxU32 BinaryTraceVersion    = 1;
+const size_t MaxBinaryEventSize    = 3 + 5 * 10;
+const size_t BinaryWriteBufferSize = 1024 * 1024;
+
+void PutVarint(std::vector<mfxU8>& buffer, mfxU64 value) {
+    while (value >= 0x80) {
+        buffer.push_back((mfxU8)(value | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back((mfxU8)value);
+}
+
+bool GetVarint(std::istream& in, mfxU64& value) {
+    value = 0;
+    for (mfxU32 shift = 0; shift < 64; shift += 7) {
+        int b = in.get();
+        if (b == EOF) {
+            return false;
+        }
+        value |= (mfxU64)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+} // namespace
+
+std::atomic<mfxU32> SMTTracer::NumOfTracers{ 0 };
+thread_local SMTTracer::ThreadBufferRef SMTTracer::CachedThreadBuffer;
+
 SMTTracer::SMTTracer() : Log(), AddonLog(), E2ELatency(), EncLatency(), TracerMutex() {
     TimeBase = GetCurrentTS();
+    TracerID = ++NumOfTracers;
 }
 
 SMTTracer::~SMTTracer() {
     if (!Enabled)
         return;
 
+    if (Streaming) {
+        StopStreaming();
+        return;
+    }
+
     //these functions are intentionally called from destructor to try to save traces in case of a crash
+    MergeThreadBuffers();
     AdjustOverlappingEvents();
     AddFlowEvents();
     mfxU32 FileID = 0xfffffff & GetCurrentTS();
@@ -32,22 +75,42 @@ SMTTracer::~SMTTracer() {
 void SMTTracer::Init(const PipelineType type,
                      const mfxU32 numOfChannels,
                      const LatencyType latency,
-                     const mfxU32 TraceBufferSize) {
+                     const mfxU32 TraceBufferSize,
+                     const bool streaming,
+                     const TraceFormat format) {
     if (Enabled) {
         return;
     }
-    Enabled = true;
 
     if (TraceBufferSize > TraceBufferSizeInMBytes && TraceBufferSize < MaxTraceBufferSizeInMBytes) {
         TraceBufferSizeInMBytes = TraceBufferSize;
     }
-    Log.reserve(TraceBufferSizeInMBytes * 1024 * 1024 / sizeof(Event));
+    MaxNumOfChunks = TraceBufferSizeInMBytes * 1024 * 1024 / (EventsPerChunk * sizeof(Event));
+    Format         = format;
+
+    if (streaming) {
+        StreamFileName = "smt_trace_" + std::to_string(0xfffffff & GetCurrentTS()) +
+                         (Format == TraceFormat::BINARY ? ".bin" : ".json");
+        StreamFile.open(StreamFileName, std::ios::out | std::ios::binary);
+        if (!StreamFile) {
+            printf("\n### failed to open trace file %s\n", StreamFileName.c_str());
+            return;
+        }
+        WriteTraceHeader(StreamFile);
+        Streaming    = true;
+        StreamThread = std::thread(&SMTTracer::StreamEvents, this);
+    }
+    Enabled = true;
 
     TypeOfPipeline = type;
     NumOfChannels  = numOfChannels;
     TypeOfLatency  = latency;
 }
 
+bool SMTTracer::IsEnabled() const {
+    return Enabled;
+}
+
 void SMTTracer::BeginEvent(const ThreadType thType,
                            const mfxU32 thID,
                            const EventName name,
@@ -166,25 +229,95 @@ void SMTTracer::AdjustOverlappingEvents() {
 }
 
 void SMTTracer::SaveTrace(mfxU32 FileID) {
-    std::string FileName = "smt_trace_" + std::to_string(FileID) + ".json";
-    std::ofstream trace_file(FileName, std::ios::out);
+    std::string FileName = "smt_trace_" + std::to_string(FileID) +
+                           (Format == TraceFormat::BINARY ? ".bin" : ".json");
+    std::ofstream trace_file(FileName, std::ios::out | std::ios::binary);
     if (!trace_file) {
         return;
     }
 
-    printf("\n### trace buffer usage %.2f%%\n", 100. * Log.size() / Log.capacity());
+    mfxU64 NumOfDroppedEvents = 0;
+    for (const auto& buffer : ThreadBuffers) {
+        NumOfDroppedEvents += buffer->NumOfDroppedEvents;
+    }
+    printf("\n### trace buffer usage %.2f%%\n",
+           100. * Log.size() / (std::max(NumOfChunks, MaxNumOfChunks) * EventsPerChunk));
+    if (NumOfDroppedEvents) {
+        printf("trace buffer is full, %llu events dropped, use -trace_buffer_size or "
+               "-trace_stream\n",
+               (unsigned long long)NumOfDroppedEvents);
+    }
     printf("trace file name %s\n", FileName.c_str());
 
-    trace_file << "[" << std::endl;
+    WriteTraceHeader(trace_file);
+    WriteEvents(trace_file, Log);
+    WriteEvents(trace_file, AddonLog);
+
+    trace_file.close();
+}
 
-    for (const Event ev : Log) {
-        WriteEvent(trace_file, ev);
+bool SMTTracer::ConvertBinaryTrace(const std::string& binaryFileName,
+                                   const std::string& jsonFileName,
+                                   bool perfetto) {
+    std::ifstream binary_file(binaryFileName, std::ios::in | std::ios::binary);
+    if (!binary_file) {
+        return false;
     }
-    for (const Event ev : AddonLog) {
-        WriteEvent(trace_file, ev);
+
+    char magic[sizeof(BinaryTraceMagic)] = {};
+    mfxU32 version                         = 0;
+    binary_file.read(magic, sizeof(magic));
+    binary_file.read(reinterpret_cast<char*>(&version), sizeof(version));
+    if (!binary_file || !std::equal(magic, magic + sizeof(magic), BinaryTraceMagic) ||
+        version != BinaryTraceVersion) {
+        return false;
     }
 
+    std::ofstream trace_file(jsonFileName, std::ios::out);
+    if (!trace_file) {
+        return false;
+    }
+    trace_file << (perfetto ? "{\"traceEvents\":[" : "[") << std::endl;
+
+    SMTTracer tracer;
+    mfxU64 ts = 0;
+    for (;;) {
+        int evType = binary_file.get();
+        if (evType == EOF) {
+            break;
+        }
+        int thType  = binary_file.get();
+        int name    = binary_file.get();
+        mfxU64 thID = 0, tsDelta = 0, inID = 0, outID = 0, evID = 0;
+        if (name == EOF || evType > (int)EventType::Counter || thType > (int)ThreadType::ENC ||
+            name > (int)EventName::SURF_WAIT || !GetVarint(binary_file, thID) ||
+            !GetVarint(binary_file, tsDelta) || !GetVarint(binary_file, inID) ||
+            !GetVarint(binary_file, outID) || !GetVarint(binary_file, evID)) {
+            //truncated trace, keep events converted so far
+            printf("binary trace %s is corrupted\n", binaryFileName.c_str());
+            break;
+        }
+        ts += (tsDelta >> 1) ^ (0 - (tsDelta & 1));
+
+        Event ev;
+        ev.EvType = (EventType)evType;
+        ev.ThType = (ThreadType)thType;
+        ev.ThID   = (mfxU32)thID;
+        ev.Name   = (EventName)name;
+        ev.EvID   = (mfxU32)evID;
+        ev.InID   = inID;
+        ev.OutID  = outID;
+        ev.TS     = ts;
+        tracer.WriteEvent(trace_file, ev);
+    }
+
+    if (perfetto) {
+        //metadata event also terminates the list, since every event is followed by comma
+        trace_file << "{\"pid\":\"smt\",\"ph\":\"M\",\"name\":\"process_name\","
+                   << "\"args\":{\"name\":\"smt\"}}]}" << std::endl;
+    }
     trace_file.close();
+    return !trace_file.fail();
 }
 
 SMTTracer::TimeInterval::TimeInterval(mfxU64 ts, mfxU64 duration) {
@@ -205,14 +338,138 @@ void SMTTracer::AddEvent(const EventType evType,
     ev.Name   = name;
     ev.InID   = reinterpret_cast<mfxU64>(inID);
     ev.OutID  = reinterpret_cast<mfxU64>(outID);
-    ev.TS     = GetCurrentTS();
+    ev.Order  = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+                   .count();
+    ev.TS = ev.Order / 1000;
+
+    ThreadBuffer* buffer = GetThreadBuffer();
+    if (buffer->Current && buffer->Current->size() == EventsPerChunk) {
+        std::unique_lock<std::mutex> guard(BufferMutex);
+        FullChunks.push_back(std::move(buffer->Current));
+        buffer->Current = NewChunk(false);
+        guard.unlock();
+        if (Streaming) {
+            StreamSync.notify_one();
+        }
+    }
 
-    if (Log.size() == Log.capacity()) {
+    if (!buffer->Current) {
+        buffer->NumOfDroppedEvents++;
         return;
     }
+    buffer->Current->push_back(ev);
+}
+
+SMTTracer::ThreadBuffer* SMTTracer::GetThreadBuffer() {
+    if (CachedThreadBuffer.TracerID == TracerID) {
+        return CachedThreadBuffer.Buffer;
+    }
+
+    //first event of this thread, the first chunk is not limited by trace buffer size, so
+    //every thread records at least its beginning
+    std::lock_guard<std::mutex> guard(BufferMutex);
+    ThreadBuffers.emplace_back(new ThreadBuffer());
+    ThreadBuffer* buffer = ThreadBuffers.back().get();
+    buffer->Current      = NewChunk(true);
+
+    CachedThreadBuffer.TracerID = TracerID;
+    CachedThreadBuffer.Buffer   = buffer;
+    return buffer;
+}
+
+SMTTracer::Chunk SMTTracer::NewChunk(bool unlimited) {
+    Chunk chunk;
+    if (!FreeChunks.empty()) {
+        chunk = std::move(FreeChunks.back());
+        FreeChunks.pop_back();
+        return chunk;
+    }
 
-    std::lock_guard<std::mutex> guard(TracerMutex);
-    Log.push_back(ev);
+    if (!Streaming && !unlimited && NumOfChunks >= MaxNumOfChunks) {
+        return chunk;
+    }
+
+    NumOfChunks++;
+    chunk.reset(new std::vector<Event>());
+    chunk->reserve(EventsPerChunk);
+    return chunk;
+}
+
+void SMTTracer::MergeThreadBuffers() {
+    //called after all processing threads are finished, so there is no concurrent recording
+    std::lock_guard<std::mutex> guard(BufferMutex);
+    for (auto& buffer : ThreadBuffers) {
+        if (buffer->Current) {
+            FullChunks.push_back(std::move(buffer->Current));
+        }
+    }
+
+    size_t NumOfEvents = 0;
+    for (const auto& chunk : FullChunks) {
+        NumOfEvents += chunk->size();
+    }
+    Log.reserve(NumOfEvents);
+    for (auto& chunk : FullChunks) {
+        Log.insert(Log.end(), chunk->begin(), chunk->end());
+        chunk.reset();
+    }
+    FullChunks.clear();
+
+    //chunks of each thread are in order of completion, so stable sort keeps order of events
+    //recorded by one thread with the same time stamp
+    std::stable_sort(Log.begin(), Log.end(), [](const Event& a, const Event& b) {
+        return a.Order < b.Order;
+    });
+}
+
+void SMTTracer::StreamEvents() {
+    std::unique_lock<std::mutex> guard(BufferMutex);
+    for (;;) {
+        StreamSync.wait(guard, [this] {
+            return StreamingCompleted || !FullChunks.empty();
+        });
+        if (FullChunks.empty()) {
+            break;
+        }
+
+        std::vector<Chunk> chunks;
+        chunks.swap(FullChunks);
+        guard.unlock();
+
+        for (auto& chunk : chunks) {
+            WriteEvents(StreamFile, *chunk);
+            chunk->clear();
+        }
+        StreamFile.flush();
+
+        guard.lock();
+        for (auto& chunk : chunks) {
+            FreeChunks.push_back(std::move(chunk));
+        }
+    }
+}
+
+void SMTTracer::StopStreaming() {
+    //hand over partially filled chunks, all processing threads are finished at this point
+    std::unique_lock<std::mutex> guard(BufferMutex);
+    for (auto& buffer : ThreadBuffers) {
+        if (buffer->Current && !buffer->Current->empty()) {
+            FullChunks.push_back(std::move(buffer->Current));
+        }
+    }
+    StreamingCompleted = true;
+    guard.unlock();
+
+    StreamSync.notify_one();
+    StreamThread.join();
+    StreamFile.close();
+
+    printf("\n### trace streamed, %zu chunks of %zu events allocated\n",
+           NumOfChunks,
+           EventsPerChunk);
+    printf("trace file name %s\n", StreamFileName.c_str());
+    printf("flow events and latency statistics are not available in streaming mode\n");
 }
 
 mfxU64 SMTTracer::GetCurrentTS() {
@@ -434,6 +691,49 @@ void SMTTracer::AddFlowEvent(const Event a, const Event b) {
     AddonLog.push_back(ev);
 }
 
+void SMTTracer::WriteTraceHeader(std::ofstream& trace_file) {
+    if (Format == TraceFormat::BINARY) {
+        trace_file.write(BinaryTraceMagic, sizeof(BinaryTraceMagic));
+        trace_file.write(reinterpret_cast<const char*>(&BinaryTraceVersion),
+                         sizeof(BinaryTraceVersion));
+        LastBinaryTS = 0;
+    }
+    else {
+        trace_file << "[" << std::endl;
+    }
+}
+
+void SMTTracer::WriteEvents(std::ofstream& trace_file, const std::vector<Event>& events) {
+    if (Format == TraceFormat::JSON) {
+        for (const Event& ev : events) {
+            WriteEvent(trace_file, ev);
+        }
+        return;
+    }
+
+    std::vector<mfxU8> buffer;
+    buffer.reserve(BinaryWriteBufferSize + MaxBinaryEventSize);
+    for (const Event& ev : events) {
+        buffer.push_back((mfxU8)ev.EvType);
+        buffer.push_back((mfxU8)ev.ThType);
+        buffer.push_back((mfxU8)ev.Name);
+        PutVarint(buffer, ev.ThID);
+        //events of different threads are not ordered in streaming mode, so delta can be negative
+        mfxI64 delta = (mfxI64)(ev.TS - LastBinaryTS);
+        PutVarint(buffer, ((mfxU64)delta << 1) ^ (mfxU64)(delta >> 63));
+        PutVarint(buffer, ev.InID);
+        PutVarint(buffer, ev.OutID);
+        PutVarint(buffer, ev.EvID);
+        LastBinaryTS = ev.TS;
+
+        if (buffer.size() >= BinaryWriteBufferSize) {
+            trace_file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+            buffer.clear();
+        }
+    }
+    trace_file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+}
+
 void SMTTracer::WriteEvent(std::ofstream& trace_file, const Event ev) {
     switch (ev.EvType) {
         case EventType::DurationStart:
@@ -582,6 +882,9 @@ void SMTTracer::WriteEventName(std::ofstream& trace_file, const Event ev) {
                 trace_file << "unknown";
                 break;
         }
+        if (ev.Name == EventName::SURF_WAIT) {
+            trace_file << "_wait";
+        }
     }
     else if (ev.Name != EventName::UNDEF) {
         switch (ev.Name) {
@@ -640,7 +943,12 @@ void SMTTracer::WriteEventInOutIDs(std::ofstream& trace_file, const Event ev) {
 }
 
 void SMTTracer::WriteEventCounter(std::ofstream& trace_file, const Event ev) {
-    trace_file << "\"args\":{\"free surfaces\":" << ev.InID << "}";
+    if (ev.Name == EventName::SURF_WAIT) {
+        trace_file << "\"args\":{\"wait time, us\":" << ev.InID << "}";
+    }
+    else {
+        trace_file << "\"args\":{\"free surfaces\":" << ev.InID << "}";
+    }
 }
 
 void SMTTracer::WriteEventCategory(std::ofstream& trace_file) {
@@ -0,0 +1,102 @@
+/*############################################################################
+  # Copyright (C) 2005 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+// compares raw frame packing used by -o::raw output with the former per-byte and per-row loops,
+// usage: sample_multi_transcode_copy_benchmark [width height frames]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <functional>
+#include <vector>
+#include "frame_copy.h"
+
+static double Measure(mfxU32 frames, const std::function<void()>& pack) {
+    auto start = std::chrono::steady_clock::now();
+    for (mfxU32 i = 0; i < frames; i++)
+        pack();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / frames;
+}
+
+// former NV12asI420toBS chroma loop
+static void SplitUV_Loop(const mfxU8* src, mfxU32 pitch, mfxU8* dst, mfxU32 w, mfxU32 h) {
+    mfxU32 len = 0;
+    for (mfxU32 offset = 0; offset < 2; offset++) {
+        for (mfxU32 i = 0; i < h; i++) {
+            for (mfxU32 j = offset; j < 2 * w; j += 2) {
+                dst[len] = *(src + i * pitch + j);
+                len++;
+            }
+        }
+    }
+}
+
+// former per-row copy with per-row length update
+static void CopyPlane_Loop(const mfxU8* src, mfxU32 pitch, mfxU8* dst, mfxU32 w, mfxU32 h) {
+    mfxU32 len = 0;
+    for (mfxU32 i = 0; i < h; i++) {
+        memcpy(dst + len, src + i * pitch, w);
+        len += w;
+    }
+}
+
+int main(int argc, char** argv) {
+    mfxU32 width  = 3840;
+    mfxU32 height = 2160;
+    mfxU32 frames = 200;
+    if (argc == 4) {
+        width  = (mfxU32)atoi(argv[1]) & ~1u;
+        height = (mfxU32)atoi(argv[2]) & ~1u;
+        frames = (mfxU32)atoi(argv[3]);
+    }
+    if (!width || !height || !frames) {
+        printf("usage: %s [width height frames]\n", argv[0]);
+        return 1;
+    }
+
+    // surface rows are padded like in video memory
+    mfxU32 pitch = (width + 127) & ~127u;
+    std::vector<mfxU8> y(pitch * height), uv(pitch * height / 2);
+    std::vector<mfxU8> out(width * height * 3 / 2);
+    for (size_t i = 0; i < uv.size(); i++)
+        uv[i] = (mfxU8)i;
+
+    mfxU32 cw = width / 2, ch = height / 2;
+    mfxU8* pU = out.data() + width * height;
+    mfxU8* pV = pU + cw * ch;
+
+    printf("%ux%u, %u frames, ms per frame\n", width, height, frames);
+    printf("%-12s %10.3f\n", "luma loop", Measure(frames, [&]() {
+               CopyPlane_Loop(y.data(), pitch, out.data(), width, height);
+           }));
+    printf("%-12s %10.3f\n", "luma copy", Measure(frames, [&]() {
+               CopyPlane(y.data(), pitch, out.data(), width, width, height);
+           }));
+    printf("%-12s %10.3f\n", "split loop", Measure(frames, [&]() {
+               SplitUV_Loop(uv.data(), pitch, pU, cw, ch);
+           }));
+
+    for (int isa = FRAME_COPY_C; isa < FRAME_COPY_ISA_COUNT; isa++) {
+        const FrameCopyKernels* kernels = GetFrameCopyKernels((FrameCopyIsa)isa);
+        if (!kernels)
+            continue;
+
+        char name[32];
+        snprintf(name, sizeof(name), "split %s", kernels->name);
+        printf("%-12s %10.3f\n", name, Measure(frames, [&]() {
+                   kernels->SplitUV(uv.data(), pitch, pU, cw, pV, cw, cw, ch);
+               }));
+        snprintf(name, sizeof(name), "merge %s", kernels->name);
+        printf("%-12s %10.3f\n", name, Measure(frames, [&]() {
+                   kernels->MergeUV(pU, cw, pV, cw, uv.data(), pitch, cw, ch);
+               }));
+    }
+    printf("selected: %s\n", GetFrameCopyKernels()->name);
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+/*############################################################################
+  # Copyright (C) 2005 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+// compares start code scanning and removal of preventing bytes used by h264 frame splitter
+// with the former per-byte loops, usage: sample_multi_transcode_nal_benchmark [size_mb passes]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <vector>
+#include "avc_nal_spl.h"
+
+static double Measure(size_t bytes, mfxU32 passes, const std::function<void()>& run) {
+    auto start = std::chrono::steady_clock::now();
+    for (mfxU32 i = 0; i < passes; i++)
+        run();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return (double)bytes * passes / elapsed.count() / (1024 * 1024);
+}
+
+// former start code search, returns number of start codes
+static size_t CountStartCodes_Loop(const mfxU8* pb, size_t size) {
+    size_t count     = 0;
+    mfxU32 zeroCount = 0;
+    for (size_t i = 0; i < size; i++) {
+        if (!pb[i]) {
+            zeroCount++;
+            continue;
+        }
+        if (pb[i] == 1 && zeroCount >= 2)
+            count++;
+        zeroCount = 0;
+    }
+    return count;
+}
+
+static size_t CountStartCodes(const mfxU8* pb, size_t size) {
+    size_t count     = 0;
+    const mfxU8* end = pb + size;
+    for (;;) {
+        pb = ProtectedLibrary::FindZeroZeroByte(pb, end, 1);
+        if (pb == end)
+            return count;
+        count++;
+        pb += 3;
+    }
+}
+
+// former removal of preventing bytes, which wrote swapped dwords byte by byte
+static mfxU32 SwapMemory_Loop(mfxU8* dst, const mfxU8* src, mfxU32 size) {
+    mfxU32* pDst   = (mfxU32*)dst;
+    mfxU32 cur     = 0;
+    mfxU32 byteNum = 0;
+    mfxU32 zeros   = 0;
+    mfxU32 dstSize = 0;
+    for (mfxU32 i = 0; i < size; i++) {
+        mfxU8 b = src[i];
+        if (i >= 2 && b == 3 && zeros >= 2) {
+            zeros = 0;
+            continue;
+        }
+        zeros = b ? 0 : zeros + 1;
+        cur   = (cur << 8) | b;
+        dstSize++;
+        if (4 == ++byteNum) {
+            *pDst++ = cur;
+            byteNum = 0;
+            cur     = 0;
+        }
+    }
+    return dstSize;
+}
+
+int main(int argc, char** argv) {
+    mfxU32 size   = 64;
+    mfxU32 passes = 20;
+    if (argc == 3) {
+        size   = (mfxU32)atoi(argv[1]);
+        passes = (mfxU32)atoi(argv[2]);
+    }
+    if (!size || size > 1024 || !passes) {
+        printf("usage: %s [size_mb passes]\n", argv[0]);
+        return 1;
+    }
+    size *= 1024 * 1024;
+
+    // slice data with start code every 64 KB and some preventing bytes
+    std::mt19937 rng(1);
+    std::vector<mfxU8> data(size);
+    for (auto& b : data)
+        b = (mfxU8)rng();
+    for (mfxU32 i = 0; i + 4 < size; i += 4096) {
+        data[i]     = 0;
+        data[i + 1] = 0;
+        data[i + 2] = (i % (64 * 1024)) ? 3 : 1;
+    }
+    std::vector<mfxU8> swapped(size + 8);
+    mfxU32 swappedSize = 0;
+
+    printf("%u MB, %u passes, MB/s\n", size / (1024 * 1024), passes);
+    size_t found = 0;
+    printf("%-14s %10.1f\n", "scan loop", Measure(size, passes, [&]() {
+               found = CountStartCodes_Loop(data.data(), size);
+           }));
+    printf("%-14s %10.1f\n", "scan", Measure(size, passes, [&]() {
+               found = CountStartCodes(data.data(), size);
+           }));
+    printf("%-14s %10.1f\n", "unescape loop", Measure(size, passes, [&]() {
+               swappedSize = SwapMemory_Loop(swapped.data(), data.data(), size);
+           }));
+    printf("%-14s %10.1f\n", "unescape", Measure(size, passes, [&]() {
+               ProtectedLibrary::SwapMemoryAndRemovePreventingBytes(swapped.data(),
+                                                                    swappedSize,
+                                                                    data.data(),
+                                                                    size);
+           }));
+    printf("start codes: %zu, unescaped size: %u\n", found, swappedSize);
+
+    return 0;
+}
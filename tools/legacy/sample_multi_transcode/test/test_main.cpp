@@ -4,10 +4,19 @@
   # SPDX-License-Identifier: MIT
   ############################################################################*/
 
+#include <algorithm>
+#include <fstream>
+#include <random>
 #include <regex>
+#include "avc_nal_spl.h"
+#include "avc_spl.h"
+#include "frame_copy.h"
+#include "frame_pacer.h"
+#include "free_list_pool.h"
 #include "gtest/gtest.h"
 #include "sample_defs.h"
 #include "sample_multi_transcode.h"
+#include "sysmem_allocator.h"
 
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
@@ -163,6 +172,8 @@ TEST(Transcode_CLI, TrivialSessionOptions) {
     EXPECT_EQ(result.parsed[0].CascadeScaler, false);
     EXPECT_EQ(result.parsed[0].EnableTracing, false);
     EXPECT_EQ(result.parsed[0].TraceBufferSize, 0);
+    EXPECT_EQ(result.parsed[0].TraceStreaming, false);
+    EXPECT_EQ(result.parsed[0].TraceFormat, TranscodingSample::SMTTracer::TraceFormat::JSON);
     EXPECT_EQ(result.parsed[0].LatencyType, TranscodingSample::SMTTracer::LatencyType::DEFAULT);
     EXPECT_EQ(result.parsed[0].ParallelEncoding, false);
     EXPECT_EQ(result.parsed[0].bIsJoin, false);
@@ -282,6 +293,8 @@ TEST(Transcode_CLI, TrivialSessionOptions) {
     EXPECT_EQ(result.parsed[0].nFPS, 0);
     EXPECT_EQ(result.parsed[0].statisticsWindowSize, 0);
     EXPECT_EQ(result.parsed[0].statisticsLogFile, nullptr);
+    EXPECT_EQ(result.parsed[0].bLatencyStatistics, false);
+    EXPECT_TRUE(result.parsed[0].LatencyDumpFileName.empty());
     EXPECT_EQ(result.parsed[0].bLABRC, false);
     EXPECT_EQ(result.parsed[0].nLADepth, 0);
     EXPECT_EQ(result.parsed[0].bEnableExtLA, false);
@@ -771,4 +784,1407 @@ TEST(Transcode_CLI, OptionRobustSoft) {
     auto result = init_session({ "-robust:soft" });
     EXPECT_EQ(result.status, MFX_ERR_NONE);
     EXPECT_EQ(result.parsed[0].bSoftRobustFlag, true);
-}
\ No newline at end of file
+}
+
+TEST(Transcode_CLI, OptionAsyncWrite) {
+    auto result = init_session({ "-async_write", "8" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].nAsyncWriteDepth, 8);
+}
+
+TEST(Transcode_CLI, OptionAsyncWriteZero) {
+    auto result = init_session({ "-async_write", "0" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+}
+
+TEST(Transcode_CLI, OptionSyncDrain) {
+    auto result = init_session({ "-sync:drain" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].bSyncDrain, true);
+    EXPECT_EQ(result.parsed[0].bAdaptiveSync, false);
+}
+
+TEST(Transcode_CLI, OptionSyncAdaptive) {
+    auto result = init_session({ "-sync:adaptive", "-async", "8" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].bAdaptiveSync, true);
+    EXPECT_EQ(result.parsed[0].nAsyncDepth, 8);
+}
+
+TEST(Transcode_CLI, OptionFPSRational) {
+    auto result = init_session({ "-fps", "60000/1001" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].nFPS, 60000);
+    EXPECT_EQ(result.parsed[0].nFPSDenom, 1001);
+
+    result = init_session({ "-fps", "30" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].nFPS, 30);
+    EXPECT_EQ(result.parsed[0].nFPSDenom, 1);
+}
+
+TEST(Transcode_CLI, OptionFPSInvalid) {
+    auto result = init_session({ "-fps", "30/0" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+    result = init_session({ "-fps", "30fps" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+    result = init_session({ "-fps", "" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+    result = init_session({ "-fps", "-1" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+    result = init_session({ "-fps", "30/-1" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+    result = init_session({ "-fps", "30/" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+    result = init_session({ "-fps", " 30" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+    result = init_session({ "-fps", "4294967296" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+}
+
+TEST(Transcode_CLI, OptionMmapInput) {
+    auto result = init_session({ "-mmap_input" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].bMappedInput, true);
+}
+
+TEST(Transcode_CLI, OptionSharedInput) {
+    auto result = init_session({ "-shared_input" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].bSharedInput, true);
+}
+
+TEST(Transcode_CLI, OptionMmapInputWithSharedInput) {
+    auto result = init_session({ "-mmap_input", "-shared_input" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+}
+
+TEST(Transcode_CLI, OptionPreload) {
+    auto result = init_session({ "-preload", "64" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].nPreloadSize, 64u);
+}
+
+TEST(Transcode_CLI, OptionPreloadZero) {
+    auto result = init_session({ "-preload", "0" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+}
+
+TEST(Transcode_CLI, OptionFramePool) {
+    auto result = init_session({ "-frame_pool", "256" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].nFramePoolSize, 256u);
+}
+
+TEST(Transcode_CLI, OptionFramePoolZero) {
+    auto result = init_session({ "-frame_pool", "0" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+}
+
+TEST(Transcode_CLI, OptionTraceStream) {
+    auto result = init_session({ "-trace_stream" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].EnableTracing, true);
+    EXPECT_EQ(result.parsed[0].TraceStreaming, true);
+}
+
+TEST(Transcode_CLI, OptionTraceBinary) {
+    auto result = init_session({ "-trace_binary" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].EnableTracing, true);
+    EXPECT_EQ(result.parsed[0].TraceFormat, TranscodingSample::SMTTracer::TraceFormat::BINARY);
+}
+
+TEST(Transcode_CLI, OptionStatLatency) {
+    auto result = init({ "-stat-latency", "-i::h264", "in_file", "-o::h265", "out_file" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].bLatencyStatistics, true);
+    EXPECT_TRUE(result.parsed[0].LatencyDumpFileName.empty());
+}
+
+TEST(Transcode_CLI, OptionStatLatencyDump) {
+    auto result = init(
+        { "-stat-latency-dump", "latency", "-i::h264", "in_file", "-o::h265", "out_file" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].bLatencyStatistics, true);
+    EXPECT_EQ(result.parsed[0].LatencyDumpFileName, "latency");
+}
+
+TEST(Transcode_CLI, OptionSched) {
+    auto result = init({ "-sched", "4", "-i::h264", "in_file", "-o::h265", "out_file" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].bCooperativeScheduler, true);
+    EXPECT_EQ(result.parsed[0].nSchedulerThreads, 4u);
+}
+
+TEST(Transcode_CLI, OptionSchedInvalid) {
+    auto result = init({ "-sched", "x", "-i::h264", "in_file", "-o::h265", "out_file" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+}
+
+TEST(Transcode_CLI, OptionAffinity) {
+    auto result = init_session({ "-affinity", "0-2,5,8-9" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    std::vector<mfxU32> expected = { 0, 1, 2, 5, 8, 9 };
+    EXPECT_EQ(result.parsed[0].CpuAffinity, expected);
+}
+
+TEST(Transcode_CLI, OptionAffinityInvalid) {
+    for (const char* list : { "", "x", "3-1", "1,", "1-", "-1", "0-4096" }) {
+        auto result = init_session({ "-affinity", list });
+        EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED) << list;
+    }
+}
+
+TEST(Transcode_CLI, OptionNuma) {
+    auto result = init_session({ "-numa", "1" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].nNumaNode, 1);
+    EXPECT_TRUE(result.parsed[0].CpuAffinity.empty());
+}
+
+TEST(Transcode_CLI, OptionNumaInvalid) {
+    auto result = init_session({ "-numa", "-1" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+}
+
+TEST(Transcode_CLI, OptionAffinityAuto) {
+    auto result = init({ "-affinity:auto", "-i::h264", "in_file", "-o::h265", "out_file" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].bAutoAffinity, true);
+    EXPECT_EQ(result.parsed[0].nNumaNode, -1);
+}
+
+// writes file of pseudo-random bytes, returns its contents
+static std::vector<mfxU8> WriteTestInput(const char* fileName, size_t size) {
+    std::mt19937 rng((mfxU32)size);
+    std::vector<mfxU8> data(size);
+    for (auto& byte : data)
+        byte = (mfxU8)rng();
+    std::ofstream(fileName, std::ios::out | std::ios::binary)
+        .write((const char*)data.data(), data.size());
+    return data;
+}
+
+// reads input as decoder does, it takes up to consume bytes per call and leaves the rest in
+// bitstream. Stops when maxSize bytes are taken or at the end of input, returns taken data
+static std::vector<mfxU8> ConsumeInput(CSmplBitstreamReader& reader,
+                                       mfxBitstream& bs,
+                                       mfxU32 consume,
+                                       size_t maxSize = SIZE_MAX) {
+    std::vector<mfxU8> data;
+    while (data.size() < maxSize) {
+        mfxStatus sts = reader.ReadNextFrame(&bs);
+        EXPECT_TRUE(MFX_ERR_NONE == sts || MFX_ERR_MORE_DATA == sts) << sts;
+        if (MFX_ERR_NONE != sts && MFX_ERR_MORE_DATA != sts)
+            break;
+
+        // at the end of input decoder drains all data
+        mfxU32 size = (MFX_ERR_MORE_DATA == sts) ? bs.DataLength : std::min(consume, bs.DataLength);
+        size        = (mfxU32)std::min((size_t)size, maxSize - data.size());
+        data.insert(data.end(), bs.Data + bs.DataOffset, bs.Data + bs.DataOffset + size);
+        bs.DataOffset += size;
+        bs.DataLength -= size;
+
+        if (MFX_ERR_MORE_DATA == sts)
+            break;
+    }
+    return data;
+}
+
+// reads a part of input, rewinds and reads the whole input after data left in bitstream
+static void ExpectReadsInput(CSmplBitstreamReader& reader,
+                             const std::vector<mfxU8>& input,
+                             mfxU32 bufferSize,
+                             mfxU32 consume) {
+    std::vector<mfxU8> buffer(bufferSize);
+    mfxBitstream bs = {};
+    bs.Data         = buffer.data();
+    bs.MaxLength    = bufferSize;
+
+    auto data       = ConsumeInput(reader, bs, consume, input.size() / 3);
+    size_t readSize = data.size() + bs.DataLength;
+    reader.Reset();
+    bs.DataFlag = 0;
+    auto rest   = ConsumeInput(reader, bs, consume);
+    data.insert(data.end(), rest.begin(), rest.end());
+
+    std::vector<mfxU8> expected(input.begin(), input.begin() + readSize);
+    expected.insert(expected.end(), input.begin(), input.end());
+    EXPECT_EQ(data.size(), expected.size());
+    EXPECT_TRUE(data == expected);
+    EXPECT_EQ(bs.DataLength, 0u);
+    EXPECT_TRUE(bs.DataFlag & MFX_BITSTREAM_EOS);
+}
+
+TEST(Transcode_Reader, MappedReaderReadsFile) {
+    const char* fileName = "temp_input.bin";
+    auto input           = WriteTestInput(fileName, 3 * 1024 * 1024 + 123);
+
+    // window of the mapping and data copied after rewind are read with odd consumption
+    CSmplBitstreamMappedReader reader;
+    ASSERT_EQ(reader.Init(fileName), MFX_ERR_NONE);
+    ExpectReadsInput(reader, input, 64 * 1024, 10000);
+    reader.Close();
+
+    remove(fileName);
+}
+
+TEST(Transcode_Reader, SharedReadersReadFileOnce) {
+    const char* fileName = "temp_input.bin";
+    auto input           = WriteTestInput(fileName, 2 * CSmplSharedInput::CHUNK_SIZE + 123);
+
+    // data crosses chunk boundaries, the second reader is served by chunks of the first one
+    CSmplBitstreamSharedReader reader1, reader2;
+    ASSERT_EQ(reader1.Init(fileName), MFX_ERR_NONE);
+    ASSERT_EQ(reader2.Init(fileName), MFX_ERR_NONE);
+    ExpectReadsInput(reader1, input, 1024 * 1024, 300000);
+    ExpectReadsInput(reader2, input, 1024 * 1024, 300000);
+
+    auto sharedInput = CSmplSharedInput::Open(fileName);
+    ASSERT_NE(sharedInput, nullptr);
+    EXPECT_EQ(sharedInput->GetNumReads(), 3u);
+    sharedInput.reset();
+    reader1.Close();
+    reader2.Close();
+
+    remove(fileName);
+}
+
+TEST(Transcode_Reader, ReadAheadFileReadsAcrossBlocks) {
+    const char* fileName = "temp_input.bin";
+    auto input           = WriteTestInput(fileName, 10 * 1000 + 37);
+
+    // reads smaller than block, of whole block and of several blocks, starting inside of blocks
+    const size_t sizes[] = { 1, 999, 1000, 2500, 7 };
+    std::vector<mfxU8> buffer(input.size());
+    for (mfxU32 depth : { 0, 2 }) {
+        FILE* file = NULL;
+        MSDK_FOPEN(file, fileName, "rb");
+        ASSERT_NE(file, nullptr);
+        {
+            CSmplReadAheadFile reader(file, 1000, depth);
+            size_t pos = 0;
+            for (size_t i = 0; pos < input.size(); i++) {
+                size_t size  = std::min(sizes[i % 5], input.size() - pos);
+                size_t nRead = reader.Read(buffer.data() + pos, sizes[i % 5]);
+                ASSERT_EQ(nRead, size) << "depth " << depth << " pos " << pos;
+                pos += nRead;
+            }
+            EXPECT_TRUE(std::equal(input.begin(), input.end(), buffer.begin())) << depth;
+            EXPECT_EQ(reader.Read(buffer.data(), 10), 0u) << depth;
+
+            // seek drops data read ahead, also after the end of file
+            ASSERT_EQ(reader.Seek(4321), 0);
+            ASSERT_EQ(reader.Read(buffer.data(), 3000), 3000u);
+            EXPECT_TRUE(std::equal(buffer.begin(), buffer.begin() + 3000, input.begin() + 4321));
+            ASSERT_EQ(reader.Seek(9990), 0);
+            ASSERT_EQ(reader.Read(buffer.data(), 100), 47u);
+            EXPECT_TRUE(std::equal(buffer.begin(), buffer.begin() + 47, input.begin() + 9990));
+            EXPECT_EQ(reader.Read(buffer.data(), 100), 0u);
+        }
+        fclose(file);
+    }
+
+    remove(fileName);
+}
+
+TEST(Transcode_Reader, ReadAheadFileReadsPreloadedData) {
+    const char* fileName = "temp_input.bin";
+    auto input           = WriteTestInput(fileName, 10 * 1000 + 37);
+
+    std::vector<mfxU8> buffer(input.size());
+    for (mfxU32 depth : { 0, 2 }) {
+        FILE* file = NULL;
+        MSDK_FOPEN(file, fileName, "rb");
+        ASSERT_NE(file, nullptr);
+        {
+            // data read ahead before preloading is kept
+            CSmplReadAheadFile reader(file, 1000, depth);
+            ASSERT_EQ(reader.Read(buffer.data(), 10), 10u);
+            ASSERT_EQ(reader.Preload(5500), 5500u);
+
+            // reading ends at the end of loaded data
+            ASSERT_EQ(reader.Read(buffer.data(), 6000), 5500u);
+            EXPECT_TRUE(std::equal(buffer.begin(), buffer.begin() + 5500, input.begin() + 10));
+            EXPECT_EQ(reader.Read(buffer.data(), 10), 0u);
+
+            // seek is done in loaded data
+            ASSERT_EQ(reader.Seek(100), 0);
+            ASSERT_EQ(reader.Read(buffer.data(), 6000), 5400u);
+            EXPECT_TRUE(std::equal(buffer.begin(), buffer.begin() + 5400, input.begin() + 110));
+            EXPECT_NE(reader.Seek(5501), 0);
+        }
+        fclose(file);
+    }
+
+    remove(fileName);
+}
+
+// reads all preloaded data twice, the reader is rewound as input is looped with -timeout
+static void ExpectReadsPreloaded(CSmplBitstreamPreloadedReader& reader,
+                                 const std::vector<mfxU8>& expected,
+                                 bool wholeFile) {
+    std::vector<mfxU8> buffer(64 * 1024);
+    mfxBitstream bs = {};
+    bs.Data         = buffer.data();
+    bs.MaxLength    = (mfxU32)buffer.size();
+    for (int loop = 0; loop < 2; loop++) {
+        auto data = ConsumeInput(reader, bs, 10000);
+        EXPECT_TRUE(data == expected) << "loop " << loop;
+        EXPECT_EQ(bs.DataLength, 0u);
+        EXPECT_EQ(!!(bs.DataFlag & MFX_BITSTREAM_EOS), wholeFile);
+        reader.Reset();
+        bs.DataFlag = 0;
+    }
+}
+
+TEST(Transcode_Reader, PreloadedReaderReadsWholeFile) {
+    const char* fileName = "preloaded_reader_test.bin";
+    auto input           = WriteTestInput(fileName, 300000);
+    {
+        std::unique_ptr<CSmplBitstreamReader> source(new CSmplBitstreamReader());
+        CSmplBitstreamPreloadedReader reader;
+        reader.SetSource(source, 1024 * 1024);
+        ASSERT_EQ(reader.Init(fileName), MFX_ERR_NONE);
+        EXPECT_EQ(reader.GetSize(), input.size());
+        ExpectReadsPreloaded(reader, input, true);
+    }
+    remove(fileName);
+}
+
+TEST(Transcode_Reader, PreloadedReaderFallsBackFromIVF) {
+    // AV1 input without IVF header is preloaded by the default reader
+    const char* fileName = "preloaded_reader_test.av1";
+    auto input           = WriteTestInput(fileName, 100000);
+    {
+        std::unique_ptr<CSmplBitstreamReader> source(new CIVFFrameReader());
+        CSmplBitstreamPreloadedReader reader;
+        reader.SetSource(source, 1024 * 1024);
+        EXPECT_EQ(reader.Init(fileName), MFX_ERR_UNSUPPORTED);
+
+        source.reset(new CSmplBitstreamReader());
+        reader.SetSource(source, 1024 * 1024);
+        ASSERT_EQ(reader.Init(fileName), MFX_ERR_NONE);
+        EXPECT_EQ(reader.GetSize(), input.size());
+        ExpectReadsPreloaded(reader, input, true);
+    }
+    remove(fileName);
+}
+
+TEST(Transcode_Reader, PreloadedReaderCutsAtStartCode) {
+    // NAL units with 4 and 3 byte start codes, payload has no zero bytes
+    const char* fileName = "preloaded_reader_test.h264";
+    std::mt19937 rng(1);
+    std::vector<mfxU8> input;
+    std::vector<size_t> units;
+    while (input.size() < 100000) {
+        units.push_back(input.size());
+        if (units.size() % 2)
+            input.push_back(0);
+        input.insert(input.end(), { 0, 0, 1 });
+        size_t size = 100 + rng() % 3000;
+        for (size_t i = 0; i < size; i++)
+            input.push_back((mfxU8)(1 + rng() % 255));
+    }
+    std::ofstream(fileName, std::ios::out | std::ios::binary)
+        .write((const char*)input.data(), input.size());
+
+    for (size_t limit : { (size_t)50000, units[10] + 3, units[10] + 4, units[10] + 2 }) {
+        std::unique_ptr<CSmplBitstreamReader> source(new CSmplBitstreamReader());
+        CSmplBitstreamPreloadedReader reader;
+        reader.SetSource(source, limit);
+        ASSERT_EQ(reader.Init(fileName), MFX_ERR_NONE);
+
+        // data ends before the last start code which is whole inside the limit
+        size_t size = 0;
+        for (size_t k = 1; k < units.size(); k++) {
+            if (units[k] + (k % 2 ? 2 : 3) < limit)
+                size = units[k];
+        }
+        EXPECT_EQ(reader.GetSize(), size) << "limit " << limit;
+        ExpectReadsPreloaded(reader,
+                             std::vector<mfxU8>(input.begin(), input.begin() + size),
+                             false);
+    }
+    remove(fileName);
+}
+
+TEST(Transcode_FrameCopy, KernelsMatchScalar) {
+    const FrameCopyKernels* ref = GetFrameCopyKernels(FRAME_COPY_C);
+    ASSERT_NE(ref, nullptr);
+    ASSERT_NE(GetFrameCopyKernels(), nullptr);
+
+    for (int isa = FRAME_COPY_C; isa < FRAME_COPY_ISA_COUNT; isa++) {
+        const FrameCopyKernels* kernels = GetFrameCopyKernels((FrameCopyIsa)isa);
+        if (!kernels)
+            continue;
+
+        // widths cover both vector body and scalar tail
+        for (mfxU32 w = 1; w <= 100; w += 3) {
+            const mfxU32 h = 4, pitchUV = 2 * w + 7, pitch = w + 5;
+            std::vector<mfxU8> uv(pitchUV * h), u(pitch * h), v(pitch * h), uRef(pitch * h),
+                vRef(pitch * h), merged(pitchUV * h), mergedRef(pitchUV * h);
+            for (size_t i = 0; i < uv.size(); i++)
+                uv[i] = (mfxU8)(i * 7 + w);
+
+            kernels->SplitUV(uv.data(), pitchUV, u.data(), pitch, v.data(), pitch, w, h);
+            ref->SplitUV(uv.data(), pitchUV, uRef.data(), pitch, vRef.data(), pitch, w, h);
+            EXPECT_EQ(u, uRef) << kernels->name << " width " << w;
+            EXPECT_EQ(v, vRef) << kernels->name << " width " << w;
+
+            kernels->MergeUV(u.data(), pitch, v.data(), pitch, merged.data(), pitchUV, w, h);
+            ref->MergeUV(u.data(), pitch, v.data(), pitch, mergedRef.data(), pitchUV, w, h);
+            EXPECT_EQ(merged, mergedRef) << kernels->name << " width " << w;
+            for (mfxU32 i = 0; i < h; i++)
+                EXPECT_EQ(0, memcmp(merged.data() + i * pitchUV, uv.data() + i * pitchUV, 2 * w));
+
+            std::vector<mfxU16> samples(w), shifted(w), shiftedRef(w);
+            for (mfxU32 i = 0; i < w; i++)
+                samples[i] = (mfxU16)(i * 4099 + w);
+            for (mfxU32 shift = 0; shift <= 8; shift += 6) {
+                kernels->ShiftRight16(samples.data(), shifted.data(), w, shift);
+                ref->ShiftRight16(samples.data(), shiftedRef.data(), w, shift);
+                EXPECT_EQ(shifted, shiftedRef) << kernels->name << " width " << w;
+            }
+        }
+    }
+}
+
+// exposes frame buffers of the writer
+class YUVWriterTest : public CSmplYUVWriter {
+public:
+    bool AreBuffersAligned() const {
+        return !((size_t)m_frameBuf.GetData() % CSmplAlignedBuffer::ALIGNMENT) &&
+               !((size_t)m_pendingBuf.GetData() % CSmplAlignedBuffer::ALIGNMENT) &&
+               m_frameBuf.GetData() && m_pendingBuf.GetData();
+    }
+};
+
+TEST(Transcode_YUVWriter, BatchedFramesMatchRowWrites) {
+    // NV12 frame with odd width, rows are shorter than pitch
+    const mfxU16 w = 37, h = 17, pitch = 64;
+    std::vector<mfxU8> frame(pitch * (h + (h + 1) / 2));
+    for (size_t i = 0; i < frame.size(); i++)
+        frame[i] = (mfxU8)(i * 7 + i / pitch);
+
+    mfxFrameSurface1 surface = {};
+    surface.Info.FourCC      = MFX_FOURCC_NV12;
+    surface.Info.Width       = pitch;
+    surface.Info.Height      = 32;
+    surface.Info.CropW       = w;
+    surface.Info.CropH       = h;
+    surface.Data.Y           = frame.data();
+    surface.Data.UV          = frame.data() + pitch * h;
+    surface.Data.Pitch       = pitch;
+
+    const char* fileName = "temp_output.yuv";
+    std::string output[3];
+    for (int mode = 0; mode < 3; mode++) {
+        // row writes, batched frames and frames written by writer thread
+        YUVWriterTest writer;
+        writer.SetFrameBatching(mode > 0, mode > 1);
+        ASSERT_EQ(writer.Init(fileName, 1), MFX_ERR_NONE);
+        for (int i = 0; i < 3; i++) {
+            ASSERT_EQ(writer.WriteNextFrame(&surface), MFX_ERR_NONE);
+            ASSERT_EQ(writer.WriteNextFrameI420(&surface), MFX_ERR_NONE);
+        }
+        if (mode > 1)
+            EXPECT_TRUE(writer.AreBuffersAligned());
+        writer.Close();
+
+        std::ifstream file(fileName, std::ios::in | std::ios::binary);
+        output[mode].assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    // NV12 frame and I420 frame of the same size
+    const size_t frameSize = (size_t)w * h + 2 * ((w + 1) / 2) * ((h + 1) / 2);
+    EXPECT_EQ(output[0].size(), 3 * (w * h + (w + 1) * ((h + 1) / 2) + frameSize));
+    EXPECT_TRUE(output[1] == output[0]);
+    EXPECT_TRUE(output[2] == output[0]);
+
+    remove(fileName);
+}
+
+// random data with many zeros, so sequences 00 00 01 and 00 00 03 occur often
+static std::vector<mfxU8> NalTestData(std::mt19937& rng, size_t size) {
+    static const mfxU8 alphabet[] = { 0, 0, 0, 0, 1, 3, 0x65, 0xff };
+    std::vector<mfxU8> data(size);
+    for (auto& b : data)
+        b = alphabet[rng() % sizeof(alphabet)];
+    return data;
+}
+
+TEST(Transcode_NalSplitter, FindZeroZeroByteMatchesScalar) {
+    std::mt19937 rng(1);
+    for (int iter = 0; iter < 2000; iter++) {
+        std::vector<mfxU8> data = NalTestData(rng, rng() % 100);
+        const mfxU8* end        = data.data() + data.size();
+        for (mfxU8 value : { 1, 3 }) {
+            for (const mfxU8* begin = data.data(); begin <= end; begin++) {
+                const mfxU8* expected = begin;
+                while (end - expected >= 3 &&
+                       (expected[0] || expected[1] || expected[2] != value))
+                    expected++;
+                if (end - expected < 3)
+                    expected = end;
+                ASSERT_EQ(ProtectedLibrary::FindZeroZeroByte(begin, end, value), expected);
+            }
+        }
+    }
+}
+
+TEST(Transcode_NalSplitter, RemovePreventingBytesMatchesScalar) {
+    std::mt19937 rng(2);
+    for (int iter = 0; iter < 2000; iter++) {
+        std::vector<mfxU8> data = NalTestData(rng, rng() % 200);
+
+        // byte 0x03 is removed if it follows two zeros, zeros are counted after removed byte again
+        std::vector<mfxU8> expected;
+        mfxU32 zeros = 0;
+        for (mfxU8 b : data) {
+            if (b == 3 && zeros >= 2) {
+                zeros = 0;
+                continue;
+            }
+            expected.push_back(b);
+            zeros = b ? 0 : zeros + 1;
+        }
+        while (expected.size() & 3)
+            expected.push_back(0);
+        for (size_t i = 0; i < expected.size(); i += 4) {
+            mfxU8* p     = expected.data() + i;
+            mfxU32 dword = ((mfxU32)p[0] << 24) | ((mfxU32)p[1] << 16) | ((mfxU32)p[2] << 8) | p[3];
+            memcpy(p, &dword, sizeof(dword));
+        }
+
+        std::vector<mfxU8> swapped(data.size() + 8);
+        mfxU32 swappedSize = 0;
+        ProtectedLibrary::SwapMemoryAndRemovePreventingBytes(swapped.data(),
+                                                             swappedSize,
+                                                             data.data(),
+                                                             (mfxU32)data.size());
+        swapped.resize(swappedSize);
+        ASSERT_EQ(swapped, expected);
+    }
+}
+
+TEST(Transcode_NalSplitter, SplitsStreamFedByChunks) {
+    std::mt19937 rng(3);
+    for (int iter = 0; iter < 200; iter++) {
+        // nal units without start code emulation, ending with non-zero byte
+        std::vector<std::vector<mfxU8>> nals(1 + rng() % 20);
+        std::vector<mfxU8> stream;
+        for (auto& nal : nals) {
+            nal.push_back((mfxU8)(1 + rng() % 23));
+            size_t size = rng() % 3000;
+            for (size_t i = 0; i < size; i++) {
+                mfxU8 b = (rng() % 4) ? (mfxU8)(4 + rng() % 252) : 0;
+                if (b || nal.back())
+                    nal.push_back(b);
+            }
+            if (!nal.back())
+                nal.push_back(0x80);
+
+            if (rng() % 2)
+                stream.push_back(0);
+            stream.insert(stream.end(), { 0, 0, 1 });
+            stream.insert(stream.end(), nal.begin(), nal.end());
+        }
+
+        ProtectedLibrary::NALUnitSplitter splitter;
+        splitter.Init();
+        std::vector<std::vector<mfxU8>> split;
+        std::vector<mfxU8> buffer(stream.size());
+        mfxBitstream bs = {};
+        bs.Data         = buffer.data();
+        bs.MaxLength    = (mfxU32)buffer.size();
+
+        mfxBitstream* nal = nullptr;
+        for (size_t pos = 0; pos < stream.size();) {
+            // feed data like bitstream reader does, remaining data is moved to the beginning
+            memmove(bs.Data, bs.Data + bs.DataOffset, bs.DataLength);
+            bs.DataOffset = 0;
+            size_t chunk  = std::min<size_t>(1 + rng() % 500, stream.size() - pos);
+            memcpy(bs.Data + bs.DataLength, stream.data() + pos, chunk);
+            bs.DataLength += (mfxU32)chunk;
+            pos += chunk;
+
+            while (splitter.GetNalUnits(&bs, nal))
+                split.emplace_back(nal->Data, nal->Data + nal->DataLength);
+        }
+        // the last nal unit is returned at the end of stream
+        while (splitter.GetNalUnits(nullptr, nal))
+            split.emplace_back(nal->Data, nal->Data + nal->DataLength);
+        ASSERT_EQ(split, nals);
+    }
+}
+
+// writes exp-golomb coded nal unit with start code, emulation prevention bytes are inserted
+class NalWriter {
+public:
+    explicit NalWriter(mfxU8 header) : data{ 0, 0, 1, header } {}
+
+    void PutBits(mfxU32 value, mfxU32 nbits) {
+        while (nbits--) {
+            byte = (mfxU8)((byte << 1) | ((value >> nbits) & 1));
+            if (++bits == 8)
+                PutByte();
+        }
+    }
+    void PutUE(mfxU32 value) {
+        mfxU32 length = 0;
+        while ((value + 1) >> (length + 1))
+            length++;
+        PutBits(0, length);
+        PutBits(value + 1, length + 1);
+    }
+    void PutSE(mfxI32 value) {
+        PutUE(value > 0 ? 2 * value - 1 : -2 * value);
+    }
+    std::vector<mfxU8> Finish() {
+        PutBits(1, 1);
+        while (bits)
+            PutBits(0, 1);
+        return data;
+    }
+
+private:
+    void PutByte() {
+        if (zeros >= 2 && byte <= 3) {
+            data.push_back(3);
+            zeros = 0;
+        }
+        data.push_back(byte);
+        zeros = byte ? 0 : zeros + 1;
+        byte  = 0;
+        bits  = 0;
+    }
+
+    std::vector<mfxU8> data;
+    mfxU8 byte   = 0;
+    mfxU32 bits  = 0;
+    mfxU32 zeros = 0;
+};
+
+TEST(Transcode_NalSplitter, ParsesSliceHeaderLongerThanPrefix) {
+    // high profile, 4:2:0, one macroblock frame, 4 bit frame_num, poc type 2
+    NalWriter sps(0x67);
+    sps.PutBits(100, 8);
+    sps.PutBits(0, 8);
+    sps.PutBits(40, 8);
+    for (mfxU32 value : { 0, 1, 0, 0 })
+        sps.PutUE(value);
+    sps.PutBits(0, 2);
+    for (mfxU32 value : { 0, 2, 1 })
+        sps.PutUE(value);
+    sps.PutBits(0, 1);
+    sps.PutUE(0);
+    sps.PutUE(0);
+    sps.PutBits(0xc, 4);
+
+    // explicit weighted bi-prediction
+    NalWriter pps(0x68);
+    for (mfxU32 value : { 0, 0 })
+        pps.PutUE(value);
+    pps.PutBits(0, 2);
+    for (mfxU32 value : { 0, 0, 0 })
+        pps.PutUE(value);
+    pps.PutBits(1, 3);
+    for (mfxI32 value : { 0, 0, 0 })
+        pps.PutSE(value);
+    pps.PutBits(0, 3);
+
+    NalWriter idr(0x65);
+    for (mfxU32 value : { 0, 7, 0 })
+        idr.PutUE(value);
+    idr.PutBits(0, 4);
+    idr.PutUE(0);
+    idr.PutBits(0, 2);
+    idr.PutSE(0);
+
+    // weight table of 32 references in both lists with long codes makes header ~1.6 KB
+    NalWriter slice(0x01);
+    for (mfxU32 value : { 0, 6, 0 })
+        slice.PutUE(value);
+    slice.PutBits(1, 4);
+    slice.PutBits(3, 2);
+    slice.PutUE(31);
+    slice.PutUE(31);
+    slice.PutBits(0, 2);
+    slice.PutUE(0);
+    slice.PutUE(0);
+    for (int ref = 0; ref < 64; ref++) {
+        mfxI32 value = (ref % 2) ? 0x8000 : -0x8000;
+        slice.PutBits(1, 1);
+        slice.PutSE(value);
+        slice.PutSE(-value);
+        slice.PutBits(1, 1);
+        for (int i = 0; i < 4; i++)
+            slice.PutSE(value);
+    }
+    slice.PutSE(0);
+    // slice data
+    for (int i = 0; i < 16; i++)
+        slice.PutBits(0xa5, 8);
+
+    std::vector<std::vector<mfxU8>> nals = { sps.Finish(),
+                                             pps.Finish(),
+                                             idr.Finish(),
+                                             slice.Finish() };
+    ASSERT_GT(nals[3].size(), 1024u + 512u);
+    std::vector<std::vector<mfxU8>> expected = { nals[0], nals[3] };
+    for (size_t i = 1; i < 3; i++)
+        expected[0].insert(expected[0].end(), nals[i].begin(), nals[i].end());
+
+    for (bool bInPlace : { false, true }) {
+        std::vector<mfxU8> stream;
+        for (auto& nal : nals)
+            stream.insert(stream.end(), nal.begin(), nal.end());
+        mfxBitstream bs = {};
+        bs.Data         = stream.data();
+        bs.DataLength   = (mfxU32)stream.size();
+        bs.MaxLength    = (mfxU32)stream.size();
+        bs.DataFlag     = MFX_BITSTREAM_EOS;
+
+        ProtectedLibrary::AVC_Spl splitter;
+        splitter.SetInPlace(bInPlace);
+        std::vector<std::vector<mfxU8>> frames;
+        std::vector<SliceSplitterInfo> slices;
+        FrameSplitterInfo* frame = nullptr;
+        // copy mode returns the last frames after source is gone
+        for (mfxBitstream* source : { &bs, bInPlace ? &bs : nullptr }) {
+            while (MFX_ERR_NONE == splitter.GetFrame(source, &frame)) {
+                frames.emplace_back(frame->Data, frame->Data + frame->DataLength);
+                slices.insert(slices.end(), frame->Slice, frame->Slice + frame->SliceNum);
+                splitter.ResetCurrentState();
+            }
+        }
+        EXPECT_EQ(frames, expected) << "in-place " << bInPlace;
+        ASSERT_EQ(slices.size(), 2u) << "in-place " << bInPlace;
+        EXPECT_EQ(slices[1].SliceType, TYPE_B) << "in-place " << bInPlace;
+        EXPECT_GT(slices[1].HeaderLength, 1024u + 512u) << "in-place " << bInPlace;
+    }
+}
+
+TEST(Transcode_SysMemAllocator, SlabReusesReleasedSurfaces) {
+    for (bool bZeroFill : { false, true }) {
+        SysMemAllocatorParams params;
+        params.backend   = SYSMEM_BACKEND_SLAB;
+        params.hugePages = MSDK_HUGE_PAGES_TRANSPARENT;
+        params.bZeroFill = bZeroFill;
+
+        SysMemFrameAllocator allocator;
+        ASSERT_EQ(allocator.Init(&params), MFX_ERR_NONE);
+
+        mfxFrameAllocRequest request = {};
+        request.Type              = MFX_MEMTYPE_SYSTEM_MEMORY | MFX_MEMTYPE_FROM_DECODE;
+        request.NumFrameSuggested = request.NumFrameMin = 4;
+        request.Info.FourCC                             = MFX_FOURCC_NV12;
+        request.Info.ChromaFormat                       = MFX_CHROMAFORMAT_YUV420;
+        request.Info.Width                              = 1920;
+        request.Info.Height                             = 1088;
+
+        std::vector<mfxMemId> mids;
+        for (int pass = 0; pass < 2; pass++) {
+            mfxFrameAllocResponse response = {};
+            ASSERT_EQ(allocator.Alloc(allocator.pthis, &request, &response), MFX_ERR_NONE);
+            ASSERT_EQ(response.NumFrameActual, request.NumFrameSuggested);
+
+            std::vector<mfxMemId> allocated(response.mids, response.mids + response.NumFrameActual);
+            for (mfxMemId mid : allocated) {
+                mfxFrameData data = {};
+                ASSERT_EQ(allocator.Lock(allocator.pthis, mid, &data), MFX_ERR_NONE);
+                EXPECT_EQ((size_t)data.Y % 4096, 0u);
+                // released surfaces keep their content unless zeroing is requested
+                mfxU8 expected = (pass && !bZeroFill) ? 0x5a : 0;
+                EXPECT_EQ(data.Y[0], expected);
+                EXPECT_EQ(data.UV[1920 * 544 - 1], expected);
+                memset(data.Y, 0x5a, 1920 * 1088 * 3 / 2);
+                ASSERT_EQ(allocator.Unlock(allocator.pthis, mid, &data), MFX_ERR_NONE);
+            }
+            if (pass) {
+                std::sort(mids.begin(), mids.end());
+                std::sort(allocated.begin(), allocated.end());
+                EXPECT_EQ(allocated, mids);
+            }
+            mids = allocated;
+            ASSERT_EQ(allocator.Free(allocator.pthis, &response), MFX_ERR_NONE);
+
+            mfxFrameData data = {};
+            EXPECT_EQ(allocator.Lock(allocator.pthis, mids[0], &data), MFX_ERR_INVALID_HANDLE);
+        }
+
+        SysMemAllocatorStats stats = {};
+        ASSERT_EQ(allocator.GetStats(&stats), MFX_ERR_NONE);
+        EXPECT_EQ(stats.numAllocs, 2u * request.NumFrameSuggested);
+        // all surfaces fit into the single arena
+        EXPECT_EQ(stats.reservedBytes, 64u * 1024 * 1024);
+    }
+}
+
+TEST(Transcode_SysMemAllocator, FramePoolReusesReleasedChains) {
+    SysMemFrameAllocator allocator;
+    ASSERT_EQ(allocator.Init(nullptr), MFX_ERR_NONE);
+    // room for a single chain of four 64x64 NV12 frames
+    allocator.SetFramePoolLimit(32 * 1024);
+
+    mfxFrameAllocRequest request = {};
+    request.Type                 = MFX_MEMTYPE_SYSTEM_MEMORY | MFX_MEMTYPE_FROM_DECODE;
+    request.NumFrameSuggested    = 4;
+    request.NumFrameMin          = 4;
+    request.Info.FourCC          = MFX_FOURCC_NV12;
+    request.Info.ChromaFormat    = MFX_CHROMAFORMAT_YUV420;
+    request.Info.Width           = 64;
+    request.Info.Height          = 64;
+
+    mfxFrameAllocResponse first = {};
+    ASSERT_EQ(allocator.Alloc(allocator.pthis, &request, &first), MFX_ERR_NONE);
+    std::vector<mfxMemId> mids(first.mids, first.mids + first.NumFrameActual);
+    ASSERT_EQ(allocator.Free(allocator.pthis, &first), MFX_ERR_NONE);
+
+    // released chain is handed back to the same request and stays usable
+    mfxFrameAllocResponse second = {};
+    ASSERT_EQ(allocator.Alloc(allocator.pthis, &request, &second), MFX_ERR_NONE);
+    ASSERT_EQ(second.NumFrameActual, 4);
+    EXPECT_EQ(std::vector<mfxMemId>(second.mids, second.mids + 4), mids);
+    mfxFrameData data = {};
+    ASSERT_EQ(allocator.Lock(allocator.pthis, second.mids[3], &data), MFX_ERR_NONE);
+    memset(data.Y, 0, 64 * 64 * 3 / 2);
+    ASSERT_EQ(allocator.Unlock(allocator.pthis, second.mids[3], &data), MFX_ERR_NONE);
+    ASSERT_EQ(allocator.Free(allocator.pthis, &second), MFX_ERR_NONE);
+
+    // other size misses the pool and evicts the pooled chain when released
+    request.Info.Height         = 48;
+    mfxFrameAllocResponse third = {};
+    ASSERT_EQ(allocator.Alloc(allocator.pthis, &request, &third), MFX_ERR_NONE);
+    ASSERT_EQ(allocator.Free(allocator.pthis, &third), MFX_ERR_NONE);
+
+    FramePoolStats stats = allocator.GetFramePoolStats();
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.misses, 2u);
+    EXPECT_EQ(stats.evictions, 1u);
+    EXPECT_EQ(stats.pooledBytes, 64u * 48 * 3 / 2 * 4);
+
+    EXPECT_EQ(allocator.Close(), MFX_ERR_NONE);
+    EXPECT_EQ(allocator.GetFramePoolStats().pooledBytes, 0u);
+}
+
+TEST(Transcode_LatencyStat, HistogramPercentiles) {
+    CTimeStatistics stat;
+    stat.TurnOnHistogram();
+    // 1..1000 ms in shuffled order
+    std::vector<mfxF64> values;
+    for (int i = 1; i <= 1000; i++)
+        values.push_back(i / 1000.);
+    std::shuffle(values.begin(), values.end(), std::mt19937(1));
+    for (mfxF64 value : values)
+        stat.AddMeasurement(value);
+
+    EXPECT_EQ(stat.GetHistogramNumMeasurements(), 1000u);
+    EXPECT_NEAR(stat.GetPercentile(50, false), 500, 500 * 0.01);
+    EXPECT_NEAR(stat.GetPercentile(90, false), 900, 900 * 0.01);
+    EXPECT_NEAR(stat.GetPercentile(99, false), 990, 990 * 0.01);
+    EXPECT_NEAR(stat.GetPercentile(99.9, false), 999, 999 * 0.01);
+    EXPECT_LE(stat.GetPercentile(100, false), 1000);
+
+    // histogram is kept for the whole run
+    stat.ResetStatistics();
+    EXPECT_EQ(stat.GetHistogramNumMeasurements(), 1000u);
+}
+
+TEST(Transcode_LatencyStat, StagesReport) {
+    CLatencyStat stat;
+    stat.AddMeasurement(LATENCY_STAGE_VPP, 0.001);
+    stat.Enable();
+    // 1..100 ms
+    for (int i = 1; i <= 100; i++)
+        stat.AddMeasurement(LATENCY_STAGE_ENCODE, i / 1000.);
+    stat.AddMeasurement(LATENCY_STAGE_WRITE, 0.002);
+    stat.AddMeasurement(LATENCY_STAGE_COUNT, 0.002);
+
+    // measurements before Enable are dropped
+    EXPECT_EQ(stat.GetStage(LATENCY_STAGE_VPP).GetNumMeasurements(), 0u);
+    EXPECT_EQ(stat.GetStage(LATENCY_STAGE_ENCODE).GetNumMeasurements(), 100u);
+    EXPECT_EQ(stat.GetStage(LATENCY_STAGE_WRITE).GetNumMeasurements(), 1u);
+
+    stat.DumpStatistics("latency_stat_test", 3);
+    std::ifstream csv_file("latency_stat_test_ID_3.csv");
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(csv_file, line);)
+        lines.push_back(line);
+    csv_file.close();
+    remove("latency_stat_test_ID_3.csv");
+
+    // stages without measurements are skipped, values are in ms
+    ASSERT_EQ(lines.size(), 3u);
+    EXPECT_EQ(lines[0], "stage,samples,avg,p50,p90,p99,p99.9,max");
+    EXPECT_EQ(lines[2], "Write,1,2.000,2.000,2.000,2.000,2.000,2.000");
+    mfxF64 values[6] = {};
+    ASSERT_EQ(sscanf(lines[1].c_str(),
+                     "Encode,100,%lf,%lf,%lf,%lf,%lf,%lf",
+                     &values[0],
+                     &values[1],
+                     &values[2],
+                     &values[3],
+                     &values[4],
+                     &values[5]),
+              6);
+    const mfxF64 expected[6] = { 50.5, 50, 90, 99, 100, 100 };
+    for (int i = 0; i < 6; i++)
+        EXPECT_NEAR(values[i], expected[i], expected[i] * 0.01);
+
+    std::ifstream json_file("latency_stat_test_ID_3.json");
+    std::string json((std::istreambuf_iterator<char>(json_file)), std::istreambuf_iterator<char>());
+    json_file.close();
+    remove("latency_stat_test_ID_3.json");
+    EXPECT_EQ(json.find("{\"session\":3,\"stages\":["), 0u);
+    EXPECT_NE(json.find("{\"stage\":\"Write\",\"samples\":1,\"avg\":2.000,\"p50\":2.000,"
+                        "\"p90\":2.000,\"p99\":2.000,\"p99.9\":2.000,\"max\":2.000}"),
+              std::string::npos);
+    EXPECT_EQ(json.find("VPP"), std::string::npos);
+}
+
+TEST(Transcode_SyncWindow, SizedByUnloadedLatency) {
+    const msdk_tick ms = CTimeStatistics::GetFrequency() / 1000;
+    CSyncWindow window;
+    window.Init(8);
+    EXPECT_EQ(window.GetWindow(), 8u);
+
+    // frame goes through empty pipeline in 3 ms, pipeline completes a frame each 1 ms,
+    // frames of busy pipeline wait in queue and their latency is larger
+    for (msdk_tick i = 0; i < 10; i++)
+        window.AddCompletions(i * ms, 1, (3 + 2 * i) * ms);
+    EXPECT_EQ(window.GetWindow(), 3u); // 3 ms / 2 ms + 1
+    EXPECT_FALSE(window.IsDrainRequired());
+
+    for (msdk_tick i = 10; i < CSyncWindow::EPOCH_FRAMES; i++)
+        window.AddCompletions(i * ms, 1, (3 + 2 * i) * ms);
+    EXPECT_TRUE(window.IsDrainRequired());
+    window.Drained();
+    EXPECT_FALSE(window.IsDrainRequired());
+
+    // longer pipeline needs more frames in flight, window is limited by async depth
+    msdk_tick start = 1000 * ms;
+    for (msdk_tick i = 0; i < 20; i++)
+        window.AddCompletions(start + i * ms, 1, start + (9 + 2 * i) * ms);
+    EXPECT_EQ(window.GetWindow(), 6u); // 9 ms / 2 ms + 1
+    window.Init(4);
+    for (msdk_tick i = 0; i < 20; i++)
+        window.AddCompletions(i * ms, 1, (9 + 2 * i) * ms);
+    EXPECT_EQ(window.GetWindow(), 4u);
+}
+
+TEST(Transcode_SyncWindow, CompletionsObservedAtOnce) {
+    const msdk_tick ms = CTimeStatistics::GetFrequency() / 1000;
+    CSyncWindow window;
+    window.Init(16);
+
+    // frame goes through empty pipeline in 8 ms and pipeline completes a frame each 1 ms,
+    // but completions are probed each 4 ms, so 4 frames are observed at once
+    for (msdk_tick i = 0; i < 20; i++)
+        window.AddCompletions(4 * i * ms, 4, (8 + 4 * i) * ms);
+    EXPECT_EQ(window.GetWindow(), 9u); // 8 ms / 1 ms + 1
+    EXPECT_FALSE(window.IsDrainRequired());
+
+    for (msdk_tick i = 20; i < CSyncWindow::EPOCH_FRAMES / 4; i++)
+        window.AddCompletions(4 * i * ms, 4, (8 + 4 * i) * ms);
+    EXPECT_TRUE(window.IsDrainRequired());
+}
+
+TEST(Transcode_LatencyStat, BatchMeasuredPerItem) {
+    CTimeStatistics stat;
+    stat.StopTimeMeasurementWithCheck(4);
+    EXPECT_EQ(stat.GetNumMeasurements(), 0u);
+
+    stat.StartTimeMeasurement();
+    stat.StopTimeMeasurementWithCheck(4);
+    EXPECT_EQ(stat.GetNumMeasurements(), 4u);
+    EXPECT_EQ(stat.GetMinTime(), stat.GetMaxTime());
+    EXPECT_NEAR(stat.GetTotalTime(), 4 * stat.GetAvgTime(), 1e-12);
+}
+
+TEST(Transcode_FramePacer, RationalDeadlines) {
+    CFramePacer pacer;
+    EXPECT_FALSE(pacer.IsEnabled());
+    pacer.Reset(30000, 1001);
+    EXPECT_TRUE(pacer.IsEnabled());
+    EXPECT_EQ(pacer.GetFrameOffset(1), 33366666u);
+    // deadlines are computed from the start, so there is no rounding drift
+    EXPECT_EQ(pacer.GetFrameOffset(30000), 1001000000000ull);
+    const mfxU64 year = 3600 * 24 * 365;
+    EXPECT_EQ(pacer.GetFrameOffset(30000 * year), 1001 * year * 1000000000);
+}
+
+TEST(Transcode_FramePacer, PacesAndCountsLateFrames) {
+    const mfxU64 ms = 1000000;
+    CFramePacer pacer;
+    pacer.Reset(1000);
+
+    mfxU64 start = msdk_time_get_monotonic_ns();
+    for (int i = 0; i <= 10; i++)
+        pacer.Work();
+    EXPECT_GE(msdk_time_get_monotonic_ns() - start, 10 * ms);
+    EXPECT_EQ(pacer.GetNumFrames(), 11u);
+
+    // stall for several frame intervals, timeline is restarted instead of bursting
+    msdk_time_sleep_until_ns(msdk_time_get_monotonic_ns() + 5 * ms);
+    pacer.Work();
+    EXPECT_GE(pacer.GetNumLateFrames(), 1u);
+    EXPECT_GE(pacer.GetNumResyncs(), 1u);
+    EXPECT_GE(pacer.GetMaxLateness(), 3 * ms);
+
+    start = msdk_time_get_monotonic_ns();
+    pacer.Work();
+    EXPECT_GE(msdk_time_get_monotonic_ns() - start, ms / 2);
+}
+
+TEST(Transcode_DeviceBusyWaiter, BacksOffExponentially) {
+    const mfxU64 us = 1000;
+    CDeviceBusyWaiter waiter;
+
+    // first attempts only yield
+    for (mfxU32 i = 0; i < CDeviceBusyWaiter::SPIN_ATTEMPTS; i++)
+        EXPECT_EQ(waiter.Wait(i), MFX_ERR_NONE);
+    EXPECT_EQ(waiter.GetNumEvents(), CDeviceBusyWaiter::SPIN_ATTEMPTS);
+
+    mfxU64 lost = waiter.GetTimeLost();
+    waiter.Wait(CDeviceBusyWaiter::SPIN_ATTEMPTS);
+    EXPECT_GE(waiter.GetTimeLost() - lost, CDeviceBusyWaiter::MIN_SLEEP_TIME * us);
+
+    // sleep is capped, so long busy period isn't slept through
+    mfxU64 start = msdk_time_get_monotonic_ns();
+    waiter.Wait(1000);
+    mfxU64 elapsed = msdk_time_get_monotonic_ns() - start;
+    EXPECT_GE(elapsed, CDeviceBusyWaiter::MAX_SLEEP_TIME * us);
+    EXPECT_LT(elapsed, 100 * CDeviceBusyWaiter::MAX_SLEEP_TIME * us);
+}
+
+TEST(Transcode_DeviceBusyWaiter, SyncsOldestInsteadOfBackOff) {
+    CDeviceBusyWaiter waiter;
+    int numSyncs = 0;
+
+    EXPECT_EQ(waiter.Wait(100,
+                          [&]() {
+                              numSyncs++;
+                              return MFX_ERR_NONE;
+                          }),
+              MFX_ERR_NONE);
+    EXPECT_EQ(numSyncs, 1);
+    // completed without back off
+    EXPECT_LT(waiter.GetTimeLost(), CDeviceBusyWaiter::MAX_SLEEP_TIME * 1000ull);
+
+    // nothing in flight, backs off instead
+    EXPECT_EQ(waiter.Wait(0,
+                          [&]() {
+                              return MFX_ERR_NOT_FOUND;
+                          }),
+              MFX_ERR_NONE);
+    EXPECT_EQ(waiter.Wait(0,
+                          [&]() {
+                              return MFX_ERR_GPU_HANG;
+                          }),
+              MFX_ERR_GPU_HANG);
+    EXPECT_EQ(waiter.GetNumEvents(), 3u);
+}
+
+TEST(Transcode_FreeListPool, ReusesItemsInReleaseOrder) {
+    CFreeListPool<ExtendedBS> pool;
+    pool.Init(3);
+    ExtendedBS* first  = pool.Acquire();
+    ExtendedBS* second = pool.Acquire();
+    ExtendedBS* third  = pool.Acquire();
+    ASSERT_NE(third, nullptr);
+    EXPECT_EQ(pool.Acquire(), nullptr);
+    EXPECT_EQ(pool.GetIndex(second), 1u);
+
+    EXPECT_TRUE(pool.Release(second));
+    EXPECT_TRUE(pool.Release(first));
+    // double and foreign releases are rejected
+    EXPECT_FALSE(pool.Release(first));
+    ExtendedBS other;
+    EXPECT_FALSE(pool.Release(&other));
+    EXPECT_EQ(pool.GetNumFree(), 2u);
+
+    EXPECT_EQ(pool.Acquire(), second);
+    EXPECT_EQ(pool.Acquire(), first);
+    EXPECT_EQ(pool.Acquire(), nullptr);
+
+    pool.ReleaseAll();
+    EXPECT_EQ(pool.GetNumFree(), 3u);
+    EXPECT_EQ(pool.Acquire(), first);
+}
+
+TEST(Transcode_FreeListPool, FixedQueueWrapsAround) {
+    CFixedQueue<mfxU32> queue;
+    queue.Init(3);
+    for (mfxU32 i = 0; i < 10; i++) {
+        EXPECT_TRUE(queue.push_back(i));
+        EXPECT_TRUE(queue.push_back(i + 100));
+        EXPECT_EQ(queue.front(), i);
+        EXPECT_EQ(queue.back(), i + 100);
+        queue.pop_front();
+        queue.pop_back();
+        EXPECT_TRUE(queue.empty());
+    }
+    EXPECT_TRUE(queue.push_back(1));
+    EXPECT_TRUE(queue.push_back(2));
+    EXPECT_TRUE(queue.push_back(3));
+    EXPECT_FALSE(queue.push_back(4));
+    EXPECT_EQ(queue[1], 2u);
+}
+
+TEST(Transcode_FreeListPool, FixedQueueWithoutInitIsEmpty) {
+    // queue of pipeline without encoder is never initialized
+    CFixedQueue<mfxU32> queue;
+    EXPECT_EQ(queue.capacity(), 0u);
+    EXPECT_FALSE(queue.push_back(1));
+    queue.pop_front();
+    queue.pop_back();
+    EXPECT_TRUE(queue.empty());
+    EXPECT_EQ(queue.size(), 0u);
+}
+
+namespace {
+// task which counts its steps and runs another task's step from the middle of each own step
+class CountingTask : public TranscodingSample::CSchedulerTask {
+public:
+    CountingTask(mfxU32 numSteps,
+                 TranscodingSample::CCompletionQueue<CountingTask>& completion,
+                 bool runPending)
+            : steps(0),
+              numSteps(numSteps),
+              completion(completion),
+              runPending(runPending) {}
+
+    bool Step() override {
+        if (runPending)
+            TranscodingSample::CSessionScheduler::GetCurrent()->RunPendingStep();
+        if (++steps < numSteps)
+            return true;
+        completion.Signal(this);
+        return false;
+    }
+
+    std::atomic<mfxU32> steps;
+    mfxU32 numSteps;
+    TranscodingSample::CCompletionQueue<CountingTask>& completion;
+    bool runPending;
+};
+} // namespace
+
+TEST(Transcode_Scheduler, RunsTasksToCompletion) {
+    TranscodingSample::CSessionScheduler scheduler;
+    ASSERT_EQ(scheduler.Init(3), MFX_ERR_NONE);
+    EXPECT_EQ(scheduler.GetNumThreads(), 3u);
+    EXPECT_EQ(TranscodingSample::CSessionScheduler::GetCurrent(), nullptr);
+
+    TranscodingSample::CCompletionQueue<CountingTask> completion;
+    std::vector<std::unique_ptr<CountingTask>> tasks;
+    for (mfxU32 i = 0; i < 50; i++) {
+        tasks.emplace_back(new CountingTask(100 + i, completion, i % 2 == 0));
+        scheduler.Submit(tasks.back().get());
+    }
+
+    std::vector<CountingTask*> completed;
+    for (size_t i = 0; i < tasks.size(); i++)
+        completed.push_back(completion.Wait());
+
+    for (auto& task : tasks) {
+        EXPECT_EQ(task->steps, task->numSteps);
+        EXPECT_EQ(std::count(completed.begin(), completed.end(), task.get()), 1);
+    }
+    scheduler.Close();
+}
+
+namespace TranscodingSample {
+// writes events with writers of the tracer, bypassing recording
+class SMTTracerTest {
+public:
+    using Event = SMTTracer::Event;
+
+    // all event kinds with varints of every length, time goes back as it does in streaming
+    // mode, where events of different threads aren't ordered
+    static std::vector<Event> MakeEvents() {
+        std::vector<Event> events;
+        mfxU64 ts = 1000;
+        for (mfxU32 i = 0; i < 40; i++) {
+            Event ev;
+            ev.EvType = (SMTTracer::EventType)(i % 5);
+            ev.ThType = (SMTTracer::ThreadType)(i % 4);
+            ev.ThID   = i % 3 ? i : 0x12345678;
+            ev.Name   = (SMTTracer::EventName)(i % 7);
+            ev.EvID   = i * 1000;
+            ev.InID   = 0x7f0012345678 + i * 0x40;
+            ev.OutID  = (i % 2) ? 0 : ~0ull - i;
+            ts        = (i % 4 == 3) ? ts - 250 : ts + i * 100;
+            ev.TS     = ts;
+            events.push_back(ev);
+        }
+        return events;
+    }
+
+    static void Write(const std::string& fileName,
+                      SMTTracer::TraceFormat format,
+                      const std::vector<Event>& events) {
+        SMTTracer tracer;
+        tracer.Format = format;
+        std::ofstream file(fileName, std::ios::out | std::ios::binary);
+        tracer.WriteTraceHeader(file);
+        tracer.WriteEvents(file, events);
+    }
+
+    static size_t GetEventsPerChunk() {
+        return SMTTracer::EventsPerChunk;
+    }
+
+    static void SetMaxNumOfChunks(SMTTracer& tracer, size_t numOfChunks) {
+        tracer.MaxNumOfChunks = numOfChunks;
+    }
+
+    static size_t GetNumOfFullChunks(SMTTracer& tracer) {
+        std::lock_guard<std::mutex> guard(tracer.BufferMutex);
+        return tracer.FullChunks.size();
+    }
+
+    static mfxU64 GetNumOfDroppedEvents(SMTTracer& tracer) {
+        mfxU64 numOfDroppedEvents = 0;
+        for (const auto& buffer : tracer.ThreadBuffers)
+            numOfDroppedEvents += buffer->NumOfDroppedEvents;
+        return numOfDroppedEvents;
+    }
+
+    // merges recorded events as it is done before saving, tracer doesn't save them then
+    static std::vector<Event> Merge(SMTTracer& tracer) {
+        tracer.MergeThreadBuffers();
+        tracer.Enabled = false;
+        return tracer.Log;
+    }
+};
+} // namespace TranscodingSample
+
+static std::string ReadTraceFile(const std::string& fileName) {
+    std::ifstream file(fileName, std::ios::in | std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+TEST(Transcode_Tracer, BinaryTraceConvertsToJsonTrace) {
+    using TranscodingSample::SMTTracer;
+    using TranscodingSample::SMTTracerTest;
+    const char* binaryName    = "temp_trace.bin";
+    const char* jsonName      = "temp_trace.json";
+    const char* convertedName = "temp_trace_converted.json";
+
+    // trace of the first k events ends where the k-th record ends
+    auto events = SMTTracerTest::MakeEvents();
+    std::vector<size_t> recordEnd;
+    std::vector<std::string> json;
+    for (size_t k = 0; k <= events.size(); k++) {
+        std::vector<SMTTracerTest::Event> first(events.begin(), events.begin() + k);
+        SMTTracerTest::Write(binaryName, SMTTracer::TraceFormat::BINARY, first);
+        recordEnd.push_back(ReadTraceFile(binaryName).size());
+        SMTTracerTest::Write(jsonName, SMTTracer::TraceFormat::JSON, first);
+        json.push_back(ReadTraceFile(jsonName));
+    }
+    std::string binary = ReadTraceFile(binaryName);
+
+    ASSERT_TRUE(SMTTracer::ConvertBinaryTrace(binaryName, convertedName, false));
+    EXPECT_EQ(ReadTraceFile(convertedName), json.back());
+
+    // truncated trace is converted up to the last complete record
+    for (size_t size = recordEnd[events.size() - 1]; size < binary.size(); size++) {
+        std::ofstream(binaryName, std::ios::out | std::ios::binary).write(binary.data(), size);
+        ASSERT_TRUE(SMTTracer::ConvertBinaryTrace(binaryName, convertedName, false));
+        EXPECT_EQ(ReadTraceFile(convertedName), json[events.size() - 1]) << "size " << size;
+    }
+
+    remove(binaryName);
+    remove(jsonName);
+    remove(convertedName);
+}
+
+TEST(Transcode_Tracer, RecordsEventsByChunks) {
+    using TranscodingSample::SMTTracer;
+    using TranscodingSample::SMTTracerTest;
+    const size_t chunkSize = SMTTracerTest::GetEventsPerChunk();
+
+    SMTTracer tracer;
+    tracer.Init(SMTTracer::PipelineType::_1x1, 1, SMTTracer::LatencyType::DEFAULT, 0);
+
+    // full chunks are handed over to the tracer, the last one stays with the thread
+    const size_t numEvents = 2 * chunkSize + 10;
+    for (size_t i = 0; i < numEvents; i++)
+        tracer.AddCounterEvent(SMTTracer::ThreadType::DEC, 0, SMTTracer::EventName::UNDEF, i);
+    EXPECT_EQ(SMTTracerTest::GetNumOfFullChunks(tracer), 2u);
+
+    auto log = SMTTracerTest::Merge(tracer);
+    ASSERT_EQ(log.size(), numEvents);
+    for (size_t i = 0; i < numEvents; i++)
+        ASSERT_EQ(log[i].InID, i);
+}
+
+TEST(Transcode_Tracer, DropsEventsWhenBufferIsFull) {
+    using TranscodingSample::SMTTracer;
+    using TranscodingSample::SMTTracerTest;
+    const size_t chunkSize = SMTTracerTest::GetEventsPerChunk();
+
+    SMTTracer tracer;
+    tracer.Init(SMTTracer::PipelineType::_1x1, 1, SMTTracer::LatencyType::DEFAULT, 0);
+    SMTTracerTest::SetMaxNumOfChunks(tracer, 2);
+
+    // buffer is exhausted by the first thread, but the first chunk of the second one is not
+    // limited, so it records its beginning
+    for (size_t i = 0; i < 4 * chunkSize; i++)
+        tracer.AddCounterEvent(SMTTracer::ThreadType::DEC, 0, SMTTracer::EventName::UNDEF, i);
+    std::thread([&tracer] {
+        for (mfxU64 i = 0; i < 10; i++)
+            tracer.AddCounterEvent(SMTTracer::ThreadType::ENC, 1, SMTTracer::EventName::UNDEF, i);
+    }).join();
+    EXPECT_EQ(SMTTracerTest::GetNumOfDroppedEvents(tracer), 2 * chunkSize);
+
+    auto log = SMTTracerTest::Merge(tracer);
+    EXPECT_EQ(log.size(), 2 * chunkSize + 10);
+    EXPECT_EQ(std::count_if(log.begin(),
+                            log.end(),
+                            [](const SMTTracerTest::Event& ev) {
+                                return ev.ThID == 1;
+                            }),
+              10);
+}
+
+TEST(Transcode_Tracer, MergesThreadsInTimeOrder) {
+    using TranscodingSample::SMTTracer;
+    using TranscodingSample::SMTTracerTest;
+    const size_t chunkSize = SMTTracerTest::GetEventsPerChunk();
+
+    SMTTracer tracer;
+    tracer.Init(SMTTracer::PipelineType::_1xN, 3, SMTTracer::LatencyType::DEFAULT, 0);
+
+    // threads record concurrently, so their chunks are completed interleaved
+    const mfxU32 numThreads = 3;
+    const size_t numEvents  = 3 * chunkSize + 100;
+    std::vector<std::thread> threads;
+    for (mfxU32 t = 0; t < numThreads; t++) {
+        threads.emplace_back([&tracer, t, numEvents] {
+            for (size_t i = 0; i < numEvents; i++)
+                tracer.AddCounterEvent(SMTTracer::ThreadType::ENC,
+                                       t,
+                                       SMTTracer::EventName::UNDEF,
+                                       i);
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    // events are ordered by time, events of each thread stay in recording order
+    auto log = SMTTracerTest::Merge(tracer);
+    ASSERT_EQ(log.size(), numThreads * numEvents);
+    std::vector<mfxU64> next(numThreads, 0);
+    for (size_t i = 0; i < log.size(); i++) {
+        if (i) {
+            ASSERT_LE(log[i - 1].Order, log[i].Order) << i;
+        }
+        ASSERT_LT(log[i].ThID, numThreads);
+        ASSERT_EQ(log[i].InID, next[log[i].ThID]++) << i;
+    }
+}